@@ -31,6 +31,10 @@ DSTATUS disk_status (BYTE pdrv);
 DRESULT disk_read (BYTE pdrv, BYTE* buff, LBA_t sector, UINT count);
 DRESULT disk_write (BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count);
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
+void disk_cache_invalidate (void);	/* After boot0 was written around diskio */
+DRESULT disk_read_queue (BYTE pdrv, BYTE* buff, LBA_t sector, UINT count);	/* RES_NOTRDY if the queue is full */
+DRESULT disk_read_wait (BYTE pdrv);	/* Oldest queued read */
+DRESULT disk_read_split (BYTE pdrv, BYTE* buff, UINT count, BYTE* buff2, UINT count2, LBA_t sector);	/* One command into two buffers */
 
 
 /* Disk Status Bits (DSTATUS) */
@@ -21,125 +21,196 @@
 
 heap_t _heap;
 
-static void _heap_create(void *start)
+static void _heap_create(void *start, u32 size)
 {
+	memset(&_heap, 0, sizeof(heap_t));
+
 	_heap.start = start;
-	_heap.first = NULL;
-	_heap.last = NULL;
+	_heap.end   = start + size;
+	_heap.top   = start;
+}
+
+static u32 _heap_class(u32 size)
+{
+	if (size < (1 << HEAP_CLASS_MIN_SHIFT))
+		return 0;
+
+	return MIN(31 - __builtin_clz(size) - HEAP_CLASS_MIN_SHIFT, HEAP_CLASSES - 1);
+}
+
+// Block right after a node, NULL for the topmost one.
+static hnode_t *_heap_next(hnode_t *node)
+{
+	hnode_t *next = (void *)node + sizeof(hnode_t) + node->size;
+
+	return (void *)next < _heap.top ? next : NULL;
+}
+
+static void _heap_list_add(hnode_t *node)
+{
+	u32 cls = _heap_class(node->size);
+	hnode_t **head = &_heap.free[cls];
+
+	node->prev = NULL;
+	node->next = *head;
+	if (*head)
+		(*head)->prev = node;
+	*head = node;
+
+	_heap.free_mask |= BIT(cls);
+}
+
+static void _heap_list_remove(hnode_t *node)
+{
+	if (node->prev)
+		node->prev->next = node->next;
+	else
+	{
+		u32 cls = _heap_class(node->size);
+
+		_heap.free[cls] = node->next;
+		if (!node->next)
+			_heap.free_mask &= ~BIT(cls);
+	}
+
+	if (node->next)
+		node->next->prev = node->prev;
+}
+
+static hnode_t *_heap_take(u32 cls, u32 size)
+{
+	for (hnode_t *node = _heap.free[cls]; node; node = node->next)
+	{
+		if (size <= node->size)
+		{
+			_heap_list_remove(node);
+			return node;
+		}
+	}
+
+	return NULL;
+}
+
+// Merge a free block into the one before it. Returns the merged block.
+static hnode_t *_heap_merge(hnode_t *prev, hnode_t *node)
+{
+	prev->size += sizeof(hnode_t) + node->size;
+
+	hnode_t *next = _heap_next(prev);
+	if (next)
+		next->phys = prev;
+	else
+		_heap.last = prev;
+
+	return prev;
+}
+
+static void _heap_split(hnode_t *node, u32 size)
+{
+	u32 left = node->size - size;
+
+	// Leftover is too small to be worth a node.
+	if (left < (sizeof(hnode_t) << 2))
+		return;
+
+	hnode_t *next = _heap_next(node);
+	hnode_t *rest = (void *)node + sizeof(hnode_t) + size;
+
+	rest->used = 0;
+	rest->size = left - sizeof(hnode_t);
+	rest->phys = node;
+	node->size = size;
+
+	if (next)
+		next->phys = rest;
+	else
+		_heap.last = rest;
+
+	_heap_list_add(rest);
 }
 
 // Node info is before node address.
 static void *_heap_alloc(u32 size)
 {
-	hnode_t *node, *new_node;
+	hnode_t *node;
 
 	// Align to cache line size.
 	size = ALIGN(size, sizeof(hnode_t));
+	u32 cls = _heap_class(size);
 
-	// First allocation.
-	if (!_heap.first)
+	// Reuse a freed block of the same class, then split one of a bigger class.
+	node = _heap_take(cls, size);
+	for (u32 mask = _heap.free_mask & ~(BIT(cls + 1) - 1); !node && mask; mask &= mask - 1)
+		node = _heap_take(__builtin_ctz(mask), size);
+
+	if (node)
+		_heap_split(node, size);
+	else if (((u32)_heap.end - (u32)_heap.top) >= sizeof(hnode_t) + size)
 	{
-		node = (hnode_t *)_heap.start;
-		node->used = 1;
+		// Carve a new block from the unused space.
+		node = (hnode_t *)_heap.top;
 		node->size = size;
-		node->prev = NULL;
-		node->next = NULL;
-
-		_heap.first = node;
+		node->phys = _heap.last;
+		_heap.top += sizeof(hnode_t) + size;
 		_heap.last = node;
-
-		return (void *)node + sizeof(hnode_t);
 	}
-
-#ifdef BDK_MALLOC_NO_DEFRAG
-	// Get the last allocated block.
-	node = _heap.last;
-#else
-	// Get first block and find the first available one.
-	node = _heap.first;
-	while (true)
+	else
 	{
-		// Check if there's available unused node.
-		if (!node->used && (size <= node->size))
-		{
-			// Size and offset of the new unused node.
-			u32 new_size = node->size - size;
-			new_node = (hnode_t *)((void *)node + sizeof(hnode_t) + size);
-
-			// If there's aligned unused space from the old node,
-			// create a new one and set the leftover size.
-			if (new_size >= (sizeof(hnode_t) << 2))
-			{
-				new_node->size = new_size - sizeof(hnode_t);
-				new_node->used = 0;
-				new_node->next = node->next;
-
-				// Check that we are not on first node.
-				if (new_node->next)
-					new_node->next->prev = new_node;
-
-				new_node->prev = node;
-				node->next = new_node;
-			}
-			else // Unused node size is just enough.
-				size += new_size;
-
-			node->size = size;
-			node->used = 1;
-
-			return (void *)node + sizeof(hnode_t);
-		}
-
-		// No unused node found, try the next one.
-		if (node->next)
-			node = node->next;
-		else
-			break;
+		_heap.failed++;
+		return NULL;
 	}
-#endif
 
-	// No unused node found, create a new one.
-	new_node = (hnode_t *)((void *)node + sizeof(hnode_t) + node->size);
-	new_node->used = 1;
-	new_node->size = size;
-	new_node->prev = node;
-	new_node->next = NULL;
+	node->used = 1;
+	node->next = NULL;
+	node->prev = NULL;
 
-	node->next = new_node;
-	_heap.last = new_node;
+	_heap.used += sizeof(hnode_t) + node->size;
+	_heap.used_max = MAX(_heap.used_max, _heap.used);
+	_heap.nodes_used++;
 
-	return (void *)new_node + sizeof(hnode_t);
+	return (void *)node + sizeof(hnode_t);
 }
 
 static void _heap_free(void *addr)
 {
 	hnode_t *node = (hnode_t *)(addr - sizeof(hnode_t));
+
+	// Double free.
+	if (!node->used)
+		return;
+
 	node->used = 0;
-	node = _heap.first;
+	_heap.used -= sizeof(hnode_t) + node->size;
+	_heap.nodes_used--;
 
-#ifndef BDK_MALLOC_NO_DEFRAG
-	// Do simple defragmentation on next blocks.
-	while (node)
+	// Coalesce with free neighbours. Free blocks are never topmost, so the next one
+	// only needs checking here.
+	hnode_t *next = _heap_next(node);
+	if (next && !next->used)
 	{
-		if (!node->used)
-		{
-			if (node->prev && !node->prev->used)
-			{
-				node->prev->size += node->size + sizeof(hnode_t);
-				node->prev->next = node->next;
-
-				if (node->next)
-					node->next->prev = node->prev;
-			}
-		}
-		node = node->next;
+		_heap_list_remove(next);
+		node = _heap_merge(node, next);
+	}
+
+	if (node->phys && !node->phys->used)
+	{
+		_heap_list_remove(node->phys);
+		node = _heap_merge(node->phys, node);
 	}
-#endif
+
+	// Topmost block goes back to the unused space, anything else to its class.
+	if (node == _heap.last)
+	{
+		_heap.top  = node;
+		_heap.last = node->phys;
+	}
+	else
+		_heap_list_add(node);
 }
 
-void heap_init(void *base)
+void heap_init(void *base, u32 size)
 {
-	_heap_create(base);
+	_heap_create(base, size);
 }
 
 void heap_set(heap_t *heap)
@@ -155,20 +226,22 @@ void *malloc(u32 size)
 void *calloc(u32 num, u32 size)
 {
 	void *res = (void *)_heap_alloc(num * size);
-	memset(res, 0, ALIGN(num * size, sizeof(hnode_t))); // Clear the aligned size.
+	if (res)
+		memset(res, 0, ALIGN(num * size, sizeof(hnode_t))); // Clear the aligned size.
 	return res;
 }
 
 void *zalloc(u32 size)
 {
 	void *res = (void *)_heap_alloc(size);
-	memset(res, 0, ALIGN(size, sizeof(hnode_t))); // Clear the aligned size.
+	if (res)
+		memset(res, 0, ALIGN(size, sizeof(hnode_t))); // Clear the aligned size.
 	return res;
 }
 
 void free(void *buf)
 {
-	if (buf >= _heap.start)
+	if (buf >= _heap.start && buf < _heap.end)
 		_heap_free(buf);
 }
 
@@ -177,28 +250,20 @@ void heap_monitor(heap_monitor_t *mon, bool print_node_stats)
 	u32 count = 0;
 	memset(mon, 0, sizeof(heap_monitor_t));
 
-	hnode_t *node = _heap.first;
-	while (true)
+	// Blocks are contiguous up to the unused space.
+	for (hnode_t *node = _heap.start; (void *)node < _heap.top; node = (void *)node + sizeof(hnode_t) + node->size)
 	{
-		if (node->used)
-		{
-			mon->nodes_used++;
-			mon->used += node->size + sizeof(hnode_t);
-		}
-		else
-			mon->total += node->size + sizeof(hnode_t);
-
 		if (print_node_stats)
 			gfx_printf("%3d - %d, addr: 0x%08X, size: 0x%X\n",
 				count, node->used, (u32)node + sizeof(hnode_t), node->size);
 
 		count++;
-
-		if (node->next)
-			node = node->next;
-		else
-			break;
 	}
-	mon->total += mon->used;
+
+	mon->total       = _heap.end - _heap.start;
+	mon->used        = _heap.used;
+	mon->used_max    = _heap.used_max;
 	mon->nodes_total = count;
+	mon->nodes_used  = _heap.nodes_used;
+	mon->failed      = _heap.failed;
 }
@@ -20,31 +20,45 @@
 
 #include <utils/types.h>
 
-typedef struct _hnode
+// Free blocks are kept per size class. Class n holds blocks of 32 << n bytes up to
+// the next power of two. The last class holds everything bigger.
+#define HEAP_CLASS_MIN_SHIFT 5
+#define HEAP_CLASSES         16
+
+typedef struct __attribute__((aligned(32))) _hnode
 {
 	int used;
-	u32 size;
+	u32 size;            // Block size, without the node.
+	struct _hnode *next; // Free list of the same class.
 	struct _hnode *prev;
-	struct _hnode *next;
-	u32 align[4]; // Align to arch cache line size.
-} hnode_t;
+	struct _hnode *phys; // Block right before this one, for coalescing.
+} hnode_t; // Aligned to arch cache line size.
 
 typedef struct _heap
 {
 	void *start;
-	hnode_t *first;
-	hnode_t *last;
+	void *end;
+	void *top; // Blocks are carved from here, anything above is unused.
+	hnode_t *last; // Topmost block.
+	hnode_t *free[HEAP_CLASSES];
+	u32 free_mask; // Classes with free blocks.
+	u32 used;
+	u32 used_max;
+	u32 nodes_used;
+	u32 failed;
 } heap_t;
 
 typedef struct
 {
 	u32 total;
 	u32 used;
+	u32 used_max;
 	u32 nodes_total;
 	u32 nodes_used;
+	u32 failed;
 } heap_monitor_t;
 
-void heap_init(void *base);
+void heap_init(void *base, u32 size);
 void heap_set(heap_t *heap);
 void *malloc(u32 size);
 void *calloc(u32 num, u32 size);
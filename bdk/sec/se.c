@@ -131,7 +131,8 @@ static int _se_execute_finalize()
 	int res = _se_wait();
 
 	// Invalidate data after OP is done.
-	bpmp_mmu_maintenance(BPMP_MMU_MAINT_INVALID_WAY, false);
+	if (ll_dst_ptr)
+		bpmp_mmu_maintenance_range(BPMP_MMU_MAINT_INVALID_PHY, (void *)ll_dst_ptr->addr, ll_dst_ptr->size);
 
 	ll_src_ptr = NULL;
 	ll_dst_ptr = NULL;
@@ -161,8 +162,14 @@ static int _se_execute(u32 op, void *dst, u32 dst_size, const void *src, u32 src
 	SE(SE_ERR_STATUS_REG) = SE(SE_ERR_STATUS_REG);
 	SE(SE_INT_STATUS_REG) = SE(SE_INT_STATUS_REG);
 
-	// Flush data before starting OP.
-	bpmp_mmu_maintenance(BPMP_MMU_MAINT_CLEAN_WAY, false);
+	// Flush data and linked lists before starting OP.
+	if (src)
+	{
+		bpmp_mmu_maintenance_range(BPMP_MMU_MAINT_CLEAN_PHY, &ll_src, sizeof(ll_src));
+		bpmp_mmu_maintenance_range(BPMP_MMU_MAINT_CLEAN_PHY, src, src_size);
+	}
+	if (dst)
+		bpmp_mmu_maintenance_range(BPMP_MMU_MAINT_CLEAN_PHY, &ll_dst, sizeof(ll_dst));
 
 	SE(SE_OPERATION_REG) = op;
 
@@ -124,15 +124,15 @@ static const bpmp_mmu_entry_t mmu_entries[] =
 	{ IRAM_BASE,  0x4003FFFF, MMU_EN_READ | MMU_EN_WRITE | MMU_EN_EXEC | MMU_EN_CACHED, true }
 };
 
-void bpmp_mmu_maintenance(u32 op, bool force)
-{
-	if (!force && !(BPMP_CACHE_CTRL(BPMP_CACHE_CONFIG) & CFG_ENABLE_CACHE))
-		return;
+static bpmp_mmu_maint_stats_t mmu_maint_stats[BPMP_MMU_MAINT_PHASES];
+static u32 mmu_maint_phase = 0;
 
+static void _bpmp_mmu_maint_req(u32 req)
+{
 	BPMP_CACHE_CTRL(BPMP_CACHE_INT_CLEAR) = INT_MAINT_DONE;
 
 	// This is a blocking operation.
-	BPMP_CACHE_CTRL(BPMP_CACHE_MAINT_REQ) = MAINT_REQ_WAY_BITMAP(0xF) | op;
+	BPMP_CACHE_CTRL(BPMP_CACHE_MAINT_REQ) = req;
 
 	while (!(BPMP_CACHE_CTRL(BPMP_CACHE_INT_RAW_EVENT) & INT_MAINT_DONE))
 		;
@@ -140,6 +140,89 @@ void bpmp_mmu_maintenance(u32 op, bool force)
 	BPMP_CACHE_CTRL(BPMP_CACHE_INT_CLEAR) = BPMP_CACHE_CTRL(BPMP_CACHE_INT_RAW_EVENT);
 }
 
+void bpmp_mmu_maintenance(u32 op, bool force)
+{
+	if (!force && !(BPMP_CACHE_CTRL(BPMP_CACHE_CONFIG) & CFG_ENABLE_CACHE))
+		return;
+
+	u32 start = get_tmr_us();
+
+	_bpmp_mmu_maint_req(MAINT_REQ_WAY_BITMAP(0xF) | op);
+
+	mmu_maint_stats[mmu_maint_phase].way_ops++;
+	mmu_maint_stats[mmu_maint_phase].time_us += get_tmr_us() - start;
+}
+
+static bool _bpmp_mmu_range_cached(u32 start, u32 end)
+{
+	for (u32 idx = 0; idx < ARRAY_SIZE(mmu_entries); idx++)
+	{
+		const bpmp_mmu_entry_t *entry = &mmu_entries[idx];
+		if (entry->enable && (entry->attr & MMU_EN_CACHED) && start <= entry->end_addr && end > entry->start_addr)
+			return true;
+	}
+
+	// Fallback entry is uncached.
+	return false;
+}
+
+/*
+ * Maintains only the cache lines covering buf. Op is one of the _PHY operations.
+ * Cache is forced to write-through, so invalidating partial lines at the edges
+ * never drops CPU writes.
+ */
+void bpmp_mmu_maintenance_range(u32 op, const void *buf, u32 size)
+{
+	if (!size || !(BPMP_CACHE_CTRL(BPMP_CACHE_CONFIG) & CFG_ENABLE_CACHE))
+		return;
+
+	u32 addr = ALIGN_DOWN((u32)buf, BPMP_MMU_CACHE_LINE_SIZE);
+	u32 end  = ALIGN((u32)buf + size, BPMP_MMU_CACHE_LINE_SIZE);
+
+	bpmp_mmu_maint_stats_t *stats = &mmu_maint_stats[mmu_maint_phase];
+
+	// DMA buffers in uncached regions need no maintenance.
+	if (!_bpmp_mmu_range_cached(addr, end))
+	{
+		stats->skipped++;
+		return;
+	}
+
+	// Way operations have the same order as the _PHY ones.
+	if (end - addr > BPMP_MMU_MAINT_RANGE_MAX)
+	{
+		bpmp_mmu_maintenance(op + (BPMP_MMU_MAINT_CLEAN_WAY - BPMP_MMU_MAINT_CLEAN_PHY), false);
+		return;
+	}
+
+	u32 start = get_tmr_us();
+
+	stats->range_ops++;
+	stats->lines += (end - addr) / BPMP_MMU_CACHE_LINE_SIZE;
+
+	for (; addr < end; addr += BPMP_MMU_CACHE_LINE_SIZE)
+	{
+		BPMP_CACHE_CTRL(BPMP_CACHE_MAINT_ADDR) = addr;
+		_bpmp_mmu_maint_req(MAINT_REQ_WAY_BITMAP(0xF) | op);
+	}
+
+	stats->time_us += get_tmr_us() - start;
+}
+
+void bpmp_mmu_maint_set_phase(u32 phase)
+{
+	if (phase < BPMP_MMU_MAINT_PHASES)
+		mmu_maint_phase = phase;
+}
+
+const bpmp_mmu_maint_stats_t *bpmp_mmu_maint_get_stats(u32 phase)
+{
+	if (phase >= BPMP_MMU_MAINT_PHASES)
+		return NULL;
+
+	return &mmu_maint_stats[phase];
+}
+
 void bpmp_mmu_set_entry(int idx, const bpmp_mmu_entry_t *entry, bool apply)
 {
 	if (idx > 31)
@@ -35,6 +35,19 @@ typedef enum
 	BPMP_MMU_MAINT_CLN_INV_WAY        = 19
 } bpmp_maintenance_t;
 
+// Ranges bigger than that are cheaper to maintain with full way operations.
+#define BPMP_MMU_MAINT_RANGE_MAX SZ_8K
+#define BPMP_MMU_MAINT_PHASES    4
+
+typedef struct _bpmp_mmu_maint_stats_t
+{
+	u32 way_ops;   // Full way operations.
+	u32 range_ops; // Address range operations.
+	u32 lines;     // Cache lines maintained by range operations.
+	u32 skipped;   // Range operations skipped on uncached regions.
+	u32 time_us;
+} bpmp_mmu_maint_stats_t;
+
 typedef struct _bpmp_mmu_entry_t
 {
 	u32 start_addr;
@@ -69,6 +82,9 @@ typedef enum
 #define BPMP_CLK_DEFAULT_BOOST BPMP_CLK_HYPER_BOOST
 
 void bpmp_mmu_maintenance(u32 op, bool force);
+void bpmp_mmu_maintenance_range(u32 op, const void *buf, u32 size);
+void bpmp_mmu_maint_set_phase(u32 phase);
+const bpmp_mmu_maint_stats_t *bpmp_mmu_maint_get_stats(u32 phase);
 void bpmp_mmu_set_entry(int idx, const bpmp_mmu_entry_t *entry, bool apply);
 void bpmp_mmu_enable();
 void bpmp_mmu_disable();
@@ -71,7 +71,14 @@ int emmc_init_retry(bool power_cycle)
 	// Power cycle SD eMMC.
 	if (power_cycle)
 	{
-		emmc_mode--;
+		// A cached tap stopped working. Tune again, from the top mode since whatever lowered it may be gone too.
+		if (emmc_storage.bus_cache_hit)
+		{
+			emmc_storage.bus_cache->tuned = 0;
+			emmc_mode = EMMC_MMC_HS400;
+		}
+		else
+			emmc_mode--;
 		emmc_end();
 	}
 
@@ -100,21 +107,78 @@ int emmc_init_retry(bool power_cycle)
 	return sdmmc_storage_init_mmc(&emmc_storage, &emmc_sdmmc, bus_width, type);
 }
 
+void emmc_set_bus_cache(sdmmc_bus_cache_t *cache)
+{
+	emmc_storage.bus_cache = cache;
+}
+
+static void _emmc_bus_cache_update()
+{
+	sdmmc_bus_cache_t *cache = emmc_storage.bus_cache;
+
+	if (!cache)
+		return;
+
+	cache->mode = emmc_mode;
+
+	// Card was not tuned in this mode, a tap from another card is useless.
+	if (memcmp(cache->raw_cid, emmc_storage.raw_cid, sizeof(emmc_storage.raw_cid)))
+	{
+		memcpy(cache->raw_cid, emmc_storage.raw_cid, sizeof(emmc_storage.raw_cid));
+		cache->tuned = 0;
+	}
+}
+
 bool emmc_initialize(bool power_cycle)
 {
+	sdmmc_bus_cache_t *cache = emmc_storage.bus_cache;
+	u8 cached_cid[0x10];
+	bool cached_mode = false;
+	bool stale_tap = false;
+
 	// Reset mode in case of previous failure.
 	if (emmc_mode == EMMC_INIT_FAIL)
 		emmc_mode = EMMC_MMC_HS400;
 
 	if (power_cycle)
+	{
+		// Errors may come from a stale cached tap. Tune again from the top mode.
+		if (emmc_storage.bus_cache_hit)
+		{
+			cache->tuned = 0;
+			emmc_mode = EMMC_MMC_HS400;
+			stale_tap = true;
+		}
 		emmc_end();
+	}
+
+	// Start at the mode the eMMC ended up in last time. Cid is only known after init.
+	if (cache && cache->mode && cache->mode < EMMC_MMC_HS400 && emmc_mode == EMMC_MMC_HS400 && !stale_tap)
+	{
+		memcpy(cached_cid, cache->raw_cid, sizeof(cached_cid));
+		emmc_mode = cache->mode;
+		cached_mode = true;
+	}
 
 	int res = !emmc_init_retry(false);
 
 	while (true)
 	{
 		if (!res)
+		{
+			// Another eMMC, start over from the default mode.
+			if (cached_mode && memcmp(cached_cid, emmc_storage.raw_cid, sizeof(cached_cid)))
+			{
+				cached_mode = false;
+				emmc_mode = EMMC_MMC_HS400;
+				emmc_end();
+				res = !emmc_init_retry(false);
+				continue;
+			}
+
+			_emmc_bus_cache_update();
 			return true;
+		}
 		else
 		{
 			emmc_errors[EMMC_ERROR_INIT_FAIL]++;
@@ -131,6 +195,37 @@ bool emmc_initialize(bool power_cycle)
 	return false;
 }
 
+bool emmc_initialize_mode(u32 mode)
+{
+	// Fixed mode without walking down, for measuring the modes an eMMC supports.
+	if (mode == EMMC_INIT_FAIL || mode > EMMC_MMC_HS400)
+		return false;
+
+	emmc_end();
+	emmc_mode = mode;
+
+	if (!emmc_init_retry(false))
+	{
+		emmc_end();
+		emmc_mode = EMMC_MMC_HS400;
+
+		return false;
+	}
+
+	_emmc_bus_cache_update();
+
+	return true;
+}
+
+bool emmc_session_init()
+{
+	// Reuse the initialized eMMC, users only switch partitions.
+	if (emmc_storage.initialized)
+		return true;
+
+	return emmc_initialize(false);
+}
+
 int emmc_set_partition(u32 partition) { return sdmmc_storage_set_mmc_partition(&emmc_storage, partition); }
 
 void emmc_gpt_parse(link_t *gpt)
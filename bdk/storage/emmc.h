@@ -63,6 +63,9 @@ u16 *emmc_get_error_count();
 u32  emmc_get_mode();
 int  emmc_init_retry(bool power_cycle);
 bool emmc_initialize(bool power_cycle);
+bool emmc_initialize_mode(u32 mode);
+bool emmc_session_init();
+void emmc_set_bus_cache(sdmmc_bus_cache_t *cache);
 int  emmc_set_partition(u32 partition);
 void emmc_end();
 
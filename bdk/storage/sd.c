@@ -15,6 +15,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
+
 #include <storage/sd.h>
 #include <storage/sdmmc.h>
 #include <storage/sdmmc_driver.h>
@@ -95,7 +97,14 @@ int sd_init_retry(bool power_cycle)
 	// Power cycle SD card.
 	if (power_cycle)
 	{
-		sd_mode--;
+		// A cached tap stopped working. Tune again, from the top mode since whatever lowered it may be gone too.
+		if (sd_storage.bus_cache_hit)
+		{
+			sd_storage.bus_cache->tuned = 0;
+			sd_mode = SD_DEFAULT_SPEED;
+		}
+		else
+			sd_mode--;
 		sdmmc_storage_end(&sd_storage);
 	}
 
@@ -145,17 +154,145 @@ int sd_init_retry(bool power_cycle)
 	return res;
 }
 
+void sd_initialize_start()
+{
+#ifndef BDK_SDMMC_UHS_DDR200_SUPPORT
+	u32 type = SDHCI_TIMING_UHS_SDR104;
+#else
+	u32 type = SDHCI_TIMING_UHS_DDR200;
+#endif
+
+	// Only for a fresh init. Card power up then overlaps with other work until sd_initialize.
+	if (sd_init_done || sd_mode != SD_DEFAULT_SPEED)
+		return;
+
+	sdmmc_storage_init_sd_start(&sd_storage, &sd_sdmmc, SDMMC_BUS_WIDTH_4, type);
+}
+
+void sd_set_bus_cache(sdmmc_bus_cache_t *cache)
+{
+	sd_storage.bus_cache = cache;
+}
+
+static void _sd_bus_cache_update()
+{
+	sdmmc_bus_cache_t *cache = sd_storage.bus_cache;
+
+	if (!cache)
+		return;
+
+	cache->mode = sd_mode;
+
+	// Card was not tuned in this mode, a tap from another card is useless.
+	if (memcmp(cache->raw_cid, sd_storage.raw_cid, sizeof(sd_storage.raw_cid)))
+	{
+		memcpy(cache->raw_cid, sd_storage.raw_cid, sizeof(sd_storage.raw_cid));
+		cache->tuned = 0;
+		cache->boots = 0;
+		cache->fails = 0;
+	}
+}
+
+void sd_bus_cache_boot(sdmmc_bus_cache_t *cache)
+{
+	// Once per boot on the saved entry, before the first init.
+	if (!cache->mode || cache->mode >= SD_DEFAULT_SPEED)
+		return;
+
+	// Card was lowered a while ago. Try the top mode again, a failure walks down as usual.
+	if (++cache->boots >= SD_BUS_CACHE_RETRY_BOOTS)
+	{
+		cache->boots = 0;
+		cache->mode  = 0;
+	}
+}
+
+void sd_bus_cache_persist(sdmmc_bus_cache_t *out, const sdmmc_bus_cache_t *saved)
+{
+	sdmmc_bus_cache_t *cache = sd_storage.bus_cache;
+
+	// Nothing learned about the card this boot.
+	if (!cache || !sd_init_done)
+	{
+		memcpy(out, saved, sizeof(*out));
+		return;
+	}
+
+	memcpy(out, cache, sizeof(*out));
+
+	// Another card starts without counts.
+	if (!saved->mode || memcmp(saved->raw_cid, cache->raw_cid, sizeof(cache->raw_cid)))
+	{
+		out->boots = 0;
+		out->fails = 0;
+		return;
+	}
+
+	// Saved mode worked.
+	if (cache->mode >= saved->mode)
+	{
+		out->fails = 0;
+		return;
+	}
+
+	// Ended below the saved mode. Only saved once it happened a few boots in a row,
+	// a single bad init doesn't slow down every boot after it.
+	out->fails = saved->fails + 1;
+	if (out->fails < SD_BUS_CACHE_DOWN_FAILS)
+		out->mode = saved->mode;
+	else
+	{
+		out->boots = 0;
+		out->fails = 0;
+	}
+}
+
 bool sd_initialize(bool power_cycle)
 {
+	sdmmc_bus_cache_t *cache = sd_storage.bus_cache;
+	u8 cached_cid[0x10];
+	bool cached_mode = false;
+	bool stale_tap = false;
+
 	if (power_cycle)
+	{
+		// Errors may come from a stale cached tap. Tune again from the top mode.
+		if (sd_storage.bus_cache_hit)
+		{
+			cache->tuned = 0;
+			sd_mode = SD_DEFAULT_SPEED;
+			stale_tap = true;
+		}
 		sdmmc_storage_end(&sd_storage);
+	}
+
+	// Start at the mode the card ended up in last time. Cid is only known after init.
+	if (cache && cache->mode && cache->mode < SD_DEFAULT_SPEED && sd_mode == SD_DEFAULT_SPEED && !stale_tap)
+	{
+		memcpy(cached_cid, cache->raw_cid, sizeof(cached_cid));
+		sd_mode = cache->mode;
+		cached_mode = true;
+	}
 
 	int res = !sd_init_retry(false);
 
 	while (true)
 	{
 		if (!res)
+		{
+			// Another card, start over from the default mode.
+			if (cached_mode && memcmp(cached_cid, sd_storage.raw_cid, sizeof(cached_cid)))
+			{
+				cached_mode = false;
+				sd_mode = SD_DEFAULT_SPEED;
+				sdmmc_storage_end(&sd_storage);
+				res = !sd_init_retry(false);
+				continue;
+			}
+
+			_sd_bus_cache_update();
 			return true;
+		}
 		else if (!sdmmc_get_sd_inserted()) // SD Card is not inserted.
 		{
 			sd_mode = SD_DEFAULT_SPEED;
@@ -177,6 +314,28 @@ bool sd_initialize(bool power_cycle)
 	return false;
 }
 
+bool sd_initialize_mode(u32 mode)
+{
+	// Fixed mode without walking down, for measuring the modes a card supports.
+	if (mode == SD_INIT_FAIL || mode > SD_DEFAULT_SPEED)
+		return false;
+
+	sdmmc_storage_end(&sd_storage);
+	sd_mode = mode;
+
+	if (!sd_init_retry(false))
+	{
+		sdmmc_storage_end(&sd_storage);
+		sd_mode = SD_DEFAULT_SPEED;
+
+		return false;
+	}
+
+	_sd_bus_cache_update();
+
+	return true;
+}
+
 // bool sd_mount()
 // {
 // 	if (sd_init_done && sd_mounted)
@@ -224,7 +383,7 @@ static void _sd_deinit(bool deinit)
 			sd_mode = SD_DEFAULT_SPEED;
 	}
 
-	if (sd_init_done)
+	if (sd_init_done || sd_storage.init_started)
 	{
 		// if (sd_mounted)
 			// f_mount(NULL, "0:", 1); // Volume 0 is SD.
@@ -24,6 +24,9 @@
 
 #define SD_BLOCKSIZE SDMMC_DAT_BLOCKSIZE
 
+#define SD_BUS_CACHE_RETRY_BOOTS 16 // Boots at a lowered mode before the top mode is tried again.
+#define SD_BUS_CACHE_DOWN_FAILS  3  // Boots in a row that ended lower before the lower mode is saved.
+
 enum
 {
 	SD_INIT_FAIL  = 0,
@@ -55,7 +58,12 @@ bool sd_get_card_initialized();
 // bool sd_get_card_mounted();
 u32  sd_get_mode();
 int  sd_init_retry(bool power_cycle);
+void sd_initialize_start();
+void sd_set_bus_cache(sdmmc_bus_cache_t *cache);
+void sd_bus_cache_boot(sdmmc_bus_cache_t *cache);
+void sd_bus_cache_persist(sdmmc_bus_cache_t *out, const sdmmc_bus_cache_t *saved);
 bool sd_initialize(bool power_cycle);
+bool sd_initialize_mode(u32 mode);
 bool sd_mount();
 // void sd_unmount();
 void sd_end();
@@ -91,6 +91,8 @@
 #define SCR_SPEC_VER_2		2	/* Implements system specification 2.00-3.0X */
 #define SD_SCR_BUS_WIDTH_1	(1U << 0)
 #define SD_SCR_BUS_WIDTH_4	(1U << 2)
+#define SD_SCR_CMD20_SUPPORT	(1U << 0)
+#define SD_SCR_CMD23_SUPPORT	(1U << 1)
 
 /*
  * SD bus widths
@@ -15,6 +15,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stddef.h>
 #include <string.h>
 
 #include <mem/heap.h>
@@ -182,12 +183,13 @@ int sdmmc_storage_vendor_sandisk_report(sdmmc_storage_t *storage, void *buf)
 
 	sdmmc_init_cmd(&cmdbuf, MMC_VENDOR_63_CMD, 0, SDMMC_RSP_TYPE_1, 0); // similar to CMD17 with arg 0x0.
 
-	reqbuf.buf              = buf;
-	reqbuf.num_sectors      = 1;
-	reqbuf.blksize          = SDMMC_DAT_BLOCKSIZE;
-	reqbuf.is_write         = 0;
-	reqbuf.is_multi_block   = 0;
-	reqbuf.is_auto_stop_trn = 0;
+	reqbuf.buf                = buf;
+	reqbuf.num_sectors        = 1;
+	reqbuf.blksize            = SDMMC_DAT_BLOCKSIZE;
+	reqbuf.is_write           = 0;
+	reqbuf.is_multi_block     = 0;
+	reqbuf.is_auto_stop_trn   = 0;
+	reqbuf.is_auto_set_blkcnt = 0;
 
 	u32 blkcnt_out;
 	if (!sdmmc_execute_cmd(storage->sdmmc, &cmdbuf, &reqbuf, &blkcnt_out))
@@ -201,11 +203,46 @@ int sdmmc_storage_vendor_sandisk_report(sdmmc_storage_t *storage, void *buf)
 	return 1;
 }
 
+// Use pre-defined block counts (auto CMD23) if the card supports them and they don't keep failing.
+static bool _sdmmc_storage_use_set_blkcnt(sdmmc_storage_t *storage)
+{
+	if (!storage->auto_set_blkcnt)
+		return false;
+
+	if (storage->set_blkcnt_backoff)
+	{
+		storage->set_blkcnt_backoff--;
+		return false;
+	}
+
+	return true;
+}
+
+static void _sdmmc_storage_set_blkcnt_result(sdmmc_storage_t *storage, bool set_blkcnt, bool ok)
+{
+	if (!set_blkcnt)
+		return;
+
+	if (ok)
+	{
+		storage->set_blkcnt_errors = 0;
+		return;
+	}
+
+	// Fall back to auto CMD12 for a while after repeated failures. A single failure after that backs off again.
+	if (++storage->set_blkcnt_errors >= SDMMC_SET_BLKCNT_ERRORS_MAX)
+	{
+		storage->set_blkcnt_errors  = SDMMC_SET_BLKCNT_ERRORS_MAX - 1;
+		storage->set_blkcnt_backoff = SDMMC_SET_BLKCNT_BACKOFF;
+	}
+}
+
 static int _sdmmc_storage_readwrite_ex(sdmmc_storage_t *storage, u32 *blkcnt_out, u32 sector, u32 num_sectors, void *buf, u32 is_write)
 {
 	u32 tmp = 0;
 	sdmmc_cmd_t cmdbuf;
 	sdmmc_req_t reqbuf;
+	bool set_blkcnt = _sdmmc_storage_use_set_blkcnt(storage);
 
 	// If SDSC convert block address to byte address.
 	if (!storage->has_sector_access)
@@ -213,17 +250,24 @@ static int _sdmmc_storage_readwrite_ex(sdmmc_storage_t *storage, u32 *blkcnt_out
 
 	sdmmc_init_cmd(&cmdbuf, is_write ? MMC_WRITE_MULTIPLE_BLOCK : MMC_READ_MULTIPLE_BLOCK, sector, SDMMC_RSP_TYPE_1, 0);
 
-	reqbuf.buf              = buf;
-	reqbuf.num_sectors      = num_sectors;
-	reqbuf.blksize          = SDMMC_DAT_BLOCKSIZE;
-	reqbuf.is_write         = is_write;
-	reqbuf.is_multi_block   = 1;
-	reqbuf.is_auto_stop_trn = 1;
+	reqbuf.buf                = buf;
+	reqbuf.num_sectors        = num_sectors;
+	reqbuf.blksize            = SDMMC_DAT_BLOCKSIZE;
+	reqbuf.is_write           = is_write;
+	reqbuf.is_multi_block     = 1;
+	reqbuf.is_auto_stop_trn   = !set_blkcnt;
+	reqbuf.is_auto_set_blkcnt = set_blkcnt;
+
+	int res = sdmmc_execute_cmd(storage->sdmmc, &cmdbuf, &reqbuf, blkcnt_out);
+	_sdmmc_storage_set_blkcnt_result(storage, set_blkcnt, res);
 
-	if (!sdmmc_execute_cmd(storage->sdmmc, &cmdbuf, &reqbuf, blkcnt_out))
+	if (!res)
 	{
 		sdmmc_stop_transmission(storage->sdmmc, &tmp);
-		_sdmmc_storage_get_status(storage, &tmp, 0);
+
+		// Partial progress only counts if the card is back in transfer state without errors.
+		if (!_sdmmc_storage_get_status(storage, &tmp, 0))
+			*blkcnt_out = 0;
 
 		return 0;
 	}
@@ -231,6 +275,41 @@ static int _sdmmc_storage_readwrite_ex(sdmmc_storage_t *storage, u32 *blkcnt_out
 	return 1;
 }
 
+void sdmmc_storage_reset(sdmmc_storage_t *storage, sdmmc_t *sdmmc)
+{
+	// Queued requests and the bus cache belong to the caller, keep them across inits.
+	memset(storage, 0, offsetof(sdmmc_storage_t, queue));
+	storage->sdmmc = sdmmc;
+}
+
+static int _sdmmc_storage_tuning_execute(sdmmc_storage_t *storage, u32 type, u32 cmd)
+{
+	sdmmc_bus_cache_t *cache = storage->bus_cache;
+
+	// Same card and timing as last time, reuse its tap.
+	if (cache && cache->tuned && cache->type == type && !memcmp(cache->raw_cid, storage->raw_cid, sizeof(storage->raw_cid)))
+	{
+		sdmmc_set_tap_value(storage->sdmmc, cache->tap);
+		storage->bus_cache_hit = 1;
+		DPRINTF("[SDMMC%d] cached tap %d\n", storage->sdmmc->id, cache->tap);
+
+		return 1;
+	}
+
+	if (!sdmmc_tuning_execute(storage->sdmmc, type, cmd))
+		return 0;
+
+	if (cache)
+	{
+		memcpy(cache->raw_cid, storage->raw_cid, sizeof(storage->raw_cid));
+		cache->type  = type;
+		cache->tap   = sdmmc_get_tap_value(storage->sdmmc);
+		cache->tuned = 1;
+	}
+
+	return 1;
+}
+
 int sdmmc_storage_end(sdmmc_storage_t *storage)
 {
 	DPRINTF("[SDMMC%d] end\n", storage->sdmmc->id);
@@ -240,11 +319,20 @@ int sdmmc_storage_end(sdmmc_storage_t *storage)
 
 	sdmmc_end(storage->sdmmc);
 
-	storage->initialized = 0;
+	storage->initialized  = 0;
+	storage->init_started = 0;
 
 	return 1;
 }
 
+// Read/Write errors per controller and bus timing. Kept across inits.
+static u16 _sdmmc_rw_errors[SDMMC_4 + 1][SDHCI_TIMING_UHS_DDR200 + 1];
+
+u16 *sdmmc_storage_get_rw_errors(sdmmc_storage_t *storage)
+{
+	return _sdmmc_rw_errors[storage->sdmmc->id];
+}
+
 static int _sdmmc_storage_readwrite(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf, u32 is_write)
 {
 	u8 *bbuf = (u8 *)buf;
@@ -261,17 +349,34 @@ static int _sdmmc_storage_readwrite(sdmmc_storage_t *storage, u32 sector, u32 nu
 		u32 blkcnt = 0;
 		// Retry 5 times if failed.
 		u32 retries = 5;
+		u32 backoff = 1;
 		do
 		{
 reinit_try:
+			blkcnt = 0;
 			if (_sdmmc_storage_readwrite_ex(storage, &blkcnt, sct_off, MIN(sct_total, 0xFFFF), bbuf, is_write))
 				goto out;
 			else
 				retries--;
 
 			sd_error_count_increment(SD_ERROR_RW_RETRY);
+			_sdmmc_rw_errors[storage->sdmmc->id][storage->sdmmc->timing]++;
+
+			// Resume after the blocks the card acknowledged. Progress restores the retries.
+			if (blkcnt)
+			{
+				sct_off += blkcnt;
+				sct_total -= blkcnt;
+				bbuf += SDMMC_DAT_BLOCKSIZE * blkcnt;
 
-			msleep(50);
+				retries = 5;
+				backoff = 1;
+				continue;
+			}
+
+			// Back off longer on consecutive failures.
+			msleep(backoff);
+			backoff = MIN(backoff * 4, 50);
 		} while (retries);
 
 		// Disk IO failure! Reinit SD/EMMC to a lower speed.
@@ -294,6 +399,8 @@ reinit_try:
 			}
 			else if (storage->sdmmc->id == SDMMC_4)
 			{
+				u32 partition = storage->partition;
+
 				emmc_error_count_increment(EMMC_ERROR_RW_FAIL);
 
 				if (first_reinit)
@@ -304,22 +411,20 @@ reinit_try:
 					if (!res)
 						emmc_error_count_increment(EMMC_ERROR_INIT_FAIL);
 				}
+
+				// Init starts on the user partition.
+				if (res && partition)
+					res = sdmmc_storage_set_mmc_partition(storage, partition);
 			}
 
 			// Reset values for a retry.
-			blkcnt = 0;
 			retries = 3;
+			backoff = 1;
 			first_reinit = false;
 
-			// If successful reinit, restart xfer.
+			// If successful reinit, resume xfer where it failed.
 			if (res)
-			{
-				bbuf = (u8 *)buf;
-				sct_off = sector;
-				sct_total = num_sectors;
-
 				goto reinit_try;
-			}
 		}
 
 		// Failed.
@@ -334,10 +439,13 @@ out:
 	return 1;
 }
 
+static void _sdmmc_storage_queue_flush(sdmmc_storage_t *storage);
+
 int sdmmc_storage_read(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf)
 {
 	// Ensure that SDMMC has access to buffer and it's SDMMC DMA aligned.
 	if(buf && !((u32)buf % 8)){
+		_sdmmc_storage_queue_flush(storage);
 		return _sdmmc_storage_readwrite(storage, sector, num_sectors, buf, 0);
 	}
 
@@ -359,6 +467,7 @@ int sdmmc_storage_write(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, v
 {
 	// Ensure that SDMMC has access to buffer and it's SDMMC DMA aligned.
 	if(buf && !((u32)buf % 8)){
+		_sdmmc_storage_queue_flush(storage);
 		return _sdmmc_storage_readwrite(storage, sector, num_sectors, buf, 1);
 	}
 	return 0;
@@ -373,6 +482,226 @@ int sdmmc_storage_write(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, v
 	// return _sdmmc_storage_readwrite(storage, sector, num_sectors, tmp_buf, 1);
 }
 
+int sdmmc_storage_read_sg(sdmmc_storage_t *storage, u32 sector, const sdmmc_sg_t *sg, u32 sg_cnt)
+{
+	u32 tmp = 0;
+	u32 num_sectors = 0;
+	sdmmc_cmd_t cmdbuf;
+	sdmmc_req_t reqbuf;
+
+	if (!storage->initialized)
+		return 0;
+
+	_sdmmc_storage_queue_flush(storage);
+
+	for (u32 i = 0; i < sg_cnt; i++)
+	{
+		if (sg[i].size % SDMMC_DAT_BLOCKSIZE)
+			return 0;
+		num_sectors += sg[i].size / SDMMC_DAT_BLOCKSIZE;
+	}
+
+	if (!num_sectors || num_sectors > 0xFFFF)
+		return 0;
+
+	// If SDSC convert block address to byte address.
+	sdmmc_init_cmd(&cmdbuf, MMC_READ_MULTIPLE_BLOCK, storage->has_sector_access ? sector : sector << 9, SDMMC_RSP_TYPE_1, 0);
+
+	bool set_blkcnt = _sdmmc_storage_use_set_blkcnt(storage);
+
+	reqbuf.buf                = NULL;
+	reqbuf.num_sectors        = num_sectors;
+	reqbuf.blksize            = SDMMC_DAT_BLOCKSIZE;
+	reqbuf.is_write           = 0;
+	reqbuf.is_multi_block     = 1;
+	reqbuf.is_auto_stop_trn   = !set_blkcnt;
+	reqbuf.is_auto_set_blkcnt = set_blkcnt;
+
+	int res = sdmmc_execute_cmd_sg(storage->sdmmc, &cmdbuf, &reqbuf, sg, sg_cnt, NULL);
+	_sdmmc_storage_set_blkcnt_result(storage, set_blkcnt, res);
+
+	if (res)
+		return 1;
+
+	sdmmc_stop_transmission(storage->sdmmc, &tmp);
+	_sdmmc_storage_get_status(storage, &tmp, 0);
+
+	// Fall back to one read per segment, with the normal retry/reinit path.
+	for (u32 i = 0; i < sg_cnt; i++)
+	{
+		u32 seg_sectors = sg[i].size / SDMMC_DAT_BLOCKSIZE;
+		if (!_sdmmc_storage_readwrite(storage, sector, seg_sectors, sg[i].buf, 0))
+			return 0;
+		sector += seg_sectors;
+	}
+
+	return 1;
+}
+
+/*
+ * Request queue.
+ * Requests are started in order and one at a time, the controller runs one data
+ * command. Polling starts the next one as soon as the previous one is seen done,
+ * so the caller can work on a finished buffer while the next transfer runs.
+ * Results are collected in order. A failed request is recovered and retried
+ * through the normal retry/reinit path when it is polled.
+ */
+static sdmmc_storage_req_t *_sdmmc_storage_queue_at(sdmmc_storage_t *storage, u32 idx)
+{
+	return &storage->queue[(storage->queue_head + idx) % SDMMC_STORAGE_QUEUE_SIZE];
+}
+
+static void _sdmmc_storage_queue_start(sdmmc_storage_t *storage, sdmmc_storage_req_t *req)
+{
+	sdmmc_cmd_t cmdbuf;
+	sdmmc_req_t reqbuf;
+
+	// If SDSC convert block address to byte address.
+	u32 sector = storage->has_sector_access ? req->sector : req->sector << 9;
+
+	req->set_blkcnt = _sdmmc_storage_use_set_blkcnt(storage);
+
+	sdmmc_init_cmd(&cmdbuf, req->is_write ? MMC_WRITE_MULTIPLE_BLOCK : MMC_READ_MULTIPLE_BLOCK, sector, SDMMC_RSP_TYPE_1, 0);
+
+	reqbuf.buf                = req->buf;
+	reqbuf.num_sectors        = req->num_sectors;
+	reqbuf.blksize            = SDMMC_DAT_BLOCKSIZE;
+	reqbuf.is_write           = req->is_write;
+	reqbuf.is_multi_block     = 1;
+	reqbuf.is_auto_stop_trn   = !req->set_blkcnt;
+	reqbuf.is_auto_set_blkcnt = req->set_blkcnt;
+
+	req->state = SDMMC_REQ_BUSY;
+
+	// A failed submit is recovered when polled.
+	sdmmc_submit_req(storage->sdmmc, &cmdbuf, &reqbuf);
+}
+
+// Advances the queue without blocking, unless a failed request has to be retried.
+static void _sdmmc_storage_queue_step(sdmmc_storage_t *storage)
+{
+	u32 tmp = 0;
+	u32 idx;
+	sdmmc_storage_req_t *req = NULL;
+
+	for (idx = 0; idx < storage->queue_cnt; idx++)
+	{
+		req = _sdmmc_storage_queue_at(storage, idx);
+		if (req->state == SDMMC_REQ_IDLE || req->state == SDMMC_REQ_BUSY)
+			break;
+	}
+
+	if (idx == storage->queue_cnt)
+		return;
+
+	if (req->state == SDMMC_REQ_IDLE)
+	{
+		_sdmmc_storage_queue_start(storage, req);
+		return;
+	}
+
+	u32 blkcnt = 0;
+	u32 state = sdmmc_poll_req(storage->sdmmc, &blkcnt);
+	if (state == SDMMC_REQ_BUSY)
+		return;
+
+	_sdmmc_storage_set_blkcnt_result(storage, req->set_blkcnt, state == SDMMC_REQ_DONE);
+
+	if (state != SDMMC_REQ_DONE)
+	{
+		// Recover the same way as a synchronous request.
+		sdmmc_stop_transmission(storage->sdmmc, &tmp);
+		_sdmmc_storage_get_status(storage, &tmp, 0);
+
+		sd_error_count_increment(SD_ERROR_RW_RETRY);
+		_sdmmc_rw_errors[storage->sdmmc->id][storage->sdmmc->timing]++;
+
+		// Retry after the blocks the card acknowledged with the normal retry/reinit path.
+		// The queue is hidden meanwhile, the partition switch of a reinit must not step it.
+		u8 queue_cnt = storage->queue_cnt;
+		storage->queue_cnt = 0;
+		blkcnt = MIN(blkcnt, req->num_sectors - 1u);
+		state = _sdmmc_storage_readwrite(storage, req->sector + blkcnt, req->num_sectors - blkcnt,
+			(u8 *)req->buf + SDMMC_DAT_BLOCKSIZE * blkcnt, req->is_write) ? SDMMC_REQ_DONE : SDMMC_REQ_ERROR;
+		storage->queue_cnt = queue_cnt;
+	}
+
+	req->state = state;
+
+	// Keep the controller busy.
+	if (idx + 1 < storage->queue_cnt)
+		_sdmmc_storage_queue_start(storage, _sdmmc_storage_queue_at(storage, idx + 1));
+}
+
+// Synchronous commands can't be issued while a request is in flight. Results stay queued.
+static void _sdmmc_storage_queue_flush(sdmmc_storage_t *storage)
+{
+	while (storage->queue_cnt && _sdmmc_storage_queue_at(storage, storage->queue_cnt - 1)->state <= SDMMC_REQ_BUSY)
+		_sdmmc_storage_queue_step(storage);
+}
+
+static int _sdmmc_storage_readwrite_async(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf, u32 is_write)
+{
+	// Exit if not initialized or the queue is full.
+	if (!storage->initialized || storage->queue_cnt == SDMMC_STORAGE_QUEUE_SIZE)
+		return 0;
+
+	// Ensure that SDMMC DMA is aligned and request fits in one command.
+	if (!buf || ((u32)buf % 8) || !num_sectors || num_sectors > 0xFFFF)
+		return 0;
+
+	sdmmc_storage_req_t *req = _sdmmc_storage_queue_at(storage, storage->queue_cnt);
+	req->sector      = sector;
+	req->num_sectors = num_sectors;
+	req->buf         = buf;
+	req->is_write    = is_write;
+	req->state       = SDMMC_REQ_IDLE;
+	storage->queue_cnt++;
+
+	// Starts it right away if the controller is idle.
+	_sdmmc_storage_queue_step(storage);
+
+	return 1;
+}
+
+int sdmmc_storage_read_async(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf)
+{
+	return _sdmmc_storage_readwrite_async(storage, sector, num_sectors, buf, 0);
+}
+
+int sdmmc_storage_write_async(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf)
+{
+	return _sdmmc_storage_readwrite_async(storage, sector, num_sectors, buf, 1);
+}
+
+int sdmmc_storage_async_busy(sdmmc_storage_t *storage)
+{
+	int busy = 0;
+
+	_sdmmc_storage_queue_step(storage);
+
+	for (u32 i = 0; i < storage->queue_cnt; i++)
+		if (_sdmmc_storage_queue_at(storage, i)->state <= SDMMC_REQ_BUSY)
+			busy++;
+
+	return busy;
+}
+
+int sdmmc_storage_async_wait(sdmmc_storage_t *storage)
+{
+	if (!storage->queue_cnt)
+		return 0;
+
+	sdmmc_storage_req_t *req = _sdmmc_storage_queue_at(storage, 0);
+	while (req->state <= SDMMC_REQ_BUSY)
+		_sdmmc_storage_queue_step(storage);
+
+	storage->queue_head = (storage->queue_head + 1) % SDMMC_STORAGE_QUEUE_SIZE;
+	storage->queue_cnt--;
+
+	return req->state == SDMMC_REQ_DONE;
+}
+
 /*
 * MMC specific functions.
 */
@@ -533,6 +862,7 @@ int mmc_storage_get_ext_csd(sdmmc_storage_t *storage, void *buf)
 	reqbuf.is_write = 0;
 	reqbuf.is_multi_block = 0;
 	reqbuf.is_auto_stop_trn = 0;
+	reqbuf.is_auto_set_blkcnt = 0;
 
 	if (!sdmmc_execute_cmd(storage->sdmmc, &cmdbuf, &reqbuf, NULL))
 		return 0;
@@ -605,7 +935,7 @@ static int _mmc_storage_enable_HS200(sdmmc_storage_t *storage)
 	if (!sdmmc_setup_clock(storage->sdmmc, SDHCI_TIMING_MMC_HS200))
 		return 0;
 
-	if (!sdmmc_tuning_execute(storage->sdmmc, SDHCI_TIMING_MMC_HS200, MMC_SEND_TUNING_BLOCK_HS200))
+	if (!_sdmmc_storage_tuning_execute(storage, SDHCI_TIMING_MMC_HS200, MMC_SEND_TUNING_BLOCK_HS200))
 		return 0;
 
 	DPRINTF("[MMC] switched to HS200\n");
@@ -675,15 +1005,18 @@ static int _mmc_storage_enable_auto_bkops(sdmmc_storage_t *storage)
 
 int sdmmc_storage_init_mmc(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 bus_width, u32 type)
 {
-	memset(storage, 0, sizeof(sdmmc_storage_t));
-	storage->sdmmc = sdmmc;
+	sdmmc_storage_reset(storage, sdmmc);
 	storage->rca = 2; // Set default device address. This could be a config item.
 
 	DPRINTF("[MMC]-[init: bus: %d, type: %d]\n", bus_width, type);
 
-	if (!sdmmc_init(sdmmc, SDMMC_4, SDMMC_POWER_1_8, SDMMC_BUS_WIDTH_1, SDHCI_TIMING_MMC_ID))
-		return 0;
-	DPRINTF("[MMC] after init\n");
+	// Controller may still be up in identification mode from a previous user, skip its power up.
+	if (!sdmmc_is_configured(sdmmc, SDMMC_4, SDMMC_POWER_1_8, SDMMC_BUS_WIDTH_1, SDHCI_TIMING_MMC_ID))
+	{
+		if (!sdmmc_init(sdmmc, SDMMC_4, SDMMC_POWER_1_8, SDMMC_BUS_WIDTH_1, SDHCI_TIMING_MMC_ID))
+			return 0;
+		DPRINTF("[MMC] after init\n");
+	}
 
 	// Wait 1ms + 74 cycles.
 	usleep(1000 + (74 * 1000 + sdmmc->card_clock - 1) / sdmmc->card_clock);
@@ -733,6 +1066,9 @@ int sdmmc_storage_init_mmc(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 bus_wid
 		return 0;
 	DPRINTF("[MMC] got ext_csd\n");
 
+	// Use pre-defined block count transfers from eMMC 4.3 (EXT_CSD_REV 3) on.
+	storage->auto_set_blkcnt = storage->ext_csd.rev >= 3;
+
 	_mmc_storage_parse_cid(storage); // This needs to be after csd and ext_csd.
 
 /*
@@ -755,8 +1091,19 @@ done:
 	return 1;
 }
 
+// CMD6 partition switches done. Kept across inits.
+static u32 _sdmmc_part_switches;
+
+u32 sdmmc_storage_get_partition_switches()
+{
+	return _sdmmc_part_switches;
+}
+
 int sdmmc_storage_set_mmc_partition(sdmmc_storage_t *storage, u32 partition)
 {
+	// Queued requests belong to the current partition.
+	_sdmmc_storage_queue_flush(storage);
+
 	if (!_mmc_storage_switch(storage, SDMMC_SWITCH(MMC_SWITCH_MODE_WRITE_BYTE, EXT_CSD_PART_CONFIG, partition)))
 		return 0;
 
@@ -764,6 +1111,7 @@ int sdmmc_storage_set_mmc_partition(sdmmc_storage_t *storage, u32 partition)
 		return 0;
 
 	storage->partition = partition;
+	_sdmmc_part_switches++;
 
 	return 1;
 }
@@ -1066,12 +1414,13 @@ int sd_storage_get_scr(sdmmc_storage_t *storage, u8 *buf)
 	sdmmc_init_cmd(&cmdbuf, SD_APP_SEND_SCR, 0, SDMMC_RSP_TYPE_1, 0);
 
 	sdmmc_req_t reqbuf;
-	reqbuf.buf              = buf;
-	reqbuf.blksize          = 8;
-	reqbuf.num_sectors      = 1;
-	reqbuf.is_write         = 0;
-	reqbuf.is_multi_block   = 0;
-	reqbuf.is_auto_stop_trn = 0;
+	reqbuf.buf                = buf;
+	reqbuf.blksize            = 8;
+	reqbuf.num_sectors        = 1;
+	reqbuf.is_write           = 0;
+	reqbuf.is_multi_block     = 0;
+	reqbuf.is_auto_stop_trn   = 0;
+	reqbuf.is_auto_set_blkcnt = 0;
 
 	if (!_sd_storage_execute_app_cmd(storage, R1_STATE_TRAN, 0, &cmdbuf, &reqbuf, NULL))
 		return 0;
@@ -1097,12 +1446,13 @@ static int _sd_storage_switch_get(sdmmc_storage_t *storage, void *buf)
 	sdmmc_init_cmd(&cmdbuf, SD_SWITCH, 0xFFFFFF, SDMMC_RSP_TYPE_1, 0);
 
 	sdmmc_req_t reqbuf;
-	reqbuf.buf              = buf;
-	reqbuf.blksize          = SDMMC_CMD_BLOCKSIZE;
-	reqbuf.num_sectors      = 1;
-	reqbuf.is_write         = 0;
-	reqbuf.is_multi_block   = 0;
-	reqbuf.is_auto_stop_trn = 0;
+	reqbuf.buf                = buf;
+	reqbuf.blksize            = SDMMC_CMD_BLOCKSIZE;
+	reqbuf.num_sectors        = 1;
+	reqbuf.is_write           = 0;
+	reqbuf.is_multi_block     = 0;
+	reqbuf.is_auto_stop_trn   = 0;
+	reqbuf.is_auto_set_blkcnt = 0;
 
 	if (!sdmmc_execute_cmd(storage->sdmmc, &cmdbuf, &reqbuf, NULL))
 		return 0;
@@ -1121,12 +1471,13 @@ static int _sd_storage_switch(sdmmc_storage_t *storage, void *buf, int mode, int
 	sdmmc_init_cmd(&cmdbuf, SD_SWITCH, switchcmd, SDMMC_RSP_TYPE_1, 0);
 
 	sdmmc_req_t reqbuf;
-	reqbuf.buf              = buf;
-	reqbuf.blksize          = SDMMC_CMD_BLOCKSIZE;
-	reqbuf.num_sectors      = 1;
-	reqbuf.is_write         = 0;
-	reqbuf.is_multi_block   = 0;
-	reqbuf.is_auto_stop_trn = 0;
+	reqbuf.buf                = buf;
+	reqbuf.blksize            = SDMMC_CMD_BLOCKSIZE;
+	reqbuf.num_sectors        = 1;
+	reqbuf.is_write           = 0;
+	reqbuf.is_multi_block     = 0;
+	reqbuf.is_auto_stop_trn   = 0;
+	reqbuf.is_auto_set_blkcnt = 0;
 
 	if (!sdmmc_execute_cmd(storage->sdmmc, &cmdbuf, &reqbuf, NULL))
 		return 0;
@@ -1421,7 +1772,7 @@ static int _sd_storage_enable_uhs_low_volt(sdmmc_storage_t *storage, u32 type, u
 		return 0;
 	DPRINTF("[SD] after setup clock\n");
 
-	if (!sdmmc_tuning_execute(storage->sdmmc, type, MMC_SEND_TUNING_BLOCK))
+	if (!_sdmmc_storage_tuning_execute(storage, type, MMC_SEND_TUNING_BLOCK))
 		return 0;
 	DPRINTF("[SD] after tuning\n");
 
@@ -1535,12 +1886,13 @@ int sd_storage_get_ssr(sdmmc_storage_t *storage, u8 *buf)
 	sdmmc_init_cmd(&cmdbuf, SD_APP_SD_STATUS, 0, SDMMC_RSP_TYPE_1, 0);
 
 	sdmmc_req_t reqbuf;
-	reqbuf.buf              = buf;
-	reqbuf.blksize          = SDMMC_CMD_BLOCKSIZE;
-	reqbuf.num_sectors      = 1;
-	reqbuf.is_write         = 0;
-	reqbuf.is_multi_block   = 0;
-	reqbuf.is_auto_stop_trn = 0;
+	reqbuf.buf                = buf;
+	reqbuf.blksize            = SDMMC_CMD_BLOCKSIZE;
+	reqbuf.num_sectors        = 1;
+	reqbuf.is_write           = 0;
+	reqbuf.is_multi_block     = 0;
+	reqbuf.is_auto_stop_trn   = 0;
+	reqbuf.is_auto_set_blkcnt = 0;
 
 	if (!(storage->csd.cmdclass & CCC_APP_SPEC))
 	{
@@ -1649,20 +2001,16 @@ void sdmmc_storage_init_wait_sd()
 		msleep(239 - sd_poweroff_time);
 }
 
-int sdmmc_storage_init_sd(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 bus_width, u32 type)
+int sdmmc_storage_init_sd_start(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 bus_width, u32 type)
 {
-	u32  tmp = 0;
+	u32  cond = 0;
 	int  is_sdsc = 0;
-	u8  *buf = (u8 *)SDMMC_UPPER_BUFFER;
 	bool bus_uhs_support = _sdmmc_storage_get_bus_uhs_support(bus_width, type);
 
-	DPRINTF("[SD]-[init: bus: %d, type: %d]\n", bus_width, type);
-
 	// Some cards (SanDisk U1), do not like a fast power cycle. Wait min 100ms.
 	sdmmc_storage_init_wait_sd();
 
-	memset(storage, 0, sizeof(sdmmc_storage_t));
-	storage->sdmmc = sdmmc;
+	sdmmc_storage_reset(storage, sdmmc);
 
 	if (!sdmmc_init(sdmmc, SDMMC_1, SDMMC_POWER_3_3, SDMMC_BUS_WIDTH_1, SDHCI_TIMING_SD_ID))
 		return 0;
@@ -1679,7 +2027,34 @@ int sdmmc_storage_init_sd(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 bus_widt
 		return 0;
 	DPRINTF("[SD] after send if cond\n");
 
-	if (!_sd_storage_get_op_cond(storage, is_sdsc, bus_uhs_support))
+	// First ACMD41 starts card power up. It continues while the host does other work.
+	if (!_sd_storage_get_op_cond_once(storage, &cond, is_sdsc, bus_uhs_support))
+		return 0;
+
+	storage->init_is_sdsc = is_sdsc;
+	storage->init_uhs     = bus_uhs_support;
+	storage->init_started = 1;
+
+	return 1;
+}
+
+int sdmmc_storage_init_sd(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 bus_width, u32 type)
+{
+	u32  tmp = 0;
+	u8  *buf = (u8 *)SDMMC_UPPER_BUFFER;
+	bool bus_uhs_support = _sdmmc_storage_get_bus_uhs_support(bus_width, type);
+
+	DPRINTF("[SD]-[init: bus: %d, type: %d]\n", bus_width, type);
+
+	// Resume init if power up was started with the same voltage request.
+	if (!storage->init_started || storage->sdmmc != sdmmc || storage->init_uhs != bus_uhs_support)
+	{
+		if (!sdmmc_storage_init_sd_start(storage, sdmmc, bus_width, type))
+			return 0;
+	}
+	storage->init_started = 0;
+
+	if (!_sd_storage_get_op_cond(storage, storage->init_is_sdsc, bus_uhs_support))
 		return 0;
 	DPRINTF("[SD] got op cond\n");
 
@@ -1721,6 +2096,9 @@ int sdmmc_storage_init_sd(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 bus_widt
 		return 0;
 	DPRINTF("[SD] got scr\n");
 
+	// Use pre-defined block count transfers if supported.
+	storage->auto_set_blkcnt = !!(storage->scr.cmds & SD_SCR_CMD23_SUPPORT);
+
 	// If card supports a wider bus and if it's not SD Version 1.0 switch bus width.
 	if (bus_width == SDMMC_BUS_WIDTH_4 && (storage->scr.bus_widths & BIT(SD_BUS_WIDTH_4)) && storage->scr.sda_vsn)
 	{
@@ -1784,12 +2162,13 @@ int _gc_storage_custom_cmd(sdmmc_storage_t *storage, void *buf)
 	sdmmc_init_cmd(&cmdbuf, MMC_VENDOR_60_CMD, 0, SDMMC_RSP_TYPE_1, 1);
 
 	sdmmc_req_t reqbuf;
-	reqbuf.buf              = buf;
-	reqbuf.blksize          = SDMMC_CMD_BLOCKSIZE;
-	reqbuf.num_sectors      = 1;
-	reqbuf.is_write         = 1;
-	reqbuf.is_multi_block   = 0;
-	reqbuf.is_auto_stop_trn = 0;
+	reqbuf.buf                = buf;
+	reqbuf.blksize            = SDMMC_CMD_BLOCKSIZE;
+	reqbuf.num_sectors        = 1;
+	reqbuf.is_write           = 1;
+	reqbuf.is_multi_block     = 0;
+	reqbuf.is_auto_stop_trn   = 0;
+	reqbuf.is_auto_set_blkcnt = 0;
 
 	if (!sdmmc_execute_cmd(storage->sdmmc, &cmdbuf, &reqbuf, NULL))
 	{
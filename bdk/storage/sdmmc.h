@@ -177,6 +177,34 @@ typedef struct _sd_ssr
 	u32 protected_size;
 } sd_ssr_t;
 
+/*! Last working bus mode and tuning result of a card. Owned by the caller and kept across inits. */
+typedef struct _sdmmc_bus_cache_t
+{
+	u8 raw_cid[0x10];
+	u8 mode;  // sd_mode/emmc_mode, 0 if not set.
+	u8 type;  // Timing the tap was tuned for.
+	u8 tap;
+	u8 tuned;
+	u8 boots; // Boots started below the top mode since it was last tried.
+	u8 fails; // Boots in a row that ended below the saved mode.
+} sdmmc_bus_cache_t;
+
+#define SDMMC_SET_BLKCNT_ERRORS_MAX 3  // Failed auto CMD23 transfers in a row before auto CMD12 is used.
+#define SDMMC_SET_BLKCNT_BACKOFF    64 // Transfers with auto CMD12 before auto CMD23 is tried again.
+
+/*! Queued storage request. */
+#define SDMMC_STORAGE_QUEUE_SIZE 4
+
+typedef struct _sdmmc_storage_req_t
+{
+	u32  sector;
+	u32  num_sectors;
+	void *buf;
+	u8   is_write;
+	u8   set_blkcnt; // Started with auto CMD23.
+	u8   state;      // SDMMC_REQ_IDLE until started.
+} sdmmc_storage_req_t;
+
 /*! SDMMC storage context. */
 typedef struct _sdmmc_storage_t
 {
@@ -197,6 +225,18 @@ typedef struct _sdmmc_storage_t
 	mmc_ext_csd_t ext_csd;
 	sd_scr_t      scr;
 	sd_ssr_t      ssr;
+	int  auto_set_blkcnt;    // Card supports pre-defined block counts (CMD23).
+	u8   set_blkcnt_errors;  // Consecutive failed transfers with auto CMD23.
+	u8   set_blkcnt_backoff; // Transfers left with auto CMD12 before auto CMD23 is tried again.
+	int  init_started;
+	int  init_is_sdsc;
+	int  init_uhs;
+	int  bus_cache_hit; // Cached tap was used instead of tuning.
+	// Kept across inits, a reinit during a queued transfer must not drop the other requests.
+	sdmmc_storage_req_t queue[SDMMC_STORAGE_QUEUE_SIZE];
+	u8   queue_head; // Oldest request, collected next.
+	u8   queue_cnt;
+	sdmmc_bus_cache_t *bus_cache;
 } sdmmc_storage_t;
 
 typedef struct _sd_func_modes_t
@@ -210,9 +250,18 @@ typedef struct _sd_func_modes_t
 int  sdmmc_storage_end(sdmmc_storage_t *storage);
 int  sdmmc_storage_read(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf);
 int  sdmmc_storage_write(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf);
+int  sdmmc_storage_read_sg(sdmmc_storage_t *storage, u32 sector, const sdmmc_sg_t *sg, u32 sg_cnt);
+int  sdmmc_storage_read_async(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf);
+int  sdmmc_storage_write_async(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf);
+int  sdmmc_storage_async_busy(sdmmc_storage_t *storage);
+int  sdmmc_storage_async_wait(sdmmc_storage_t *storage);
+u16 *sdmmc_storage_get_rw_errors(sdmmc_storage_t *storage);
+void sdmmc_storage_reset(sdmmc_storage_t *storage, sdmmc_t *sdmmc);
 int  sdmmc_storage_init_mmc(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 bus_width, u32 type);
 int  sdmmc_storage_set_mmc_partition(sdmmc_storage_t *storage, u32 partition);
+u32  sdmmc_storage_get_partition_switches();
 void sdmmc_storage_init_wait_sd();
+int  sdmmc_storage_init_sd_start(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 bus_width, u32 type);
 int  sdmmc_storage_init_sd(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 bus_width, u32 type);
 int  sdmmc_storage_init_gc(sdmmc_storage_t *storage, sdmmc_t *sdmmc);
 
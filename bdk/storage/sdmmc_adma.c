@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2018-2024 CTCaer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <storage/sdmmc_driver.h>
+
+/*
+ * ADMA2 descriptor table builder.
+ * No hardware access, so it can be built and tested on its own.
+ */
+u32 sdmmc_adma2_build_desc(sdmmc_adma2_desc_t *desc, u32 desc_max, const sdmmc_sg_t *sg, u32 sg_cnt)
+{
+	u32 idx = 0;
+	u32 total = 0;
+
+	for (u32 i = 0; i < sg_cnt; i++)
+	{
+		u32 addr = (u32)sg[i].buf;
+		u32 size = sg[i].size;
+
+		// Check alignment.
+		if ((addr & 7) || (size & 7) || !size)
+			return 0;
+
+		// Split segments that exceed the max descriptor length.
+		while (size)
+		{
+			if (idx >= desc_max)
+				return 0;
+
+			u32 len = MIN(size, SDMMC_ADMA2_MAX_LEN);
+
+			desc[idx].attr    = SDMMC_ADMA2_ATTR_TRAN | SDMMC_ADMA2_ATTR_VALID;
+			desc[idx].len     = len & 0xFFFF; // 0 means max length.
+			desc[idx].addr    = addr;
+			desc[idx].addr_hi = 0;
+			desc[idx].rsvd    = 0;
+
+			addr  += len;
+			size  -= len;
+			total += len;
+			idx++;
+		}
+	}
+
+	if (!idx)
+		return 0;
+
+	desc[idx - 1].attr |= SDMMC_ADMA2_ATTR_END;
+
+	return total;
+}
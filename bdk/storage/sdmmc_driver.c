@@ -53,6 +53,15 @@ int sdmmc_get_io_power(sdmmc_t *sdmmc)
 	return -1;
 }
 
+int sdmmc_is_configured(sdmmc_t *sdmmc, u32 id, u32 power, u32 bus_width, u32 type)
+{
+	// Id is only set once regs are valid.
+	if (sdmmc->clock_stopped || sdmmc->id != id || !sdmmc->regs)
+		return 0;
+
+	return sdmmc_get_io_power(sdmmc) == (int)power && sdmmc_get_bus_width(sdmmc) == bus_width && sdmmc->timing == type;
+}
+
 static int _sdmmc_set_io_power(sdmmc_t *sdmmc, u32 power)
 {
 	switch (power)
@@ -103,10 +112,15 @@ void sdmmc_set_bus_width(sdmmc_t *sdmmc, u32 bus_width)
 
 void sdmmc_save_tap_value(sdmmc_t *sdmmc)
 {
-	sdmmc->venclkctl_tap = (sdmmc->regs->venclkctl & 0xFF0000) >> 16;
+	sdmmc->venclkctl_tap = sdmmc_get_tap_value(sdmmc);
 	sdmmc->venclkctl_set = 1;
 }
 
+u32 sdmmc_get_tap_value(sdmmc_t *sdmmc)
+{
+	return (sdmmc->regs->venclkctl & 0xFF0000) >> 16;
+}
+
 static int _sdmmc_config_tap_val(sdmmc_t *sdmmc, u32 type)
 {
 	static const u32 dqs_trim_val = 40; // 24 if HS533/HS667.
@@ -139,6 +153,20 @@ static void _sdmmc_commit_changes(sdmmc_t *sdmmc)
 	(void)sdmmc->regs->clkcon;
 }
 
+// Apply a previously tuned tap instead of running tuning.
+void sdmmc_set_tap_value(sdmmc_t *sdmmc, u32 tap)
+{
+	sdmmc->regs->clkcon     &= ~SDHCI_CLOCK_CARD_EN;
+	sdmmc->regs->ventunctl0 &= ~SDHCI_TEGRA_TUNING_TAP_HW_UPDATED;
+
+	sdmmc->regs->venclkctl   = (sdmmc->regs->venclkctl & 0xFF00FFFF) | (tap << 16);
+
+	sdmmc->regs->ventunctl0 |=  SDHCI_TEGRA_TUNING_TAP_HW_UPDATED;
+	sdmmc->regs->hostctl2   |=  SDHCI_CTRL_TUNED_CLK;
+	sdmmc->regs->clkcon     |=  SDHCI_CLOCK_CARD_EN;
+	_sdmmc_commit_changes(sdmmc);
+}
+
 static void _sdmmc_pad_config_fallback(sdmmc_t *sdmmc, u32 power)
 {
 	_sdmmc_commit_changes(sdmmc);
@@ -373,6 +401,7 @@ int sdmmc_setup_clock(sdmmc_t *sdmmc, u32 type)
 	clock_sdmmc_get_card_clock_div(&clock, &divisor, type);
 	clock_sdmmc_config_clock_source(&clock, sdmmc->id, clock);
 	sdmmc->card_clock = (clock + divisor - 1) / divisor;
+	sdmmc->timing = type;
 
 	// (divisor != 1) && (divisor & 1) -> error
 
@@ -913,13 +942,15 @@ static void _sdmmc_enable_interrupts(sdmmc_t *sdmmc)
 {
 	sdmmc->regs->norintstsen |= SDHCI_INT_DMA_END | SDHCI_INT_DATA_END | SDHCI_INT_RESPONSE;
 	sdmmc->regs->errintstsen |= SDHCI_ERR_INT_ALL_EXCEPT_ADMA_BUSPWR;
+	if (sdmmc->use_adma)
+		sdmmc->regs->errintstsen |= SDHCI_ERR_INT_ADMA;
 	sdmmc->regs->norintsts = sdmmc->regs->norintsts;
 	sdmmc->regs->errintsts = sdmmc->regs->errintsts;
 }
 
 static void _sdmmc_mask_interrupts(sdmmc_t *sdmmc)
 {
-	sdmmc->regs->errintstsen &= ~SDHCI_ERR_INT_ALL_EXCEPT_ADMA_BUSPWR;
+	sdmmc->regs->errintstsen &= ~(SDHCI_ERR_INT_ALL_EXCEPT_ADMA_BUSPWR | SDHCI_ERR_INT_ADMA);
 	sdmmc->regs->norintstsen &= ~(SDHCI_INT_DMA_END | SDHCI_INT_DATA_END | SDHCI_INT_RESPONSE);
 }
 
@@ -1025,7 +1056,10 @@ int sdmmc_stop_transmission(sdmmc_t *sdmmc, u32 *rsp)
 	return result;
 }
 
-static int _sdmmc_config_sdma(sdmmc_t *sdmmc, u32 *blkcnt_out, const sdmmc_req_t *req)
+// ADMA2 descriptors of the scatter/gather request in flight. Those are synchronous, one at a time.
+static sdmmc_adma2_desc_t _sdmmc_adma_desc[SDMMC_ADMA2_DESC_MAX] __attribute__((aligned(8)));
+
+static int _sdmmc_config_dma(sdmmc_t *sdmmc, u32 *blkcnt_out, const sdmmc_req_t *req)
 {
 	if (!req->blksize || !req->num_sectors)
 		return 0;
@@ -1033,19 +1067,37 @@ static int _sdmmc_config_sdma(sdmmc_t *sdmmc, u32 *blkcnt_out, const sdmmc_req_t
 	u32 blkcnt = req->num_sectors;
 	if (blkcnt >= 0xFFFF)
 		blkcnt = 0xFFFF;
-	u32 admaaddr = (u32)req->buf;
 
-	// Check alignment.
-	if (admaaddr & 7)
-		return 0;
+	if (sdmmc->use_adma)
+	{
+		// Descriptors were built by sdmmc_execute_cmd_sg. They must cover the whole request.
+		if (blkcnt != req->num_sectors)
+			return 0;
+
+		sdmmc->regs->hostctl = (sdmmc->regs->hostctl & ~SDHCI_CTRL_DMA_MASK) | SDHCI_CTRL_ADMA32; // ADMA2 with 64bit addressing in Host V4.
+		sdmmc->regs->admaaddr = (u32)_sdmmc_adma_desc;
+		sdmmc->regs->admaaddr_hi = 0;
+
+		sdmmc->regs->blksize = req->blksize;
+	}
+	else
+	{
+		u32 admaaddr = (u32)req->buf;
+
+		// Check alignment.
+		if (admaaddr & 7)
+			return 0;
 
-	sdmmc->regs->admaaddr = admaaddr;
-	sdmmc->regs->admaaddr_hi = 0;
+		sdmmc->regs->hostctl &= ~SDHCI_CTRL_DMA_MASK; // Use SDMA.
+		sdmmc->regs->admaaddr = admaaddr;
+		sdmmc->regs->admaaddr_hi = 0;
 
-	sdmmc->dma_addr_next = ALIGN_DOWN((admaaddr + SZ_512K), SZ_512K);
+		sdmmc->dma_addr_next = ALIGN_DOWN((admaaddr + SZ_512K), SZ_512K);
 
-	sdmmc->regs->blksize = req->blksize | (7u << 12); // SDMA DMA 512KB Boundary (Detects A18 carry out).
+		sdmmc->regs->blksize = req->blksize | (7u << 12); // SDMA DMA 512KB Boundary (Detects A18 carry out).
+	}
 	sdmmc->regs->blkcnt  = blkcnt;
+	sdmmc->req_blkcnt_left = blkcnt;
 
 	if (blkcnt_out)
 		*blkcnt_out = blkcnt;
@@ -1063,72 +1115,130 @@ static int _sdmmc_config_sdma(sdmmc_t *sdmmc, u32 *blkcnt_out, const sdmmc_req_t
 	// Automatic send of stop transmission or set block count cmd.
 	if (req->is_auto_stop_trn)
 		trnmode |= SDHCI_TRNS_AUTO_CMD12;
-	//else if (req->is_auto_set_blkcnt)
-	//	trnmode |= SDHCI_TRNS_AUTO_CMD23;
+	else if (req->is_auto_set_blkcnt && req->is_multi_block)
+	{
+		// Host V4 is enabled, so sysad is used as argument 2 for the CMD23 block count.
+		sdmmc->regs->sysad = blkcnt;
+		trnmode |= SDHCI_TRNS_AUTO_CMD23;
+	}
 
 	sdmmc->regs->trnmod = trnmode;
 
 	return 1;
 }
 
-static int _sdmmc_update_sdma(sdmmc_t *sdmmc)
+static void _sdmmc_sdma_arm_timeout(sdmmc_t *sdmmc)
 {
-	u16 blkcnt = 0;
-	do
+	sdmmc->req_blkcnt_last = sdmmc->regs->blkcnt;
+	sdmmc->req_timeout = get_tmr_ms() + 1500;
+}
+
+static u32 _sdmmc_poll_sdma(sdmmc_t *sdmmc)
+{
+	u32 result = SDMMC_MASKINT_MASKED;
+	while (true)
 	{
-		blkcnt = sdmmc->regs->blkcnt;
-		u32 timeout = get_tmr_ms() + 1500;
-		do
-		{
-			u32 result = SDMMC_MASKINT_MASKED;
-			while (true)
-			{
-				u16 intr = 0;
-				result = _sdmmc_check_mask_interrupt(sdmmc, &intr,
-					SDHCI_INT_DATA_END | SDHCI_INT_DMA_END);
-				if (result != SDMMC_MASKINT_MASKED)
-					break;
+		u16 intr = 0;
+		result = _sdmmc_check_mask_interrupt(sdmmc, &intr,
+			SDHCI_INT_DATA_END | SDHCI_INT_DMA_END);
+		if (result != SDMMC_MASKINT_MASKED)
+			break;
 
-				if (intr & SDHCI_INT_DATA_END)
-					return 1; // Transfer complete.
+		if (intr & SDHCI_INT_DATA_END)
+		{
+			sdmmc->req_blkcnt_left = 0;
+			return SDMMC_REQ_DONE; // Transfer complete.
+		}
 
-				if (intr & SDHCI_INT_DMA_END)
-				{
-					// Update DMA.
-					sdmmc->regs->admaaddr = sdmmc->dma_addr_next;
-					sdmmc->regs->admaaddr_hi = 0;
-					sdmmc->dma_addr_next += SZ_512K;
-				}
-			}
+		if ((intr & SDHCI_INT_DMA_END) && !sdmmc->use_adma)
+		{
+			// Update DMA.
+			sdmmc->regs->admaaddr = sdmmc->dma_addr_next;
+			sdmmc->regs->admaaddr_hi = 0;
+			sdmmc->dma_addr_next += SZ_512K;
+		}
+	}
 
-			if (result != SDMMC_MASKINT_NOERROR)
-			{
+	if (result != SDMMC_MASKINT_NOERROR)
+	{
 #ifdef ERROR_EXTRA_PRINTING
-				EPRINTFARGS("SDMMC%d: int error!", sdmmc->id + 1);
+		EPRINTFARGS("SDMMC%d: int error!", sdmmc->id + 1);
 #endif
-				_sdmmc_reset_cmd_data(sdmmc);
+		sdmmc->req_blkcnt_left = sdmmc->regs->blkcnt;
+		_sdmmc_reset_cmd_data(sdmmc);
 
-				return 0;
-			}
-		} while (get_tmr_ms() < timeout);
-	} while (sdmmc->regs->blkcnt != blkcnt);
+		return SDMMC_REQ_ERROR;
+	}
 
-	_sdmmc_reset_cmd_data(sdmmc);
+	// Timeout only if the transfer made no progress.
+	if (get_tmr_ms() > sdmmc->req_timeout)
+	{
+		if (sdmmc->regs->blkcnt == sdmmc->req_blkcnt_last)
+		{
+			sdmmc->req_blkcnt_left = sdmmc->regs->blkcnt;
+			_sdmmc_reset_cmd_data(sdmmc);
 
-	return 0;
+			return SDMMC_REQ_ERROR;
+		}
+
+		_sdmmc_sdma_arm_timeout(sdmmc);
+	}
+
+	return SDMMC_REQ_BUSY;
 }
 
-static int _sdmmc_execute_cmd_inner(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req, u32 *blkcnt_out)
+static int _sdmmc_update_sdma(sdmmc_t *sdmmc)
+{
+	u32 state;
+
+	_sdmmc_sdma_arm_timeout(sdmmc);
+	do
+	{
+		state = _sdmmc_poll_sdma(sdmmc);
+	} while (state == SDMMC_REQ_BUSY);
+
+	return state == SDMMC_REQ_DONE;
+}
+
+static void _sdmmc_dma_maintenance(sdmmc_t *sdmmc, u32 op)
+{
+	if (!sdmmc->use_adma)
+	{
+		bpmp_mmu_maintenance_range(op, sdmmc->dma_buf, sdmmc->dma_size);
+		return;
+	}
+
+	// Scattered buffers add up, let the whole cache be maintained once.
+	if (sdmmc->dma_size > BPMP_MMU_MAINT_RANGE_MAX)
+	{
+		bpmp_mmu_maintenance(op + (BPMP_MMU_MAINT_CLEAN_WAY - BPMP_MMU_MAINT_CLEAN_PHY), false);
+		return;
+	}
+
+	// Descriptors are read by the controller too.
+	if (op == BPMP_MMU_MAINT_CLEAN_PHY)
+		bpmp_mmu_maintenance_range(op, _sdmmc_adma_desc, sizeof(_sdmmc_adma_desc));
+
+	for (u32 i = 0; i < SDMMC_ADMA2_DESC_MAX; i++)
+	{
+		sdmmc_adma2_desc_t *desc = &_sdmmc_adma_desc[i];
+		bpmp_mmu_maintenance_range(op, (void *)desc->addr, desc->len ? desc->len : SDMMC_ADMA2_MAX_LEN);
+
+		if (desc->attr & SDMMC_ADMA2_ATTR_END)
+			break;
+	}
+}
+
+static int _sdmmc_execute_cmd_start(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req, u32 *blkcnt)
 {
 	int has_req_or_check_busy = req || cmd->check_busy;
 	if (!_sdmmc_wait_cmd_data_inhibit(sdmmc, has_req_or_check_busy))
 		return 0;
 
-	u32 blkcnt = 0;
 	bool is_data_present = false;
 	if (req)
 	{
-		if (!_sdmmc_config_sdma(sdmmc, &blkcnt, req))
+		if (!_sdmmc_config_dma(sdmmc, blkcnt, req))
 		{
 #ifdef ERROR_EXTRA_PRINTING
 			EPRINTFARGS("SDMMC%d: DMA Wrong cfg!", sdmmc->id + 1);
@@ -1137,7 +1247,9 @@ static int _sdmmc_execute_cmd_inner(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_
 		}
 
 		// Flush cache before starting the transfer.
-		bpmp_mmu_maintenance(BPMP_MMU_MAINT_CLEAN_WAY, false);
+		sdmmc->dma_buf  = req->buf;
+		sdmmc->dma_size = req->blksize * *blkcnt;
+		_sdmmc_dma_maintenance(sdmmc, BPMP_MMU_MAINT_CLEAN_PHY);
 
 		is_data_present = true;
 	}
@@ -1159,52 +1271,87 @@ static int _sdmmc_execute_cmd_inner(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_
 #endif
 	DPRINTF("rsp(%d): %08X, %08X, %08X, %08X\n", result,
 		sdmmc->regs->rspreg0, sdmmc->regs->rspreg1, sdmmc->regs->rspreg2, sdmmc->regs->rspreg3);
-	if (result)
+	if (result && cmd->rsp_type)
 	{
-		if (cmd->rsp_type)
-		{
-			sdmmc->expected_rsp_type = cmd->rsp_type;
-			result = _sdmmc_cache_rsp(sdmmc, sdmmc->rsp, 0x10, cmd->rsp_type);
+		sdmmc->expected_rsp_type = cmd->rsp_type;
+		result = _sdmmc_cache_rsp(sdmmc, sdmmc->rsp, 0x10, cmd->rsp_type);
 #ifdef ERROR_EXTRA_PRINTING
-			if (!result)
-				EPRINTFARGS("SDMMC%d: Unknown response type!", sdmmc->id + 1);
+		if (!result)
+			EPRINTFARGS("SDMMC%d: Unknown response type!", sdmmc->id + 1);
 #endif
-		}
-		if (req && result)
-		{
-			result = _sdmmc_update_sdma(sdmmc);
+	}
+
+	return result;
+}
+
+static int _sdmmc_data_complete(sdmmc_t *sdmmc, int is_auto_stop_trn)
+{
+	// Invalidate cache after transfer.
+	_sdmmc_dma_maintenance(sdmmc, BPMP_MMU_MAINT_INVALID_PHY);
+
+	if (is_auto_stop_trn)
+		sdmmc->rsp3 = sdmmc->regs->rspreg3;
+
+	int result = _sdmmc_wait_card_busy(sdmmc);
 #ifdef ERROR_EXTRA_PRINTING
-			if (!result)
-				EPRINTFARGS("SDMMC%d: DMA Update failed!", sdmmc->id + 1);
+	if (!result)
+		EPRINTFARGS("SDMMC%d: Busy timeout!", sdmmc->id + 1);
+#endif
+	return result;
+}
+
+static int _sdmmc_execute_cmd_inner(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req, u32 *blkcnt_out)
+{
+	u32 blkcnt = 0;
+	int result = _sdmmc_execute_cmd_start(sdmmc, cmd, req, &blkcnt);
+	if (req && result)
+	{
+		result = _sdmmc_update_sdma(sdmmc);
+#ifdef ERROR_EXTRA_PRINTING
+		if (!result)
+			EPRINTFARGS("SDMMC%d: DMA Update failed!", sdmmc->id + 1);
 #endif
-		}
 	}
 
 	_sdmmc_mask_interrupts(sdmmc);
 
-	if (result)
+	if (!result)
 	{
-		if (req)
+		// Report the blocks moved before the failure, without the last one that may be incomplete.
+		if (req && blkcnt)
 		{
-			// Invalidate cache after transfer.
-			bpmp_mmu_maintenance(BPMP_MMU_MAINT_INVALID_WAY, false);
+			_sdmmc_dma_maintenance(sdmmc, BPMP_MMU_MAINT_INVALID_PHY);
 
 			if (blkcnt_out)
-				*blkcnt_out = blkcnt;
-
-			if (req->is_auto_stop_trn)
-				sdmmc->rsp3 = sdmmc->regs->rspreg3;
+				*blkcnt_out = blkcnt - MIN(blkcnt, sdmmc->req_blkcnt_left + 1u);
 		}
 
-		if (cmd->check_busy || req)
+		return 0;
+	}
+
+	if (req)
+	{
+		if (blkcnt_out)
+			*blkcnt_out = blkcnt;
+
+		if (!_sdmmc_data_complete(sdmmc, req->is_auto_stop_trn))
 		{
-			result = _sdmmc_wait_card_busy(sdmmc);
+			if (blkcnt_out)
+				*blkcnt_out = blkcnt - 1;
+
+			return 0;
+		}
+
+		return 1;
+	}
+
+	if (cmd->check_busy)
+	{
+		result = _sdmmc_wait_card_busy(sdmmc);
 #ifdef ERROR_EXTRA_PRINTING
-			if (!result)
-				EPRINTFARGS("SDMMC%d: Busy timeout!", sdmmc->id + 1);
+		if (!result)
+			EPRINTFARGS("SDMMC%d: Busy timeout!", sdmmc->id + 1);
 #endif
-			return result;
-		}
 	}
 
 	return result;
@@ -1501,11 +1648,8 @@ void sdmmc_init_cmd(sdmmc_cmd_t *cmdbuf, u16 cmd, u32 arg, u32 rsp_type, u32 che
 	cmdbuf->check_busy = check_busy;
 }
 
-int sdmmc_execute_cmd(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req, u32 *blkcnt_out)
+static int _sdmmc_card_clock_begin(sdmmc_t *sdmmc)
 {
-	if (!sdmmc->card_clock_enabled)
-		return 0;
-
 	// Recalibrate periodically for SDMMC1.
 	if (sdmmc->manual_cal && sdmmc->powersave_enabled)
 		_sdmmc_autocal_execute(sdmmc, sdmmc_get_io_power(sdmmc));
@@ -1519,15 +1663,116 @@ int sdmmc_execute_cmd(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req, u32 *b
 		usleep((8 * 1000 + sdmmc->card_clock - 1) / sdmmc->card_clock); // Wait 8 cycles.
 	}
 
-	int result = _sdmmc_execute_cmd_inner(sdmmc, cmd, req, blkcnt_out);
+	return should_disable_sd_clock;
+}
+
+static void _sdmmc_card_clock_end(sdmmc_t *sdmmc, int should_disable_sd_clock)
+{
 	usleep((8 * 1000 + sdmmc->card_clock - 1) / sdmmc->card_clock); // Wait 8 cycles.
 
 	if (should_disable_sd_clock)
 		sdmmc->regs->clkcon &= ~SDHCI_CLOCK_CARD_EN;
+}
+
+int sdmmc_execute_cmd(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req, u32 *blkcnt_out)
+{
+	if (!sdmmc->card_clock_enabled || sdmmc->req_state == SDMMC_REQ_BUSY)
+		return 0;
+
+	int should_disable_sd_clock = _sdmmc_card_clock_begin(sdmmc);
+
+	int result = _sdmmc_execute_cmd_inner(sdmmc, cmd, req, blkcnt_out);
+
+	_sdmmc_card_clock_end(sdmmc, should_disable_sd_clock);
+
+	return result;
+}
+
+int sdmmc_execute_cmd_sg(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req, const sdmmc_sg_t *sg, u32 sg_cnt, u32 *blkcnt_out)
+{
+	if (!req || sdmmc->req_state == SDMMC_REQ_BUSY)
+		return 0;
+
+	u32 size = sdmmc_adma2_build_desc(_sdmmc_adma_desc, SDMMC_ADMA2_DESC_MAX, sg, sg_cnt);
+	if (!size || size != req->blksize * req->num_sectors)
+		return 0;
+
+	sdmmc->use_adma = 1;
+
+	int result = sdmmc_execute_cmd(sdmmc, cmd, req, blkcnt_out);
+
+	sdmmc->use_adma = 0;
 
 	return result;
 }
 
+/*
+ * Asynchronous data requests.
+ * The command and its response are handled synchronously, only the data phase
+ * is left running. Only one request per controller can be in flight. Any other
+ * command to that controller fails until the request is polled to completion.
+ */
+int sdmmc_submit_req(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req)
+{
+	if (!req || !sdmmc->card_clock_enabled || sdmmc->req_state == SDMMC_REQ_BUSY)
+		return 0;
+
+	sdmmc->req_disable_clock = _sdmmc_card_clock_begin(sdmmc);
+
+	u32 blkcnt = 0;
+	if (!_sdmmc_execute_cmd_start(sdmmc, cmd, req, &blkcnt))
+	{
+		_sdmmc_mask_interrupts(sdmmc);
+		_sdmmc_card_clock_end(sdmmc, sdmmc->req_disable_clock);
+		sdmmc->req_state = SDMMC_REQ_ERROR;
+
+		return 0;
+	}
+
+	sdmmc->req_blkcnt = blkcnt;
+	sdmmc->req_auto_stop_trn = req->is_auto_stop_trn;
+	sdmmc->req_state = SDMMC_REQ_BUSY;
+	_sdmmc_sdma_arm_timeout(sdmmc);
+
+	return 1;
+}
+
+u32 sdmmc_poll_req(sdmmc_t *sdmmc, u32 *blkcnt_out)
+{
+	if (sdmmc->req_state != SDMMC_REQ_BUSY)
+		return sdmmc->req_state;
+
+	u32 state = _sdmmc_poll_sdma(sdmmc);
+	if (state == SDMMC_REQ_BUSY)
+		return state;
+
+	_sdmmc_mask_interrupts(sdmmc);
+
+	if (state == SDMMC_REQ_DONE && !_sdmmc_data_complete(sdmmc, sdmmc->req_auto_stop_trn))
+	{
+		sdmmc->req_blkcnt_left = 0;
+		state = SDMMC_REQ_ERROR;
+	}
+
+	// Report the blocks moved before the failure, without the last one that may be incomplete.
+	if (state == SDMMC_REQ_ERROR)
+		_sdmmc_dma_maintenance(sdmmc, BPMP_MMU_MAINT_INVALID_PHY);
+
+	_sdmmc_card_clock_end(sdmmc, sdmmc->req_disable_clock);
+
+	if (blkcnt_out)
+	{
+		if (state == SDMMC_REQ_DONE)
+			*blkcnt_out = sdmmc->req_blkcnt;
+		else
+			*blkcnt_out = sdmmc->req_blkcnt - MIN(sdmmc->req_blkcnt, sdmmc->req_blkcnt_left + 1u);
+	}
+
+	sdmmc->req_state = state;
+
+	return state;
+}
+
 int sdmmc_enable_low_voltage(sdmmc_t *sdmmc)
 {
 	if (sdmmc->id != SDMMC_1)
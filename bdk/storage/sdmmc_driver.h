@@ -266,6 +266,12 @@
 #define SDHCI_TIMING_MMC_HS100  14 // GC ASIC.
 #define SDHCI_TIMING_UHS_DDR200 15
 
+/*! SDMMC async request states. */
+#define SDMMC_REQ_IDLE  0
+#define SDMMC_REQ_BUSY  1
+#define SDMMC_REQ_DONE  2
+#define SDMMC_REQ_ERROR 3
+
 /*! SDMMC Low power features. */
 #define SDMMC_POWER_SAVE_DISABLE 0
 #define SDMMC_POWER_SAVE_ENABLE  1
@@ -277,12 +283,39 @@
 #define INVALID_TAP              0x100
 #define SAMPLING_WINDOW_SIZE_MIN 8
 
+/*! SDMMC ADMA2 descriptor attributes. */
+#define SDMMC_ADMA2_ATTR_VALID BIT(0)
+#define SDMMC_ADMA2_ATTR_END   BIT(1)
+#define SDMMC_ADMA2_ATTR_INT   BIT(2)
+#define SDMMC_ADMA2_ATTR_TRAN  (2U << 4)
+
+#define SDMMC_ADMA2_MAX_LEN  SZ_64K
+#define SDMMC_ADMA2_DESC_MAX 8
+
+/*! SDMMC ADMA2 descriptor. 128bit for 64bit addressing in Host V4 mode. */
+typedef struct _sdmmc_adma2_desc_t
+{
+	u16 attr;
+	u16 len;
+	u32 addr;
+	u32 addr_hi;
+	u32 rsvd;
+} sdmmc_adma2_desc_t;
+
+/*! SDMMC scatter/gather segment. */
+typedef struct _sdmmc_sg_t
+{
+	void *buf;
+	u32 size;
+} sdmmc_sg_t;
+
 /*! SDMMC controller context. */
 typedef struct _sdmmc_t
 {
 	t210_sdmmc_t *regs;
 	u32 id;
 	u32 card_clock;
+	u32 timing;
 	u32 clock_stopped;
 	int powersave_enabled;
 	int manual_cal;
@@ -294,6 +327,16 @@ typedef struct _sdmmc_t
 	u32 rsp[4];
 	u32 rsp3;
 	int t210b01;
+	u32 req_state;
+	u32 req_blkcnt;
+	u32 req_timeout;
+	u16 req_blkcnt_last;
+	u16 req_blkcnt_left; // Blocks not transferred when the last request ended.
+	int req_auto_stop_trn;
+	int req_disable_clock;
+	int use_adma;
+	void *dma_buf;
+	u32 dma_size;
 } sdmmc_t;
 
 /*! SDMMC command. */
@@ -314,12 +357,16 @@ typedef struct _sdmmc_req_t
 	int is_write;
 	int is_multi_block;
 	int is_auto_stop_trn;
+	int is_auto_set_blkcnt;
 } sdmmc_req_t;
 
 int  sdmmc_get_io_power(sdmmc_t *sdmmc);
 u32  sdmmc_get_bus_width(sdmmc_t *sdmmc);
+int  sdmmc_is_configured(sdmmc_t *sdmmc, u32 id, u32 power, u32 bus_width, u32 type);
 void sdmmc_set_bus_width(sdmmc_t *sdmmc, u32 bus_width);
 void sdmmc_save_tap_value(sdmmc_t *sdmmc);
+u32  sdmmc_get_tap_value(sdmmc_t *sdmmc);
+void sdmmc_set_tap_value(sdmmc_t *sdmmc, u32 tap);
 void sdmmc_setup_drv_type(sdmmc_t *sdmmc, u32 type);
 int  sdmmc_setup_clock(sdmmc_t *sdmmc, u32 type);
 void sdmmc_card_clock_powersave(sdmmc_t *sdmmc, int powersave_enable);
@@ -331,6 +378,10 @@ int  sdmmc_init(sdmmc_t *sdmmc, u32 id, u32 power, u32 bus_width, u32 type);
 void sdmmc_end(sdmmc_t *sdmmc);
 void sdmmc_init_cmd(sdmmc_cmd_t *cmdbuf, u16 cmd, u32 arg, u32 rsp_type, u32 check_busy);
 int  sdmmc_execute_cmd(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req, u32 *blkcnt_out);
+int  sdmmc_execute_cmd_sg(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req, const sdmmc_sg_t *sg, u32 sg_cnt, u32 *blkcnt_out);
+u32  sdmmc_adma2_build_desc(sdmmc_adma2_desc_t *desc, u32 desc_max, const sdmmc_sg_t *sg, u32 sg_cnt);
+int  sdmmc_submit_req(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req);
+u32  sdmmc_poll_req(sdmmc_t *sdmmc, u32 *blkcnt_out);
 int  sdmmc_enable_low_voltage(sdmmc_t *sdmmc);
 
 #endif
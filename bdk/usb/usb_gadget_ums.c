@@ -63,6 +63,10 @@
 
 #define UMS_EP_OUT_MAX_XFER (USB_EP_BULK_OUT_MAX_XFER)
 
+// Write-back cache. Lives in the OUT buffer after the page that receives the CBWs.
+#define UMS_WCACHE_ADDR (USB_EP_BULK_OUT_BUF_ADDR + USB_EP_BUFFER_ALIGN)
+#define UMS_WCACHE_SIZE (USB_EP_BULK_OUT_MAX_XFER - USB_EP_BUFFER_ALIGN)
+
 // Length of a SCSI Command Data Block.
 #define SCSI_MAX_CMD_SZ 16
 
@@ -184,6 +188,9 @@ typedef struct _logical_unit_t
 	u32 sense_data;
 	u32 sense_data_info;
 	u32 unit_attention_data;
+
+	u32 deferred_error; // Failed write back. Survives resets until reported.
+	u32 deferred_error_info;
 } logical_unit_t;
 
 typedef struct _bulk_ctxt_t {
@@ -235,6 +242,20 @@ typedef struct _usbd_gadget_ums_t {
 	u32 timeouts;
 	bool xusb;
 
+	bool wcache_enabled;
+	u32  wcache_lun;
+	u32  wcache_lba;
+	u32  wcache_cnt; // In sectors.
+
+	bool ra_enabled;
+	u8  *ra_buf;
+	bool ra_busy;
+	u32  ra_lun;
+	u32  ra_lba;
+	u32  ra_cnt; // In sectors.
+	u32  read_end_lun;
+	u32  read_end_lba;
+
 	void (*system_maintenance)(bool);
 	void *label;
 	void (*set_text)(void *, const char *);
@@ -445,6 +466,71 @@ static void _reset_buffer(bulk_ctxt_t *bulk_ctxt, u32 ep)
  *  --.- --/-,  23.8 MB/s,  27.2 MB/s, 25.8 MB/s, 17.5 MB/s - SCSI  64KB, Concurrency.
  */
 
+/*
+ * Sequential reads are prefetched. When a read continues the previous one, the
+ * next chunk of the same size is read while the CSW and the next CBW are exchanged.
+ * A read that starts exactly there sends it right away. The prefetch has to be
+ * complete before the storage is used for anything else, so any other command,
+ * a LUN change or the exit drop it. Writes can't see stale data that way.
+ *
+ * It goes to its own buffer, unless the last chunk of the read is still there.
+ * Then the write-back cache area is used, which is always clean during reads.
+ */
+
+static bool _ra_drop(usbd_gadget_ums_t *ums)
+{
+	bool res = true;
+
+	if (ums->ra_busy)
+		res = sdmmc_storage_async_wait(ums->luns[ums->ra_lun].storage);
+
+	ums->ra_busy = false;
+	ums->ra_cnt  = 0;
+
+	return res;
+}
+
+static u32 _ra_take(usbd_gadget_ums_t *ums, u32 lba_offset, u32 amount)
+{
+	u32 cnt = 0;
+
+	if (ums->ra_cnt && ums->ra_lun == ums->lun_idx && ums->ra_lba == lba_offset)
+		cnt = MIN(ums->ra_cnt, amount);
+
+	// A failed prefetch is read again normally, so errors get reported there.
+	if (!_ra_drop(ums))
+		cnt = 0;
+
+	return cnt;
+}
+
+static void _ra_start(usbd_gadget_ums_t *ums, u32 lba_offset, u32 amount, u8 *last_buf)
+{
+	logical_unit_t *lun = &ums->luns[ums->lun_idx];
+	u8 *buf = (u8 *)UMS_READ_AHEAD_ADDR;
+	u32 buf_sz = UMS_READ_AHEAD_SZ;
+
+	if (last_buf == buf)
+	{
+		buf = (u8 *)UMS_WCACHE_ADDR;
+		buf_sz = UMS_WCACHE_SIZE;
+	}
+
+	amount = MIN(amount, buf_sz >> UMS_DISK_LBA_SHIFT);
+	amount = MIN(amount, lun->num_sectors - lba_offset);
+	if (!amount)
+		return;
+
+	if (!sdmmc_storage_read_async(lun->storage, lun->offset + lba_offset, amount, buf))
+		return;
+
+	ums->ra_buf  = buf;
+	ums->ra_busy = true;
+	ums->ra_lun  = ums->lun_idx;
+	ums->ra_lba  = lba_offset;
+	ums->ra_cnt  = amount;
+}
+
 static int _scsi_read(usbd_gadget_ums_t *ums, bulk_ctxt_t *bulk_ctxt)
 {
 	u32 lba_offset;
@@ -495,6 +581,9 @@ static int _scsi_read(usbd_gadget_ums_t *ums, bulk_ctxt_t *bulk_ctxt)
 
 	max_io_transfer = MIN(max_io_transfer, sdmmc_buf2_sz >> UMS_DISK_LBA_SHIFT);
 
+	u32 amount_cmd = amount_left;
+	bool sequential = ums->ra_enabled && ums->read_end_lun == ums->lun_idx && ums->read_end_lba == lba_offset;
+	u32 amount_prefetched = _ra_take(ums, lba_offset, MIN(amount_left, max_io_transfer));
 
 	while (true)
 	{
@@ -513,15 +602,30 @@ static int _scsi_read(usbd_gadget_ums_t *ums, bulk_ctxt_t *bulk_ctxt)
 			break;
 		}
 
-		// Do the SDMMC read.
-		if (!sdmmc_storage_read(ums->luns[ums->lun_idx].storage, ums->luns[ums->lun_idx].offset + lba_offset, amount, sdmmc_buf_current))
-			amount = 0;
+		if (amount_prefetched)
+		{
+			// First chunk was prefetched after the previous read.
+			amount = MIN(amount, amount_prefetched);
+			amount_prefetched = 0;
+			sdmmc_buf_current = ums->ra_buf;
+		}
+		else
+		{
+			// Start the SDMMC read.
+			sdmmc_storage_t *storage = ums->luns[ums->lun_idx].storage;
+			if (!sdmmc_storage_read_async(storage, ums->luns[ums->lun_idx].offset + lba_offset, amount, sdmmc_buf_current))
+				amount = 0;
 
-		use_buf1 = !use_buf1;
+			use_buf1 = !use_buf1;
 
-		// Wait for the async USB transfer to finish.
-		if (!first_read)
-			_transfer_finish(ums, bulk_ctxt, bulk_ctxt->bulk_in, USB_XFER_SYNCED);
+			// Wait for the async USB transfer to finish, while the SDMMC DMA runs.
+			if (!first_read)
+				_transfer_finish(ums, bulk_ctxt, bulk_ctxt->bulk_in, USB_XFER_SYNCED);
+
+			// Wait for the SDMMC read.
+			if (amount && !sdmmc_storage_async_wait(storage))
+				amount = 0;
+		}
 
 		lba_offset   += amount;
 		amount_left  -= amount;
@@ -557,22 +661,178 @@ static int _scsi_read(usbd_gadget_ums_t *ums, bulk_ctxt_t *bulk_ctxt)
 		}
 	}
 
+	if (!amount_left)
+	{
+		// Prefetch the next chunk, while the last one is sent by the finish reply function.
+		if (sequential)
+			_ra_start(ums, lba_offset, amount_cmd, bulk_ctxt->bulk_in_buf);
+
+		ums->read_end_lun = ums->lun_idx;
+		ums->read_end_lba = lba_offset;
+	}
+
 	return UMS_RES_IO_ERROR; // No default reply.
 }
 
 /*
- * Writes are another story.
- * Tests showed that big writes are faster than concurrent 32K usb reads + writes.
- * The only thing that can help here is caching the writes. But for the simplicity
- * of this implementation it will not be implemented yet.
+ * Writes are pipelined. The host sends the next chunk into one buffer while the
+ * previous chunk is written to the SDMMC from the other one.
+ *
+ * Small writes (mostly FS metadata) can also be coalesced into a write-back cache,
+ * if they continue the cached range. The cache is written back before any other
+ * command, on LUN change, on resets and on exit. So SYNCHRONIZE CACHE and ejection
+ * always find it clean. FUA writes bypass it. The write that caused a write back
+ * error already passed, so it's deferred and the next SYNCHRONIZE CACHE or WRITE
+ * on that LUN fails with it instead.
  */
 
-static int _scsi_write(usbd_gadget_ums_t *ums, bulk_ctxt_t *bulk_ctxt)
+static bool _wcache_flush(usbd_gadget_ums_t *ums)
+{
+	if (!ums->wcache_cnt)
+		return true;
+
+	logical_unit_t *lun = &ums->luns[ums->wcache_lun];
+
+	bool res = sdmmc_storage_write(lun->storage, lun->offset + ums->wcache_lba, ums->wcache_cnt, (u8 *)UMS_WCACHE_ADDR);
+	if (!res)
+	{
+		ums->set_text(ums->label, "ERR: SDMMC Write");
+		lun->deferred_error      = SS_WRITE_ERROR;
+		lun->deferred_error_info = ums->wcache_lba;
+	}
+
+	ums->wcache_cnt = 0;
+
+	return res;
+}
+
+static bool _wcache_report_error(usbd_gadget_ums_t *ums)
+{
+	logical_unit_t *lun = &ums->luns[ums->lun_idx];
+
+	if (lun->deferred_error == SS_NO_SENSE)
+		return false;
+
+	lun->sense_data      = lun->deferred_error;
+	lun->sense_data_info = lun->deferred_error_info;
+	lun->info_valid      = 1;
+	lun->deferred_error  = SS_NO_SENSE;
+
+	return true;
+}
+
+static bool _wcache_can_cache(usbd_gadget_ums_t *ums, u32 lba_offset, bool fua)
+{
+	u32 amount = ums->data_size_from_cmnd;
+
+	// Only whole small writes. Excess data is thrown away into the OUT buffer that hosts the cache.
+	if (!ums->wcache_enabled || fua || !amount || amount > UMS_WCACHE_SIZE || amount != ums->data_size)
+		return false;
+
+	if ((ums->luns[ums->lun_idx].num_sectors - lba_offset) < (amount >> UMS_DISK_LBA_SHIFT))
+		return false;
+
+	// Write back the cache if the new data does not continue it or does not fit.
+	if (ums->wcache_cnt && (ums->wcache_lun != ums->lun_idx ||
+		(ums->wcache_lba + ums->wcache_cnt) != lba_offset ||
+		((ums->wcache_cnt << UMS_DISK_LBA_SHIFT) + amount) > UMS_WCACHE_SIZE))
+	{
+		_wcache_flush(ums);
+	}
+
+	return true;
+}
+
+static void _scsi_write_usb_error(usbd_gadget_ums_t *ums, bulk_ctxt_t *bulk_ctxt, u32 lba_offset)
 {
 	static char txt_buf[256];
+
+	ums->luns[ums->lun_idx].sense_data      = SS_COMMUNICATION_FAILURE;
+	ums->luns[ums->lun_idx].sense_data_info = lba_offset;
+	ums->luns[ums->lun_idx].info_valid      = 1;
+
+	s_printf(txt_buf, "ERR: Write - %d", bulk_ctxt->bulk_out_status);
+	ums->set_text(ums->label, txt_buf);
+}
+
+static int _scsi_write_cached(usbd_gadget_ums_t *ums, bulk_ctxt_t *bulk_ctxt, u32 lba_offset)
+{
+	u32 amount = ums->data_size_from_cmnd;
+	u8 *buf = (u8 *)USB_EP_BULK_IN_BUF_ADDR;
+
+	ums->usb_amount_left -= amount;
+
+	bulk_ctxt->bulk_out_buf    = buf;
+	bulk_ctxt->bulk_out_length = amount;
+	_transfer_out_big_read(ums, bulk_ctxt);
+	bulk_ctxt->bulk_out_buf_state = BUF_STATE_EMPTY;
+	_reset_buffer(bulk_ctxt, bulk_ctxt->bulk_out);
+
+	// Did something go wrong with the transfer?.
+	if (bulk_ctxt->bulk_out_status != 0)
+	{
+		_scsi_write_usb_error(ums, bulk_ctxt, lba_offset);
+
+		return UMS_RES_IO_ERROR;
+	}
+
+	// Did the host decide to stop early? Nothing gets cached.
+	if (bulk_ctxt->bulk_out_length_actual < amount)
+	{
+		ums->set_text(ums->label, "ERR: Empty Write");
+		ums->short_packet_received = 1;
+
+		return UMS_RES_IO_ERROR;
+	}
+
+	if (!ums->wcache_cnt)
+	{
+		ums->wcache_lun = ums->lun_idx;
+		ums->wcache_lba = lba_offset;
+	}
+
+	memcpy((u8 *)UMS_WCACHE_ADDR + (ums->wcache_cnt << UMS_DISK_LBA_SHIFT), buf, amount);
+	ums->wcache_cnt += amount >> UMS_DISK_LBA_SHIFT;
+	ums->residue    -= amount;
+
+	return UMS_RES_IO_ERROR; // No default reply.
+}
+
+static bool _scsi_write_wait(usbd_gadget_ums_t *ums, u32 *lba_offset, u32 *amount)
+{
+	if (!*amount)
+		return true;
+
+	bool res = sdmmc_storage_async_wait(ums->luns[ums->lun_idx].storage);
+	if (res)
+	{
+		*lba_offset  += *amount >> UMS_DISK_LBA_SHIFT;
+		ums->residue -= *amount;
+	}
+	else
+	{
+		ums->set_text(ums->label, "ERR: SDMMC Write");
+		ums->luns[ums->lun_idx].sense_data = SS_WRITE_ERROR;
+		ums->luns[ums->lun_idx].sense_data_info = *lba_offset;
+		ums->luns[ums->lun_idx].info_valid = 1;
+	}
+
+	*amount = 0;
+
+	return res;
+}
+
+static int _scsi_write(usbd_gadget_ums_t *ums, bulk_ctxt_t *bulk_ctxt)
+{
 	u32 amount_left_to_req, amount_left_to_write;
 	u32 usb_lba_offset, lba_offset;
 	u32 amount;
+	bool fua = false;
+
+	u8 *usb_bufs[2] = { (u8 *)USB_EP_BULK_IN_BUF_ADDR, (u8 *)USB_EP_BULK_OUT_BUF_ADDR };
+	u32 usb_buf_idx = 0;
+	u32 max_io_transfer = MIN(USB_EP_BULK_IN_MAX_XFER, UMS_EP_OUT_MAX_XFER);
+	u32 amount_writing = 0;
 
 	if (ums->luns[ums->lun_idx].ro)
 	{
@@ -588,13 +848,15 @@ static int _scsi_write(usbd_gadget_ums_t *ums, bulk_ctxt_t *bulk_ctxt)
 	{
 		lba_offset = get_array_be_to_le32(&ums->cmnd[2]);
 
-		// We allow DPO and FUA bypass cache bits. We only implement FUA by performing synchronous output.
+		// We allow DPO and FUA bypass cache bits. We only implement FUA by bypassing the write cache.
 		if (ums->cmnd[1] & ~0x18)
 		{
 			ums->luns[ums->lun_idx].sense_data = SS_INVALID_FIELD_IN_CDB;
 
 			return UMS_RES_INVALID_ARG;
 		}
+
+		fua = ums->cmnd[1] & 0x08;
 	}
 
 	// Check that starting LBA is not past the end sector offset.
@@ -606,87 +868,94 @@ static int _scsi_write(usbd_gadget_ums_t *ums, bulk_ctxt_t *bulk_ctxt)
 		return UMS_RES_INVALID_ARG;
 	}
 
+	bool cached = _wcache_can_cache(ums, lba_offset, fua);
+
+	// Keep the write order. The cache also lives in a buffer used below.
+	if (!cached)
+		_wcache_flush(ums);
+
+	// Fail with an earlier write back error, before this write is accepted.
+	if (_wcache_report_error(ums))
+		return UMS_RES_INVALID_ARG;
+
+	if (cached)
+		return _scsi_write_cached(ums, bulk_ctxt, lba_offset);
+
+	sdmmc_storage_t *storage = ums->luns[ums->lun_idx].storage;
+
 	// Carry out the file writes.
 	usb_lba_offset       = lba_offset;
 	amount_left_to_req   = ums->data_size_from_cmnd;
 	amount_left_to_write = ums->data_size_from_cmnd;
 
-	while (amount_left_to_write > 0)
+	while (amount_left_to_write > 0 && amount_left_to_req > 0)
 	{
-		// Queue a request for more data from the host.
-		if (amount_left_to_req > 0)
-		{
+		// Limit write to max supported read from EP OUT.
+		amount = MIN(amount_left_to_req, max_io_transfer);
 
-			// Limit write to max supported read from EP OUT.
-			amount = MIN(amount_left_to_req, UMS_EP_OUT_MAX_XFER);
-
-			if (usb_lba_offset >= ums->luns[ums->lun_idx].num_sectors)
-			{
-				ums->set_text(ums->label, "ERR: Write - Past End");
-				ums->luns[ums->lun_idx].sense_data = SS_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
-				ums->luns[ums->lun_idx].sense_data_info = usb_lba_offset;
-				ums->luns[ums->lun_idx].info_valid = 1;
-				break;
-			}
+		if (usb_lba_offset >= ums->luns[ums->lun_idx].num_sectors)
+		{
+			ums->set_text(ums->label, "ERR: Write - Past End");
+			ums->luns[ums->lun_idx].sense_data = SS_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
+			ums->luns[ums->lun_idx].sense_data_info = usb_lba_offset;
+			ums->luns[ums->lun_idx].info_valid = 1;
+			break;
+		}
 
-			// Get the next buffer.
-			usb_lba_offset       += amount >> UMS_DISK_LBA_SHIFT;
-			ums->usb_amount_left -= amount;
-			amount_left_to_req   -= amount;
+		// Queue a request for more data from the host.
+		usb_lba_offset       += amount >> UMS_DISK_LBA_SHIFT;
+		ums->usb_amount_left -= amount;
+		amount_left_to_req   -= amount;
 
-			bulk_ctxt->bulk_out_length = amount;
+		bulk_ctxt->bulk_out_buf    = usb_bufs[usb_buf_idx];
+		bulk_ctxt->bulk_out_length = amount;
 
-			_transfer_out_big_read(ums, bulk_ctxt);
-		}
+		_transfer_start(ums, bulk_ctxt, bulk_ctxt->bulk_out, USB_XFER_START);
+		bool usb_started = !bulk_ctxt->bulk_out_status;
 
-		if (bulk_ctxt->bulk_out_buf_state == BUF_STATE_FULL)
-		{
-			bulk_ctxt->bulk_out_buf_state = BUF_STATE_EMPTY;
+		// Wait for the previous SDMMC write, while the USB OUT transfer runs.
+		bool write_ok = _scsi_write_wait(ums, &lba_offset, &amount_writing);
 
-			// Did something go wrong with the transfer?.
-			if (bulk_ctxt->bulk_out_status != 0)
-			{
-				ums->luns[ums->lun_idx].sense_data      = SS_COMMUNICATION_FAILURE;
-				ums->luns[ums->lun_idx].sense_data_info = lba_offset;
-				ums->luns[ums->lun_idx].info_valid      = 1;
+		// Wait for the USB OUT transfer.
+		if (usb_started)
+			_transfer_finish(ums, bulk_ctxt, bulk_ctxt->bulk_out, USB_XFER_SYNCED_DATA);
+		bulk_ctxt->bulk_out_buf_state = BUF_STATE_EMPTY;
 
-				s_printf(txt_buf, "ERR: Write - %d", bulk_ctxt->bulk_out_status);
-				ums->set_text(ums->label, txt_buf);
-				break;
-			}
+		// If an error occurred, it's already reported.
+		if (!write_ok)
+			break;
 
-			amount = bulk_ctxt->bulk_out_length_actual;
+		// Did something go wrong with the transfer?.
+		if (bulk_ctxt->bulk_out_status != 0)
+		{
+			_scsi_write_usb_error(ums, bulk_ctxt, lba_offset);
+			break;
+		}
 
-			if ((ums->luns[ums->lun_idx].num_sectors - lba_offset) < (amount >> UMS_DISK_LBA_SHIFT))
-			{
-				DPRINTF("write %X @ %X beyond end %X\n", amount, lba_offset, ums->luns[ums->lun_idx].num_sectors);
-				amount = (ums->luns[ums->lun_idx].num_sectors - lba_offset) << UMS_DISK_LBA_SHIFT;
-			}
+		amount = bulk_ctxt->bulk_out_length_actual;
 
-			/*
-			 * Don't accept excess data.  The spec doesn't say
-			 * what to do in this case.  We'll ignore the error.
-			 */
-			amount = MIN(amount, bulk_ctxt->bulk_out_length);
+		if ((ums->luns[ums->lun_idx].num_sectors - lba_offset) < (amount >> UMS_DISK_LBA_SHIFT))
+		{
+			DPRINTF("write %X @ %X beyond end %X\n", amount, lba_offset, ums->luns[ums->lun_idx].num_sectors);
+			amount = (ums->luns[ums->lun_idx].num_sectors - lba_offset) << UMS_DISK_LBA_SHIFT;
+		}
 
-			// Don't write a partial block.
-			amount -= (amount & 511);
-			if (amount == 0)
-				goto empty_write;
+		/*
+		 * Don't accept excess data.  The spec doesn't say
+		 * what to do in this case.  We'll ignore the error.
+		 */
+		amount = MIN(amount, bulk_ctxt->bulk_out_length);
 
-			// Perform the write.
-			if (!sdmmc_storage_write(ums->luns[ums->lun_idx].storage, ums->luns[ums->lun_idx].offset + lba_offset,
-				amount >> UMS_DISK_LBA_SHIFT, (u8 *)bulk_ctxt->bulk_out_buf))
-				amount = 0;
+		// Don't write a partial block.
+		amount -= (amount & 511);
 
+		// Start the write and swap buffers for the next USB OUT transfer.
+		if (amount)
+		{
 DPRINTF("file write %X @ %X\n", amount, lba_offset);
 
-			lba_offset           += amount >> UMS_DISK_LBA_SHIFT;
-			amount_left_to_write -= amount;
-			ums->residue         -= amount;
-
-			// If an error occurred, report it and its position.
-			if (!amount)
+			if (!sdmmc_storage_write_async(storage, ums->luns[ums->lun_idx].offset + lba_offset,
+				amount >> UMS_DISK_LBA_SHIFT, bulk_ctxt->bulk_out_buf))
 			{
 				ums->set_text(ums->label, "ERR: SDMMC Write");
 				ums->luns[ums->lun_idx].sense_data = SS_WRITE_ERROR;
@@ -695,17 +964,25 @@ DPRINTF("file write %X @ %X\n", amount, lba_offset);
 				break;
 			}
 
- empty_write:
-			// Did the host decide to stop early?
-			if (bulk_ctxt->bulk_out_length_actual < bulk_ctxt->bulk_out_length)
-			{
-				ums->set_text(ums->label, "ERR: Empty Write");
-				ums->short_packet_received = 1;
-				break;
-			}
+			amount_writing        = amount;
+			amount_left_to_write -= amount;
+			usb_buf_idx ^= 1;
+		}
+
+		// Did the host decide to stop early?
+		if (bulk_ctxt->bulk_out_length_actual < bulk_ctxt->bulk_out_length)
+		{
+			ums->set_text(ums->label, "ERR: Empty Write");
+			ums->short_packet_received = 1;
+			break;
 		}
 	}
 
+	// Wait for the last SDMMC write.
+	_scsi_write_wait(ums, &lba_offset, &amount_writing);
+
+	_reset_buffer(bulk_ctxt, bulk_ctxt->bulk_out);
+
 	return UMS_RES_IO_ERROR; // No default reply.
 }
 
@@ -1123,7 +1400,7 @@ static int _scsi_prevent_allow_removal(usbd_gadget_ums_t *ums)
 	}
 
 	// Notify for possible unmounting?
-	// Normally we sync here but we do synced writes to SDMMC.
+	// Normally we sync here but the write cache is already written back before any non write command.
 	if (ums->luns[ums->lun_idx].prevent_medium_removal && !prevent) { /* Do nothing */ }
 
 	ums->luns[ums->lun_idx].prevent_medium_removal = prevent;
@@ -1245,6 +1522,14 @@ static int _parse_scsi_cmd(usbd_gadget_ums_t *ums, bulk_ctxt_t *bulk_ctxt)
 	ums->phase_error = 0;
 	ums->short_packet_received = 0;
 
+	// Write back cached writes before anything else can access the medium.
+	if (ums->cmnd[0] != SC_WRITE_6 && ums->cmnd[0] != SC_WRITE_10 && ums->cmnd[0] != SC_WRITE_12)
+		_wcache_flush(ums);
+
+	// Reads take the prefetched data themselves.
+	if (ums->cmnd[0] != SC_READ_6 && ums->cmnd[0] != SC_READ_10 && ums->cmnd[0] != SC_READ_12)
+		_ra_drop(ums);
+
 	switch (ums->cmnd[0])
 	{
 	case SC_INQUIRY:
@@ -1359,8 +1644,8 @@ static int _parse_scsi_cmd(usbd_gadget_ums_t *ums, bulk_ctxt_t *bulk_ctxt)
 	case SC_SYNCHRONIZE_CACHE:
 		ums->data_size_from_cmnd = 0;
 		reply = _check_scsi_cmd(ums, 10, DATA_DIR_NONE, (0xf<<2) | (3<<7), 1);
-		if (reply == 0)
-			reply = 0; // Don't bother
+		if (reply == 0 && _wcache_report_error(ums))
+			reply = UMS_RES_INVALID_ARG; // Already written back, but that failed.
 		break;
 
 	case SC_TEST_UNIT_READY:
@@ -1688,6 +1973,10 @@ static int _received_cbw(usbd_gadget_ums_t *ums, bulk_ctxt_t *bulk_ctxt)
 		ums->data_dir = DATA_DIR_NONE;
 
 	if(cbw->Lun != ums->lun_idx){
+		// Cached writes and prefetched reads target the active partition.
+		_ra_drop(ums);
+		_wcache_flush(ums);
+
 		DPRINTF("Change active LUN to %d (was %d)\n", cbw->Lun, ums->lun_idx);
 		if(ums->luns[cbw->Lun].type == MMC_EMMC && ums->luns[cbw->Lun].partition - 1 != ums->luns[cbw->Lun].storage->partition){
 			//No need to change part on SD
@@ -1783,6 +2072,10 @@ static void _handle_exception(usbd_gadget_ums_t *ums, bulk_ctxt_t *bulk_ctxt)
 {
 	enum ums_state old_state;
 
+	// Whatever happened, the medium has to be up to date before it's acked.
+	_ra_drop(ums);
+	_wcache_flush(ums);
+
 	// Clear out the controller's fifos.
 	_flush_endpoint(bulk_ctxt->bulk_in);
 	_flush_endpoint(bulk_ctxt->bulk_out);
@@ -1826,6 +2119,9 @@ static void _handle_exception(usbd_gadget_ums_t *ums, bulk_ctxt_t *bulk_ctxt)
 			_clear_ep_stall(bulk_ctxt->bulk_in);
 		}
 		ums->luns[ums->lun_idx].unit_attention_data = SS_RESET_OCCURRED;
+
+		// The host waits for the reset to complete. Cached writes are on the medium now.
+		usb_ops.usbd_ack_bulk_reset();
 		break;
 
 	case UMS_STATE_EXIT:
@@ -1887,6 +2183,8 @@ int usb_device_gadget_ums(usb_ctxt_t *usbs)
 
 	ums.state = UMS_STATE_NORMAL;
 	ums.can_stall = 0;
+	ums.wcache_enabled = usbs->write_cache;
+	ums.ra_enabled = usbs->read_ahead;
 
 	ums.bulk_ctxt.bulk_in      = USB_EP_BULK_IN;
 	ums.bulk_ctxt.bulk_in_buf  = (u8 *)USB_EP_BULK_IN_BUF_ADDR;
@@ -2003,7 +2301,16 @@ int usb_device_gadget_ums(usb_ctxt_t *usbs)
 		_send_status(&ums, &ums.bulk_ctxt);
 	} while (ums.state != UMS_STATE_TERMINATED);
 
-	if (_get_prevent_media_removal(&ums))
+	_ra_drop(&ums);
+
+	// Write back errors the host never got to see.
+	bool write_err = !_wcache_flush(&ums);
+	for (u32 i = 0; i < ums.lun_cnt; i++)
+		write_err |= ums.luns[i].deferred_error != SS_NO_SENSE;
+
+	if (write_err)
+		ums.set_text(ums.label, "ERR: SDMMC Write");
+	else if (_get_prevent_media_removal(&ums))
 		ums.set_text(ums.label, "ERR: Unsafe eject");
 	else
 		ums.set_text(ums.label, "Disk ejected");
@@ -900,9 +900,8 @@ static void _usbd_handle_get_class_request(bool *transmit_data, u8 *descriptor,
 	switch (_bRequest)
 	{
 	case USB_REQUEST_BULK_RESET:
-		_usbd_ep_ack(USB_EP_CTRL_IN);
 		usbd_otg->bulk_reset_req = true;
-		break; // DELAYED_STATUS;
+		break; // DELAYED_STATUS. Acked by the gadget when ready.
 	case USB_REQUEST_BULK_GET_MAX_LUN:
 		*transmit_data = true;
 		*size = 1;
@@ -1415,6 +1414,11 @@ int usbd_handle_ep0_ctrl_setup()
 	return USB_RES_OK;
 }
 
+int usbd_ack_bulk_reset()
+{
+	return _usbd_ep_ack(USB_EP_CTRL_IN);
+}
+
 static usb_ep_status_t _usbd_get_ep1_status(usb_dir_t dir)
 {
 	usb_ep_t ep;
@@ -1601,6 +1605,7 @@ void usb_device_get_ops(usb_ops_t *ops)
 	ops->usbd_flush_endpoint               = usbd_flush_endpoint;
 	ops->usbd_set_ep_stall                 = usbd_set_ep_stall;
 	ops->usbd_handle_ep0_ctrl_setup        = usbd_handle_ep0_ctrl_setup;
+	ops->usbd_ack_bulk_reset               = usbd_ack_bulk_reset;
 	ops->usbd_end                          = usbd_end;
 	ops->usb_device_init                   = usb_device_init;
 	ops->usb_device_enumerate              = usb_device_enumerate;
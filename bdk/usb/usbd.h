@@ -168,6 +168,7 @@ typedef struct _usb_ops_t
 	int  (*usbd_flush_endpoint)(u32);
 	int  (*usbd_set_ep_stall)(u32, int);
 	int  (*usbd_handle_ep0_ctrl_setup)();
+	int  (*usbd_ack_bulk_reset)();
 	void (*usbd_end)(bool, bool);
 	int  (*usb_device_init)();
 	int  (*usb_device_enumerate)(usb_gadget_type gadget);
@@ -195,6 +196,8 @@ typedef struct _usb_ctxt_t
 {
 	u32 volumes_cnt;
 	usb_ctxt_vol_t *volumes;
+	bool write_cache;
+	bool read_ahead;
 	void (*system_maintenance)(bool);
 	void *label;
 	void (*set_text)(void *, const char *);
@@ -361,6 +361,8 @@ typedef struct _xusbd_controller_t
 	data_trb_t *bulkout_epenqueue_ptr;
 	data_trb_t *bulkout_epdequeue_ptr;
 	u32 bulkout_producer_cycle;
+	u8 *bulkout_buf;
+	u32 bulkout_len;
 	data_trb_t *bulkin_epenqueue_ptr;
 	data_trb_t *bulkin_epdequeue_ptr;
 	u32 bulkin_producer_cycle;
@@ -963,6 +965,10 @@ int xusb_device_init()
 	if (res)
 		return USB_ERROR_INIT;
 
+	// Write back and drop the zeroed rings and EP contexts before the first poll.
+	// A dirty line evicted later would overwrite events written by the controller.
+	bpmp_mmu_maintenance_range(BPMP_MMU_MAINT_CLEAN_INVALID_PHY, xusb_evtq, sizeof(xusbd_event_queues_t));
+
 	// Enable events and interrupts.
 	XUSB_DEV_XHCI(XUSB_DEV_XHCI_CTRL) |= XHCI_CTRL_IE | XHCI_CTRL_LSE;
 	XUSB_DEV_XHCI(XUSB_DEV_XHCI_ECPLO) = (u32)xusb_evtq->xusb_ep_ctxt & 0xFFFFFFF0;
@@ -1084,8 +1090,8 @@ static int _xusb_queue_trb(u32 ep_idx, const void *trb, bool ring_doorbell)
 	// Ring doorbell.
 	if (ring_doorbell)
 	{
-		// Flush data before transfer.
-		bpmp_mmu_maintenance(BPMP_MMU_MAINT_CLEAN_WAY, false);
+		// Flush rings and EP contexts before transfer. Data buffers are flushed by the issuer.
+		bpmp_mmu_maintenance_range(BPMP_MMU_MAINT_CLEAN_PHY, xusb_evtq, sizeof(xusbd_event_queues_t));
 
 		u32 target_id = (ep_idx << 8) & 0xFFFF;
 		if (ep_idx == XUSB_EP_CTRL_IN)
@@ -1188,6 +1194,9 @@ static int _xusb_issue_data_trb(u8 *buf, u32 len, usb_dir_t direction)
 	{
 		_xusb_create_data_trb(&trb, buf, len, direction);
 
+		// Flush data before transfer.
+		bpmp_mmu_maintenance_range(BPMP_MMU_MAINT_CLEAN_PHY, buf, len);
+
 		res = _xusb_queue_trb(XUSB_EP_CTRL_IN, &trb, EP_RING_DOORBELL);
 		if (!res)
 			usbd_xotg->wait_for_event_trb = XUSB_TRB_DATA;
@@ -1479,7 +1488,7 @@ static int _xusb_handle_get_class_request(const usb_ctrl_setup_t *ctrl_setup)
 	{
 	case USB_REQUEST_BULK_RESET:
 		usbd_xotg->bulk_reset_req = true;
-		return _xusb_issue_status_trb(USB_DIR_IN); // DELAYED_STATUS;
+		return USB_RES_OK; // DELAYED_STATUS. Acked by the gadget when ready.
 
 	case USB_REQUEST_BULK_GET_MAX_LUN:
 		if (!usbd_xotg->max_lun_set)
@@ -1883,6 +1892,9 @@ static int _xusb_ep_operation(u32 tries)
 	// Clear interrupt status.
 	XUSB_DEV_XHCI(XUSB_DEV_XHCI_ST) |= XHCI_ST_IP;
 
+	// Invalidate event rings and EP contexts updated by the controller.
+	bpmp_mmu_maintenance_range(BPMP_MMU_MAINT_INVALID_PHY, xusb_evtq, sizeof(xusbd_event_queues_t));
+
 	usbd_xotg->event_enqueue_ptr = (event_trb_t *)(XUSB_DEV_XHCI(XUSB_DEV_XHCI_EREPLO) & 0xFFFFFFF0);
 	event_trb = usbd_xotg->event_dequeue_ptr;
 
@@ -2033,6 +2045,11 @@ int xusb_handle_ep0_ctrl_setup()
 	return USB_RES_OK;
 }
 
+int xusb_ack_bulk_reset()
+{
+	return _xusb_issue_status_trb(USB_DIR_IN);
+}
+
 int xusb_device_ep1_out_read(u8 *buf, u32 len, u32 *bytes_read, u32 sync_tries)
 {
 	if (len > USB_EP_BUFFER_MAX_SIZE)
@@ -2041,6 +2058,8 @@ int xusb_device_ep1_out_read(u8 *buf, u32 len, u32 *bytes_read, u32 sync_tries)
 	int res = USB_RES_OK;
 	usbd_xotg->tx_count[USB_DIR_OUT] = 0;
 	usbd_xotg->tx_bytes[USB_DIR_OUT] = len;
+	usbd_xotg->bulkout_buf = buf;
+	usbd_xotg->bulkout_len = len;
 
 	_xusb_issue_normal_trb(buf, len, USB_DIR_OUT);
 	usbd_xotg->tx_count[USB_DIR_OUT]++;
@@ -2052,10 +2071,10 @@ int xusb_device_ep1_out_read(u8 *buf, u32 len, u32 *bytes_read, u32 sync_tries)
 
 		if (bytes_read)
 			*bytes_read = res ? 0 : usbd_xotg->tx_bytes[USB_DIR_OUT];
-	}
 
-	// Invalidate data after transfer.
-	bpmp_mmu_maintenance(BPMP_MMU_MAINT_INVALID_WAY, false);
+		// Invalidate data after transfer.
+		bpmp_mmu_maintenance_range(BPMP_MMU_MAINT_INVALID_PHY, buf, len);
+	}
 
 	return res;
 }
@@ -2095,7 +2114,7 @@ int xusb_device_ep1_out_reading_finish(u32 *pending_bytes, u32 sync_tries)
 		*pending_bytes = res ? 0 : usbd_xotg->tx_bytes[USB_DIR_OUT];
 
 	// Invalidate data after transfer.
-	bpmp_mmu_maintenance(BPMP_MMU_MAINT_INVALID_WAY, false);
+	bpmp_mmu_maintenance_range(BPMP_MMU_MAINT_INVALID_PHY, usbd_xotg->bulkout_buf, usbd_xotg->bulkout_len);
 
 	return res;
 }
@@ -2106,7 +2125,7 @@ int xusb_device_ep1_in_write(u8 *buf, u32 len, u32 *bytes_written, u32 sync_trie
 		len = USB_EP_BUFFER_MAX_SIZE;
 
 	// Flush data before transfer.
-	bpmp_mmu_maintenance(BPMP_MMU_MAINT_CLEAN_WAY, false);
+	bpmp_mmu_maintenance_range(BPMP_MMU_MAINT_CLEAN_PHY, buf, len);
 
 	int res = USB_RES_OK;
 	usbd_xotg->tx_count[USB_DIR_IN] = 0;
@@ -2200,6 +2219,7 @@ void xusb_device_get_ops(usb_ops_t *ops)
 	ops->usbd_flush_endpoint               = NULL;
 	ops->usbd_set_ep_stall                 = xusb_set_ep_stall;
 	ops->usbd_handle_ep0_ctrl_setup        = xusb_handle_ep0_ctrl_setup;
+	ops->usbd_ack_bulk_reset               = xusb_ack_bulk_reset;
 	ops->usbd_end                          = xusb_end;
 	ops->usb_device_init                   = xusb_device_init;
 	ops->usb_device_enumerate              = xusb_device_enumerate;
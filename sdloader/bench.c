@@ -0,0 +1,100 @@
+#include "bench.h"
+#include "memory_map.h"
+#include <soc/timer.h>
+#include <storage/emmc.h>
+#include <storage/sd.h>
+#include <string.h>
+
+#define BENCH_SEQ_KB     (SZ_8M / SZ_1K)
+#define BENCH_SEQ_CHUNK  (SZ_64K / SDMMC_DAT_BLOCKSIZE)
+#define BENCH_RND_CNT    128
+#define BENCH_RND_CHUNK  (SZ_4K / SDMMC_DAT_BLOCKSIZE)
+
+static const bench_result_t sd_modes[BENCH_MODES] = {
+	{ .mode = SD_UHS_SDR104, .name = "SDR104" },
+	{ .mode = SD_UHS_SDR82,  .name = "SDR82"  },
+	{ .mode = SD_4BIT_HS25,  .name = "HS25"   },
+};
+
+static const bench_result_t emmc_modes[BENCH_MODES] = {
+	{ .mode = EMMC_MMC_HS400, .name = "HS400" },
+	{ .mode = EMMC_MMC_HS200, .name = "HS200" },
+	{ .mode = EMMC_8BIT_HS52, .name = "HS52"  },
+};
+
+static void bench_storage(sdmmc_storage_t *storage, bench_result_t *res){
+	u8 *buf = (u8*)SDMMC_UPPER_BUFFER;
+	u16 *rw_errors = sdmmc_storage_get_rw_errors(storage);
+	u32 timing = storage->sdmmc->timing;
+	u32 errors = rw_errors[timing];
+	u32 failed = 0;
+
+	u32 start = get_tmr_ms();
+	for(u32 sct = 0; sct < BENCH_SEQ_KB * 2; sct += BENCH_SEQ_CHUNK){
+		failed += !sdmmc_storage_read(storage, sct, BENCH_SEQ_CHUNK, buf);
+	}
+	res->seq_kbs = BENCH_SEQ_KB * 1000 / MAX(get_tmr_ms() - start, 1);
+
+	// same sequence for every mode, spread over the whole device
+	u32 seed = 1;
+	start = get_tmr_us();
+	for(u32 i = 0; i < BENCH_RND_CNT; i++){
+		seed = seed * 1103515245 + 12345;
+		u32 sct = (seed % (storage->sec_cnt / BENCH_RND_CHUNK)) * BENCH_RND_CHUNK;
+		failed += !sdmmc_storage_read(storage, sct, BENCH_RND_CHUNK, buf);
+	}
+	res->rnd_iops = BENCH_RND_CNT * 1000000 / MAX(get_tmr_us() - start, 1);
+
+	res->errors = rw_errors[timing] - errors + failed;
+}
+
+static int bench_pick(bench_result_t res[BENCH_MODES]){
+	int best = -1;
+
+	// payloads and ums dumps are sequential
+	for(int i = 0; i < BENCH_MODES; i++){
+		if(res[i].ok && !res[i].errors && (best < 0 || res[i].seq_kbs > res[best].seq_kbs)){
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+int bench_sd(bench_result_t res[BENCH_MODES]){
+	memcpy(res, sd_modes, sizeof(sd_modes));
+
+	for(u32 i = 0; i < BENCH_MODES; i++){
+		res[i].ok = sd_initialize_mode(res[i].mode);
+		if(res[i].ok){
+			bench_storage(&sd_storage, &res[i]);
+		}
+	}
+
+	int best = bench_pick(res);
+	if(best < 0 || !sd_initialize_mode(res[best].mode)){
+		sd_initialize(false);
+		return -1;
+	}
+
+	return best;
+}
+
+int bench_emmc(bench_result_t res[BENCH_MODES]){
+	memcpy(res, emmc_modes, sizeof(emmc_modes));
+
+	for(u32 i = 0; i < BENCH_MODES; i++){
+		res[i].ok = emmc_initialize_mode(res[i].mode);
+		if(res[i].ok){
+			bench_storage(&emmc_storage, &res[i]);
+		}
+	}
+
+	int best = bench_pick(res);
+	if(best < 0 || !emmc_initialize_mode(res[best].mode)){
+		emmc_initialize(false);
+		return -1;
+	}
+
+	return best;
+}
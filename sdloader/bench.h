@@ -0,0 +1,21 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <utils/types.h>
+
+#define BENCH_MODES 3
+
+typedef struct{
+	u32 mode;      // sd_mode / emmc_mode
+	const char *name;
+	bool ok;       // init in this mode worked
+	u32 seq_kbs;   // sequential read
+	u32 rnd_iops;  // 4KB random reads
+	u32 errors;    // retries and failed reads
+}bench_result_t;
+
+// measures every mode, leaves the device in the fastest one without errors and returns its index, -1 if none
+int bench_sd(bench_result_t res[BENCH_MODES]);
+int bench_emmc(bench_result_t res[BENCH_MODES]);
+
+#endif
@@ -1,8 +1,11 @@
 #include "files.h"
 #include <libs/fatfs/ff.h>
+#include <libs/fatfs/diskio.h>
+#include <string.h>
 #include <utils/btn.h>
 #include <utils/types.h>
 #include <tui.h>
+#include "trace.h"
 
 const char* drive_friendly_names[4] = {
 	[SDLOADER_DRIVE_BOOT1]     = "BOOT 1",
@@ -20,6 +23,8 @@ const char* drive_names[4] = {
 
 static FATFS fs;
 static u8 cur_drive = SDLOADER_DRIVE_INVALID;
+// cluster link map of the file being read, a single fragment uses 4 entries
+static DWORD clmt[16];
 
 FRESULT unmount_drive(){
 	if(cur_drive != SDLOADER_DRIVE_INVALID){
@@ -32,7 +37,9 @@ static FRESULT mount_drive(u8 drive){
 	if(cur_drive != drive){
 		unmount_drive();
 		cur_drive = SDLOADER_DRIVE_INVALID;
+		trace_begin(TRACE_MOUNT);
 		FRESULT res = f_mount(&fs, drive_names[drive], 1);
+		trace_end(TRACE_MOUNT);
 		if(res == FR_OK){
 			cur_drive = drive;
 		}
@@ -58,7 +65,11 @@ FRESULT open_file_on(const char *path, FIL *f, u8 drive){
 		return res;
 	}
 
-	return f_open(f, path, FA_READ | FA_OPEN_EXISTING);
+	trace_begin(TRACE_F_OPEN);
+	res = f_open(f, path, FA_READ | FA_OPEN_EXISTING);
+	trace_end(TRACE_F_OPEN);
+
+	return res;
 }
 
 FRESULT open_file_on_any(const char *path, FIL *f, u8 *drive){
@@ -86,4 +97,207 @@ FRESULT open_file_on_any(const char *path, FIL *f, u8 *drive){
 	}
 
 	return FR_NO_FILE;
-}
\ No newline at end of file
+}
+
+static u8 drive_pdrv(u8 drive){
+	return drive_names[drive][0] - '0';
+}
+
+// build the link map once per opened file, f_open clears cltbl
+static FRESULT build_linkmap(FIL *f){
+	FRESULT res;
+
+	if(f->cltbl == clmt){
+		return FR_OK;
+	}
+
+	f->cltbl = clmt;
+	clmt[0] = sizeof(clmt) / sizeof(clmt[0]);
+	res = f_lseek(f, CREATE_LINKMAP);
+	if(res != FR_OK){
+		f->cltbl = NULL;
+		// too fragmented for the table, f_read will follow the fat chain
+		if(res == FR_NOT_ENOUGH_CORE){
+			return FR_OK;
+		}
+	}
+	return res;
+}
+
+static bool is_contiguous(FIL *f){
+	return f->cltbl == clmt && clmt[0] == 4;
+}
+
+FRESULT read_file_fast(FIL *f, void *buf, u32 btr, u32 *br){
+	FRESULT res;
+	FATFS *ffs = f->obj.fs;
+	u8 *bbuf = (u8*)buf;
+	UINT rd;
+
+	*br = 0;
+
+	if(btr > f_size(f) - f_tell(f)){
+		btr = f_size(f) - f_tell(f);
+	}
+
+	res = build_linkmap(f);
+	if(res != FR_OK){
+		return res;
+	}
+
+	// whole sectors with one request per fragment, a contiguous file takes a single one
+	while(f->cltbl == clmt && !(f_tell(f) % 0x200) && btr >= 0x200){
+		u32 sect_ofs = f_tell(f) / 0x200;
+		u32 clus_ofs = sect_ofs / ffs->csize;
+		DWORD *frag = clmt + 1;
+
+		// fragments are (length, first cluster) pairs ending with 0
+		while(frag[0] && clus_ofs >= frag[0]){
+			clus_ofs -= frag[0];
+			frag += 2;
+		}
+		if(!frag[0]){
+			break;
+		}
+
+		u32 cnt = MIN(btr / 0x200, (frag[0] - clus_ofs) * ffs->csize - sect_ofs % ffs->csize);
+		LBA_t sect = ffs->database + (LBA_t)ffs->csize * (frag[1] - 2 + clus_ofs) + sect_ofs % ffs->csize;
+
+		if(disk_read(ffs->pdrv, bbuf, sect, cnt) != RES_OK){
+			return FR_DISK_ERR;
+		}
+
+		res = f_lseek(f, f_tell(f) + cnt * 0x200);
+		if(res != FR_OK){
+			return res;
+		}
+
+		bbuf += cnt * 0x200;
+		btr -= cnt * 0x200;
+		*br += cnt * 0x200;
+	}
+
+	if(!btr){
+		return FR_OK;
+	}
+
+	res = f_read(f, bbuf, btr, &rd);
+	*br += rd;
+
+	return res;
+}
+
+// where the volume serial number is in the boot sector, which ffs->win holds
+static u16 vol_serial_ofs(FATFS *ffs){
+	switch(ffs->fs_type){
+	case FS_EXFAT:
+		return 100;
+	case FS_FAT32:
+		return 67;
+	default:
+		// fat12/16 only have it with the extended boot signature
+		return ffs->win[38] == 0x29 ? 39 : 0;
+	}
+}
+
+bool get_file_loc(FIL *f, u8 drive, file_loc_t *loc){
+	FATFS *ffs = f->obj.fs;
+
+	memset(loc, 0, sizeof(*loc));
+
+	// f_open leaves the sector holding the directory entry in the window
+	for(u32 ofs = 0; ofs < 0x200; ofs += 32){
+		u8 *ent = ffs->win + ofs;
+		if(ffs->fs_type == FS_EXFAT){
+			// stream extension entry, preceded by the file entry with the set checksum and timestamps
+			if(ofs && ent[0] == 0xc0 && ent[-32] == 0x85 && *(u32*)(ent + 20) == f->obj.sclust && *(u64*)(ent + 24) == f_size(f)){
+				loc->ent_ofs = ofs - 32;
+				loc->ent_len = 64;
+				break;
+			}
+		}else if(ent[0] != 0xe5 && ent[11] != 0x0f && (*(u16*)(ent + 20) << 16 | *(u16*)(ent + 26)) == f->obj.sclust && *(u32*)(ent + 28) == f_size(f)){
+			loc->ent_ofs = ofs;
+			loc->ent_len = 32;
+			break;
+		}
+	}
+
+	if(!loc->ent_len){
+		return false;
+	}
+
+	memcpy(loc->ent, ffs->win + loc->ent_ofs, loc->ent_len);
+	loc->ent_sect = ffs->winsect;
+
+	if(build_linkmap(f) != FR_OK || !is_contiguous(f)){
+		return false;
+	}
+
+	loc->drive = drive;
+	loc->data_sect = ffs->database + (LBA_t)ffs->csize * (clmt[2] - 2);
+	loc->size = f_size(f);
+
+	// boot sector to the window like f_getlabel does, fs is read only so nothing is lost
+	if(disk_read(ffs->pdrv, ffs->win, ffs->volbase, 1) != RES_OK){
+		ffs->winsect = (LBA_t)0 - 1;
+		return false;
+	}
+	ffs->winsect = ffs->volbase;
+
+	loc->vol_sect = ffs->volbase;
+	loc->vol_serial_ofs = vol_serial_ofs(ffs);
+	if(loc->vol_serial_ofs){
+		memcpy(&loc->vol_serial, ffs->win + loc->vol_serial_ofs, sizeof(loc->vol_serial));
+	}
+
+	return true;
+}
+
+bool check_file_loc(const file_loc_t *loc, void *scratch){
+	u8 pdrv;
+
+	if(loc->drive > 3 || !loc->ent_len || loc->ent_ofs + loc->ent_len > 0x200 || loc->vol_serial_ofs > 0x200 - sizeof(loc->vol_serial)){
+		return false;
+	}
+
+	pdrv = drive_pdrv(loc->drive);
+	if(disk_initialize(pdrv) != 0){
+		return false;
+	}
+
+	if(disk_read(pdrv, scratch, loc->vol_sect, 1) != RES_OK ||
+		(loc->vol_serial_ofs && memcmp((u8*)scratch + loc->vol_serial_ofs, &loc->vol_serial, sizeof(loc->vol_serial)))){
+		return false;
+	}
+
+	return disk_read(pdrv, scratch, loc->ent_sect, 1) == RES_OK && !memcmp((u8*)scratch + loc->ent_ofs, loc->ent, loc->ent_len);
+}
+
+bool read_file_loc(const file_loc_t *loc, void *buf, u32 ofs, u32 len){
+	if(!len){
+		return true;
+	}
+
+	return disk_read(drive_pdrv(loc->drive), buf, loc->data_sect + ofs / 0x200, (len + 0x1ff) / 0x200) == RES_OK;
+}
+
+bool read_file_loc_queue(const file_loc_t *loc, void *buf, u32 ofs, u32 len){
+	if(!len){
+		return false;
+	}
+
+	return disk_read_queue(drive_pdrv(loc->drive), buf, loc->data_sect + ofs / 0x200, (len + 0x1ff) / 0x200) == RES_OK;
+}
+
+bool read_file_loc_wait(const file_loc_t *loc){
+	return disk_read_wait(drive_pdrv(loc->drive)) == RES_OK;
+}
+
+// len is a multiple of the sector size, buf2 continues the file behind it
+bool read_file_loc_split(const file_loc_t *loc, void *buf, u32 ofs, u32 len, void *buf2, u32 len2){
+	if(!len2){
+		return read_file_loc(loc, buf, ofs, len);
+	}
+
+	return disk_read_split(drive_pdrv(loc->drive), buf, len / 0x200, buf2, (len2 + 0x1ff) / 0x200, loc->data_sect + ofs / 0x200) == RES_OK;
+}
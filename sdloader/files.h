@@ -12,11 +12,38 @@ typedef enum{
 	SDLOADER_DRIVE_INVALID,
 }sdloader_drive;
 
+// raw location of a contiguous file, enough to read it without mounting
+typedef struct{
+	u8  drive;
+	u8  ent_len;
+	u16 ent_ofs;
+	u32 ent_sect;
+	u32 data_sect;
+	u32 size;
+	u32 vol_sect;       // boot sector of the volume
+	u32 vol_serial;     // volume serial number, the same entry on a reformatted or other card doesn't match
+	u16 vol_serial_ofs; // where it is in the boot sector, 0 for a volume without one
+	u8  ent[64]; // directory entry, fat sfn entry or exfat file + stream entries
+}file_loc_t;
+
 extern const char* drive_friendly_names[4];
 
 FRESULT open_file_on(const char *path, FIL *f, u8 drive);
 FRESULT open_file_on_any(const char *path, FIL *f, u8 *drive);
 FRESULT unmount_drive();
+// f_read replacement, only one file may use it at a time
+FRESULT read_file_fast(FIL *f, void *buf, u32 btr, u32 *br);
+// must be called right after opening the file
+bool get_file_loc(FIL *f, u8 drive, file_loc_t *loc);
+// checks the volume and the directory entry are unchanged, scratch must hold 512 bytes
+bool check_file_loc(const file_loc_t *loc, void *scratch);
+// whole sectors only, ofs must be 512 aligned and buf must hold len rounded up to 512
+bool read_file_loc(const file_loc_t *loc, void *buf, u32 ofs, u32 len);
+// same as read_file_loc, but only queued. false if the queue is full, read_file_loc_wait collects the oldest
+bool read_file_loc_queue(const file_loc_t *loc, void *buf, u32 ofs, u32 len);
+bool read_file_loc_wait(const file_loc_t *loc);
+// one command for data that goes to two places, like the payload head and the part behind it
+bool read_file_loc_split(const file_loc_t *loc, void *buf, u32 ofs, u32 len, void *buf2, u32 len2);
 
 
 #endif
\ No newline at end of file
@@ -123,6 +123,18 @@ static const u8 _gfx_font[] = {
 	0x00, 0x00, 0x00, 0x4C, 0x32, 0x00, 0x00, 0x00  // Char 126 (~)
 };
 
+// _gfx_font transposed for rotated output, one byte per framebuffer row. Built on first use.
+static u8 _gfx_font_rot[sizeof(_gfx_font)];
+static bool _gfx_font_rot_done = false;
+
+// Byte mask of 4 pixels for each nibble of a glyph row.
+static const u32 _gfx_nibble_mask[16] = {
+	0x00000000, 0x000000FF, 0x0000FF00, 0x0000FFFF,
+	0x00FF0000, 0x00FF00FF, 0x00FFFF00, 0x00FFFFFF,
+	0xFF000000, 0xFF0000FF, 0xFF00FF00, 0xFF00FFFF,
+	0xFFFF0000, 0xFFFF00FF, 0xFFFFFF00, 0xFFFFFFFF
+};
+
 #define RGB_TRIPLE(R, G, B) (((R) & 0xff) | (((G) & 0xff) << 8) | (((G) & 0xff) << 16))
 
 // Palette idx 0-31: grey levels
@@ -263,22 +275,64 @@ void gfx_putc(char c)
 	}
 }
 
+static void _gfx_build_font_rot(){
+	for(u32 c = 0; c < sizeof(_gfx_font); c += 8){
+		for(u32 i = 0; i < 8; i++){
+			u8 v = _gfx_font[c + i];
+			for(u32 j = 0; j < 8; j++){
+				if(v & BIT(j)){
+					_gfx_font_rot[c + j] |= BIT(i);
+				}
+			}
+		}
+	}
+	_gfx_font_rot_done = true;
+}
+
 void gfx_putc_rot(char c){
 	// Duplicate code for performance reasons.
 	if (c >= 32 && c <= 126)
 	{
-		u8 *cbuf = (u8 *)&_gfx_font[8 * (c - 32)];
-		for (u32 i = 0; i < 8; i++)
-		{
-			u8 *fb = gfx_ctxt.fb + gfx_ctxt.stride * gfx_con.y + gfx_con.x + i;
-			u8 v = *cbuf++;
+		if(!_gfx_font_rot_done){
+			_gfx_build_font_rot();
+		}
+
+		const u8 *cbuf = &_gfx_font_rot[8 * (c - 32)];
+		u8 *fb = gfx_ctxt.fb + gfx_ctxt.stride * gfx_con.y + gfx_con.x;
+
+		if(!((u32)fb & 3) && !(gfx_ctxt.stride & 3)){
+			// 4 pixels per store
+			u32 fg = gfx_con.fgcol * 0x01010101;
+			u32 bg = gfx_con.bgcol * 0x01010101;
 			for (u32 j = 0; j < 8; j++)
 			{
-				if (v & 1)
-					*fb = gfx_con.fgcol;
-				else if (gfx_con.fillbg)
-					*fb = gfx_con.bgcol;
-				v >>= 1;
+				u32 *fbw = (u32 *)fb;
+				u32 lo = _gfx_nibble_mask[cbuf[j] & 0xF];
+				u32 hi = _gfx_nibble_mask[cbuf[j] >> 4];
+				if (gfx_con.fillbg)
+				{
+					fbw[0] = (fg & lo) | (bg & ~lo);
+					fbw[1] = (fg & hi) | (bg & ~hi);
+				}
+				else
+				{
+					fbw[0] = (fbw[0] & ~lo) | (fg & lo);
+					fbw[1] = (fbw[1] & ~hi) | (fg & hi);
+				}
+				fb -= gfx_ctxt.stride;
+			}
+		}else{
+			for (u32 j = 0; j < 8; j++)
+			{
+				u8 v = cbuf[j];
+				for (u32 i = 0; i < 8; i++)
+				{
+					if (v & 1)
+						fb[i] = gfx_con.fgcol;
+					else if (gfx_con.fillbg)
+						fb[i] = gfx_con.bgcol;
+					v >>= 1;
+				}
 				fb -= gfx_ctxt.stride;
 			}
 		}
@@ -546,11 +600,8 @@ void gfx_set_rect_grey(const u8 *buf, u32 size_x, u32 size_y, u32 pos_x, u32 pos
 	u32 pos = 0;
 	for (u32 y = pos_y; y < (pos_y + size_y); y++)
 	{
-		for (u32 x = pos_x; x < (pos_x + size_x); x++)
-		{
-			memset(&gfx_ctxt.fb[x + y*gfx_ctxt.stride], buf[pos], 1);
-			pos++;
-		}
+		memcpy(&gfx_ctxt.fb[pos_x + y*gfx_ctxt.stride], &buf[pos], size_x);
+		pos += size_x;
 	}
 }
 
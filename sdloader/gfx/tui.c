@@ -219,6 +219,51 @@ void tui_menu_clear_screen(tui_entry_menu_t *menu){
 	gfx_clear_rect_rot(menu->colors->bg, menu->pos_x, menu->pos_y, menu->width * 8, menu->height * 8);
 }
 
+static const char *tui_entry_title(tui_entry_t *entry){
+	switch(entry->type){
+		case TUI_ENTRY_TYPE_MENU:
+		case TUI_ENTRY_TYPE_ACTION:
+		case TUI_ENTRY_TYPE_ACTION_MODIFYING:
+		case TUI_ENTRY_TYPE_TEXT:
+		case TUI_ENTRY_TYPE_ACTION_NO_BLANK:
+		case TUI_ENTRY_TYPE_ACTION_MODIFYING_NO_BLANK:
+			return entry->title.text;
+		case TUI_ENTRY_TYPE_BACK:
+			return "Back";
+	}
+	return NULL;
+}
+
+// prints a single entry at the current position
+static void tui_print_entry(tui_entry_menu_t *menu, tui_entry_t *current){
+	const tui_color_scheme_t *colors = menu->colors;
+	const char *title = tui_entry_title(current);
+
+	if(current == menu->selected){
+		if(current->disabled){
+			gfx_con_setcol(colors->fg_active_disabled, true, colors->bg_active_disabled);
+		}else{
+			gfx_con_setcol(colors->fg_active, true, colors->bg_active);
+		}
+	}else{
+		if(current->disabled){
+			gfx_con_setcol(colors->fg_disabled, true, colors->bg_disabled);
+		}else{
+			gfx_con_setcol(colors->fg, true, colors->bg);
+		}
+	}
+
+	if(title){
+		gfx_printf_rot("%s", title);
+		for(u8 i = strlen(title); i < menu->pad; i++){
+			gfx_putc_rot(' ');
+		}
+		gfx_putc_rot('\n');
+	}
+
+	current->dirty = false;
+}
+
 void tui_print_menu(tui_entry_menu_t *menu){
 	const tui_color_scheme_t *colors = menu->colors;
 	u32 ox, oy;
@@ -234,27 +279,14 @@ void tui_print_menu(tui_entry_menu_t *menu){
 	gfx_con_setcol(colors->fg, true, colors->bg);
 
 	for(tui_entry_t *current = menu->entries; current != NULL; current = current->next){
-		const char *title = NULL;
-		switch(current->type){
-			case TUI_ENTRY_TYPE_MENU:
-			case TUI_ENTRY_TYPE_ACTION:
-			case TUI_ENTRY_TYPE_ACTION_MODIFYING:
-			case TUI_ENTRY_TYPE_TEXT:
-			case TUI_ENTRY_TYPE_ACTION_NO_BLANK:
-			case TUI_ENTRY_TYPE_ACTION_MODIFYING_NO_BLANK:
-				title = current->title.text;
-				break;
-			case TUI_ENTRY_TYPE_BACK:
-				title = "Back";
-				break;
-		}
+		gfx_con_getpos_rot(&_x, &y);
+		current->draw_y = y;
 
 		switch(current->type){
 		case TUI_ENTRY_TYPE_ACTION:
 		case TUI_ENTRY_TYPE_ACTION_MODIFYING:
 		case TUI_ENTRY_TYPE_ACTION_NO_BLANK:
 		case TUI_ENTRY_TYPE_ACTION_MODIFYING_NO_BLANK:
-			gfx_con_getpos_rot(&_x, &y);
 			current->action.y_pos = y;
 			current->action.x_pos = menu->pos_x;
 			break;
@@ -262,26 +294,22 @@ void tui_print_menu(tui_entry_menu_t *menu){
 			break;
 		}
 
-		if(current == menu->selected){
-			if(current->disabled){
-				gfx_con_setcol(colors->fg_active_disabled, true, colors->bg_active_disabled);
-			}else{
-				gfx_con_setcol(colors->fg_active, true, colors->bg_active);
-			}
-		}else{
-			if(current->disabled){
-				gfx_con_setcol(colors->fg_disabled, true, colors->bg_disabled);
-			}else{
-				gfx_con_setcol(colors->fg, true, colors->bg);
-			}
-		}
+		tui_print_entry(menu, current);
+	}
 
-		if(title){
-			gfx_printf_rot("%s", title);
-			for(u8 i = strlen(title); i < menu->pad; i++){
-				gfx_putc_rot(' ');
-			}
-			gfx_putc_rot('\n');
+	gfx_con_set_origin_rot(ox, oy);
+}
+
+// repaints only the entries marked dirty since the last tui_print_menu
+static void tui_print_menu_dirty(tui_entry_menu_t *menu){
+	u32 ox, oy;
+	gfx_con_get_origin_rot(&ox, &oy);
+	gfx_con_set_origin_rot(menu->pos_x, menu->pos_y);
+
+	for(tui_entry_t *current = menu->entries; current != NULL; current = current->next){
+		if(current->dirty){
+			gfx_con_setpos_rot(menu->pos_x, current->draw_y);
+			tui_print_entry(menu, current);
 		}
 	}
 
@@ -306,9 +334,11 @@ tui_status_t tui_menu_start_rot(tui_entry_menu_t *menu){
 	}
 
 	tui_menu_clear_screen(menu);
+	tui_print_menu(menu);
 
 	while(true){
-		tui_print_menu(menu);
+		tui_entry_t *prev_selected = menu->selected;
+		bool redraw = false;
 
 		u8 btn = btn_wait_timeout_single1(1000);
 
@@ -375,6 +405,18 @@ tui_status_t tui_menu_start_rot(tui_entry_menu_t *menu){
 			}
 			//restore brightness on return from action
 			tui_dim_on_timeout(1);
+
+			// actions may have shaded the menu or changed any label
+			redraw = true;
+		}
+
+		if(redraw){
+			tui_print_menu(menu);
+		}else if(menu->selected != prev_selected){
+			// only the old and new highlight change while navigating
+			prev_selected->dirty = true;
+			menu->selected->dirty = true;
+			tui_print_menu_dirty(menu);
 		}
 
 		if(btn){
@@ -235,6 +235,8 @@ typedef struct tui_entry_action_modifying_t{
 struct tui_entry_t{
 	tui_entry_type_t type;
 	bool disabled;
+	bool dirty;   // repainted by the next incremental redraw
+	u16 draw_y;   // where tui_print_menu last drew the entry
 	struct tui_entry_t *next;
 	union{
 		tui_text_t title;
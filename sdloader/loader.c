@@ -1,24 +1,119 @@
+#include <string.h>
 #include <utils/types.h>
 #include <memory_map.h>
+#include "loader.h"
 
+extern u8 __bss_end[];
 
-#pragma GCC optimize ("O3")
-static void reloc(void *dst, void *src, u32 size){
-	u8 *src_8 = (u8*)src;
-	u8 *dst_8 = (u8*)dst;
-	if(dst_8 < src_8){
-		for(u32 i = 0; i < size; i++){
-			dst_8[i] = src_8[i];
-		} 
-	}else if(dst_8 > src_8){
-		for(u32 i = size - 1; i < size; i--){
-			dst_8[i] = src_8[i];
-		}
+bool plan_payload(u32 size, payload_plan_t *plan){
+	u32 target_end = PAYLOAD_LOAD_ADDR + size;
+	u32 head_size = 0;
+
+	// part of the target still used by sdloader code/data, goes through a bounce buffer
+	if((u32)__bss_end > PAYLOAD_LOAD_ADDR){
+		head_size = MIN(ALIGN((u32)__bss_end - PAYLOAD_LOAD_ADDR, 0x200), size);
+	}
+
+	// bounce buffer right after the target, never below the payload buffer
+	u32 bounce = MAX(ALIGN(target_end, 0x200), PAYLOAD_BUF_ADDR);
+
+	if(!size || bounce + ALIGN(head_size, 0x200) > IPL_HEAP_START){
+		return false;
+	}
+
+	plan->size = size;
+	plan->head = (u8*)bounce;
+	plan->head_size = head_size;
+	plan->rest = (u8*)(PAYLOAD_LOAD_ADDR + head_size);
+	plan->cmp_size = 0;
+
+	return true;
+}
+
+u8 *plan_payload_ptr(const payload_plan_t *plan, u32 ofs){
+	return ofs < plan->head_size ? plan->head + ofs : plan->rest + (ofs - plan->head_size);
+}
+
+// copy bytes of the payload as it was laid out by the plan
+static void plan_copy(const payload_plan_t *plan, u32 ofs, void *dst, u32 len){
+	u8 *d = (u8*)dst;
+	for(u32 i = 0; i < len; i++, ofs++){
+		d[i] = *plan_payload_ptr(plan, ofs);
 	}
 }
 
-__attribute__((noreturn)) void reloc_and_start_payload(void *addr, u32 size){
-	reloc((void*)PAYLOAD_LOAD_ADDR, addr, size);
+bool plan_payload_check_hash(payload_plan_t *plan, const u8 *hash){
+	payload_sha_trailer_t trailer;
+
+	if(plan->size < sizeof(trailer)){
+		return true;
+	}
+
+	plan_copy(plan, plan->size - sizeof(trailer), &trailer, sizeof(trailer));
+	if(trailer.magic != PAYLOAD_SHA_MAGIC){
+		return true;
+	}
+
+	if(!trailer.size || trailer.size != plan->size - sizeof(trailer) || memcmp(trailer.sha256, hash, sizeof(trailer.sha256))){
+		return false;
+	}
+
+	plan->size -= sizeof(trailer);
+
+	return true;
+}
+
+bool plan_payload_unpack(payload_plan_t *plan){
+	payload_blz_trailer_t trailer;
+	blz_footer footer;
+
+	plan->cmp_size = 0;
+
+	if(plan->size < sizeof(trailer) + sizeof(footer)){
+		return true;
+	}
+
+	plan_copy(plan, plan->size - sizeof(trailer), &trailer, sizeof(trailer));
+	if(trailer.magic != PAYLOAD_BLZ_MAGIC){
+		return true;
+	}
+
+	u32 cmp_size = plan->size - sizeof(trailer);
+	plan_copy(plan, cmp_size - sizeof(footer), &footer, sizeof(footer));
+
+	// decompression happens in place at the load address, the result has to end before the heap
+	if(footer.header_size < sizeof(footer) || footer.header_size > footer.cmp_and_hdr_size ||
+		footer.cmp_and_hdr_size > cmp_size || footer.addl_size > trailer.size ||
+		cmp_size + footer.addl_size != trailer.size || trailer.size > IPL_HEAP_START - PAYLOAD_LOAD_ADDR){
+		return false;
+	}
+
+	plan->cmp_size = cmp_size;
+	plan->footer = footer;
+
+	return true;
+}
+
+// src and dst are 0x200 aligned and never overlap, memcpy is linked below the target (see link.ld)
+static void reloc_head(u32 *dst, const u32 *src, u32 size){
+	memcpy(dst, src, ALIGN(size, 4));
+}
+
+__attribute__((noreturn)) void reloc_and_start_payload(const payload_plan_t *plan){
+	// plan itself may live in the overwritten range, read it before copying
+	const u32 *head = (const u32*)plan->head;
+	u32 head_size = plan->head_size;
+	u32 cmp_size = plan->cmp_size;
+	blz_footer footer = plan->footer;
+
+	// rest was read straight to its final location, only the overlapping head needs a copy
+	reloc_head((u32*)PAYLOAD_LOAD_ADDR, head, head_size);
+
+	// blz decompresses backwards in place, the bounce buffer is no longer needed (see link.ld)
+	if(cmp_size && !blz_uncompress_inplace((u8*)PAYLOAD_LOAD_ADDR, cmp_size, &footer)){
+		while(1){}
+	}
+
 	((void (*)()) PAYLOAD_LOAD_ADDR)();
 	while(1){}
 }
\ No newline at end of file
@@ -2,7 +2,42 @@
 #define _LOADER_H
 
 #include <utils/types.h>
+#include <libs/compr/blz.h>
 
-void reloc_and_start_payload(void *addr, u32 size);
+// appended to a blz compressed payload.bin by tools/payloadpack
+#define PAYLOAD_BLZ_MAGIC 0x5A4C4453 // "SDLZ"
+
+typedef struct{
+	u32 magic;
+	u32 size;      // decompressed size
+}payload_blz_trailer_t;
+
+// appended to payload.bin by tools/payloadpack --sha256, covers everything in front of it
+#define PAYLOAD_SHA_MAGIC 0x48534453 // "SDSH"
+
+typedef struct{
+	u32 magic;
+	u32 size;      // hashed size
+	u8  sha256[32];
+}payload_sha_trailer_t;
+
+typedef struct{
+	u32 size;
+	u8 *head;      // bounce buffer for the part overlapping sdloader
+	u32 head_size;
+	u8 *rest;      // final location of everything after head
+	u32 cmp_size;  // blz data size without the trailer, 0 if not compressed
+	blz_footer footer;
+}payload_plan_t;
+
+// split the payload into what can be read in place and what has to be relocated at launch
+bool plan_payload(u32 size, payload_plan_t *plan);
+// where a payload offset is read to according to the plan
+u8 *plan_payload_ptr(const payload_plan_t *plan, u32 ofs);
+// call once the payload was read, strips a sha256 trailer if it matches hash
+bool plan_payload_check_hash(payload_plan_t *plan, const u8 *hash);
+// call once the payload was read according to the plan, detects a compressed payload
+bool plan_payload_unpack(payload_plan_t *plan);
+void reloc_and_start_payload(const payload_plan_t *plan);
 
 #endif
\ No newline at end of file
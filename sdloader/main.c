@@ -29,11 +29,12 @@
 #include "modchip_toolbox.h"
 #include "files.h"
 #include <soc/bpmp.h>
+#include <sec/se.h>
+#include <sec/se_t210.h>
+#include "trace.h"
 
-typedef struct{
-	void *addr;
-	u32 size;
-}payload_ctx_t;
+// payload is read in chunks so hashing overlaps the storage reads
+#define PAYLOAD_READ_CHUNK SZ_32K
 
 typedef enum{
 	SD_LOADER_OK = 0,
@@ -41,6 +42,7 @@ typedef enum{
 	SD_LOADER_NO_PAYLOAD_ON_DEV, // no payload found on active drive
 	SD_LOADER_NO_PAYLOAD,        // no payload found on any drive
 	SD_LOADER_ERR_PAYLOAD,       // found payload, but read error
+	SD_LOADER_INV_PAYLOAD_HASH,  // found payload, but its hash trailer does not match
 	SD_LOADER_FORCE_MENU,        // forced menu by button combo
 	SD_LOADER_ERROR              // other error
 } SD_LOADER_STATUS;
@@ -50,7 +52,13 @@ extern void excp_reset(void);
 
 static bool display_init_done = false;
 static sd_loader_cfg_t sdloader_cfg;
-static payload_ctx_t payload_ctx = {0};
+static payload_plan_t payload_plan = {0};
+static file_loc_t payload_loc;
+static bool payload_loc_valid = false;
+static sdmmc_bus_cache_t sd_bus_cache;
+static sdmmc_bus_cache_t sd_bus_cache_saved; // as found in boot0
+// boot0 is read after the first emmc init, this only spares the re-inits of this boot a tuning
+static sdmmc_bus_cache_t emmc_bus_cache;
 
 
 static void deinit(){
@@ -60,28 +68,111 @@ static void deinit(){
 	hw_deinit(false, 0);
 }
 
-static SD_LOADER_STATUS read_payload(FIL *f){
-	FSIZE_t sz = f_size(f);
-	FRESULT res;
-	SD_LOADER_STATUS sd_res = SD_LOADER_OK;
+static FIL *payload_file;
 
- 	if(sz > PAYLOAD_SIZE_MAX){
- 		return SD_LOADER_INV_PAYLOAD_SZ;
- 	}
+static bool read_payload_chunk(const file_loc_t *loc, u8 *buf, u32 ofs, u32 len){
+	u32 br;
 
- 	void *buf = (void*)PAYLOAD_BUF_ADDR;
+	if(loc){
+		return read_file_loc(loc, buf, ofs, len);
+	}
 
- 	u32 br;
- 	res = f_read(f, (void*)buf, sz, &br);
+	return read_file_fast(payload_file, buf, len, &br) == FR_OK && br == len;
+}
 
- 	if(res != FR_OK || br != sz){
- 		return SD_LOADER_ERR_PAYLOAD;
- 	}
+static u32 payload_chunk_len(u32 ofs){
+	u32 len = MIN(payload_plan.size - ofs, PAYLOAD_READ_CHUNK);
+	// chunks never span the bounce buffer and the in place part
+	if(ofs < payload_plan.head_size){
+		len = MIN(len, payload_plan.head_size - ofs);
+	}
+	return len;
+}
+
+// read the payload as planned, the se hashes each chunk while the next one is read.
+// with a known location (contiguous file) the following chunks stay queued on the storage
+static SD_LOADER_STATUS read_payload_chunks(const file_loc_t *loc){
+	u32 hash[SE_SHA_256_SIZE / 4] = {0};
+	u32 msg_left[2];
+	bool hashing = false;
+	bool res = true;
+	u32 ofs = 0;
+	u32 done = 0;
+	u32 queued = 0;
+
+	// a hash trailer may follow the payload, always hash what would be in front of it
+	u32 hash_size = payload_plan.size > sizeof(payload_sha_trailer_t) ? payload_plan.size - sizeof(payload_sha_trailer_t) : 0;
+
+	trace_begin(TRACE_F_READ);
+
+	// the head goes to the bounce buffer, one command reads it together with the chunk behind it
+	if(loc && payload_plan.head_size && payload_plan.head_size < payload_plan.size){
+		u32 len2 = payload_chunk_len(payload_plan.head_size);
+		res = read_file_loc_split(loc, payload_plan.head, 0, payload_plan.head_size, payload_plan.rest, len2);
+		done = queued = payload_plan.head_size + len2;
+	}
 
- 	payload_ctx.addr = (void *)PAYLOAD_BUF_ADDR;
- 	payload_ctx.size = sz;
+	while(ofs < payload_plan.size && res){
+		u32 len = payload_chunk_len(ofs);
+		u8 *buf = plan_payload_ptr(&payload_plan, ofs);
 
-	return sd_res;
+		while(loc && queued < payload_plan.size && read_file_loc_queue(loc, plan_payload_ptr(&payload_plan, queued), queued, payload_chunk_len(queued))){
+			queued += payload_chunk_len(queued);
+		}
+
+		if(ofs >= done){
+			res = ofs < queued ? read_file_loc_wait(loc) : read_payload_chunk(loc, buf, ofs, len);
+		}
+
+		if(hashing){
+			se_calc_sha256_finalize(hash, msg_left);
+			hashing = false;
+		}
+
+		if(res && ofs < hash_size){
+			hashing = se_calc_sha256(hash, msg_left, buf, MIN(len, hash_size - ofs), hash_size, ofs ? SHA_CONTINUE : SHA_INIT_HASH, false);
+		}
+
+		ofs += len;
+	}
+
+	if(hashing){
+		se_calc_sha256_finalize(hash, msg_left);
+	}
+
+	// a failed read leaves the rest of the queue behind
+	for(ofs = MAX(ofs, done); ofs < queued; ofs += payload_chunk_len(ofs)){
+		read_file_loc_wait(loc);
+	}
+
+	trace_end(TRACE_F_READ);
+
+	if(!res){
+		return SD_LOADER_ERR_PAYLOAD;
+	}
+
+	if(!plan_payload_check_hash(&payload_plan, (u8*)hash)){
+		return SD_LOADER_INV_PAYLOAD_HASH;
+	}
+
+	// compressed payloads are unpacked at launch
+	if(!plan_payload_unpack(&payload_plan)){
+		return SD_LOADER_INV_PAYLOAD_SZ;
+	}
+
+	return SD_LOADER_OK;
+}
+
+static SD_LOADER_STATUS read_payload(FIL *f, const file_loc_t *loc){
+	FSIZE_t sz = f_size(f);
+
+	if(sz > PAYLOAD_SIZE_MAX || !plan_payload(sz, &payload_plan)){
+		return SD_LOADER_INV_PAYLOAD_SZ;
+	}
+
+	payload_file = f;
+
+	return read_payload_chunks(loc);
 }
 
 static void display_logo(){
@@ -91,6 +182,7 @@ static void display_logo(){
 
 static void init_display(){
 	if(!display_init_done){
+		trace_begin(TRACE_DISPLAY);
 		display_init();
 		u8 *fb = (u8*)display_init_window_a_pitch_small_palette(logo_lut, sizeof(logo_lut) / 4);
 		gfx_init_ctxt(fb, 180, 320, 192);
@@ -101,6 +193,7 @@ static void init_display(){
 		display_backlight_pwm_init();
 		display_backlight_brightness(128, 1000);
 		display_logo();
+		trace_end(TRACE_DISPLAY);
 	}
 }
 
@@ -112,6 +205,9 @@ static void handle_sdloader_status(SD_LOADER_STATUS res, u32 extra_info){
 	case SD_LOADER_INV_PAYLOAD_SZ:
 		s_printf(msg, "Payload on %s too large!", drive_friendly_names[extra_info]);
 		break;
+	case SD_LOADER_INV_PAYLOAD_HASH:
+		s_printf(msg, "Payload on %s corrupted!", drive_friendly_names[extra_info]);
+		break;
 	case SD_LOADER_FORCE_MENU:
 		s_printf(msg, "User forced menu!");
 		col = COL_TEAL;
@@ -128,9 +224,14 @@ static void handle_sdloader_status(SD_LOADER_STATUS res, u32 extra_info){
 }
 
 __attribute__((noreturn)) static void launch_payload(){
+	// reloc has no end point, it is the last thing recorded before handoff
+	trace_begin(TRACE_RELOC);
+	if(sdloader_cfg.boot_trace){
+		trace_save();
+	}
 	deinit();
 	/* payloads (may) expect to be loaded at 0x40010000, relocate before jumping to payload */
-	reloc_and_start_payload(payload_ctx.addr, payload_ctx.size);
+	reloc_and_start_payload(&payload_plan);
 	while(1){
 		bpmp_halt();
 	}
@@ -149,13 +250,80 @@ static void handle_file_error(const char *path, u8 drive, FRESULT res){
 	tui_print_status(COL_ORANGE, msg);
 }
 
+// cached location may only be used if its drive would be searched first
+static bool payload_cache_usable(){
+	if(!payload_loc_valid || payload_loc.size > PAYLOAD_SIZE_MAX || !plan_payload(payload_loc.size, &payload_plan)){
+		return false;
+	}
+
+	if(sdloader_cfg.default_payload_vol != MODCHIP_PAYLOAD_VOL_AUTO){
+		return payload_loc.drive == sdloader_cfg.default_payload_vol - 1;
+	}
+
+	// boot1 1mb is searched right after sd, only trust it if there is no usable sd card
+	return payload_loc.drive == SDLOADER_DRIVE_SD || (payload_loc.drive == SDLOADER_DRIVE_BOOT1_1MB && !sd_initialize(false));
+}
+
+// taps move a little between tunings, only a new card, mode, timing or retry count is worth a boot0 write
+static bool bus_cache_entry_changed(const sdmmc_bus_cache_t *a, const sdmmc_bus_cache_t *b){
+	return memcmp(a->raw_cid, b->raw_cid, sizeof(a->raw_cid)) || a->mode != b->mode || a->type != b->type || a->tuned != b->tuned ||
+		a->boots != b->boots || a->fails != b->fails;
+}
+
+// a lowered card writes once per boot, its retry count moves every boot
+static void update_bus_cache(){
+	sdmmc_bus_cache_t next;
+
+	sd_bus_cache_persist(&next, &sd_bus_cache_saved);
+	if(!bus_cache_entry_changed(&next, &sd_bus_cache_saved)){
+		return;
+	}
+
+	emmc_session_init();
+	if(modchip_set_bus_cache(&next)){
+		memcpy(&sd_bus_cache_saved, &next, sizeof(next));
+	}
+}
+
+static bool load_cached_payload(){
+	// bounce buffer doubles as scratch for the directory sector
+	if(!payload_cache_usable() || !check_file_loc(&payload_loc, payload_plan.head)){
+		return false;
+	}
+
+	// boot0 access goes through the buffer the payload is read to
+	update_bus_cache();
+
+	return read_payload_chunks(&payload_loc) == SD_LOADER_OK;
+}
+
+static void update_payload_cache(const file_loc_t *loc){
+	// only touch boot0 if the record changed
+	if(loc ? (payload_loc_valid && !memcmp(loc, &payload_loc, sizeof(*loc))) : !payload_loc_valid){
+		return;
+	}
+
+	emmc_session_init();
+	if(modchip_set_payload_cache(loc)){
+		payload_loc_valid = loc != NULL;
+		if(loc){
+			memcpy(&payload_loc, loc, sizeof(*loc));
+		}
+	}
+}
+
 static SD_LOADER_STATUS load_payload(){
 	FIL f;
 	FRESULT res;
 	u8 drive;
+	file_loc_t loc;
 
 	const char *path = "payload.bin";
 
+	if(load_cached_payload()){
+		return SD_LOADER_OK;
+	}
+
 	if(sdloader_cfg.default_payload_vol == MODCHIP_PAYLOAD_VOL_AUTO){
 		res = open_file_on_any(path, &f, &drive);
 	}else{
@@ -168,7 +336,12 @@ static SD_LOADER_STATUS load_payload(){
 		return SD_LOADER_ERROR;
 	}
 
-	SD_LOADER_STATUS sd_res = read_payload(&f);
+	// update the cache before reading, boot0 access goes through the buffer the payload is read to
+	bool contiguous = get_file_loc(&f, drive, &loc);
+	update_payload_cache(contiguous ? &loc : NULL);
+	update_bus_cache();
+
+	SD_LOADER_STATUS sd_res = read_payload(&f, contiguous ? &loc : NULL);
 
 	if(sd_res != SD_LOADER_OK){
 		handle_sdloader_status(sd_res, drive);
@@ -211,6 +384,8 @@ static void ofw_cb(void *data){
 static void try_launch_payload(){
 	SD_LOADER_STATUS res = SD_LOADER_ERROR;
 
+	bpmp_mmu_maint_set_phase(BOOT_PHASE_PAYLOAD);
+
 	//TODO: probably should disable backlight if payload is big enough to overwrite frame buffer
 	res = load_payload();
 
@@ -277,20 +452,37 @@ static void low_battery_shutdown(){
 }
 
 static void get_cfg(){
+	trace_begin(TRACE_GET_CFG);
+	sd_set_bus_cache(&sd_bus_cache);
+	emmc_set_bus_cache(&emmc_bus_cache);
+	// start sd power up first, it finishes in the background while boot0 is read
+	sd_initialize_start();
+	trace_begin(TRACE_EMMC_INIT);
 	emmc_initialize(false);
+	trace_end(TRACE_EMMC_INIT);
 	modchip_get_cfg_or_default(&sdloader_cfg);
-	emmc_end();
+	payload_loc_valid = modchip_get_payload_cache(&payload_loc);
+	if(modchip_get_bus_cache(&sd_bus_cache_saved)){
+		memcpy(&sd_bus_cache, &sd_bus_cache_saved, sizeof(sd_bus_cache));
+		sd_bus_cache_boot(&sd_bus_cache);
+	}
+	// emmc stays initialized for boot0/boot1/gpp access until deinit
+	trace_end(TRACE_GET_CFG);
 }
 
 void main(){
+	trace_begin(TRACE_CONFIRM);
 	modchip_confirm_execution();
+	trace_end(TRACE_CONFIRM);
 	low_battery_shutdown();
 
 	bpmp_clk_rate_set(is_t210() ? BPMP_CLK_LOWER_BOOST : BPMP_CLK_DEFAULT_BOOST);
 
 	get_cfg();
 
+	trace_begin(TRACE_BTN);
 	u8 btn = btn_read_vol();
+	trace_end(TRACE_BTN);
 
 	if(btn & BTN_VOL_DOWN && btn & BTN_VOL_UP && !sdloader_cfg.disable_ofw_btn_combo){
 		power_set_state(REBOOT_BYPASS_FUSES);
@@ -308,6 +500,7 @@ void main(){
 
 	bq24193_enable_charger();
 
+	bpmp_mmu_maint_set_phase(BOOT_PHASE_MENU);
 	do_menu();
 
 	gfx_clear_color(COL_BLACK);
@@ -67,6 +67,9 @@
 #define XUSB_RING_ADDR            (USB_EP_BULK_OUT_BUF_ADDR + USB_EP_BULK_OUT_MAX_XFER) //1.5K
 #define USB_EP_CONTROL_BUF_ADDR   (XUSB_RING_ADDR + SZ_1K + (SZ_1K / 2)) //1K
 
+// ums read-ahead, only used while ums runs
+#define UMS_READ_AHEAD_ADDR       (XUSB_RING_ADDR + SZ_4K) //32K
+#define UMS_READ_AHEAD_SZ         SZ_32K
 
 #define IPL_SMALL_FB_SZ           (SZ_32K + SZ_16K + SZ_8K + SZ_4K)
 
@@ -98,6 +101,10 @@
 #error Payload buffer too small
 #endif
 
+#if (UMS_READ_AHEAD_ADDR + UMS_READ_AHEAD_SZ) > IPL_SMALL_FB_ADDR
+#error UMS read-ahead overlaps the framebuffer
+#endif
+
 #endif
 
 
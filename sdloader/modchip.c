@@ -18,6 +18,7 @@ static sd_loader_cfg_t default_cfg = {
 	.default_action = MODCHIP_DEFAULT_ACTION_PAYLOAD,
 	.disable_menu_btn_combo = false,
 	.disable_ofw_btn_combo = false,
+	.boot_trace = false,
 };
 
 static void _init_mmc(){
@@ -35,7 +36,8 @@ void modchip_confirm_execution(){
 	sdmmc_cmd_t cmdbuf;
 	sdmmc_init_cmd(&cmdbuf, MMC_GO_IDLE_STATE, MODCHIP_MAGIC, SDMMC_RSP_TYPE_0, 0);
 	sdmmc_execute_cmd(&emmc_sdmmc, &cmdbuf, NULL, NULL);
-	sdmmc_end(&emmc_sdmmc);
+	// controller stays up in identification mode for the emmc init, which starts with its own GO_IDLE.
+	// sdmmc_end would only stop the controller, the emmc stays powered in the same state either way
 }
 
 void modchip_send(u8 *buf){
@@ -50,20 +52,122 @@ void modchip_send(u8 *buf){
 	req.is_write = 1;
 	req.is_multi_block = 0;
 	req.is_auto_stop_trn = 0;
+	req.is_auto_set_blkcnt = 0;
 	req.buf = buf;
 
 	sdmmc_execute_cmd(&emmc_sdmmc, &cmdbuf, &req, NULL);
 }
 
-bool modchip_get_cfg(sd_loader_cfg_t *cfg){
+static u32 _crc32(const u8 *buf, u32 len){
+	u32 crc = 0xffffffff;
+	while(len--){
+		crc ^= *buf++;
+		for(u32 i = 0; i < 8; i++){
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+		}
+	}
+	return ~crc;
+}
+
+static u32 _bus_cache_crc(const modchip_bus_cache_t *cache){
+	// sd and emmc entries are byte arrays, no padding in between
+	return _crc32((const u8*)&cache->sd, sizeof(cache->sd) + sizeof(cache->emmc));
+}
+
+// current record, as of the last load or commit
+static modchip_record_t record;
+
+// over seq as well, a write torn in the middle of it must not make the older record in that slot current
+static u32 _record_crc(const modchip_record_t *rec){
+	modchip_record_t tmp;
+	memcpy(&tmp, rec, sizeof(tmp));
+	tmp.crc = 0;
+	return _crc32((const u8*)&tmp, sizeof(tmp));
+}
+
+static bool _record_valid(const modchip_record_t *rec){
+	return rec->magic == MODCHIP_RECORD_MAGIC && rec->crc == _record_crc(rec);
+}
+
+// no slot written yet, take over what older versions kept in the cfg sector. their payload cache
+// has no volume serial and is left for the next boot to find the payload again
+static bool _record_import_legacy(){
+	u8 *buf = (u8*)SDMMC_UPPER_BUFFER;
+	const modchip_bus_cache_t *bus = (const modchip_bus_cache_t*)(buf + MODCHIP_BUS_CACHE_OFFSET);
+
+	if(disk_read(DEV_BOOT0, buf, MODCHIP_CFG_SECTOR, 1) != RES_OK){
+		return false;
+	}
+
+	memset(&record, 0, sizeof(record));
+	record.magic = MODCHIP_RECORD_MAGIC;
+	memcpy(&record.cfg, buf + MODCHIP_CFG_OFFSET, sizeof(record.cfg));
+
+	if(bus->magic == MODCHIP_MAGIC && bus->crc == _bus_cache_crc(bus)){
+		memcpy(&record.sd, &bus->sd, sizeof(bus->sd));
+		record.bus_valid = true;
+	}
+
+	return true;
+}
+
+// both slots in one go, after the first time from the diskio cache. a boot0 written around diskio
+// invalidates it and the next load sees the new record
+static bool _record_load(){
 	u8 *buf = (u8*)SDMMC_UPPER_BUFFER;
-	DRESULT res = disk_read(DEV_BOOT0, buf, MODCHIP_CFG_SECTOR, 1);
-	if(res == RES_OK){
-		memcpy(cfg, buf + MODCHIP_CFG_OFFSET, sizeof(*cfg));
-		return true;
+	if(disk_read(DEV_BOOT0, buf, MODCHIP_RECORD_SECTOR, MODCHIP_RECORD_SLOTS) != RES_OK){
+		return false;
 	}
 
-	return false;
+	const modchip_record_t *cur = NULL;
+	for(u32 i = 0; i < MODCHIP_RECORD_SLOTS; i++){
+		const modchip_record_t *rec = (const modchip_record_t*)(buf + i * 0x200);
+		if(_record_valid(rec) && (!cur || (s32)(rec->seq - cur->seq) > 0)){
+			cur = rec;
+		}
+	}
+
+	if(cur){
+		memcpy(&record, cur, sizeof(record));
+	}else if(!_record_import_legacy()){
+		return false;
+	}
+
+	return true;
+}
+
+// copy of the current record in the sdmmc buffer, modify it and pass it to _record_commit
+static modchip_record_t *_record_begin(){
+	if(!_record_load()){
+		return NULL;
+	}
+
+	u8 *buf = (u8*)SDMMC_UPPER_BUFFER;
+	memset(buf, 0, 0x200);
+	memcpy(buf, &record, sizeof(record));
+	return (modchip_record_t*)buf;
+}
+
+// a single write to the slot not holding the current record, a torn write leaves the current one intact
+static bool _record_commit(modchip_record_t *next){
+	next->seq = record.seq + 1;
+	next->crc = _record_crc(next);
+
+	if(disk_write(DEV_BOOT0, (u8*)next, MODCHIP_RECORD_SECTOR + next->seq % MODCHIP_RECORD_SLOTS, 1) != RES_OK){
+		return false;
+	}
+
+	memcpy(&record, next, sizeof(record));
+	return true;
+}
+
+bool modchip_get_cfg(sd_loader_cfg_t *cfg){
+	if(!_record_load()){
+		return false;
+	}
+
+	memcpy(cfg, &record.cfg, sizeof(*cfg));
+	return true;
 }
 
 void modchip_get_cfg_or_default(sd_loader_cfg_t *cfg){
@@ -73,12 +177,13 @@ void modchip_get_cfg_or_default(sd_loader_cfg_t *cfg){
 }
 
 bool modchip_set_cfg(sd_loader_cfg_t *cfg){
-	u8 *buf = (u8*)SDMMC_UPPER_BUFFER;
-	if(disk_read(DEV_BOOT0, buf, MODCHIP_CFG_SECTOR, 1) != RES_OK){
+	modchip_record_t *next = _record_begin();
+	if(!next){
 		return false;
 	}
-	memcpy(buf + MODCHIP_CFG_OFFSET, cfg, sizeof(*cfg));
-	return disk_write(DEV_BOOT0, buf, MODCHIP_CFG_SECTOR, 1) == RES_OK;
+
+	memcpy(&next->cfg, cfg, sizeof(next->cfg));
+	return _record_commit(next);
 }
 
 bool modchip_is_cfg_valid(sd_loader_cfg_t *cfg){
@@ -96,27 +201,132 @@ void modchip_get_cfg_default(sd_loader_cfg_t *cfg){
 	memcpy(cfg, &default_cfg, sizeof(*cfg));
 }
 
-static bool modchip_write_cmd(modchip_cmd_t *cmd){
+bool modchip_get_payload_cache(file_loc_t *loc){
+	if(!_record_load() || !record.payload_valid){
+		return false;
+	}
+
+	memcpy(loc, &record.payload_loc, sizeof(*loc));
+	return true;
+}
+
+// loc == NULL invalidates the cache
+bool modchip_set_payload_cache(const file_loc_t *loc){
+	modchip_record_t *next = _record_begin();
+	if(!next){
+		return false;
+	}
+
+	next->payload_valid = loc != NULL;
+	if(loc){
+		memcpy(&next->payload_loc, loc, sizeof(*loc));
+	}
+
+	return _record_commit(next);
+}
+
+bool modchip_get_bus_cache(sdmmc_bus_cache_t *sd){
+	if(!_record_load() || !record.bus_valid){
+		return false;
+	}
+
+	memcpy(sd, &record.sd, sizeof(*sd));
+	return true;
+}
+
+bool modchip_set_bus_cache(const sdmmc_bus_cache_t *sd){
+	modchip_record_t *next = _record_begin();
+	if(!next){
+		return false;
+	}
+
+	memcpy(&next->sd, sd, sizeof(next->sd));
+	next->bus_valid = true;
+
+	return _record_commit(next);
+}
+
+// the rest of the cmd sector is not ours, the read is served from the diskio cache after the first time
+static bool modchip_write_cmd_ex(modchip_cmd_t *cmd, u32 clear){
 	u8 *buf = (u8 *)SDMMC_UPPER_BUFFER;
 
 	if(disk_read(DEV_BOOT0, buf, MODCHIP_CMD_SECTOR, 1) != RES_OK){
 		return false;
 	}
 
-	memset(buf + MODCHIP_CMD_OFFSET, 0, 0x10);
+	memset(buf + MODCHIP_CMD_OFFSET, 0, clear);
 	memcpy(buf + MODCHIP_CMD_OFFSET, cmd, sizeof(*cmd));
 
 	return disk_write(DEV_BOOT0, buf, MODCHIP_CMD_SECTOR, 1) == RES_OK;
 }
 
+static bool modchip_write_cmd(modchip_cmd_t *cmd){
+	return modchip_write_cmd_ex(cmd, 0x10);
+}
+
+// boot0 is compared and read back through the end of the sdmmc buffer, images are read to its start
+#define BOOT0_CMP_SECTORS 16
+#define BOOT0_CMP_BUF     (SDMMC_UPPER_BUFFER + SDMMC_UP_BUF_SZ - BOOT0_CMP_SECTORS * 0x200)
+#define BOOT0_IMG_MAX     (SDMMC_UP_BUF_SZ - BOOT0_CMP_SECTORS * 0x200)
+// clean sectors between two dirty runs that are written along, cheaper than another command
+#define BOOT0_MERGE_GAP   4
+
+#if BOOT0_IMG_MAX < MODCHIP_BL_MAX_SIZE
+#error Image buffer too small for the compare buffer
+#endif
+
+// updates mostly change a few sectors, only sectors that differ from boot0 are written, runs of them
+// close to each other with a single command. everything is read back afterwards
+static bool modchip_write_boot0(const u8 *buf, u32 sector, u32 cnt){
+	u8 *cmp = (u8*)BOOT0_CMP_BUF;
+	u32 run_start = 0, run_end = 0;
+
+	for(u32 ofs = 0; ofs < cnt; ofs += BOOT0_CMP_SECTORS){
+		u32 n = MIN(cnt - ofs, BOOT0_CMP_SECTORS);
+		// an unreadable chunk is simply rewritten
+		bool read = disk_read(DEV_BOOT0, cmp, sector + ofs, n) == RES_OK;
+
+		for(u32 i = ofs; i < ofs + n; i++){
+			if(read && !memcmp(cmp + (i - ofs) * 0x200, buf + i * 0x200, 0x200)){
+				continue;
+			}
+
+			if(run_end && i - run_end > BOOT0_MERGE_GAP){
+				if(disk_write(DEV_BOOT0, buf + run_start * 0x200, sector + run_start, run_end - run_start) != RES_OK){
+					return false;
+				}
+				run_end = 0;
+			}
+			if(!run_end){
+				run_start = i;
+			}
+			run_end = i + 1;
+		}
+	}
+
+	if(run_end && disk_write(DEV_BOOT0, buf + run_start * 0x200, sector + run_start, run_end - run_start) != RES_OK){
+		return false;
+	}
+
+	// the cfg and cmd sectors would come from the diskio cache
+	disk_cache_invalidate();
+
+	for(u32 ofs = 0; ofs < cnt; ofs += BOOT0_CMP_SECTORS){
+		u32 n = MIN(cnt - ofs, BOOT0_CMP_SECTORS);
+		if(disk_read(DEV_BOOT0, cmp, sector + ofs, n) != RES_OK || memcmp(cmp, buf + ofs * 0x200, n * 0x200)){
+			return false;
+		}
+	}
+
+	return true;
+}
+
 // buf must be multiple of 512
 bool modchip_write_fw_update(u8 *buf, u32 size){
 	u32 sec_cnt = (size + 0x1ff) / 0x200;
 
 	// modchip will overwrite our config and fw descriptor when applying update/resetting
-	DRESULT res = disk_write(DEV_BOOT0, buf, MODCHIP_FW_START_SECTOR, sec_cnt);
-
-	if(res == RES_OK){
+	if(modchip_write_boot0(buf, MODCHIP_FW_START_SECTOR, sec_cnt)){
 		// fw image written, now issue fw update command. if this fails, not much we can do
 		return modchip_write_fw_update_cmd(MODCHIP_FW_START_SECTOR, sec_cnt);
 	}else{
@@ -134,9 +344,9 @@ bool modchip_write_fw_update_from_file(FIL *f){
 	u32 br;
 
 	// we can read entire fw update into memory first
-	if(size < SDMMC_UP_BUF_SZ){
+	if(size < BOOT0_IMG_MAX){
 		memset(buf + (size & ~(0x200 - 1)), 0, 0x200);
-		f_res = f_read(f, buf, size, &br);
+		f_res = read_file_fast(f, buf, size, &br);
 		if(f_res != FR_OK || br != size){
 			return false;
 		}
@@ -144,7 +354,7 @@ bool modchip_write_fw_update_from_file(FIL *f){
 		return modchip_write_fw_update(buf, size);
 	}
 
-	u32 max_btr = SDMMC_UP_BUF_SZ & ~(0x200 - 1);
+	u32 max_btr = BOOT0_IMG_MAX & ~(0x200 - 1);
 	for(u32 i = 0; i < size; i += max_btr){
 		u32 btr = MIN((size - i), max_btr);
 
@@ -153,20 +363,20 @@ bool modchip_write_fw_update_from_file(FIL *f){
 
 		}
 
-		f_res = f_read(f, buf, btr, &br);
+		f_res = read_file_fast(f, buf, btr, &br);
 		if(f_res != FR_OK || br != btr){
 			res = false;
 			break;
 		}
 
-		if(disk_write(DEV_BOOT0, buf, MODCHIP_FW_START_SECTOR + (i / 0x200), (btr + (0x200 - 1)) / 0x200) != RES_OK){
+		if(!modchip_write_boot0(buf, MODCHIP_FW_START_SECTOR + (i / 0x200), (btr + (0x200 - 1)) / 0x200)){
 			res = false;
 			break;
 		}
 	}
 
 	if(res){
-		return modchip_write_fw_update_cmd(MODCHIP_FW_START_SECTOR, (size + (0x200 - 1) / 0x200));
+		return modchip_write_fw_update_cmd(MODCHIP_FW_START_SECTOR, (size + (0x200 - 1)) / 0x200);
 	}else{
 		modchip_write_rst_cmd();
 		return false;
@@ -176,7 +386,7 @@ bool modchip_write_fw_update_from_file(FIL *f){
 // buf must be multiple of 512
 bool modchip_write_ipl_update(u8 *buf, u32 size){
 	u32 sec_cnt = (size + (0x200 - 1)) / 0x200;
-	if(disk_write(DEV_BOOT0, buf, MODCHIP_BL_START_SECTOR, sec_cnt) != RES_OK){
+	if(!modchip_write_boot0(buf, MODCHIP_BL_START_SECTOR, sec_cnt)){
 		modchip_write_rst_cmd();
 		return false;
 	}
@@ -188,13 +398,13 @@ bool modchip_write_ipl_update_from_file(FIL *f){
 	u8 *buf = (u8*)SDMMC_UPPER_BUFFER;
 	u32 br;
 
-	if(size > SDMMC_UP_BUF_SZ){
+	if(size >= BOOT0_IMG_MAX){
 		return false;
 	}
 
 	memset(buf + (size & ~(0x200 - 1)), 0, 0x200);
 
-	FRESULT res = f_read(f, buf, size, &br);
+	FRESULT res = read_file_fast(f, buf, size, &br);
 
 	if(res != FR_OK || br != size){
 		return false;
@@ -206,12 +416,8 @@ bool modchip_write_ipl_update_from_file(FIL *f){
 bool modchip_write_rst_cmd(){
 	modchip_cmd_t cmd = {0};
 	cmd.cmd = MODCHIP_CMD_RST;
-	u8 *buf = (u8*)SDMMC_UPPER_BUFFER;
-	if(!disk_read(DEV_BOOT0, buf, 1, 1)){
-		return false;
-	}
-	memset(buf, 0, 256);
-	return disk_write(DEV_BOOT0, buf, 1, 1) && modchip_write_cmd(&cmd);
+	// the modchip area of the cmd sector is cleared and the command placed in the same write
+	return modchip_write_cmd_ex(&cmd, 256);
 }
 
 bool modchip_write_fw_update_cmd(u32 sector_start, u32 sector_cnt){
@@ -253,9 +459,7 @@ bool modchip_write_bl_update(u8 *buf, u32 size){
 	u32 sec_cnt = (size + 0x1ff) / 0x200;
 
 	// modchip will overwrite our config and fw descriptor when applying update/resetting
-	DRESULT res = disk_write(DEV_BOOT0, buf, MODCHIP_RP_BL_START_SECTOR, sec_cnt);
-
-	if(res == RES_OK){
+	if(modchip_write_boot0(buf, MODCHIP_RP_BL_START_SECTOR, sec_cnt)){
 		// fw image written, now issue fw update command. if this fails, not much we can do
 		return modchip_write_bl_update_cmd(MODCHIP_RP_BL_START_SECTOR, sec_cnt);
 	}else{
@@ -270,13 +474,13 @@ bool modchip_write_bl_update_from_file(FIL *f){
 	u8 *buf = (u8*)SDMMC_UPPER_BUFFER;
 	u32 br;
 
-	if(size > SDMMC_UP_BUF_SZ){
+	if(size >= BOOT0_IMG_MAX){
 		return false;
 	}
 
 	memset(buf + (size & ~(0x200 - 1)), 0xff, 0x200);
 
-	FRESULT res = f_read(f, buf, size, &br);
+	FRESULT res = read_file_fast(f, buf, size, &br);
 
 	if(res != FR_OK || br != size){
 		return false;
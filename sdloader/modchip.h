@@ -3,6 +3,8 @@
 
 #include <utils/types.h>
 #include <libs/fatfs/ff.h>
+#include "files.h"
+#include <storage/sdmmc.h>
 
 // last 64kb of boot0
 #define MODCHIP_BL_START_SECTOR   0x1f80
@@ -25,7 +27,14 @@
 
 #define MODCHIP_DESC_OFFSET       0x0
 #define MODCHIP_CMD_OFFSET        0x0
+// where older versions kept their state, only read to import it into the record
 #define MODCHIP_CFG_OFFSET        0x100
+#define MODCHIP_BUS_CACHE_OFFSET  0x140
+
+// sdloader state, two slots right below the trace sector, written alternately
+#define MODCHIP_RECORD_SECTOR     0x1efd
+#define MODCHIP_RECORD_SLOTS      2
+#define MODCHIP_RECORD_MAGIC      0x52524453 // "SDRR"
 
 #define MODCHIP_DESC_SIGNATURE    0x9cabe959
 
@@ -61,8 +70,40 @@ typedef struct{
 	u8 default_action:2;
 	u8 disable_ofw_btn_combo:1;
 	u8 disable_menu_btn_combo:1; // DO NOT USE, menu can't be forced to show otherwise
+	u8 boot_trace:1; // boot stage timings to boot0, one sector write per boot
 }sd_loader_cfg_t;
 
+// bus cache entry as the legacy layout has it, before the retry counters
+typedef struct{
+	u8 raw_cid[0x10];
+	u8 mode;
+	u8 type;
+	u8 tap;
+	u8 tuned;
+}modchip_bus_entry_legacy_t;
+
+// last working bus mode and tuning tap of sd and emmc, legacy layout in the cfg sector
+typedef struct{
+	u32 magic;
+	modchip_bus_entry_legacy_t sd;
+	modchip_bus_entry_legacy_t emmc;
+	u32 crc;
+}modchip_bus_cache_t;
+
+// the valid slot with the highest seq is current, record seq always lives in slot seq % MODCHIP_RECORD_SLOTS
+typedef struct{
+	u32 magic;
+	u32 seq;
+	u32 crc;            // over the whole record with crc as 0
+	u8  payload_valid;
+	u8  bus_valid;
+	u16 rsvd;
+	sd_loader_cfg_t cfg;
+	file_loc_t payload_loc;
+	// emmc has no entry, boot0 is only readable once emmc is up
+	sdmmc_bus_cache_t sd;
+}modchip_record_t;
+
 typedef enum{
 	MODCHIP_DEFAULT_ACTION_PAYLOAD = 0x0,
 	MODCHIP_DEFAULT_ACTION_OFW     = 0x1,
@@ -83,6 +124,10 @@ void modchip_get_cfg_default(sd_loader_cfg_t *cfg);
 bool modchip_set_cfg(sd_loader_cfg_t *cfg);
 bool modchip_is_cfg_valid(sd_loader_cfg_t *cfg);
 bool modchip_clear_cfg();
+bool modchip_get_payload_cache(file_loc_t *loc);
+bool modchip_set_payload_cache(const file_loc_t *loc);
+bool modchip_get_bus_cache(sdmmc_bus_cache_t *sd);
+bool modchip_set_bus_cache(const sdmmc_bus_cache_t *sd);
 void modchip_confirm_execution();
 void modchip_send(unsigned char *buf);
 
@@ -1,8 +1,13 @@
+#include "bench.h"
 #include "files.h"
 #include "modchip.h"
+#include "modchip_toolbox.h"
+#include "trace.h"
 #include <libs/fatfs/ff.h>
+#include <soc/bpmp.h>
 #include <soc/timer.h>
 #include <storage/emmc.h>
+#include <storage/sd.h>
 #include <string.h>
 #include <tui.h>
 #include <gfx.h>
@@ -110,6 +115,75 @@ void info_cb(void *data, tui_entry_t *entry, tui_entry_menu_t *menu){
 	menu->colors = &TUI_COLOR_SCHEME_DEFAULT;
 }
 
+// newest boot first: sequence, time until the last point and the slowest stage in ms
+static void boot_trace_str(char str[TRACE_MAX_BOOTS][26]){
+	trace_sector_t sector;
+	bool valid = trace_load(&sector);
+
+	for(u32 i = 0; i < TRACE_MAX_BOOTS; i++){
+		const trace_boot_t *boot = &sector.boots[(sector.next + TRACE_MAX_BOOTS - 1 - i) % TRACE_MAX_BOOTS];
+		u32 total_us;
+		u8 id;
+
+		str[i][0] = 0;
+		if(!valid || !boot->cnt){
+			continue;
+		}
+
+		u32 slowest_us = trace_slowest(boot, &id, &total_us);
+		s_printf(&str[i][0], "%4d %5d %.8s %5d", boot->seq % 10000, MIN(total_us / 1000, 99999),
+			trace_name(id), MIN(slowest_us / 1000, 99999));
+	}
+}
+
+static void maint_stats_cb(void *data, tui_entry_t *entry, tui_entry_menu_t *menu){
+	static const char *phase_names[BOOT_PHASE_MAX] = {"Cfg ", "Load", "Menu"};
+	char stats_str[BOOT_PHASE_MAX][26];
+	char trace_str[TRACE_MAX_BOOTS][26];
+
+	menu->colors = &TUI_COLOR_SCHEME_SHADOW;
+	tui_print_menu(menu);
+
+	for(u32 i = 0; i < BOOT_PHASE_MAX; i++){
+		const bpmp_mmu_maint_stats_t *stats = bpmp_mmu_maint_get_stats(i);
+		s_printf(&stats_str[i][0], "%s:%7dus %3dw %4dl", phase_names[i], stats->time_us > 9999999 ? 9999999 : stats->time_us,
+			stats->way_ops > 999 ? 999 : stats->way_ops, stats->lines > 9999 ? 9999 : stats->lines);
+	}
+
+	boot_trace_str(trace_str);
+
+	tui_entry_t menu_entries[] = {
+		[0] = TUI_ENTRY_TEXT_DISABLED(stats_str[BOOT_PHASE_CFG],     &menu_entries[1]),
+		[1] = TUI_ENTRY_TEXT_DISABLED(stats_str[BOOT_PHASE_PAYLOAD], &menu_entries[2]),
+		[2] = TUI_ENTRY_TEXT_DISABLED(stats_str[BOOT_PHASE_MENU],    &menu_entries[3]),
+		[3] = TUI_ENTRY_TEXT_DISABLED("Boot Total Slowest     ms", &menu_entries[4]),
+		[4] = TUI_ENTRY_TEXT_DISABLED(trace_str[0],                  &menu_entries[5]),
+		[5] = TUI_ENTRY_TEXT_DISABLED(trace_str[1],                  &menu_entries[6]),
+		[6] = TUI_ENTRY_TEXT_DISABLED(trace_str[2],                  &menu_entries[7]),
+		[7] = TUI_ENTRY_TEXT_DISABLED(trace_str[3],                  &menu_entries[8]),
+		[8] = TUI_ENTRY_BACK(NULL),
+	};
+
+	tui_entry_menu_t stats_menu = {
+		.entries    = menu_entries,
+		.title      = {
+			.text = "IPL Stats"
+		},
+		.pos_x      = menu->pos_x + (menu->width * 8 + 8),
+		.pos_y      = menu->pos_y,
+		.pad        = 25,
+		.height     = ARRAY_SIZE(menu_entries) + 2,
+		.width      = 25,
+		.colors     = &TUI_COLOR_SCHEME_DEFAULT,
+		.timeout_ms = 0,
+		.show_title = true,
+	};
+
+	tui_menu_start_rot(&stats_menu);
+
+	menu->colors = &TUI_COLOR_SCHEME_DEFAULT;
+}
+
 static void confirm_menu(const char *title, tui_action_modifying_cb_t cb, tui_entry_menu_t *menu, void *data){
 	menu->colors = &TUI_COLOR_SCHEME_SHADOW;
 	tui_print_menu(menu);
@@ -440,6 +514,92 @@ static void ofw_btn_cb(void *data, tui_entry_t *entry, tui_entry_menu_t *menu){
 	ofw_btn_update(cfg, entry, menu);
 }
 
+static void boot_trace_update(sd_loader_cfg_t *vol_cfg, tui_entry_t *entry, tui_entry_menu_t *menu){
+	s_printf((char*)entry->title.text, "Boot trace   %s", vol_cfg->boot_trace ? "Enabled" : "Disabled");
+}
+
+// off by default, saving the trace writes boot0 on every boot
+static void boot_trace_cb(void *data, tui_entry_t *entry, tui_entry_menu_t *menu){
+	sd_loader_cfg_t *cfg = (sd_loader_cfg_t*)data;
+
+	cfg->boot_trace = !cfg->boot_trace;
+
+	boot_trace_update(cfg, entry, menu);
+}
+
+// mode, sequential MB/s, random 4KB reads/s and errors, the chosen mode is marked
+static void bench_str(char *str, const bench_result_t *res, bool best){
+	if(!res->ok){
+		s_printf(str, "%.6s    --    --  --", res->name);
+		return;
+	}
+
+	s_printf(str, "%.6s %3d.%d %5d %3d%s", res->name, MIN(res->seq_kbs / 1024, 999), (res->seq_kbs % 1024) * 10 / 1024,
+		MIN(res->rnd_iops, 99999), MIN(res->errors, 999), best ? "*" : "");
+}
+
+static void bench_cb(void *data, tui_entry_t *entry, tui_entry_menu_t *menu){
+	bench_result_t sd_res[BENCH_MODES];
+	bench_result_t emmc_res[BENCH_MODES];
+	char sd_str[BENCH_MODES][26];
+	char emmc_str[BENCH_MODES][26];
+
+	menu->colors = &TUI_COLOR_SCHEME_SHADOW;
+	tui_print_menu(menu);
+
+	tui_print_status(COL_TEAL, "Measuring bus modes...");
+
+	int sd_best = bench_sd(sd_res);
+	int emmc_best = bench_emmc(emmc_res);
+
+	for(int i = 0; i < BENCH_MODES; i++){
+		bench_str(&sd_str[i][0], &sd_res[i], i == sd_best);
+		bench_str(&emmc_str[i][0], &emmc_res[i], i == emmc_best);
+	}
+
+	// the modes picked are in the live bus caches now. boot0 keeps the sd one for later boots, a picked
+	// mode starts over without retry counts. the emmc one lasts until power off
+	sdmmc_bus_cache_t cache = *sd_storage.bus_cache;
+	cache.boots = 0;
+	cache.fails = 0;
+	if(emmc_session_init() && modchip_set_bus_cache(&cache)){
+		tui_print_status(COL_TEAL, "Bus modes saved!");
+	}else{
+		tui_print_status(COL_ORANGE, "Failed to save bus modes!");
+	}
+
+	tui_entry_t menu_entries[] = {
+		[0] = TUI_ENTRY_TEXT_DISABLED("SD      MB/s  IO/s Err", &menu_entries[1]),
+		[1] = TUI_ENTRY_TEXT_DISABLED(sd_str[0],   &menu_entries[2]),
+		[2] = TUI_ENTRY_TEXT_DISABLED(sd_str[1],   &menu_entries[3]),
+		[3] = TUI_ENTRY_TEXT_DISABLED(sd_str[2],   &menu_entries[4]),
+		[4] = TUI_ENTRY_TEXT_DISABLED("eMMC    MB/s  IO/s Err", &menu_entries[5]),
+		[5] = TUI_ENTRY_TEXT_DISABLED(emmc_str[0], &menu_entries[6]),
+		[6] = TUI_ENTRY_TEXT_DISABLED(emmc_str[1], &menu_entries[7]),
+		[7] = TUI_ENTRY_TEXT_DISABLED(emmc_str[2], &menu_entries[8]),
+		[8] = TUI_ENTRY_BACK(NULL),
+	};
+
+	tui_entry_menu_t bench_menu = {
+		.entries    = menu_entries,
+		.title      = {
+			.text = "Bus Benchmark"
+		},
+		.pos_x      = menu->pos_x,
+		.pos_y      = menu->pos_y,
+		.pad        = 25,
+		.height     = ARRAY_SIZE(menu_entries) + 2,
+		.width      = 25,
+		.colors     = &TUI_COLOR_SCHEME_DEFAULT,
+		.timeout_ms = 0,
+		.show_title = true,
+	};
+
+	tui_menu_start_rot(&bench_menu);
+
+	menu->colors = &TUI_COLOR_SCHEME_DEFAULT;
+}
+
 static void ipl_settings_cb(void *data, tui_entry_t *entry, tui_entry_menu_t *menu){
 	sd_loader_cfg_t *cfg = (sd_loader_cfg_t*)data;
 	sd_loader_cfg_t temp_cfg = *cfg;
@@ -455,15 +615,18 @@ static void ipl_settings_cb(void *data, tui_entry_t *entry, tui_entry_menu_t *me
 	char default_vol_str[30] = "";
 	char default_action_str[30] = "";
 	char ofw_btn_str[30] = "";
+	char trace_str[30] = "";
 
 	tui_entry_t menu_entries[] = {
 		[0] = TUI_ENTRY_ACTION_MODIFYING_NO_BLANK(default_vol_str, default_vol_cb, &temp_cfg, false, &menu_entries[1]),
 		[1] = TUI_ENTRY_ACTION_MODIFYING_NO_BLANK(default_action_str, default_action_cb, &temp_cfg, false, &menu_entries[2]),
 		[2] = TUI_ENTRY_ACTION_MODIFYING_NO_BLANK(ofw_btn_str, ofw_btn_cb, &temp_cfg, false, &menu_entries[3]),
-		[3] = TUI_ENTRY_TEXT("", &menu_entries[4]),
-		[4] = TUI_ENTRY_ACTION_NO_BLANK("Save", save_settings_cb, &save_settings_data, false, &menu_entries[5]),
-		[5] = TUI_ENTRY_TEXT("\n", &menu_entries[6]),
-		[6] = TUI_ENTRY_BACK(NULL),
+		[3] = TUI_ENTRY_ACTION_MODIFYING_NO_BLANK(trace_str, boot_trace_cb, &temp_cfg, false, &menu_entries[4]),
+		[4] = TUI_ENTRY_ACTION_MODIFYING_NO_BLANK("Bus speed    Benchmark", bench_cb, NULL, false, &menu_entries[5]),
+		[5] = TUI_ENTRY_TEXT("", &menu_entries[6]),
+		[6] = TUI_ENTRY_ACTION_NO_BLANK("Save", save_settings_cb, &save_settings_data, false, &menu_entries[7]),
+		[7] = TUI_ENTRY_TEXT("\n", &menu_entries[8]),
+		[8] = TUI_ENTRY_BACK(NULL),
 	};
 
 
@@ -485,6 +648,7 @@ static void ipl_settings_cb(void *data, tui_entry_t *entry, tui_entry_menu_t *me
 	default_vol_update(cfg, &menu_entries[0], &settings_menu);
 	default_action_update(cfg, &menu_entries[1], &settings_menu);
 	ofw_btn_update(cfg, &menu_entries[2], &settings_menu);
+	boot_trace_update(cfg, &menu_entries[3], &settings_menu);
 
 	tui_menu_start_rot(&settings_menu);
 
@@ -492,7 +656,7 @@ static void ipl_settings_cb(void *data, tui_entry_t *entry, tui_entry_menu_t *me
 }
 
 void toolbox(u32 x, u32 y, sd_loader_cfg_t *cfg){
-	emmc_initialize(false);
+	emmc_session_init();
 
 	tui_entry_t menu_entries[] = {
 		[0] = TUI_ENTRY_ACTION_MODIFYING_NO_BLANK("FW  Info", info_cb, NULL, false, &menu_entries[1]),
@@ -502,8 +666,9 @@ void toolbox(u32 x, u32 y, sd_loader_cfg_t *cfg){
 		[4] = TUI_ENTRY_ACTION_MODIFYING_NO_BLANK("IPL Update", ipl_update_cb, NULL, command_pending, &menu_entries[5]),
 		[5] = TUI_ENTRY_ACTION_MODIFYING_NO_BLANK("IPL Settings", ipl_settings_cb, cfg, false, &menu_entries[6]),
 		[6] = TUI_ENTRY_ACTION_MODIFYING_NO_BLANK("BL  Update", bl_update_cb, NULL, command_pending, &menu_entries[7]),
+		[7] = TUI_ENTRY_ACTION_MODIFYING_NO_BLANK("IPL Stats", maint_stats_cb, NULL, false, &menu_entries[8]),
 		// [6] = TUI_ENTRY_TEXT("", &menu_entries[7]),
-		[7] = TUI_ENTRY_BACK(NULL)
+		[8] = TUI_ENTRY_BACK(NULL)
 	};
 
 	tui_entry_menu_t menu = {
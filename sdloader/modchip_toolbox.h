@@ -4,6 +4,14 @@
 #include "modchip.h"
 #include <utils/types.h>
 
+// boot phases cache maintenance is accounted to, see bpmp_mmu_maint_set_phase
+typedef enum{
+	BOOT_PHASE_CFG = 0,
+	BOOT_PHASE_PAYLOAD,
+	BOOT_PHASE_MENU,
+	BOOT_PHASE_MAX
+}boot_phase_t;
+
 void toolbox(u32 x, u32 y, sd_loader_cfg_t *cfg);
 
 #endif
\ No newline at end of file
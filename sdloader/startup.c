@@ -15,7 +15,7 @@ void main();
 __attribute__((noreturn)) void ipl_main(){
 	hw_init();
 	pivot_stack(IPL_STACK_TOP);
-	heap_init((void*)IPL_HEAP_START);
+	heap_init((void*)IPL_HEAP_START, IPL_HEAP_SIZE_MAX);
 
 	mc_enable_ahb_redirect();
 
@@ -12,6 +12,9 @@
 #include <storage/emmc.h>
 #include <storage/sd.h>
 #include <storage/sdmmc.h>
+#include <string.h>
+#include "modchip.h"
+#include "trace.h"
 
 /* Definitions of physical drive number for each drive */
 
@@ -21,6 +24,22 @@
 /* Get Drive Status                                                      */
 /*-----------------------------------------------------------------------*/
 
+// map physical drive to backing storage, translate sector if needed
+static sdmmc_storage_t *get_storage(BYTE pdrv, u32 *sector){
+	switch (pdrv) {
+	case DEV_BOOT0:
+	case DEV_BOOT1:
+	case DEV_GPP:
+		return &emmc_storage;
+	case DEV_BOOT1_1MB:
+		*sector += (0x100000 / 512);
+		return &emmc_storage;
+	case DEV_SD:
+	default:
+		return &sd_storage;
+	}
+}
+
 static bool ensure_partition(BYTE pdrv){
 	u8 part;
 	switch (pdrv) {
@@ -35,6 +54,7 @@ static bool ensure_partition(BYTE pdrv){
 		part = EMMC_BOOT0;
 		break;
 	case DEV_SD:
+	default:
 		return true;
 	}
 
@@ -44,6 +64,72 @@ static bool ensure_partition(BYTE pdrv){
 	return true;
 }
 
+// boot0 metadata is read again and again during a boot while the payload comes from another partition,
+// every sector kept here saves a partition switch. cfg and fw descriptor share MODCHIP_CFG_SECTOR,
+// the sdloader record alternates between its two slots
+#define META_CACHE_SECTORS 4
+
+static const u32 meta_sectors[META_CACHE_SECTORS] = {
+	MODCHIP_CFG_SECTOR, MODCHIP_CMD_SECTOR, MODCHIP_RECORD_SECTOR, MODCHIP_RECORD_SECTOR + 1
+};
+
+static struct{
+	u8 buf[0x200];
+	bool valid;
+}meta_cache[META_CACHE_SECTORS];
+
+static int meta_cache_idx(BYTE pdrv, u32 sector){
+	if(pdrv == DEV_BOOT0){
+		for(int i = 0; i < META_CACHE_SECTORS; i++){
+			if(meta_sectors[i] == sector){
+				return i;
+			}
+		}
+	}
+	return -1;
+}
+
+// only a range that is cached as a whole, anything else goes to the card
+static bool meta_cache_read(BYTE pdrv, BYTE *buff, u32 sector, u32 count){
+	if(pdrv != DEV_BOOT0 || count > META_CACHE_SECTORS){
+		return false;
+	}
+
+	for(u32 i = 0; i < count; i++){
+		int idx = meta_cache_idx(pdrv, sector + i);
+		if(idx < 0 || !meta_cache[idx].valid){
+			return false;
+		}
+	}
+
+	for(u32 i = 0; i < count; i++){
+		memcpy(buff + i * 0x200, meta_cache[meta_cache_idx(pdrv, sector + i)].buf, 0x200);
+	}
+	return true;
+}
+
+// write through, a failed write leaves the sectors in an unknown state
+static void meta_cache_update(BYTE pdrv, const BYTE *buff, u32 sector, u32 count, bool ok){
+	if(pdrv != DEV_BOOT0){
+		return;
+	}
+
+	for(int i = 0; i < META_CACHE_SECTORS; i++){
+		if(meta_sectors[i] >= sector && meta_sectors[i] - sector < count){
+			meta_cache[i].valid = ok;
+			if(ok){
+				memcpy(meta_cache[i].buf, buff + (meta_sectors[i] - sector) * 0x200, 0x200);
+			}
+		}
+	}
+}
+
+void disk_cache_invalidate(){
+	for(int i = 0; i < META_CACHE_SECTORS; i++){
+		meta_cache[i].valid = false;
+	}
+}
+
 DSTATUS disk_status (
 	BYTE pdrv		/* Physical drive nmuber to identify the drive */
 )
@@ -64,20 +150,28 @@ DSTATUS disk_initialize (
 	bool res = true;
 	switch (pdrv) {
 	case DEV_SD:
+		trace_begin(TRACE_SD_INIT);
 		res &= sd_initialize(false);
+		trace_end(TRACE_SD_INIT);
 		break;
 	case DEV_BOOT1:
 	case DEV_BOOT1_1MB:
-		res &= emmc_initialize(false);
-		res &= emmc_set_partition(EMMC_BOOT1);
+		trace_begin(TRACE_EMMC_INIT);
+		res &= emmc_session_init();
+		trace_end(TRACE_EMMC_INIT);
+		res &= ensure_partition(DEV_BOOT1);
 		break;
 	case DEV_BOOT0:
-		res &= emmc_initialize(false);
-		res &= emmc_set_partition(EMMC_BOOT0);
+		trace_begin(TRACE_EMMC_INIT);
+		res &= emmc_session_init();
+		trace_end(TRACE_EMMC_INIT);
+		res &= ensure_partition(DEV_BOOT0);
 		break;
 	case DEV_GPP:
-		res &= emmc_initialize(false);
-		res &= emmc_set_partition(0);
+		trace_begin(TRACE_EMMC_INIT);
+		res &= emmc_session_init();
+		trace_end(TRACE_EMMC_INIT);
+		res &= ensure_partition(DEV_GPP);
 		break;
 	}
 
@@ -97,24 +191,75 @@ DRESULT disk_read (
 	UINT count		/* Number of sectors to read */
 )
 {
-	sdmmc_storage_t *storage = &sd_storage;
 	u32 actual_sector = sector;
+	sdmmc_storage_t *storage = get_storage(pdrv, &actual_sector);
 
-	switch (pdrv) {
-	case DEV_BOOT0:
-	case DEV_BOOT1:
-	case DEV_GPP:
-		storage = &emmc_storage;
-		break;
-	case DEV_BOOT1_1MB:
-		storage = &emmc_storage;
-		actual_sector = sector + (0x100000 / 512);
-		break;
+	if(meta_cache_read(pdrv, buff, sector, count)){
+		return RES_OK;
+	}
+
+	if(!ensure_partition(pdrv) || !sdmmc_storage_read(storage, actual_sector, count, buff)){
+		return RES_ERROR;
 	}
 
-	ensure_partition(pdrv);
+	meta_cache_update(pdrv, buff, sector, count, true);
 
-	return sdmmc_storage_read(storage, actual_sector, count, buff) ? RES_OK : RES_ERROR;
+	return RES_OK;
+}
+
+// queued reads run while the caller works on earlier ones, they are collected in order.
+// the partition must not change in between, reads of other drives on the same storage wait for them
+DRESULT disk_read_queue (
+	BYTE pdrv,
+	BYTE *buff,
+	LBA_t sector,
+	UINT count
+)
+{
+	u32 actual_sector = sector;
+	sdmmc_storage_t *storage = get_storage(pdrv, &actual_sector);
+
+	if(storage->queue_cnt == SDMMC_STORAGE_QUEUE_SIZE){
+		return RES_NOTRDY;
+	}
+
+	if(!ensure_partition(pdrv) || !sdmmc_storage_read_async(storage, actual_sector, count, buff)){
+		return RES_ERROR;
+	}
+
+	return RES_OK;
+}
+
+DRESULT disk_read_wait (
+	BYTE pdrv
+)
+{
+	u32 sector = 0;
+	return sdmmc_storage_async_wait(get_storage(pdrv, &sector)) ? RES_OK : RES_ERROR;
+}
+
+// consecutive sectors into two buffers with a single command
+DRESULT disk_read_split (
+	BYTE pdrv,
+	BYTE *buff,
+	UINT count,
+	BYTE *buff2,
+	UINT count2,
+	LBA_t sector
+)
+{
+	u32 actual_sector = sector;
+	sdmmc_storage_t *storage = get_storage(pdrv, &actual_sector);
+	sdmmc_sg_t sg[2] = {
+		{buff, count * 0x200},
+		{buff2, count2 * 0x200},
+	};
+
+	if(!ensure_partition(pdrv) || !sdmmc_storage_read_sg(storage, actual_sector, sg, 2)){
+		return RES_ERROR;
+	}
+
+	return RES_OK;
 }
 
 DRESULT disk_write (
@@ -124,29 +269,23 @@ DRESULT disk_write (
 	UINT count		/* Number of sectors to read */
 )
 {
-	sdmmc_storage_t *storage = &sd_storage;
 	u32 actual_sector = sector;
-
-	switch (pdrv) {
-	case DEV_BOOT0:
-	case DEV_BOOT1:
-	case DEV_GPP:
-		storage = &emmc_storage;
-		break;
-	case DEV_BOOT1_1MB:
-		storage = &emmc_storage;
-		actual_sector = sector + (0x100000 / 512);
-		break;
-	}
-
-	ensure_partition(pdrv);
+	sdmmc_storage_t *storage = get_storage(pdrv, &actual_sector);
 
 	// we only ever want to write to boot0, return error if trying to write to anyting else
+	// checked first, a rejected write must not cost a partition switch
 	if(pdrv == DEV_GPP || pdrv == DEV_BOOT1 || pdrv == DEV_BOOT1_1MB || pdrv == DEV_SD){
 		return RES_ERROR;
 	}
 
-	return sdmmc_storage_write(storage, actual_sector, count, (u8*)buff) ? RES_OK : RES_ERROR;
+	if(!ensure_partition(pdrv)){
+		return RES_ERROR;
+	}
+
+	bool ok = sdmmc_storage_write(storage, actual_sector, count, (u8*)buff);
+	meta_cache_update(pdrv, buff, sector, count, ok);
+
+	return ok ? RES_OK : RES_ERROR;
 }
 
 /*-----------------------------------------------------------------------*/
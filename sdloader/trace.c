@@ -0,0 +1,133 @@
+#include "trace.h"
+#include "memory_map.h"
+#include <libs/fatfs/ff.h>
+#include <libs/fatfs/diskio.h>
+#include <soc/timer.h>
+#include <storage/emmc.h>
+#include <storage/sdmmc.h>
+#include <string.h>
+
+static const char *trace_names[TRACE_ID_MAX] = {
+	[TRACE_CONFIRM]   = "confirm",
+	[TRACE_GET_CFG]   = "get_cfg",
+	[TRACE_BTN]       = "btn",
+	[TRACE_SD_INIT]   = "sd_init",
+	[TRACE_EMMC_INIT] = "emmc_ini",
+	[TRACE_MOUNT]     = "mount",
+	[TRACE_F_OPEN]    = "f_open",
+	[TRACE_F_READ]    = "f_read",
+	[TRACE_DISPLAY]   = "display",
+	[TRACE_RELOC]     = "reloc",
+};
+
+static trace_boot_t trace_cur;
+
+static void trace_point(u8 id){
+	if(trace_cur.cnt == 0xff){
+		return;
+	}
+
+	u32 us = get_tmr_us();
+	trace_point_t *p = &trace_cur.points[trace_cur.cnt % TRACE_MAX_POINTS];
+	p->id = id;
+	p->us = MIN(us, 0xffffff);
+	trace_cur.cnt++;
+}
+
+void trace_begin(trace_id_t id){
+	trace_point(id);
+}
+
+void trace_end(trace_id_t id){
+	trace_point(id | TRACE_END);
+}
+
+const char *trace_name(u8 id){
+	id &= ~TRACE_END;
+	return id < TRACE_ID_MAX ? trace_names[id] : "?";
+}
+
+static const trace_point_t *trace_get(const trace_boot_t *boot, u32 i){
+	// oldest point first, cnt never wraps so the ring start is cnt % TRACE_MAX_POINTS once full
+	u32 first = boot->cnt > TRACE_MAX_POINTS ? boot->cnt % TRACE_MAX_POINTS : 0;
+	return &boot->points[(first + i) % TRACE_MAX_POINTS];
+}
+
+u32 trace_slowest(const trace_boot_t *boot, u8 *id, u32 *total_us){
+	u32 n = MIN(boot->cnt, TRACE_MAX_POINTS);
+	u32 slowest = 0;
+
+	*id = TRACE_ID_MAX;
+	*total_us = n ? trace_get(boot, n - 1)->us : 0;
+
+	for(u32 i = 0; i < n; i++){
+		const trace_point_t *end = trace_get(boot, i);
+		if(!(end->id & TRACE_END)){
+			continue;
+		}
+
+		// pair with the closest begin of the same stage
+		for(u32 j = i; j-- > 0;){
+			const trace_point_t *begin = trace_get(boot, j);
+			if(begin->id == (end->id & ~TRACE_END)){
+				if(end->us - begin->us >= slowest){
+					slowest = end->us - begin->us;
+					*id = begin->id;
+				}
+				break;
+			}
+		}
+	}
+
+	return slowest;
+}
+
+static bool trace_valid(const trace_sector_t *sector){
+	return sector->magic == TRACE_MAGIC && sector->next < TRACE_MAX_BOOTS;
+}
+
+bool trace_save(){
+	// the payload occupies the sdmmc buffer at handoff
+	u8 buf[0x200] __attribute__((aligned(8)));
+	trace_sector_t *sector = (trace_sector_t*)buf;
+
+	// emmc init reads ext_csd to the sdmmc buffer, keep the payload bytes it overwrites
+	if(!emmc_storage.initialized){
+		memcpy(buf, (void*)SDMMC_UPPER_BUFFER, sizeof(buf));
+		bool res = emmc_initialize(false);
+		memcpy((void*)SDMMC_UPPER_BUFFER, buf, sizeof(buf));
+		if(!res){
+			return false;
+		}
+	}
+
+	if(disk_read(DEV_BOOT0, buf, TRACE_SECTOR, 1) != RES_OK){
+		return false;
+	}
+
+	u16 seq = 0;
+	if(trace_valid(sector)){
+		seq = sector->boots[(sector->next + TRACE_MAX_BOOTS - 1) % TRACE_MAX_BOOTS].seq + 1;
+	}else{
+		memset(buf, 0, sizeof(buf));
+		sector->magic = TRACE_MAGIC;
+	}
+
+	trace_cur.seq = seq;
+	trace_cur.switches = MIN(sdmmc_storage_get_partition_switches(), 0xff);
+	memcpy(&sector->boots[sector->next], &trace_cur, sizeof(trace_cur));
+	sector->next = (sector->next + 1) % TRACE_MAX_BOOTS;
+
+	return disk_write(DEV_BOOT0, buf, TRACE_SECTOR, 1) == RES_OK;
+}
+
+bool trace_load(trace_sector_t *sector){
+	u8 *buf = (u8*)SDMMC_UPPER_BUFFER;
+
+	if(disk_read(DEV_BOOT0, buf, TRACE_SECTOR, 1) != RES_OK){
+		return false;
+	}
+
+	memcpy(sector, buf, sizeof(*sector));
+	return trace_valid(sector);
+}
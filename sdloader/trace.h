@@ -0,0 +1,61 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <utils/types.h>
+
+// spare boot0 sector right below the modchip fw update area (byte 0x3dfe00). boot0 holds the bcts
+// at 0-0xfffff, package1 at 0x100000 and its backup at 0x140000 and the keyblobs up to 0x183fff,
+// nothing after that until the last 128kb the modchip owns from sector 0x1f00
+#define TRACE_SECTOR      0x1eff
+#define TRACE_MAGIC       0x43525453 // "STRC"
+
+#define TRACE_MAX_POINTS  24
+#define TRACE_MAX_BOOTS   4
+
+// must match tools/tracedump
+typedef enum{
+	TRACE_CONFIRM = 0,
+	TRACE_GET_CFG,
+	TRACE_BTN,
+	TRACE_SD_INIT,
+	TRACE_EMMC_INIT,
+	TRACE_MOUNT,
+	TRACE_F_OPEN,
+	TRACE_F_READ,
+	TRACE_DISPLAY,
+	TRACE_RELOC,
+	TRACE_ID_MAX
+}trace_id_t;
+
+// set on the id of the point closing a stage
+#define TRACE_END 0x80
+
+typedef struct{
+	u32 id:8;
+	u32 us:24;   // get_tmr_us, saturated
+}trace_point_t;
+
+typedef struct{
+	u16 seq;     // boot counter
+	u8  cnt;     // points recorded, the ring keeps the last TRACE_MAX_POINTS
+	u8  switches; // emmc partition switches up to the trace save, saturated
+	trace_point_t points[TRACE_MAX_POINTS];
+}trace_boot_t;
+
+// boot0 record, boots[next] is overwritten by the next boot
+typedef struct{
+	u32 magic;
+	u32 next;
+	trace_boot_t boots[TRACE_MAX_BOOTS];
+}trace_sector_t;
+
+void trace_begin(trace_id_t id);
+void trace_end(trace_id_t id);
+// appends the current boot to the boot0 record, payload buffers may be in use
+bool trace_save();
+bool trace_load(trace_sector_t *sector);
+const char *trace_name(u8 id);
+// duration of the slowest closed stage in a recorded boot, total_us is the time of its last point
+u32 trace_slowest(const trace_boot_t *boot, u8 *id, u32 *total_us);
+
+#endif
@@ -16,6 +16,7 @@
 #include <utils/sprintf.h>
 #include <soc/t210.h>
 #include <libs/fatfs/ff.h>
+#include <libs/fatfs/diskio.h>
 
 #include <display/di.h>
 #include <gfx_utils.h>
@@ -175,7 +176,7 @@ void volume_load_part_table(ums_volume_cfg_t *vol_cfg){
 		return;
 	case MEMLOADER_EMMC_GPP:
 		storage = &emmc_storage;
-		if(!emmc_initialize(false)){
+		if(!emmc_session_init()){
 			return;
 		}
 		emmc_set_partition(EMMC_GPP);
@@ -549,9 +550,14 @@ void ums_start_ums(ums_loader_ums_cfg_t *ums_cfg, const tui_color_scheme_t *colo
 	usbs.system_maintenance = &system_maintenance;
 	usbs.volumes_cnt = volumes_cnt;
 	usbs.volumes = volumes;
+	usbs.write_cache = true;
+	usbs.read_ahead = true;
 
 	usb_device_gadget_ums(&usbs);
 
+	// the host may have written boot0
+	disk_cache_invalidate();
+
 	msleep(1000);
 
 	gfx_clear_rect_rot(colors->bg, x, y, width, height);
@@ -583,7 +589,7 @@ void init_ums_cfg(ums_loader_ums_cfg_t *ums_cfg){
 		ums_cfg->storage_state |= MEMLOADER_ERROR_SD;
 	}
 	sd_end();
-	if(!emmc_initialize(false)){
+	if(!emmc_session_init()){
 		ums_cfg->storage_state |= MEMLOADER_ERROR_EMMC;
 	}
 	sdmmc_storage_end(&emmc_storage);
@@ -0,0 +1,193 @@
+#include "host.h"
+#include "sdmmc_mock.h"
+#include <stdlib.h>
+#include <string.h>
+#include <storage/emmc.h>
+#include <storage/sd.h>
+#include "bench.h"
+
+// the toolbox bus mode benchmark (sdloader/bench.c) through bdk/storage/sdmmc.c on the mock
+// controller. every mode has its own modelled bus speed, whether its init works and how many of its
+// reads fail part way. the pick is the fastest measured mode whose reads all went through without a
+// retry, not the first in the list, and the device is left in it. with no such mode the device is
+// initialized the normal way.
+
+#define CARD_SECTORS (32 * 1024 * 1024 / 0x200)
+
+sdmmc_storage_t sd_storage;
+sdmmc_storage_t emmc_storage;
+
+typedef struct{
+	u32 mode;
+	u32 timing;
+	bool init_ok;
+	u32 sector_ns;
+	u32 faults;    // reads failing half way, the retry gets them through
+}mode_model_t;
+
+static mode_model_t models[BENCH_MODES];
+static u8 *card;
+static u32 faults_left;
+static u32 current_mode;
+
+static bool fault(u32 req, u32 sector, u32 num_sectors, bool write, u32 *blocks){
+	if(!faults_left){
+		return false;
+	}
+	faults_left--;
+	*blocks = num_sectors / 2;
+	return true;
+}
+
+static void card_reset(sdmmc_storage_t *storage, const mode_model_t *m){
+	mock_reset(card, CARD_SECTORS);
+	mock.fault = fault;
+	mock.sector_ns = m->sector_ns;
+	mock_sdmmc.timing = m->timing;
+	memcpy(storage, &mock_storage, sizeof(*storage));
+	faults_left = m->faults;
+}
+
+static bool init_mode(sdmmc_storage_t *storage, u32 mode){
+	for(u32 i = 0; i < BENCH_MODES; i++){
+		if(models[i].mode == mode){
+			current_mode = 0;
+			if(!models[i].init_ok){
+				storage->initialized = 0;
+				return false;
+			}
+			card_reset(storage, &models[i]);
+			current_mode = mode;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool sd_initialize_mode(u32 mode){
+	return init_mode(&sd_storage, mode);
+}
+
+bool emmc_initialize_mode(u32 mode){
+	return init_mode(&emmc_storage, mode);
+}
+
+static void set_models(const u32 modes[BENCH_MODES], const u32 timings[BENCH_MODES], const u32 sector_ns[BENCH_MODES]){
+	for(u32 i = 0; i < BENCH_MODES; i++){
+		models[i] = (mode_model_t){modes[i], timings[i], true, sector_ns[i], 0};
+	}
+	host_time_reset();
+}
+
+static const u32 sd_modes[BENCH_MODES] = {SD_UHS_SDR104, SD_UHS_SDR82, SD_4BIT_HS25};
+static const u32 sd_timings[BENCH_MODES] = {SDHCI_TIMING_UHS_SDR104, SDHCI_TIMING_UHS_SDR82, SDHCI_TIMING_SD_HS25};
+static const u32 sd_ns[BENCH_MODES] = {6400, 8000, 22000};
+
+static void print(const char *name, const bench_result_t res[BENCH_MODES], int best){
+	for(u32 i = 0; i < BENCH_MODES; i++){
+		printf("%-12s %-8s %3s %8u %8u %6u %s\n", name, res[i].name, res[i].ok ? "ok" : "-", res[i].seq_kbs, res[i].rnd_iops,
+			res[i].errors, (int)i == best ? "<" : "");
+	}
+}
+
+// all modes work, the fastest one wins and the numbers follow the bus speed
+static void test_fastest(){
+	bench_result_t res[BENCH_MODES];
+
+	set_models(sd_modes, sd_timings, sd_ns);
+	int best = bench_sd(res);
+	print("fastest", res, best);
+
+	CHECK_EQ(best, 0);
+	CHECK_EQ(current_mode, SD_UHS_SDR104);
+	for(u32 i = 0; i < BENCH_MODES; i++){
+		CHECK(res[i].ok);
+		CHECK_EQ(res[i].mode, sd_modes[i]);
+		CHECK_EQ(res[i].errors, 0);
+		if(i){
+			CHECK(res[i].seq_kbs < res[i - 1].seq_kbs);
+			CHECK(res[i].rnd_iops < res[i - 1].rnd_iops);
+		}
+	}
+	// 8MB at 6400ns a sector and the command costs
+	CHECK(res[0].seq_kbs > 65000 && res[0].seq_kbs < 80000);
+	CHECK_EQ(mock.reinits, 0);
+}
+
+// a read that needed a retry rules the mode out even though the data arrived and it was fastest
+static void test_errors(){
+	bench_result_t res[BENCH_MODES];
+
+	set_models(sd_modes, sd_timings, sd_ns);
+	models[0].faults = 1;
+	int best = bench_sd(res);
+	print("retry", res, best);
+
+	CHECK(res[0].ok);
+	CHECK_EQ(res[0].errors, 1);
+	CHECK_EQ(best, 1);
+	CHECK_EQ(current_mode, SD_UHS_SDR82);
+	CHECK_EQ(mock.reinits, 0);
+}
+
+// a mode that doesn't init isn't measured
+static void test_init_fail(){
+	bench_result_t res[BENCH_MODES];
+
+	set_models(sd_modes, sd_timings, sd_ns);
+	models[0].init_ok = false;
+	int best = bench_sd(res);
+	print("no sdr104", res, best);
+
+	CHECK(!res[0].ok);
+	CHECK_EQ(res[0].seq_kbs, 0);
+	CHECK_EQ(best, 1);
+	CHECK_EQ(current_mode, SD_UHS_SDR82);
+}
+
+// errors in every mode, nothing is picked and the device gets the normal init
+static void test_none(){
+	bench_result_t res[BENCH_MODES];
+
+	set_models(sd_modes, sd_timings, sd_ns);
+	for(u32 i = 0; i < BENCH_MODES; i++){
+		models[i].faults = 2;
+	}
+	int best = bench_sd(res);
+	print("all errors", res, best);
+
+	CHECK_EQ(best, -1);
+	// the mock's sd_initialize, retried reads don't get that far
+	CHECK_EQ(mock.reinits, 1);
+}
+
+// an emmc whose hs400 is slower than hs200 on this board, the measurement decides over the order
+static void test_emmc(){
+	static const u32 modes[BENCH_MODES] = {EMMC_MMC_HS400, EMMC_MMC_HS200, EMMC_8BIT_HS52};
+	static const u32 timings[BENCH_MODES] = {SDHCI_TIMING_MMC_HS400, SDHCI_TIMING_MMC_HS200, SDHCI_TIMING_MMC_HS52};
+	static const u32 ns[BENCH_MODES] = {5000, 3000, 11000};
+	bench_result_t res[BENCH_MODES];
+
+	set_models(modes, timings, ns);
+	int best = bench_emmc(res);
+	print("emmc", res, best);
+
+	CHECK_EQ(best, 1);
+	CHECK_EQ(current_mode, EMMC_MMC_HS200);
+	CHECK(res[1].seq_kbs > res[0].seq_kbs);
+	CHECK_EQ(mock.reinits, 0);
+}
+
+int main(){
+	card = malloc(CARD_SECTORS * 0x200);
+	memset(card, 0x5a, CARD_SECTORS * 0x200);
+
+	printf("%-12s %-8s %3s %8s %8s %6s\n", "card", "mode", "", "seq kbs", "rnd iops", "errors");
+	test_fastest();
+	test_errors();
+	test_init_fail();
+	test_none();
+	test_emmc();
+
+	return host_result("bench_test");
+}
@@ -0,0 +1,301 @@
+#include "host.h"
+#include "storage_img.h"
+#include <stdlib.h>
+#include <string.h>
+#include <libs/fatfs/ff.h>
+#include <libs/fatfs/diskio.h>
+#include <storage/emmc.h>
+#include <memory_map.h>
+#include "modchip.h"
+
+// ipl and firmware updates of sdloader/modchip.c over old/new image pairs on image backed boot0: only
+// the sectors that differ are written, close runs of them in one command, the compare and the read
+// back go in chunks. prints the sectors written and skipped, the commands and the modelled time
+// against the single write of the whole image the update used to be. without arguments the pairs
+// are made from the machine code of this binary, otherwise from the files given, e.g. two releases.
+//
+//   boot0_update_test [old.bin new.bin ...]
+
+#define BOOT_SECTORS (4 * 1024 * 1024 / 0x200)
+#define GPP_SECTORS  (64 * 1024 * 1024 / 0x200)
+#define IMG_MAX      MODCHIP_BL_MAX_SIZE
+#define FW_SIZE      (96 * 1024)
+
+typedef struct{
+	u32 written;
+	u32 read_cmds;
+	u32 write_cmds;
+	u64 ns;
+}update_t;
+
+static u8 *exe;
+static u32 exe_size;
+static u8 old_img[0x20000];
+static u8 new_img[0x20000];
+
+static u32 seed = 0xb0070;
+
+static u32 rnd(){
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+typedef enum{
+	FAULT_NONE = 0,
+	FAULT_WRITE, // writes to the image fail
+	FAULT_LOST   // writes to the image are acked, the first of them doesn't stick
+}fault_t;
+
+static fault_t faults;
+static u32 lost_sector;
+
+static bool in_image(img_id_t id, u32 sector){
+	return id == IMG_BOOT0 && sector >= MODCHIP_FW_START_SECTOR && sector < MODCHIP_DESC_SECTOR;
+}
+
+static bool fault(img_id_t id, u32 sector, u32 num_sectors, bool write){
+	if(!in_image(id, sector)){
+		return false;
+	}
+	if(faults == FAULT_WRITE){
+		return write;
+	}
+	// the card loses the first write, seen by the read back
+	if(faults == FAULT_LOST){
+		if(write && !lost_sector){
+			lost_sector = sector;
+		}else if(!write && lost_sector){
+			img_sector(id, lost_sector)[0x10] ^= 0xff;
+			faults = FAULT_NONE;
+		}
+	}
+	return false;
+}
+
+static void setup(const u8 *old, u32 old_size, u32 start){
+	img_create(IMG_GPP, GPP_SECTORS);
+	img_create(IMG_BOOT0, BOOT_SECTORS);
+	img_fault = fault;
+	faults = FAULT_NONE;
+	lost_sector = 0;
+	emmc_session_init();
+	disk_cache_invalidate();
+	memcpy(img_sector(IMG_BOOT0, start), old, old_size);
+	img_stats_reset();
+}
+
+// the image goes through the sdmmc buffer like from the file, ends of partial sectors zeroed
+static u8 *stage(const u8 *data, u32 size){
+	u8 *buf = (u8*)SDMMC_UPPER_BUFFER;
+	memset(buf + (size & ~0x1ff), 0, 0x200);
+	memcpy(buf, data, size);
+	return buf;
+}
+
+static bool update(const u8 *old, u32 old_size, const u8 *new, u32 size, bool fw, update_t *u){
+	u32 start = fw ? MODCHIP_FW_START_SECTOR : MODCHIP_BL_START_SECTOR;
+	u32 cnt = ALIGN(size, 0x200) / 0x200;
+
+	setup(old, old_size, start);
+	u8 *buf = stage(new, size);
+
+	u64 t = host_time_ns();
+	bool ok = fw ? modchip_write_fw_update(buf, size) : modchip_write_ipl_update(buf, size);
+	u->ns = host_time_ns() - t;
+	u->written = img_stats->write_sectors;
+	u->write_cmds = img_stats->writes;
+	u->read_cmds = img_stats->cmds - img_stats->writes;
+
+	// the fw update command follows the image, the same single write as before
+	if(fw){
+		u->written--;
+		u->write_cmds--;
+	}
+
+	return ok && !memcmp(img_sector(IMG_BOOT0, start), stage(new, size), cnt * 0x200);
+}
+
+// images are created again for every update
+static const modchip_cmd_t *boot0_cmd(){
+	return (const modchip_cmd_t*)(img_sector(IMG_BOOT0, MODCHIP_CMD_SECTOR) + MODCHIP_CMD_OFFSET);
+}
+
+// what an update cost before: one write of the whole image, nothing read
+static u64 full_write_ns(const u8 *old, u32 old_size, const u8 *new, u32 size){
+	setup(old, old_size, MODCHIP_BL_START_SECTOR);
+	u8 *buf = stage(new, size);
+	u64 t = host_time_ns();
+	CHECK_EQ(disk_write(DEV_BOOT0, buf, MODCHIP_BL_START_SECTOR, ALIGN(size, 0x200) / 0x200), RES_OK);
+	return host_time_ns() - t;
+}
+
+// sectors that differ and the runs they make, the least an update has to write
+static void dirty(const u8 *old, u32 old_size, const u8 *new, u32 size, u32 *sectors, u32 *runs){
+	const u8 *buf = stage(new, size);
+	bool prev = false;
+
+	*sectors = 0;
+	*runs = 0;
+	for(u32 i = 0; i < ALIGN(size, 0x200) / 0x200; i++){
+		bool d = (i + 1) * 0x200 > old_size || memcmp(old + i * 0x200, buf + i * 0x200, 0x200);
+		*sectors += d;
+		*runs += d && !prev;
+		prev = d;
+	}
+}
+
+// the write commands the update took
+static u32 run(const char *name, const u8 *old, u32 old_size, const u8 *new, u32 size){
+	update_t u;
+	u32 cnt = ALIGN(size, 0x200) / 0x200;
+	u32 sectors, runs;
+
+	dirty(old, old_size, new, size, &sectors, &runs);
+	u64 full_ns = full_write_ns(old, old_size, new, size);
+
+	if(!update(old, old_size, new, size, false, &u)){
+		printf("%-16s update failed\n", name);
+		host_failures++;
+		return 0;
+	}
+
+	printf("%-16s %7u %7u %7u %7u %6u %6u %8llu %8llu\n", name, cnt, sectors, u.written, cnt - u.written, u.read_cmds,
+		u.write_cmds, u.ns / 1000, full_ns / 1000);
+
+	// everything that differs and close to nothing else
+	CHECK(u.written >= sectors);
+	CHECK(u.written <= sectors + (runs - !!runs) * 4);
+	CHECK(u.write_cmds <= runs);
+	CHECK(!sectors || u.write_cmds);
+	// compare and read back in chunks, not per sector
+	CHECK_EQ(u.read_cmds, 2 * ((cnt + 15) / 16));
+	// skipping most of the image beats writing it
+	if(sectors < cnt / 4){
+		CHECK(u.ns < full_ns);
+	}
+
+	return u.write_cmds;
+}
+
+// a few bytes at each of the offsets
+static void patch(u8 *img, const u32 *ofs, u32 cnt){
+	for(u32 i = 0; i < cnt; i++){
+		for(u32 b = 0; b < 8; b++){
+			img[ofs[i] + b] ^= 0x5a;
+		}
+	}
+}
+
+static void run_builtin(){
+	const u32 size = IMG_MAX;
+	const u8 *code = exe + 0x1000;
+	const u32 near[] = {0x1400, 0x1a00, 0x1e10};
+	const u32 spread[] = {0x300, 0x4000, 0x8200, 0xc000, 0xf000};
+
+	memcpy(old_img, code, size);
+
+	memcpy(new_img, old_img, size);
+	run("identical", old_img, size, new_img, size);
+
+	// a version string
+	memcpy(new_img, old_img, size);
+	memcpy(new_img + 0x100, "sdloader v1.2.4", 16);
+	run("version", old_img, size, new_img, size);
+
+	// a fix in one function, the sectors around it in one write
+	memcpy(new_img, old_img, size);
+	patch(new_img, near, ARRAY_SIZE(near));
+	CHECK_EQ(run("near patches", old_img, size, new_img, size), 1);
+
+	memcpy(new_img, old_img, size);
+	patch(new_img, spread, ARRAY_SIZE(spread));
+	run("spread patches", old_img, size, new_img, size);
+
+	// code added in the middle moves everything after it
+	memcpy(new_img, old_img, 0x6000);
+	memcpy(new_img + 0x6000, exe + 0x20000, 0x180);
+	memcpy(new_img + 0x6180, old_img + 0x6000, size - 0x6180);
+	run("inserted", old_img, size, new_img, size);
+
+	// a smaller image, its tail sector padded
+	memcpy(new_img, old_img, size);
+	run("shrunk", old_img, size, new_img, size - 0x1234);
+
+	for(u32 i = 0; i < size; i++){
+		new_img[i] = rnd();
+	}
+	run("all changed", old_img, size, new_img, size);
+}
+
+static bool read_file(const char *path, u8 *buf, u32 max, u32 *size){
+	FILE *f = fopen(path, "rb");
+	if(!f){
+		return false;
+	}
+	*size = fread(buf, 1, max, f);
+	fclose(f);
+	return true;
+}
+
+// a firmware update is followed by its command
+static void test_fw(){
+	update_t u;
+
+	memcpy(old_img, exe + 0x1000, FW_SIZE);
+	memcpy(new_img, old_img, FW_SIZE);
+	memcpy(new_img + 0x9000, "fw", 2);
+
+	CHECK(update(old_img, FW_SIZE, new_img, FW_SIZE, true, &u));
+	CHECK_EQ(u.written, 1);
+	CHECK_EQ(u.write_cmds, 1);
+	CHECK_EQ(boot0_cmd()->cmd, MODCHIP_CMD_FW_UPDATE);
+	CHECK_EQ(boot0_cmd()->fw_update_info.fw_sector_start, MODCHIP_FW_START_SECTOR);
+	CHECK_EQ(boot0_cmd()->fw_update_info.fw_sector_cnt, FW_SIZE / 0x200);
+}
+
+// an image that didn't make it fails the update and leaves the reset command
+static void test_failed(){
+
+	memcpy(old_img, exe + 0x1000, IMG_MAX);
+	memcpy(new_img, old_img, IMG_MAX);
+	new_img[0x4321] ^= 1;
+	new_img[0xa000] ^= 1;
+
+	for(u32 f = FAULT_WRITE; f <= FAULT_LOST; f++){
+		setup(old_img, IMG_MAX, MODCHIP_BL_START_SECTOR);
+		faults = f;
+		CHECK(!modchip_write_ipl_update(stage(new_img, IMG_MAX), IMG_MAX));
+		CHECK_EQ(boot0_cmd()->cmd, MODCHIP_CMD_RST);
+		// the lost write was seen by the read back
+		CHECK(f != FAULT_LOST || (lost_sector && faults == FAULT_NONE));
+	}
+}
+
+int main(int argc, char *argv[]){
+	exe = malloc(0x40000);
+	if(!read_file("/proc/self/exe", exe, 0x40000, &exe_size) || exe_size < 0x30000){
+		printf("can't read the test binary\n");
+		return 1;
+	}
+
+	printf("%-16s %7s %7s %7s %7s %6s %6s %8s %8s\n", "pair", "sectors", "differ", "written", "skipped", "reads",
+		"writes", "us", "full us");
+
+	if(argc > 2){
+		for(int i = 1; i + 1 < argc; i += 2){
+			u32 old_size, size;
+			if(!read_file(argv[i], old_img, IMG_MAX, &old_size) || !read_file(argv[i + 1], new_img, IMG_MAX, &size)){
+				printf("can't read %s or %s\n", argv[i], argv[i + 1]);
+				host_failures++;
+				continue;
+			}
+			run(argv[i + 1], old_img, old_size, new_img, size);
+		}
+	}else{
+		run_builtin();
+	}
+	test_fw();
+	test_failed();
+
+	return host_result("boot0_update_test");
+}
@@ -0,0 +1,294 @@
+#include "host.h"
+#include "storage_img.h"
+#include "fatimg.h"
+#include "boot_run.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "loader.h"
+#include "trace.h"
+#include "se_model.h"
+
+// time from reset to the payload jump for the drives and payload formats sdloader supports.
+// every boot runs main() in its own process on the same images, boot0 keeps what the
+// previous boot wrote, so the second boot of a scenario shows the cached paths. the -nosess
+// scenarios run the same boots on the emmc as it was before sessions, for the controller power ups
+// and card inits the session saves.
+//
+//   boot_bench [--check] [--baseline file] [--write-baseline file] [--packer payloadpack]
+//
+// --check fails on payload mismatches, on boots that got more than BASELINE_SLACK slower and on
+// session boots that power a controller up twice or init the emmc more than once
+
+#define PAYLOAD_SIZE     (140 * 1024)
+#define BOOTS            3
+#define BASELINE_SLACK   5 // percent
+
+#define SD_SECTORS       (64 * 1024 * 1024 / 0x200)
+#define GPP_SECTORS      (64 * 1024 * 1024 / 0x200)
+#define BOOT_SECTORS     (4 * 1024 * 1024 / 0x200)
+
+typedef enum{
+	FMT_RAW = 0,
+	FMT_SHA,
+	FMT_BLZ,
+}payload_fmt_t;
+
+typedef struct{
+	const char *name;
+	img_id_t id;       // where payload.bin goes
+	fatimg_type_t type;
+	u32 clus_sectors;
+	u32 frag_clusters;
+	payload_fmt_t fmt;
+	bool no_sd;
+	bool no_session; // img_no_session, the emmc inits and controller power ups it takes
+}scenario_t;
+
+static const scenario_t scenarios[] = {
+	{"sd-fat32",         IMG_SD,    FATIMG_FAT32, 1,  0, FMT_RAW, false, false},
+	{"sd-exfat",         IMG_SD,    FATIMG_EXFAT, 64, 0, FMT_RAW, false, false},
+	{"sd-fat32-frag",    IMG_SD,    FATIMG_FAT32, 1,  8, FMT_RAW, false, false},
+	{"sd-exfat-sha",     IMG_SD,    FATIMG_EXFAT, 64, 0, FMT_SHA, false, false},
+	{"sd-exfat-blz",     IMG_SD,    FATIMG_EXFAT, 64, 0, FMT_BLZ, false, false},
+	{"boot1-1mb",        IMG_BOOT1, FATIMG_FAT16, 1,  0, FMT_RAW, true,  false},
+	{"gpp",              IMG_GPP,   FATIMG_FAT32, 1,  0, FMT_RAW, false, false},
+	{"sd-fat32-nosess",  IMG_SD,    FATIMG_FAT32, 1,  0, FMT_RAW, false, true},
+	{"boot1-1mb-nosess", IMG_BOOT1, FATIMG_FAT16, 1,  0, FMT_RAW, true,  true},
+	{"gpp-nosess",       IMG_GPP,   FATIMG_FAT32, 1,  0, FMT_RAW, false, true},
+};
+
+static u8 payload[PAYLOAD_SIZE];
+static const char *packer;
+
+// code like data, long runs of a few patterns with noise in between so blz has something to do
+static void make_payload(){
+	u32 seed = 0x1234567;
+	for(u32 i = 0; i < PAYLOAD_SIZE;){
+		seed = seed * 1103515245 + 12345;
+		u32 run = 4 + ((seed >> 16) & 0x1f);
+		u8 base = seed >> 24;
+		for(u32 j = 0; j < run && i < PAYLOAD_SIZE; j++, i++){
+			payload[i] = (seed & 0x100) ? base + (j & 3) : (u8)(seed >> (j & 7));
+		}
+	}
+}
+
+static u8 *pack_payload(payload_fmt_t fmt, u32 *size){
+	u8 *out = malloc(PAYLOAD_SIZE + sizeof(payload_sha_trailer_t));
+
+	if(fmt == FMT_SHA){
+		payload_sha_trailer_t trailer = {.magic = PAYLOAD_SHA_MAGIC, .size = PAYLOAD_SIZE};
+		host_sha256(payload, PAYLOAD_SIZE, trailer.sha256);
+		memcpy(out, payload, PAYLOAD_SIZE);
+		memcpy(out + PAYLOAD_SIZE, &trailer, sizeof(trailer));
+		*size = PAYLOAD_SIZE + sizeof(trailer);
+		return out;
+	}
+
+	if(fmt == FMT_BLZ){
+		char in_path[] = "/tmp/boot_bench_XXXXXX";
+		char cmd[512];
+		int fd = mkstemp(in_path);
+		if(fd < 0 || write(fd, payload, PAYLOAD_SIZE) != PAYLOAD_SIZE){
+			free(out);
+			return NULL;
+		}
+		close(fd);
+
+		char out_path[sizeof(in_path) + 4];
+		snprintf(out_path, sizeof(out_path), "%s.blz", in_path);
+		snprintf(cmd, sizeof(cmd), "%s %s %s >/dev/null", packer, in_path, out_path);
+		int res = system(cmd);
+
+		FILE *f = fopen(out_path, "rb");
+		*size = f && !res ? fread(out, 1, PAYLOAD_SIZE, f) : 0;
+		if(f){
+			fclose(f);
+		}
+		unlink(in_path);
+		unlink(out_path);
+		if(!*size){
+			free(out);
+			return NULL;
+		}
+		return out;
+	}
+
+	memcpy(out, payload, PAYLOAD_SIZE);
+	*size = PAYLOAD_SIZE;
+	return out;
+}
+
+static bool setup(const scenario_t *s){
+	u32 size;
+	u8 *data = pack_payload(s->fmt, &size);
+	if(!data){
+		return false;
+	}
+
+	img_create(IMG_SD, s->no_sd ? 0 : SD_SECTORS);
+	img_create(IMG_GPP, GPP_SECTORS);
+	img_create(IMG_BOOT0, BOOT_SECTORS);
+	boot_enable_trace();
+	img_create(IMG_BOOT1, BOOT_SECTORS);
+
+	bool res = true;
+	if(!s->no_sd){
+		res &= fatimg_format(IMG_SD, 0x800, SD_SECTORS - 0x800, s->id == IMG_SD ? s->type : FATIMG_FAT32, s->clus_sectors, true);
+	}
+
+	switch(s->id){
+	case IMG_BOOT1:
+		// the 1mb variant, behind the bct copies
+		res &= fatimg_format(IMG_BOOT1, 0x800, BOOT_SECTORS - 0x800, s->type, s->clus_sectors, false);
+		break;
+	case IMG_GPP:
+		res &= fatimg_format(IMG_GPP, 0x800, GPP_SECTORS - 0x800, s->type, s->clus_sectors, true);
+		break;
+	default:
+		break;
+	}
+
+	// something in front of the payload like on a used card
+	fatimg_skip_clusters(s->id, 37);
+	res &= fatimg_add_file(s->id, "payload.bin", data, size, s->frag_clusters, NULL);
+
+	free(data);
+	return res;
+}
+
+// stage durations of the boot just recorded
+static void print_stages(u64 jump_ns){
+	u32 total[TRACE_ID_MAX];
+	bool seen[TRACE_ID_MAX];
+
+	if(!boot_stages(jump_ns, total, seen)){
+		return;
+	}
+
+	printf("    ");
+	for(u32 id = 0; id < TRACE_ID_MAX; id++){
+		if(seen[id]){
+			printf(" %s %u.%03u", trace_name(id), total[id] / 1000, total[id] % 1000);
+		}
+	}
+	printf("\n");
+}
+
+typedef struct{
+	char key[48];
+	u64 jump_ns;
+}baseline_t;
+
+static baseline_t baseline[64];
+static u32 baseline_cnt;
+
+static void load_baseline(const char *path){
+	FILE *f = fopen(path, "r");
+	if(!f){
+		fprintf(stderr, "no baseline %s\n", path);
+		return;
+	}
+	unsigned long long ns;
+	while(baseline_cnt < 64 && fscanf(f, "%47s %llu", baseline[baseline_cnt].key, &ns) == 2){
+		baseline[baseline_cnt++].jump_ns = ns;
+	}
+	fclose(f);
+}
+
+static u64 find_baseline(const char *key){
+	for(u32 i = 0; i < baseline_cnt; i++){
+		if(!strcmp(baseline[i].key, key)){
+			return baseline[i].jump_ns;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[]){
+	bool check = false;
+	FILE *out_baseline = NULL;
+
+	for(int i = 1; i < argc; i++){
+		if(!strcmp(argv[i], "--check")){
+			check = true;
+		}else if(!strcmp(argv[i], "--baseline") && i + 1 < argc){
+			load_baseline(argv[++i]);
+		}else if(!strcmp(argv[i], "--write-baseline") && i + 1 < argc){
+			out_baseline = fopen(argv[++i], "w");
+		}else if(!strcmp(argv[i], "--packer") && i + 1 < argc){
+			packer = argv[++i];
+		}else{
+			fprintf(stderr, "usage: boot_bench [--check] [--baseline file] [--write-baseline file] [--packer payloadpack]\n");
+			return 2;
+		}
+	}
+
+	make_payload();
+
+	printf("%-16s %4s %10s %6s %8s %8s %6s %6s %6s %6s\n", "scenario", "boot", "jump ms", "cmds", "rd sect", "wr sect", "switch", "tunes",
+		"pwr up", "inits");
+
+	for(u32 i = 0; i < ARRAY_SIZE(scenarios); i++){
+		const scenario_t *s = &scenarios[i];
+
+		if(s->fmt == FMT_BLZ && !packer){
+			printf("%-16s skipped, needs --packer\n", s->name);
+			continue;
+		}
+
+		img_no_session = s->no_session;
+		if(!setup(s)){
+			printf("%-16s setup failed\n", s->name);
+			host_failures++;
+			continue;
+		}
+
+		for(u32 n = 0; n < BOOTS; n++){
+			boot_result_t res;
+
+			if(!boot_run(payload, PAYLOAD_SIZE, &res)){
+				printf("%-16s %4u no payload jump\n", s->name, n);
+				host_failures++;
+				continue;
+			}
+
+			img_stats_t *st = &res.stats;
+			printf("%-16s %4u %6llu.%03llu %6u %8u %8u %6u %6u %6u %6u%s\n", s->name, n,
+				res.jump_ns / 1000000, res.jump_ns / 1000 % 1000,
+				st->cmds, st->read_sectors, st->write_sectors, st->switches, st->tunes, st->power_ups,
+				st->sd_inits + st->emmc_inits,
+				res.payload_ok ? "" : "  PAYLOAD MISMATCH");
+			print_stages(res.jump_ns);
+
+			CHECK(res.payload_ok);
+			if(!s->no_session){
+				CHECK(st->power_ups <= 2);
+				CHECK_EQ(st->emmc_inits, 1);
+			}
+
+			char key[48];
+			snprintf(key, sizeof(key), "%s/%u", s->name, n);
+			if(out_baseline){
+				fprintf(out_baseline, "%s %llu\n", key, (unsigned long long)res.jump_ns);
+			}
+
+			u64 base = find_baseline(key);
+			if(base && base != res.jump_ns){
+				printf("     %+lld us against the baseline\n", ((long long)res.jump_ns - (long long)base) / 1000);
+			}
+			if(base && check && res.jump_ns * 100 > base * (100 + BASELINE_SLACK)){
+				printf("     slower than the baseline by more than %u%%\n", BASELINE_SLACK);
+				host_failures++;
+			}
+		}
+	}
+
+	if(out_baseline){
+		fclose(out_baseline);
+	}
+
+	return check ? host_result("boot_bench") : 0;
+}
@@ -0,0 +1,588 @@
+#include "arm_sim.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INSN_MAX   512
+#define LABEL_MAX  128
+#define STEPS_MAX  (64 * 1024 * 1024)
+#define CODE_BASE  0x00100000
+#define RET_ADDR   0xfffffff0
+
+u8 arm_sim_mem[ARM_SIM_MEM_SIZE];
+
+enum{
+	OP_AND, OP_EOR, OP_SUB, OP_ADD, OP_TST, OP_CMP, OP_ORR, OP_MOV,
+	OP_B, OP_BX, OP_LDR, OP_STR, OP_LDM, OP_STM,
+};
+
+enum{
+	ADDR_OFS, ADDR_PRE, ADDR_POST,
+};
+
+static const char *const conds[] = {"EQ", "NE", "HS", "LO", "MI", "PL", "VS", "VC", "HI", "LS", "GE", "LT", "GT", "LE", "AL"};
+
+typedef struct{
+	u8 op;
+	u8 cond;
+	bool s;
+	bool byte;
+	u8 rd;
+	u8 rn;
+	// second operand, register with lsl or immediate
+	bool imm;
+	u32 val;
+	u8 rm;
+	u8 lsl;
+	// ldr/str
+	u8 addr;
+	s32 ofs;
+	// ldm/stm
+	u16 list;
+	bool wb;
+	bool down;
+	char target[32];
+	int line;
+}insn_t;
+
+typedef struct{
+	char name[32];
+	u32 idx;
+}label_t;
+
+static insn_t insns[INSN_MAX];
+static u32 insn_cnt;
+static label_t labels[LABEL_MAX];
+static u32 label_cnt;
+
+static struct{
+	u32 r[16];
+	bool n, z, c, v;
+}cpu;
+
+static const char *cur;
+static int cur_line;
+
+static bool fail(const char *what){
+	fprintf(stderr, "arm_sim: line %d: %s\n", cur_line, what);
+	return false;
+}
+
+static void skip_ws(){
+	while(*cur == ' ' || *cur == '\t'){
+		cur++;
+	}
+}
+
+static bool accept(char c){
+	skip_ws();
+	if(*cur == c){
+		cur++;
+		return true;
+	}
+	return false;
+}
+
+static bool parse_reg(u8 *reg){
+	skip_ws();
+	if(!strncasecmp(cur, "SP", 2)){
+		*reg = 13;
+	}else if(!strncasecmp(cur, "LR", 2)){
+		*reg = 14;
+	}else if(!strncasecmp(cur, "PC", 2)){
+		*reg = 15;
+	}else if(toupper(*cur) == 'R' && isdigit(cur[1])){
+		char *end;
+		u32 r = strtoul(cur + 1, &end, 10);
+		if(r > 15){
+			return false;
+		}
+		*reg = r;
+		cur = end;
+		return true;
+	}else{
+		return false;
+	}
+	cur += 2;
+	return true;
+}
+
+static bool parse_imm(s32 *val){
+	char *end;
+	if(!accept('#')){
+		return false;
+	}
+	*val = strtol(cur, &end, 0);
+	if(end == cur){
+		return false;
+	}
+	cur = end;
+	return true;
+}
+
+static bool parse_list(u16 *list){
+	if(!accept('{')){
+		return false;
+	}
+	*list = 0;
+	do{
+		u8 first, last;
+		if(!parse_reg(&first)){
+			return false;
+		}
+		last = first;
+		if(accept('-') && !parse_reg(&last)){
+			return false;
+		}
+		for(u32 r = first; r <= last; r++){
+			*list |= 1 << r;
+		}
+	}while(accept(','));
+	return accept('}');
+}
+
+// register with an optional lsl, or an immediate
+static bool parse_op2(insn_t *in){
+	s32 val;
+	skip_ws();
+	if(*cur == '#'){
+		if(!parse_imm(&val)){
+			return false;
+		}
+		in->imm = true;
+		in->val = val;
+		return true;
+	}
+	if(!parse_reg(&in->rm)){
+		return false;
+	}
+	if(accept(',')){
+		skip_ws();
+		if(strncasecmp(cur, "LSL", 3)){
+			return false;
+		}
+		cur += 3;
+		if(!parse_imm(&val) || val < 0 || val > 31){
+			return false;
+		}
+		in->lsl = val;
+	}
+	return true;
+}
+
+static bool parse_mem(insn_t *in){
+	s32 ofs = 0;
+	if(!accept('[') || !parse_reg(&in->rn)){
+		return false;
+	}
+	if(accept(',') && !parse_imm(&ofs)){
+		return false;
+	}
+	if(!accept(']')){
+		return false;
+	}
+	in->ofs = ofs;
+	if(accept('!')){
+		in->addr = ADDR_PRE;
+	}else if(accept(',')){
+		if(ofs || !parse_imm(&in->ofs)){
+			return false;
+		}
+		in->addr = ADDR_POST;
+	}else{
+		in->addr = ADDR_OFS;
+	}
+	return true;
+}
+
+// condition code at s, 14 (AL) if none
+static u8 parse_cond(const char **s){
+	for(u32 i = 0; i < ARRAY_SIZE(conds); i++){
+		if(!strncmp(*s, conds[i], 2)){
+			*s += 2;
+			return i;
+		}
+	}
+	if(!strncmp(*s, "CS", 2) || !strncmp(*s, "CC", 2)){
+		u8 cond = (*s)[1] == 'S' ? 2 : 3;
+		*s += 2;
+		return cond;
+	}
+	return 14;
+}
+
+static bool parse_insn(const char *mn, insn_t *in){
+	static const char *const dp[] = {"AND", "EOR", "SUB", "ADD", "TST", "CMP", "ORR", "MOV"};
+	const char *s = mn + 3;
+
+	memset(in, 0, sizeof(*in));
+	in->cond = 14;
+	in->line = cur_line;
+
+	if(!strncmp(mn, "BX", 2)){
+		s = mn + 2;
+		in->op = OP_BX;
+		in->cond = parse_cond(&s);
+		return !*s && parse_reg(&in->rm);
+	}
+	if(mn[0] == 'B'){
+		s = mn + 1;
+		in->op = OP_B;
+		in->cond = parse_cond(&s);
+		if(*s){
+			return false;
+		}
+		skip_ws();
+		u32 len = 0;
+		while((isalnum(cur[len]) || cur[len] == '_') && len < sizeof(in->target) - 1){
+			len++;
+		}
+		memcpy(in->target, cur, len);
+		cur += len;
+		return len;
+	}
+
+	if(!strncmp(mn, "LDM", 3) || !strncmp(mn, "STM", 3)){
+		in->op = mn[0] == 'L' ? OP_LDM : OP_STM;
+		if(strlen(s) == 4){
+			in->cond = parse_cond(&s);
+		}
+		// full descending stack is ia for loads and db for stores
+		if(!strcmp(s, "IA")){
+			in->down = false;
+		}else if(!strcmp(s, "DB")){
+			in->down = true;
+		}else if(!strcmp(s, "FD")){
+			in->down = in->op == OP_STM;
+		}else{
+			return false;
+		}
+		if(!parse_reg(&in->rn)){
+			return false;
+		}
+		in->wb = accept('!');
+		return accept(',') && parse_list(&in->list) && !(in->list & (1 << 15));
+	}
+
+	if(!strncmp(mn, "LDR", 3) || !strncmp(mn, "STR", 3)){
+		in->op = mn[0] == 'L' ? OP_LDR : OP_STR;
+		in->cond = parse_cond(&s);
+		if(*s == 'B'){
+			in->byte = true;
+			s++;
+		}
+		return !*s && parse_reg(&in->rd) && accept(',') && parse_mem(in);
+	}
+
+	for(u32 i = 0; i < ARRAY_SIZE(dp); i++){
+		if(strncmp(mn, dp[i], 3)){
+			continue;
+		}
+		in->op = OP_AND + i;
+		in->cond = parse_cond(&s);
+		if(*s == 'S'){
+			in->s = true;
+			s++;
+		}
+		if(*s){
+			return false;
+		}
+		// compares set flags and have no destination
+		if(in->op == OP_TST || in->op == OP_CMP){
+			in->s = true;
+			return parse_reg(&in->rn) && accept(',') && parse_op2(in);
+		}
+		if(!parse_reg(&in->rd) || !accept(',')){
+			return false;
+		}
+		if(in->op != OP_MOV && (!parse_reg(&in->rn) || !accept(','))){
+			return false;
+		}
+		return parse_op2(in) && in->rd != 15;
+	}
+
+	return false;
+}
+
+bool arm_sim_load(const char *path){
+	FILE *f = fopen(path, "r");
+	char line[256];
+	bool comment = false;
+
+	insn_cnt = 0;
+	label_cnt = 0;
+	cur_line = 0;
+
+	if(!f){
+		perror(path);
+		return false;
+	}
+
+	while(fgets(line, sizeof(line), f)){
+		cur_line++;
+
+		// block comments, @ and // line comments
+		for(char *p = line; *p; p++){
+			if(comment){
+				if(p[0] == '*' && p[1] == '/'){
+					p[1] = ' ';
+					comment = false;
+				}
+				*p = ' ';
+			}else if(p[0] == '/' && p[1] == '*'){
+				*p = ' ';
+				comment = true;
+			}else if(*p == '@' || (p[0] == '/' && p[1] == '/') || *p == '\n'){
+				*p = 0;
+				break;
+			}
+		}
+
+		cur = line;
+		skip_ws();
+
+		// labels
+		const char *colon = strchr(cur, ':');
+		if(colon && colon - cur < 32){
+			if(label_cnt == LABEL_MAX){
+				fclose(f);
+				return fail("too many labels");
+			}
+			memcpy(labels[label_cnt].name, cur, colon - cur);
+			labels[label_cnt].name[colon - cur] = 0;
+			labels[label_cnt++].idx = insn_cnt;
+			cur = colon + 1;
+			skip_ws();
+		}
+
+		// directives
+		if(!*cur || *cur == '.'){
+			continue;
+		}
+
+		char mn[16] = {0};
+		for(u32 i = 0; i < sizeof(mn) - 1 && isalpha(*cur); i++){
+			mn[i] = toupper(*cur++);
+		}
+		if(insn_cnt == INSN_MAX || !parse_insn(mn, &insns[insn_cnt])){
+			fclose(f);
+			return fail("unsupported instruction");
+		}
+		skip_ws();
+		if(*cur){
+			fclose(f);
+			return fail("trailing characters");
+		}
+		insn_cnt++;
+	}
+
+	fclose(f);
+
+	// every branch has its label
+	for(u32 i = 0; i < insn_cnt; i++){
+		bool found = insns[i].op != OP_B;
+		for(u32 l = 0; !found && l < label_cnt; l++){
+			found = !strcmp(labels[l].name, insns[i].target);
+		}
+		if(!found){
+			cur_line = insns[i].line;
+			return fail("unknown label");
+		}
+	}
+
+	return insn_cnt;
+}
+
+static bool find_label(const char *name, u32 *idx){
+	for(u32 i = 0; i < label_cnt; i++){
+		if(!strcmp(labels[i].name, name)){
+			*idx = labels[i].idx;
+			return true;
+		}
+	}
+	return false;
+}
+
+static u8 *mem(u32 addr, u32 size){
+	if(addr < ARM_SIM_MEM_BASE || addr - ARM_SIM_MEM_BASE + size > ARM_SIM_MEM_SIZE || (addr & (size - 1))){
+		return NULL;
+	}
+	return arm_sim_mem + addr - ARM_SIM_MEM_BASE;
+}
+
+static bool cond_pass(u8 cond){
+	switch(cond){
+	case 0:  return cpu.z;
+	case 1:  return !cpu.z;
+	case 2:  return cpu.c;
+	case 3:  return !cpu.c;
+	case 4:  return cpu.n;
+	case 5:  return !cpu.n;
+	case 6:  return cpu.v;
+	case 7:  return !cpu.v;
+	case 8:  return cpu.c && !cpu.z;
+	case 9:  return !cpu.c || cpu.z;
+	case 10: return cpu.n == cpu.v;
+	case 11: return cpu.n != cpu.v;
+	case 12: return !cpu.z && cpu.n == cpu.v;
+	case 13: return cpu.z || cpu.n != cpu.v;
+	default: return true;
+	}
+}
+
+// executes insns[*pc], cycles as on the arm7tdmi: data processing 1S, taken branch 2S+1N,
+// ldr 1S+1N+1I, str 2N, ldm nS+1N+1I, stm (n-1)S+2N, a failed condition 1S
+static bool step(u32 *pc, u64 *cycles){
+	const insn_t *in = &insns[*pc];
+	u32 next = *pc + 1;
+
+	cur_line = in->line;
+
+	if(!cond_pass(in->cond)){
+		*cycles += 1;
+		*pc = next;
+		return true;
+	}
+
+	switch(in->op){
+	case OP_B:
+		find_label(in->target, &next);
+		*cycles += 3;
+		break;
+	case OP_BX:
+		if(cpu.r[in->rm] != RET_ADDR && (cpu.r[in->rm] < CODE_BASE || (cpu.r[in->rm] - CODE_BASE) / 4 >= insn_cnt)){
+			return fail("bx to an unknown address");
+		}
+		next = cpu.r[in->rm] == RET_ADDR ? insn_cnt : (cpu.r[in->rm] - CODE_BASE) / 4;
+		*cycles += 3;
+		break;
+	case OP_LDR:
+	case OP_STR:{
+		u32 addr = cpu.r[in->rn] + (in->addr == ADDR_POST ? 0 : in->ofs);
+		u8 *p = mem(addr, in->byte ? 1 : 4);
+		if(!p){
+			return fail("bad address");
+		}
+		if(in->op == OP_LDR){
+			cpu.r[in->rd] = in->byte ? *p : *(u32*)p;
+			*cycles += 3;
+		}else if(in->byte){
+			*p = cpu.r[in->rd];
+			*cycles += 2;
+		}else{
+			*(u32*)p = cpu.r[in->rd];
+			*cycles += 2;
+		}
+		if(in->addr != ADDR_OFS){
+			cpu.r[in->rn] += in->ofs;
+		}
+		break;
+	}
+	case OP_LDM:
+	case OP_STM:{
+		u32 n = __builtin_popcount(in->list);
+		u32 addr = cpu.r[in->rn] - (in->down ? 4 * n : 0);
+		for(u32 r = 0; r < 16; r++){
+			if(!(in->list & (1 << r))){
+				continue;
+			}
+			u8 *p = mem(addr, 4);
+			if(!p){
+				return fail("bad address");
+			}
+			if(in->op == OP_LDM){
+				cpu.r[r] = *(u32*)p;
+			}else{
+				*(u32*)p = cpu.r[r];
+			}
+			addr += 4;
+		}
+		if(in->wb){
+			cpu.r[in->rn] += in->down ? -4 * n : 4 * n;
+		}
+		*cycles += in->op == OP_LDM ? n + 2 : n + 1;
+		break;
+	}
+	default:{
+		u32 a = cpu.r[in->rn];
+		u32 b = in->imm ? in->val : cpu.r[in->rm] << in->lsl;
+		bool shift_c = in->imm || !in->lsl ? cpu.c : (cpu.r[in->rm] >> (32 - in->lsl)) & 1;
+		u32 res;
+		bool c = shift_c, v = cpu.v;
+
+		switch(in->op){
+		case OP_AND:
+		case OP_TST: res = a & b; break;
+		case OP_EOR: res = a ^ b; break;
+		case OP_ORR: res = a | b; break;
+		case OP_MOV: res = b; break;
+		case OP_ADD:
+			res = a + b;
+			c = res < a;
+			v = (~(a ^ b) & (a ^ res)) >> 31;
+			break;
+		default:
+			res = a - b;
+			c = a >= b;
+			v = ((a ^ b) & (a ^ res)) >> 31;
+			break;
+		}
+		if(in->op != OP_TST && in->op != OP_CMP){
+			cpu.r[in->rd] = res;
+		}
+		if(in->s){
+			cpu.n = res >> 31;
+			cpu.z = !res;
+			cpu.c = c;
+			cpu.v = v;
+		}
+		*cycles += 1;
+		break;
+	}
+	}
+
+	*pc = next;
+	return true;
+}
+
+bool arm_sim_call(const char *func, u32 a0, u32 a1, u32 a2, u32 *ret, u64 *cycles){
+	u32 pc;
+	u32 saved[16];
+
+	if(!find_label(func, &pc)){
+		fprintf(stderr, "arm_sim: no %s\n", func);
+		return false;
+	}
+
+	for(u32 i = 0; i < 16; i++){
+		cpu.r[i] = 0x5a5a0000 + i;
+	}
+	cpu.r[0] = a0;
+	cpu.r[1] = a1;
+	cpu.r[2] = a2;
+	cpu.r[13] = ARM_SIM_MEM_BASE + ARM_SIM_MEM_SIZE;
+	cpu.r[14] = RET_ADDR;
+	cpu.n = cpu.z = cpu.c = cpu.v = false;
+	memcpy(saved, cpu.r, sizeof(saved));
+
+	*cycles = 0;
+	for(u32 steps = 0; pc < insn_cnt; steps++){
+		if(steps == STEPS_MAX){
+			return fail("no return");
+		}
+		if(!step(&pc, cycles)){
+			return false;
+		}
+	}
+
+	// aapcs callee saved registers
+	for(u32 r = 4; r <= 13; r++){
+		if(r != 12 && cpu.r[r] != saved[r]){
+			return fail("callee saved register clobbered");
+		}
+	}
+
+	*ret = cpu.r[0];
+	return true;
+}
@@ -0,0 +1,20 @@
+#ifndef _ARM_SIM_H
+#define _ARM_SIM_H
+
+#include <utils/types.h>
+
+// interpreter for the arm state subset the bdk assembly routines are written in. it runs the .S
+// source itself on a flat memory and counts arm7tdmi cycles, memory without wait states.
+// data processing, b/bx, ldr/str(b) with immediate offsets and ldm/stm are supported.
+
+#define ARM_SIM_MEM_BASE 0x10000000
+#define ARM_SIM_MEM_SIZE 0x20000
+
+extern u8 arm_sim_mem[ARM_SIM_MEM_SIZE];
+
+bool arm_sim_load(const char *path);
+// calls a label of the loaded source with r0-r2 and sp at the end of the memory. false on a fault
+// or if r4-r11 and sp are not preserved
+bool arm_sim_call(const char *func, u32 a0, u32 a1, u32 a2, u32 *ret, u64 *cycles);
+
+#endif
@@ -0,0 +1,90 @@
+#include "boot_run.h"
+#include "boot_stubs.h"
+#include "host.h"
+#include "se_model.h"
+#include <string.h>
+#include <memory_map.h>
+#include "modchip.h"
+
+// shared with the boot children
+static boot_result_t *result;
+static const void *expected;
+static u32 expected_size;
+
+static void on_jump(){
+	result->jumped = true;
+	result->jump_ns = host_time_ns();
+	result->payload_ok = !memcmp((void*)PAYLOAD_LOAD_ADDR, expected, expected_size);
+	result->stats = *img_stats;
+	result->se_errors = se_model_errors;
+}
+
+static void boot(void *arg){
+	host_time_reset();
+	img_stats_reset();
+	host_set_jump_handler(on_jump);
+	sdloader_main();
+}
+
+void boot_enable_trace(){
+	sd_loader_cfg_t cfg;
+
+	modchip_get_cfg_default(&cfg);
+	cfg.boot_trace = true;
+	memcpy(img_sector(IMG_BOOT0, MODCHIP_CFG_SECTOR) + MODCHIP_CFG_OFFSET, &cfg, sizeof(cfg));
+}
+
+bool boot_run(const void *payload, u32 size, boot_result_t *res){
+	if(!result){
+		result = host_shared_alloc(sizeof(*result));
+	}
+
+	memset(result, 0, sizeof(*result));
+	expected = payload;
+	expected_size = size;
+
+	int code = host_run_isolated(boot, NULL);
+	*res = *result;
+
+	return code == HOST_EXIT_JUMP && res->jumped;
+}
+
+bool boot_stages(u64 jump_ns, u32 total[TRACE_ID_MAX], bool seen[TRACE_ID_MAX]){
+	const trace_sector_t *t = (const trace_sector_t*)img_sector(IMG_BOOT0, TRACE_SECTOR);
+	u32 begin[TRACE_ID_MAX] = {0};
+	bool open[TRACE_ID_MAX] = {0};
+
+	memset(total, 0, TRACE_ID_MAX * sizeof(u32));
+	memset(seen, 0, TRACE_ID_MAX * sizeof(bool));
+
+	if(t->magic != TRACE_MAGIC){
+		return false;
+	}
+
+	const trace_boot_t *b = &t->boots[(t->next + TRACE_MAX_BOOTS - 1) % TRACE_MAX_BOOTS];
+	// the ring keeps the last TRACE_MAX_POINTS points, an end without its begin is dropped
+	u32 n = MIN(b->cnt, TRACE_MAX_POINTS);
+	u32 first = b->cnt > TRACE_MAX_POINTS ? b->cnt % TRACE_MAX_POINTS : 0;
+
+	for(u32 i = 0; i < n; i++){
+		trace_point_t p = b->points[(first + i) % TRACE_MAX_POINTS];
+		u8 id = p.id & ~TRACE_END;
+		if(id >= TRACE_ID_MAX){
+			continue;
+		}
+		if(p.id & TRACE_END){
+			if(open[id]){
+				total[id] += p.us - begin[id];
+				open[id] = false;
+			}
+		}else if(!open[id]){
+			begin[id] = p.us;
+			open[id] = seen[id] = true;
+		}
+	}
+	if(open[TRACE_RELOC]){
+		total[TRACE_RELOC] = jump_ns / 1000 - begin[TRACE_RELOC];
+	}
+
+	return true;
+}
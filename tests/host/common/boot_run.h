@@ -0,0 +1,25 @@
+#ifndef _BOOT_RUN_H
+#define _BOOT_RUN_H
+
+#include "storage_img.h"
+#include "trace.h"
+
+// one boot of sdloader's main() in its own process on the current images, up to the payload jump
+
+typedef struct{
+	bool jumped;
+	bool payload_ok;
+	u64 jump_ns;
+	img_stats_t stats;
+	// se_model_errors of the boot
+	u32 se_errors;
+}boot_result_t;
+
+// boot_trace set in the cfg of a blank boot0 image, as older versions kept it, for boot_stages
+void boot_enable_trace();
+// payload is what the jump has to find at PAYLOAD_LOAD_ADDR. false if the boot never got there
+bool boot_run(const void *payload, u32 size, boot_result_t *res);
+// stage durations (us) of the last boot in the boot0 trace, the reloc stage is closed by the jump
+bool boot_stages(u64 jump_ns, u32 total[TRACE_ID_MAX], bool seen[TRACE_ID_MAX]);
+
+#endif
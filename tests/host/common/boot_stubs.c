@@ -0,0 +1,115 @@
+#include "boot_stubs.h"
+#include "host.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory_map.h>
+#include <gfx.h>
+#include <tui.h>
+#include <display/di.h>
+#include <power/bq24193.h>
+#include <soc/bpmp.h>
+#include <soc/hw_init.h>
+#include <soc/i2c.h>
+#include <utils/btn.h>
+#include <utils/util.h>
+#include "modchip_toolbox.h"
+#include "ums.h"
+
+// hardware main.c touches outside of storage, nothing here is timed but hw_deinit
+
+u8 boot_btn;
+
+gfx_ctxt_t gfx_ctxt = {
+	.width = 180,
+	.height = 320,
+	.stride = 192,
+};
+
+u8 btn_read_vol(){
+	return boot_btn;
+}
+
+u8 i2c_recv_byte(u32 i2c_idx, u32 dev_addr, u32 reg){
+	return 0;
+}
+
+bool is_t210(){
+	return true;
+}
+
+void bpmp_clk_rate_set(bpmp_freq_t fid){
+}
+
+void bpmp_halt(){
+}
+
+void bpmp_mmu_maint_set_phase(u32 phase){
+}
+
+void bq24193_enable_charger(){
+}
+
+void hw_deinit(bool coreboot, u32 magic){
+	host_advance_ns(host_cost.hw_deinit * 1000ull);
+}
+
+void display_init(){
+}
+
+void display_backlight_pwm_init(){
+}
+
+void display_backlight_brightness(u32 brightness, u32 step_delay){
+}
+
+u32 *display_init_window_a_pitch_small_palette(const u32 *lut, const u32 lut_entries){
+	return (u32*)IPL_SMALL_FB_ADDR;
+}
+
+void gfx_init_ctxt(u8 *fb, u32 width, u32 height, u32 stride){
+}
+
+void gfx_con_init(){
+}
+
+void gfx_con_set_origin_rot(u32 x, u32 y){
+}
+
+void gfx_con_setpos_rot(u32 x, u32 y){
+}
+
+void gfx_clear_color(u32 color){
+}
+
+void gfx_clear_rect_rot(u8 color, u32 pos_x, u32 pos_y, u32 width, u32 height){
+}
+
+void gfx_render_bmp_2bit_rot(const u8 *bmp, u32 width, u32 height, u32 pos_x, u32 pos_y){
+}
+
+void tui_print_status(u8 col_fg, const char *fmt){
+	printf("  status: %s\n", fmt);
+}
+
+// a boot that ends in the menu failed to load the payload
+tui_status_t tui_menu_start_rot(tui_entry_menu_t *menu){
+	fflush(stdout);
+	exit(BOOT_EXIT_MENU);
+}
+
+void power_set_state(power_state_t state){
+	fflush(stdout);
+	exit(BOOT_EXIT_POWER);
+}
+
+void rcm_if_t210_or_off(){
+	power_set_state(POWER_OFF);
+}
+
+void toolbox(u32 x, u32 y, sd_loader_cfg_t *cfg){
+	abort();
+}
+
+void ums(u32 pos_x, u32 pos_y){
+	abort();
+}
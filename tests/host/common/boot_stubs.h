@@ -0,0 +1,16 @@
+#ifndef _BOOT_STUBS_H
+#define _BOOT_STUBS_H
+
+#include <utils/types.h>
+
+// child exit codes of a boot that did not reach the payload jump
+#define BOOT_EXIT_MENU  43
+#define BOOT_EXIT_POWER 44
+
+// buttons held during the boot, BTN_VOL_UP/BTN_VOL_DOWN
+extern u8 boot_btn;
+
+// sdloader's main(), renamed by the build
+void sdloader_main();
+
+#endif
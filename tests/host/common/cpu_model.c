@@ -0,0 +1,17 @@
+#include "host.h"
+#include <string.h>
+#include <libs/compr/blz.h>
+
+// bpmp work that matters for the boot time, everything else is free
+
+void *host_cpu_memcpy(void *dst, const void *src, size_t len){
+	host_charge(host_cost.cpu_copy, len);
+	return memcpy(dst, src, len);
+}
+
+int __real_blz_uncompress_inplace(u8 *data, u32 comp_size, const blz_footer *footer);
+
+int __wrap_blz_uncompress_inplace(u8 *data, u32 comp_size, const blz_footer *footer){
+	host_charge(host_cost.blz, comp_size + footer->addl_size);
+	return __real_blz_uncompress_inplace(data, comp_size, footer);
+}
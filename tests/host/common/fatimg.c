@@ -0,0 +1,597 @@
+#include "fatimg.h"
+#include <ctype.h>
+#include <string.h>
+
+typedef struct{
+	fatimg_type_t type;
+	u32 lba;
+	u32 sectors;
+	u32 csize;
+	u32 fat;          // first fat sector
+	u32 fat_size;
+	u32 n_fats;
+	u32 root_sect;    // fat16 fixed root directory
+	u32 root_ents;
+	u32 root_clus;    // fat32/exfat root directory, allocated contiguous
+	u32 data;         // sector of cluster 2
+	u32 nclst;
+	u32 bitmap_clus;  // exfat allocation bitmap
+	u32 next_clus;
+	u32 next_ent;
+}vol_t;
+
+static vol_t vols[IMG_MAX];
+static u32 serial = 0x1234abcd;
+
+static void put16(u8 *p, u16 v){
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put32(u8 *p, u32 v){
+	put16(p, v);
+	put16(p + 2, v >> 16);
+}
+
+static void put64(u8 *p, u64 v){
+	put32(p, v);
+	put32(p + 4, v >> 32);
+}
+
+static u8 *sect(img_id_t id, u32 s){
+	return img_sector(id, s);
+}
+
+static u32 clus_sect(const vol_t *v, u32 clus){
+	return v->data + (clus - 2) * v->csize;
+}
+
+static void set_fat(img_id_t id, const vol_t *v, u32 clus, u32 val){
+	u32 ent = v->type == FATIMG_FAT16 ? 2 : 4;
+	for(u32 i = 0; i < v->n_fats; i++){
+		u8 *p = sect(id, v->fat + i * v->fat_size) + clus * ent;
+		if(ent == 2){
+			put16(p, val);
+		}else{
+			put32(p, val);
+		}
+	}
+
+	if(v->type == FATIMG_EXFAT && v->bitmap_clus && val){
+		u8 *bm = sect(id, clus_sect(v, v->bitmap_clus));
+		bm[(clus - 2) / 8] |= 1 << ((clus - 2) % 8);
+	}
+}
+
+static u32 eoc(const vol_t *v){
+	switch(v->type){
+	case FATIMG_FAT16:
+		return 0xffff;
+	case FATIMG_FAT32:
+		return 0x0fffffff;
+	default:
+		return 0xffffffff;
+	}
+}
+
+// chain of cnt clusters, a free cluster after every frag clusters if frag != 0
+static u32 alloc_chain(img_id_t id, vol_t *v, u32 cnt, u32 frag, u32 *clusters, u32 *frags){
+	u32 first = 0, prev = 0;
+	*frags = 0;
+
+	for(u32 i = 0; i < cnt; i++){
+		if(i && frag && !(i % frag)){
+			v->next_clus++;
+		}
+		if(v->next_clus >= v->nclst + 2){
+			return 0;
+		}
+
+		u32 c = v->next_clus++;
+		if(prev){
+			set_fat(id, v, prev, c);
+		}
+		if(!prev || c != prev + 1){
+			(*frags)++;
+		}
+		if(!first){
+			first = c;
+		}
+		if(clusters){
+			clusters[i] = c;
+		}
+		prev = c;
+	}
+
+	if(prev){
+		set_fat(id, v, prev, eoc(v));
+	}
+	return first;
+}
+
+static u8 *dir_ent(img_id_t id, const vol_t *v, u32 idx, u32 *s, u32 *ofs){
+	u32 byte = idx * 32;
+	if(v->type == FATIMG_FAT16){
+		*s = v->root_sect + byte / 0x200;
+	}else{
+		*s = clus_sect(v, v->root_clus) + byte / 0x200;
+	}
+	*ofs = byte % 0x200;
+	return sect(id, *s) + *ofs;
+}
+
+static bool to_sfn(const char *name, u8 *sfn){
+	memset(sfn, ' ', 11);
+	const char *dot = strchr(name, '.');
+	u32 base = dot ? (u32)(dot - name) : strlen(name);
+	if(!base || base > 8 || (dot && strlen(dot + 1) > 3)){
+		return false;
+	}
+	for(u32 i = 0; i < base; i++){
+		sfn[i] = toupper((u8)name[i]);
+	}
+	for(u32 i = 0; dot && dot[1 + i]; i++){
+		sfn[8 + i] = toupper((u8)dot[1 + i]);
+	}
+	return true;
+}
+
+static u16 name_hash(const char *name){
+	u16 hash = 0;
+	for(; *name; name++){
+		u16 c = toupper((u8)*name);
+		hash = ((hash & 1) ? 0x8000 : 0) + (hash >> 1) + (c & 0xff);
+		hash = ((hash & 1) ? 0x8000 : 0) + (hash >> 1) + (c >> 8);
+	}
+	return hash;
+}
+
+static u16 set_sum(const u8 *set){
+	u32 len = (set[1] + 1) * 32;
+	u16 sum = 0;
+	for(u32 i = 0; i < len; i++){
+		if(i == 2 || i == 3){
+			continue;
+		}
+		sum = ((sum & 1) ? 0x8000 : 0) + (sum >> 1) + set[i];
+	}
+	return sum;
+}
+
+static void exfat_names(u8 *set, const char *name){
+	u32 len = strlen(name);
+	u32 n = (len + 14) / 15;
+
+	set[32 + 3] = len;
+	put16(set + 32 + 4, name_hash(name));
+	for(u32 i = 0; i < n; i++){
+		u8 *e = set + 64 + i * 32;
+		memset(e, 0, 32);
+		e[0] = 0xc1;
+		for(u32 j = 0; j < 15 && i * 15 + j < len; j++){
+			put16(e + 2 + j * 2, (u8)name[i * 15 + j]);
+		}
+	}
+	put16(set + 2, set_sum(set));
+}
+
+static void write_dir_bytes(img_id_t id, const vol_t *v, u32 idx, const u8 *src, u32 cnt){
+	for(u32 i = 0; i < cnt; i++){
+		u32 s, ofs;
+		memcpy(dir_ent(id, v, idx + i, &s, &ofs), src + i * 32, 32);
+	}
+}
+
+static void read_dir_bytes(img_id_t id, const vol_t *v, u32 idx, u8 *dst, u32 cnt){
+	for(u32 i = 0; i < cnt; i++){
+		u32 s, ofs;
+		memcpy(dst + i * 32, dir_ent(id, v, idx + i, &s, &ofs), 32);
+	}
+}
+
+static void exfat_boot_region(img_id_t id, vol_t *v){
+	u8 *vbr = sect(id, v->lba);
+	vbr[0] = 0xeb;
+	vbr[1] = 0x76;
+	vbr[2] = 0x90;
+	memcpy(vbr + 3, "EXFAT   ", 8);
+	put64(vbr + 64, v->lba);
+	put64(vbr + 72, v->sectors);
+	put32(vbr + 80, v->fat - v->lba);
+	put32(vbr + 84, v->fat_size);
+	put32(vbr + 88, v->data - v->lba);
+	put32(vbr + 92, v->nclst);
+	put32(vbr + 96, v->root_clus);
+	put32(vbr + 100, serial);
+	put16(vbr + 104, 0x100);
+	vbr[108] = 9;
+	vbr[109] = __builtin_ctz(v->csize);
+	vbr[110] = 1;
+	vbr[111] = 0x80;
+	vbr[510] = 0x55;
+	vbr[511] = 0xaa;
+
+	for(u32 i = 1; i <= 8; i++){
+		put32(sect(id, v->lba + i) + 508, 0xaa550000);
+	}
+
+	u32 sum = 0;
+	for(u32 i = 0; i < 11 * 0x200; i++){
+		if(i == 106 || i == 107 || i == 112){
+			continue;
+		}
+		sum = ((sum & 1) ? 0x80000000 : 0) + (sum >> 1) + sect(id, v->lba)[i];
+	}
+	for(u32 i = 0; i < 0x200; i += 4){
+		put32(sect(id, v->lba + 11) + i, sum);
+	}
+
+	memcpy(sect(id, v->lba + 12), sect(id, v->lba), 12 * 0x200);
+}
+
+static void fat_boot_sector(img_id_t id, vol_t *v, u32 rsvd){
+	u8 *vbr = sect(id, v->lba);
+	bool fat32 = v->type == FATIMG_FAT32;
+
+	vbr[0] = 0xeb;
+	vbr[1] = fat32 ? 0x58 : 0x3c;
+	vbr[2] = 0x90;
+	memcpy(vbr + 3, "MSDOS5.0", 8);
+	put16(vbr + 11, 0x200);
+	vbr[13] = v->csize;
+	put16(vbr + 14, rsvd);
+	vbr[16] = v->n_fats;
+	put16(vbr + 17, v->root_ents);
+	if(v->sectors < 0x10000 && !fat32){
+		put16(vbr + 19, v->sectors);
+	}else{
+		put32(vbr + 32, v->sectors);
+	}
+	vbr[21] = 0xf8;
+	put16(vbr + 24, 63);
+	put16(vbr + 26, 255);
+	put32(vbr + 28, v->lba);
+
+	u8 *ext = vbr + (fat32 ? 64 : 36);
+	if(fat32){
+		put32(vbr + 36, v->fat_size);
+		put32(vbr + 44, v->root_clus);
+		put16(vbr + 48, 1);
+		put16(vbr + 50, 6);
+	}else{
+		put16(vbr + 22, v->fat_size);
+	}
+	ext[0] = 0x80;
+	ext[2] = 0x29;
+	put32(ext + 3, serial);
+	memcpy(ext + 7, "NO NAME    ", 11);
+	memcpy(ext + 18, fat32 ? "FAT32   " : "FAT16   ", 8);
+	vbr[510] = 0x55;
+	vbr[511] = 0xaa;
+
+	if(fat32){
+		u8 *fsi = sect(id, v->lba + 1);
+		put32(fsi, 0x41615252);
+		put32(fsi + 484, 0x61417272);
+		put32(fsi + 488, 0xffffffff);
+		put32(fsi + 492, 0xffffffff);
+		put32(fsi + 508, 0xaa550000);
+		memcpy(sect(id, v->lba + 6), vbr, 0x200);
+		memcpy(sect(id, v->lba + 7), fsi, 0x200);
+	}
+}
+
+void fatimg_set_serial(u32 vol_serial){
+	serial = vol_serial;
+}
+
+bool fatimg_format(img_id_t id, u32 lba, u32 sectors, fatimg_type_t type, u32 clus_sectors, bool mbr){
+	vol_t *v = &vols[id];
+	u32 ent = type == FATIMG_FAT16 ? 2 : 4;
+	u32 rsvd = type == FATIMG_FAT16 ? 4 : 32;
+
+	if(!img[id].data || lba + sectors > img[id].sectors || (mbr && !lba)){
+		return false;
+	}
+
+	memset(v, 0, sizeof(*v));
+	memset(sect(id, lba), 0, sectors * 0x200);
+	v->type = type;
+	v->lba = lba;
+	v->sectors = sectors;
+	v->csize = clus_sectors;
+	v->n_fats = type == FATIMG_EXFAT ? 1 : 2;
+	v->root_ents = type == FATIMG_FAT16 ? 512 : 0;
+	v->fat = lba + rsvd;
+
+	u32 root_sects = v->root_ents * 32 / 0x200;
+	for(u32 fs = 1;;){
+		u32 sys = type == FATIMG_EXFAT ? ALIGN(rsvd + fs, clus_sectors) : rsvd + v->n_fats * fs + root_sects;
+		if(sys >= sectors){
+			return false;
+		}
+		v->nclst = (sectors - sys) / clus_sectors;
+		u32 need = ((v->nclst + 2) * ent + 0x1ff) / 0x200;
+		if(need <= fs){
+			v->fat_size = fs;
+			v->data = lba + sys;
+			break;
+		}
+		fs = need;
+	}
+
+	// fatfs tells fat12/16/32 apart by the cluster count only
+	if((type == FATIMG_FAT16 && (v->nclst < 4086 || v->nclst > 65525)) || (type == FATIMG_FAT32 && v->nclst < 65526)){
+		return false;
+	}
+
+	v->root_sect = v->fat + v->n_fats * v->fat_size;
+	v->next_clus = 2;
+
+	set_fat(id, v, 0, type == FATIMG_FAT16 ? 0xfff8 : type == FATIMG_FAT32 ? 0x0ffffff8 : 0xfffffff8);
+	set_fat(id, v, 1, eoc(v));
+
+	// 64 root directory entries are plenty for tests
+	u32 root_clusters = (64 * 32 + clus_sectors * 0x200 - 1) / (clus_sectors * 0x200);
+	u32 frags;
+
+	if(type == FATIMG_EXFAT){
+		u32 bm_len = (v->nclst + 7) / 8;
+		u32 bm_clusters = (bm_len + clus_sectors * 0x200 - 1) / (clus_sectors * 0x200);
+		v->bitmap_clus = 2;
+		// the bitmap marks its own clusters
+		alloc_chain(id, v, bm_clusters, 0, NULL, &frags);
+
+		u32 upcase = alloc_chain(id, v, 1, 0, NULL, &frags);
+		u8 *tbl = sect(id, clus_sect(v, upcase));
+		u32 tbl_sum = 0;
+		for(u32 i = 0; i < 128; i++){
+			put16(tbl + i * 2, toupper(i));
+		}
+		for(u32 i = 0; i < 256; i++){
+			tbl_sum = ((tbl_sum & 1) ? 0x80000000 : 0) + (tbl_sum >> 1) + tbl[i];
+		}
+
+		v->root_clus = alloc_chain(id, v, root_clusters, 0, NULL, &frags);
+
+		u8 ents[64] = {0};
+		ents[0] = 0x81;
+		put32(ents + 20, v->bitmap_clus);
+		put64(ents + 24, bm_len);
+		ents[32] = 0x82;
+		put32(ents + 36, tbl_sum);
+		put32(ents + 52, upcase);
+		put64(ents + 56, 256);
+		write_dir_bytes(id, v, 0, ents, 2);
+		v->next_ent = 2;
+
+		exfat_boot_region(id, v);
+	}else{
+		if(type == FATIMG_FAT32){
+			v->root_clus = alloc_chain(id, v, root_clusters, 0, NULL, &frags);
+		}
+		fat_boot_sector(id, v, rsvd);
+	}
+
+	if(mbr){
+		u8 *m = sect(id, 0);
+		memset(m, 0, 0x200);
+		u8 *pte = m + 446;
+		pte[1] = 0xfe;
+		pte[2] = 0xff;
+		pte[3] = 0xff;
+		pte[4] = type == FATIMG_EXFAT ? 0x07 : type == FATIMG_FAT32 ? 0x0c : 0x0e;
+		pte[5] = 0xfe;
+		pte[6] = 0xff;
+		pte[7] = 0xff;
+		put32(pte + 8, lba);
+		put32(pte + 12, sectors);
+		m[510] = 0x55;
+		m[511] = 0xaa;
+	}
+
+	return true;
+}
+
+void fatimg_skip_clusters(img_id_t id, u32 cnt){
+	u32 frags;
+	alloc_chain(id, &vols[id], cnt, 0, NULL, &frags);
+}
+
+bool fatimg_add_file(img_id_t id, const char *name, const void *data, u32 size, u32 frag_clusters, fatimg_file_t *file){
+	vol_t *v = &vols[id];
+	u32 clus_bytes = v->csize * 0x200;
+	u32 cnt = (size + clus_bytes - 1) / clus_bytes;
+	u32 frags = 0;
+	u32 first = 0;
+	fatimg_file_t info = {0};
+
+	if(cnt){
+		u32 clusters[cnt];
+		first = alloc_chain(id, v, cnt, frag_clusters, clusters, &frags);
+		if(!first){
+			return false;
+		}
+		for(u32 i = 0; i < cnt; i++){
+			u32 len = MIN(size - i * clus_bytes, clus_bytes);
+			memcpy(sect(id, clus_sect(v, clusters[i])), (const u8*)data + i * clus_bytes, len);
+		}
+		info.data_sect = clus_sect(v, first);
+	}
+	info.clus = first;
+	info.frags = frags;
+
+	if(v->type == FATIMG_EXFAT){
+		u32 n = (strlen(name) + 14) / 15;
+		u8 set[32 * 20] = {0};
+		set[0] = 0x85;
+		set[1] = 1 + n;
+		put16(set + 4, 0x20);
+		set[32] = 0xc0;
+		// contiguous files go without fat chain like every exfat driver writes them
+		set[33] = 0x01 | (frags <= 1 ? 0x02 : 0);
+		put64(set + 40, size);
+		put32(set + 52, first);
+		put64(set + 56, size);
+		exfat_names(set, name);
+
+		dir_ent(id, v, v->next_ent, &info.ent_sect, &info.ent_ofs);
+		write_dir_bytes(id, v, v->next_ent, set, 2 + n);
+		v->next_ent += 2 + n;
+	}else{
+		u8 e[32] = {0};
+		if(!to_sfn(name, e)){
+			return false;
+		}
+		e[11] = 0x20;
+		put16(e + 20, first >> 16);
+		put16(e + 26, first);
+		put32(e + 28, size);
+
+		memcpy(dir_ent(id, v, v->next_ent, &info.ent_sect, &info.ent_ofs), e, 32);
+		v->next_ent++;
+	}
+
+	if(file){
+		*file = info;
+	}
+	return true;
+}
+
+// index of the entry (set) of name, -1 if not found
+static int find_ent(img_id_t id, const vol_t *v, const char *name, u32 *n){
+	u8 sfn[11];
+	bool fat = v->type != FATIMG_EXFAT;
+
+	if(fat && !to_sfn(name, sfn)){
+		return -1;
+	}
+
+	for(u32 i = 0; i < v->next_ent; i++){
+		u8 e[32 * 20];
+		read_dir_bytes(id, v, i, e, 1);
+
+		if(fat){
+			if(!memcmp(e, sfn, 11)){
+				*n = 1;
+				return i;
+			}
+			continue;
+		}
+
+		if(e[0] != 0x85){
+			continue;
+		}
+
+		read_dir_bytes(id, v, i, e, e[1] + 1);
+		u32 len = e[32 + 3];
+		bool match = len == strlen(name);
+		for(u32 j = 0; match && j < len; j++){
+			match = toupper(e[64 + (j / 15) * 32 + 2 + (j % 15) * 2]) == toupper((u8)name[j]);
+		}
+		if(match){
+			*n = e[1] + 1;
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+bool fatimg_delete(img_id_t id, const char *name){
+	vol_t *v = &vols[id];
+	u32 n;
+	int idx = find_ent(id, v, name, &n);
+
+	if(idx < 0){
+		return false;
+	}
+
+	for(u32 i = 0; i < n; i++){
+		u32 s, ofs;
+		u8 *e = dir_ent(id, v, idx + i, &s, &ofs);
+		if(v->type == FATIMG_EXFAT){
+			e[0] &= 0x7f;
+		}else{
+			e[0] = 0xe5;
+		}
+	}
+	return true;
+}
+
+bool fatimg_update(img_id_t id, const char *name, const void *data, u32 size, u32 frag_clusters){
+	vol_t *v = &vols[id];
+	u32 clus_bytes = v->csize * 0x200;
+	u32 cnt = (size + clus_bytes - 1) / clus_bytes;
+	u32 n, frags = 1;
+	int idx = find_ent(id, v, name, &n);
+	u8 set[32 * 20];
+
+	if(idx < 0 || !cnt){
+		return false;
+	}
+
+	read_dir_bytes(id, v, idx, set, n);
+	bool exfat = v->type == FATIMG_EXFAT;
+	u32 first = exfat ? set[32 + 20] | set[32 + 21] << 8 | set[32 + 22] << 16 | set[32 + 23] << 24 : (set[20] | set[21] << 8) << 16 | set[26] | set[27] << 8;
+	if(!first){
+		return false;
+	}
+
+	u32 clusters[cnt];
+	clusters[0] = first;
+	if(!frag_clusters){
+		for(u32 i = 1; i < cnt; i++){
+			clusters[i] = first + i;
+		}
+	}else if(cnt > 1){
+		// a gap right behind the first cluster, then fragments from the allocation point
+		v->next_clus++;
+		if(!alloc_chain(id, v, cnt - 1, frag_clusters, clusters + 1, &frags)){
+			return false;
+		}
+		frags += clusters[1] != first + 1;
+	}
+
+	for(u32 i = 0; i < cnt; i++){
+		set_fat(id, v, clusters[i], i + 1 < cnt ? clusters[i + 1] : eoc(v));
+		u32 len = MIN(size - i * clus_bytes, clus_bytes);
+		memcpy(sect(id, clus_sect(v, clusters[i])), (const u8*)data + i * clus_bytes, len);
+	}
+
+	// two seconds later is enough for a different entry
+	if(exfat){
+		put32(set + 12, (set[12] | set[13] << 8 | set[14] << 16 | set[15] << 24) + 1);
+		set[32 + 1] = 0x01 | (frags <= 1 ? 0x02 : 0);
+		put64(set + 32 + 8, size);
+		put64(set + 32 + 24, size);
+		put16(set + 2, set_sum(set));
+	}else{
+		put16(set + 22, (set[22] | set[23] << 8) + 1);
+		put32(set + 28, size);
+	}
+	write_dir_bytes(id, v, idx, set, n);
+
+	return true;
+}
+
+bool fatimg_rename(img_id_t id, const char *name, const char *new_name){
+	vol_t *v = &vols[id];
+	u32 n;
+	int idx = find_ent(id, v, name, &n);
+
+	if(idx < 0 || strlen(name) != strlen(new_name)){
+		return false;
+	}
+
+	if(v->type == FATIMG_EXFAT){
+		u8 set[32 * 20];
+		read_dir_bytes(id, v, idx, set, n);
+		exfat_names(set, new_name);
+		write_dir_bytes(id, v, idx, set, n);
+		return true;
+	}
+
+	u32 s, ofs;
+	return to_sfn(new_name, dir_ent(id, v, idx, &s, &ofs));
+}
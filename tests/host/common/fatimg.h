@@ -0,0 +1,39 @@
+#ifndef _FATIMG_H
+#define _FATIMG_H
+
+#include "storage_img.h"
+
+// minimal fat16/fat32/exfat formatter for test images, files live in the root directory
+
+typedef enum{
+	FATIMG_FAT16 = 0,
+	FATIMG_FAT32,
+	FATIMG_EXFAT,
+}fatimg_type_t;
+
+typedef struct{
+	u32 clus;       // first cluster
+	u32 data_sect;  // first data sector, relative to the image
+	u32 ent_sect;   // sector holding the (first) directory entry, relative to the image
+	u32 ent_ofs;
+	u32 frags;      // number of fragments
+}fatimg_file_t;
+
+// volume serial number of the following formats
+void fatimg_set_serial(u32 vol_serial);
+// formats sectors at lba of image id, mbr adds a partition table in sector 0 pointing to it
+bool fatimg_format(img_id_t id, u32 lba, u32 sectors, fatimg_type_t type, u32 clus_sectors, bool mbr);
+// frag_clusters != 0 splits the file into fragments of that many clusters with a free cluster in between
+bool fatimg_add_file(img_id_t id, const char *name, const void *data, u32 size, u32 frag_clusters, fatimg_file_t *file);
+// marks the entry deleted, its clusters stay allocated like after a crash
+bool fatimg_delete(img_id_t id, const char *name);
+// rewrites the file like an editor saving over it: same directory entry and first cluster, the
+// modification time moves on. frag_clusters == 0 keeps the clusters of a contiguous file, otherwise
+// the clusters behind the first one are allocated anew with gaps like fatimg_add_file
+bool fatimg_update(img_id_t id, const char *name, const void *data, u32 size, u32 frag_clusters);
+// same length names only, the entry stays where it is
+bool fatimg_rename(img_id_t id, const char *name, const char *new_name);
+// allocates and leaves empty clusters, moves the allocation point like other files would
+void fatimg_skip_clusters(img_id_t id, u32 cnt);
+
+#endif
@@ -0,0 +1,128 @@
+#define _GNU_SOURCE
+#include "host.h"
+#include <memory_map.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+host_cost_t host_cost = {
+	.cpu_copy    = 5000,     // ~200MB/s ldm/stm copy at boost clock
+	.se_sha      = 4000,     // ~250MB/s
+	.blz         = 20000,    // ~50MB/s of output
+	.sd_cmd      = 40000,
+	.sd_sector   = 6400,     // sdr104, ~80MB/s
+	.emmc_cmd    = 30000,
+	.emmc_sector = 2600,     // hs400, ~200MB/s
+	.emmc_write_sector = 20000, // ~25MB/s
+	.emmc_switch = 300000,
+	.sd_power_up = 35000,
+	.sd_init     = 60000,
+	.sd_tune     = 40000,
+	.emmc_init   = 25000,
+	.emmc_tune   = 15000,
+	.sdmmc_init  = 1000,
+	.hw_deinit   = 2000,
+};
+
+int host_failures = 0;
+
+u64 host_now_ns;
+static void (*jump_handler)();
+
+u64 host_time_ns(){
+	return host_now_ns;
+}
+
+void host_advance_ns(u64 ns){
+	host_now_ns += ns;
+}
+
+void host_wait_until_ns(u64 t){
+	if(t > host_now_ns){
+		host_now_ns = t;
+	}
+}
+
+void host_time_reset(){
+	host_now_ns = 0;
+}
+
+void host_charge(u32 ps_per_byte, u32 bytes){
+	host_now_ns += (u64)ps_per_byte * bytes / 1000;
+}
+
+void *host_shared_alloc(u32 size){
+	void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(p == MAP_FAILED){
+		perror("mmap");
+		exit(2);
+	}
+	return p;
+}
+
+void host_set_jump_handler(void (*fn)()){
+	jump_handler = fn;
+}
+
+// iram is not executable, the payload jump ends up here
+static void segv_handler(int sig, siginfo_t *info, void *ctx){
+	if(info->si_addr == (void*)PAYLOAD_LOAD_ADDR){
+		if(jump_handler){
+			jump_handler();
+		}
+		_exit(HOST_EXIT_JUMP);
+	}
+
+	static const char msg[] = "segfault outside the payload jump\n";
+	write(2, msg, sizeof(msg) - 1);
+	_exit(3);
+}
+
+int host_run_isolated(void (*fn)(void *arg), void *arg){
+	fflush(stdout);
+	fflush(stderr);
+
+	pid_t pid = fork();
+	if(pid < 0){
+		perror("fork");
+		exit(2);
+	}
+
+	if(!pid){
+		struct sigaction sa = {0};
+		sa.sa_sigaction = segv_handler;
+		sa.sa_flags = SA_SIGINFO;
+		sigaction(SIGSEGV, &sa, NULL);
+		fn(arg);
+		fflush(stdout);
+		_exit(host_failures ? 1 : 0);
+	}
+
+	int status;
+	waitpid(pid, &status, 0);
+	if(!WIFEXITED(status)){
+		fprintf(stderr, "child died with signal %d\n", WTERMSIG(status));
+		return -1;
+	}
+	return WEXITSTATUS(status);
+}
+
+int host_result(const char *name){
+	if(host_failures){
+		printf("%s: %d check(s) failed\n", name, host_failures);
+		return 1;
+	}
+	printf("%s: ok\n", name);
+	return 0;
+}
+
+__attribute__((constructor)) static void map_iram(){
+	void *p = mmap((void*)HOST_IRAM_BASE, HOST_IRAM_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	if(p != (void*)HOST_IRAM_BASE){
+		perror("iram mmap");
+		exit(2);
+	}
+}
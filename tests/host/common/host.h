@@ -0,0 +1,78 @@
+#ifndef _HOST_H
+#define _HOST_H
+
+#include <stdio.h>
+#include <utils/types.h>
+
+// iram is mapped at its real address, the sdloader memory map is used unchanged
+#define HOST_IRAM_BASE 0x40000000
+#define HOST_IRAM_SIZE 0x40000
+
+// exit code of a child that reached the payload jump
+#define HOST_EXIT_JUMP 42
+
+// modelled costs, times in ns unless noted. not measured on a console, only meant to compare runs
+typedef struct{
+	// bpmp and se work, ps per byte
+	u32 cpu_copy;
+	u32 se_sha;
+	u32 blz;
+	// one command incl. response and data setup, and one 512 byte sector on the bus
+	u32 sd_cmd;
+	u32 sd_sector;
+	u32 emmc_cmd;
+	u32 emmc_sector;
+	// programming a written sector, boot partitions are slc-like but still far slower than reads
+	u32 emmc_write_sector;
+	// CMD6 partition access switch incl. busy
+	u32 emmc_switch;
+	// card power up, overlaps other work after sd_initialize_start (us)
+	u32 sd_power_up;
+	// identification up to the transfer mode and the tuning on top of it (us)
+	u32 sd_init;
+	u32 sd_tune;
+	u32 emmc_init;
+	u32 emmc_tune;
+	// controller bring up (us)
+	u32 sdmmc_init;
+	u32 hw_deinit;
+}host_cost_t;
+
+extern host_cost_t host_cost;
+extern int host_failures;
+
+#define CHECK(cond) do{ \
+	if(!(cond)){ \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		host_failures++; \
+	} \
+}while(0)
+
+#define CHECK_EQ(a, b) do{ \
+	long long _a = (long long)(a), _b = (long long)(b); \
+	if(_a != _b){ \
+		fprintf(stderr, "%s:%d: check failed: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+		host_failures++; \
+	} \
+}while(0)
+
+// simulated clock, only the models advance it
+u64  host_time_ns();
+void host_advance_ns(u64 ns);
+void host_wait_until_ns(u64 t);
+void host_time_reset();
+// ps per byte cost of a cpu/se operation
+void host_charge(u32 ps_per_byte, u32 bytes);
+
+// zeroed memory shared with forked children
+void *host_shared_alloc(u32 size);
+
+// runs fn in a forked child so sdloader statics start from zero again, returns the child exit code
+int host_run_isolated(void (*fn)(void *arg), void *arg);
+// called in the child when it jumps to PAYLOAD_LOAD_ADDR, the child exits with HOST_EXIT_JUMP afterwards
+void host_set_jump_handler(void (*fn)());
+
+// prints the summary, returns the exit code of the test
+int host_result(const char *name);
+
+#endif
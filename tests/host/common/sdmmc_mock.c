@@ -0,0 +1,480 @@
+#include "sdmmc_mock.h"
+#include "host.h"
+#include <stdint.h>
+#include <string.h>
+#include <storage/emmc.h>
+#include <storage/mmc.h>
+#include <storage/sd.h>
+#include <storage/sd_def.h>
+
+sdmmc_mock_t mock;
+sdmmc_t mock_sdmmc;
+sdmmc_storage_t mock_storage;
+
+// the request left running by sdmmc_submit_req
+static struct{
+	mock_cmd_t *log;
+	sdmmc_req_t req;
+	u32 sector;
+	u32 blocks;
+	bool fail;
+}pending;
+
+static u32 rsp[4];
+
+void mock_reset(u8 *data, u32 sectors){
+	memset(&mock, 0, sizeof(mock));
+	mock.data = data;
+	mock.sectors = sectors;
+	mock.cmd_ns = 40000;
+	mock.sector_ns = 6400;
+	mock.stop_ns = 60000;
+	mock.poll_ns = 1000;
+	mock.cmd23 = true;
+
+	memset(&mock_sdmmc, 0, sizeof(mock_sdmmc));
+	mock_sdmmc.id = SDMMC_1;
+	mock_sdmmc.card_clock = 400; // khz
+	mock_sdmmc.card_clock_enabled = 1;
+	mock_sdmmc.timing = SDHCI_TIMING_UHS_SDR104;
+
+	memset(&mock_storage, 0, sizeof(mock_storage));
+	mock_storage.sdmmc = &mock_sdmmc;
+	mock_storage.has_sector_access = 1;
+	mock_storage.sec_cnt = sectors;
+	mock_storage.initialized = 1;
+}
+
+u32 mock_data_cmds(mock_cmd_t *out, u32 max){
+	u32 n = 0;
+	for(u32 i = 0; i < mock.log_cnt && n < max; i++){
+		if(mock.log[i].cmd == MMC_READ_MULTIPLE_BLOCK || mock.log[i].cmd == MMC_WRITE_MULTIPLE_BLOCK){
+			out[n++] = mock.log[i];
+		}
+	}
+	return n;
+}
+
+u32 mock_cmd_count(u16 cmd){
+	u32 n = 0;
+	for(u32 i = 0; i < mock.log_cnt; i++){
+		n += mock.log[i].cmd == cmd;
+	}
+	return n;
+}
+
+static mock_cmd_t *log_cmd(u16 cmd, u32 arg, bool async){
+	static mock_cmd_t dummy;
+	mock_cmd_t *l = mock.log_cnt < MOCK_LOG_MAX ? &mock.log[mock.log_cnt++] : &dummy;
+
+	memset(l, 0, sizeof(*l));
+	l->cmd = cmd;
+	l->arg = arg;
+	l->async = async;
+	l->start_ns = host_time_ns();
+	return l;
+}
+
+// how a data request ends, the transfer itself is done by finish_data
+static u64 start_data(sdmmc_cmd_t *cmd, sdmmc_req_t *req, u32 *blocks, bool *fail){
+	u32 sector = cmd->arg;
+	u64 cost = mock.cmd_ns;
+
+	mock.data_reqs++;
+	*blocks = req->num_sectors;
+	*fail = false;
+
+	if(req->is_auto_set_blkcnt){
+		cost += mock.cmd_ns;
+		// rejected, nothing is transferred
+		if(!mock.cmd23 || mock.cmd23_rejects){
+			mock.cmd23_rejects -= !!mock.cmd23_rejects;
+			*blocks = 0;
+			*fail = true;
+		}
+	}
+
+	if(sector + req->num_sectors > mock.sectors){
+		*blocks = sector < mock.sectors ? mock.sectors - sector : 0;
+		*fail = true;
+	}
+
+	u32 fault_blocks = 0;
+	if(!*fail && mock.fault && mock.fault(mock.data_reqs, sector, req->num_sectors, req->is_write, &fault_blocks)){
+		*blocks = MIN(fault_blocks, req->num_sectors);
+		*fail = true;
+	}
+
+	cost += (u64)*blocks * mock.sector_ns;
+	if(req->is_auto_stop_trn && !*fail){
+		cost += mock.stop_ns;
+	}
+
+	return cost;
+}
+
+static void finish_data(mock_cmd_t *l, sdmmc_req_t *req, u32 sector, u32 blocks, bool fail){
+	u8 *card = mock.data + (u64)sector * 0x200;
+
+	if(req->is_write){
+		memcpy(card, req->buf, blocks * 0x200);
+	}else{
+		memcpy(req->buf, card, blocks * 0x200);
+	}
+
+	l->blocks = blocks;
+	l->ok = !fail;
+	l->end_ns = host_time_ns();
+	mock.data_state = fail;
+}
+
+static bool sector_cmd(u16 cmd){
+	return cmd == MMC_READ_SINGLE_BLOCK || cmd == MMC_READ_MULTIPLE_BLOCK || cmd == MMC_WRITE_BLOCK ||
+		cmd == MMC_WRITE_MULTIPLE_BLOCK;
+}
+
+#define APP(cmd) ((cmd) | 0x100)
+
+// the card side of an init, an sdhc card of mock.sectors without 1.8v signaling or an emmc
+static int card_cmd(mock_cmd_t *l, sdmmc_cmd_t *cmd, sdmmc_req_t *req){
+	u16 c = mock.app_cmd ? APP(cmd->cmd) : cmd->cmd;
+	mock.app_cmd = false;
+
+	host_advance_ns(mock.cmd_ns);
+	memset(rsp, 0, sizeof(rsp));
+	rsp[0] = R1_READY_FOR_DATA | R1_STATE(R1_STATE_TRAN);
+	if(req){
+		memset(req->buf, 0, req->blksize * req->num_sectors);
+	}
+
+	switch(c){
+	case MMC_GO_IDLE_STATE:
+		mock.powering = false;
+		break;
+	case MMC_SEND_OP_COND:
+		rsp[0] = MMC_CARD_BUSY | MMC_CARD_CCS | MMC_CARD_VDD_18;
+		break;
+	case SD_SEND_IF_COND:
+		if(mock.card == MOCK_CARD_SD){
+			rsp[0] = cmd->arg & 0xfff;
+		}
+		break;
+	case MMC_APP_CMD:
+		mock.app_cmd = true;
+		rsp[0] |= R1_APP_CMD;
+		break;
+	case APP(SD_APP_OP_COND):
+		if(!mock.powering){
+			mock.powering = true;
+			mock.power_start_ns = host_time_ns();
+		}
+		rsp[0] = SD_OCR_VDD_32_33;
+		if(host_time_ns() - mock.power_start_ns >= mock.power_up_ns){
+			rsp[0] |= SD_OCR_BUSY | (cmd->arg & SD_OCR_CCS);
+		}
+		break;
+	case MMC_ALL_SEND_CID:
+		rsp[0] = 0x03534453; // manufacturer 3, oem "SD"
+		rsp[1] = 0x4d4f434b;
+		rsp[2] = 0x10123456;
+		rsp[3] = 0x78012a00;
+		break;
+	case SD_SEND_RELATIVE_ADDR:
+		// the emmc gets its address from the host
+		if(mock.card == MOCK_CARD_SD){
+			rsp[0] = 0xaaaa << 16;
+		}
+		break;
+	case MMC_SEND_CSD:
+		// csd v2, c_size in 512k units
+		if(mock.card == MOCK_CARD_SD){
+			rsp[0] = 1 << 30;
+			rsp[1] = (mock.sectors / 1024 - 1) >> 16;
+			rsp[2] = (mock.sectors / 1024 - 1) << 16;
+		}
+		break;
+	case APP(SD_APP_SEND_SCR):
+		// spec 2.00 with 3.0, 1 and 4 bit bus, CMD23
+		memcpy(req->buf, "\x02\x05\x80\x02", 4);
+		break;
+	}
+
+	l->ok = 1;
+	l->end_ns = host_time_ns();
+	return 1;
+}
+
+int sdmmc_execute_cmd(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req, u32 *blkcnt_out){
+	if(mock.busy){
+		mock.overlaps++;
+		return 0;
+	}
+
+	mock_cmd_t *l = log_cmd(cmd->cmd, cmd->arg, false);
+
+	if(mock.card && !sector_cmd(cmd->cmd)){
+		return card_cmd(l, cmd, req);
+	}
+
+	if(req){
+		l->set_blkcnt = req->is_auto_set_blkcnt;
+		u32 blocks;
+		bool fail;
+		host_advance_ns(start_data(cmd, req, &blocks, &fail));
+		finish_data(l, req, cmd->arg, blocks, fail);
+		if(blkcnt_out){
+			*blkcnt_out = blocks;
+		}
+		return !fail;
+	}
+
+	host_advance_ns(mock.cmd_ns);
+	rsp[0] = R1_READY_FOR_DATA | R1_STATE(mock.data_state ? R1_STATE_DATA : R1_STATE_TRAN);
+	l->end_ns = host_time_ns();
+	if(cmd->cmd == MMC_SWITCH && mock.switch_fails){
+		mock.switch_fails--;
+		return 0;
+	}
+	l->ok = 1;
+	return 1;
+}
+
+int sdmmc_stop_transmission(sdmmc_t *sdmmc, u32 *rsp_out){
+	if(mock.busy){
+		mock.overlaps++;
+		return 0;
+	}
+
+	mock_cmd_t *l = log_cmd(MMC_STOP_TRANSMISSION, 0, false);
+	host_advance_ns(mock.stop_ns);
+	mock.data_state = false;
+	l->ok = 1;
+	l->end_ns = host_time_ns();
+	return 1;
+}
+
+int sdmmc_submit_req(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req){
+	if(!req || mock.busy){
+		mock.overlaps += mock.busy;
+		sdmmc->req_state = SDMMC_REQ_ERROR;
+		return 0;
+	}
+
+	pending.log = log_cmd(cmd->cmd, cmd->arg, true);
+	pending.log->set_blkcnt = req->is_auto_set_blkcnt;
+	pending.req = *req;
+	pending.sector = cmd->arg;
+	pending.log->end_ns = host_time_ns() + start_data(cmd, req, &pending.blocks, &pending.fail);
+
+	mock.busy = true;
+	sdmmc->req_state = SDMMC_REQ_BUSY;
+	return 1;
+}
+
+u32 sdmmc_poll_req(sdmmc_t *sdmmc, u32 *blkcnt_out){
+	if(sdmmc->req_state != SDMMC_REQ_BUSY){
+		return sdmmc->req_state;
+	}
+
+	// the caller spins on the status registers
+	if(host_time_ns() < pending.log->end_ns){
+		host_advance_ns(MIN(mock.poll_ns, pending.log->end_ns - host_time_ns()));
+		return SDMMC_REQ_BUSY;
+	}
+
+	mock.busy = false;
+	finish_data(pending.log, &pending.req, pending.sector, pending.blocks, pending.fail);
+
+	// on errors only the blocks the card acknowledged
+	if(blkcnt_out){
+		*blkcnt_out = pending.blocks;
+	}
+
+	sdmmc->req_state = pending.fail ? SDMMC_REQ_ERROR : SDMMC_REQ_DONE;
+	return sdmmc->req_state;
+}
+
+u32 mock_adma2_run(const sdmmc_adma2_desc_t *desc, u32 desc_max, u8 *card, u32 bytes, bool write){
+	u32 done = 0;
+
+	for(u32 i = 0; i < desc_max && done < bytes; i++){
+		u32 act = desc[i].attr & (3 << 4);
+
+		// invalid descriptor or link, the controller stops with an adma error
+		if(!(desc[i].attr & SDMMC_ADMA2_ATTR_VALID) || act == (3 << 4) || desc[i].addr_hi){
+			break;
+		}
+
+		if(act == SDMMC_ADMA2_ATTR_TRAN){
+			u32 len = MIN(desc[i].len ? desc[i].len : SDMMC_ADMA2_MAX_LEN, bytes - done);
+			u8 *mem = (u8*)(uintptr_t)desc[i].addr;
+
+			if(write){
+				memcpy(card + done, mem, len);
+			}else{
+				memcpy(mem, card + done, len);
+			}
+			done += len;
+		}
+
+		if(desc[i].attr & SDMMC_ADMA2_ATTR_END){
+			break;
+		}
+	}
+
+	return done;
+}
+
+int sdmmc_execute_cmd_sg(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req, const sdmmc_sg_t *sg, u32 sg_cnt, u32 *blkcnt_out){
+	sdmmc_adma2_desc_t desc[SDMMC_ADMA2_DESC_MAX];
+
+	// same checks as the driver, the table has to cover the request
+	u32 size = sdmmc_adma2_build_desc(desc, SDMMC_ADMA2_DESC_MAX, sg, sg_cnt);
+	if(!size || size != req->num_sectors * req->blksize){
+		return 0;
+	}
+
+	if(mock.busy){
+		mock.overlaps++;
+		return 0;
+	}
+
+	mock_cmd_t *l = log_cmd(cmd->cmd, cmd->arg, false);
+	l->set_blkcnt = req->is_auto_set_blkcnt;
+	u32 blocks;
+	bool fail;
+	host_advance_ns(start_data(cmd, req, &blocks, &fail));
+
+	u32 bytes = mock_adma2_run(desc, SDMMC_ADMA2_DESC_MAX, mock.data + (u64)cmd->arg * 0x200, blocks * 0x200, req->is_write);
+	if(bytes != blocks * 0x200){
+		blocks = bytes / 0x200;
+		fail = true;
+	}
+
+	mock.sg_reqs++;
+	l->blocks = blocks;
+	l->ok = !fail;
+	l->end_ns = host_time_ns();
+	mock.data_state = fail;
+
+	if(blkcnt_out){
+		*blkcnt_out = blocks;
+	}
+	return !fail;
+}
+
+int sdmmc_get_rsp(sdmmc_t *sdmmc, u32 *rsp_out, u32 size, u32 type){
+	memset(rsp_out, 0, size);
+	memcpy(rsp_out, rsp, MIN(size, sizeof(rsp)));
+	return 1;
+}
+
+void sdmmc_init_cmd(sdmmc_cmd_t *cmdbuf, u16 cmd, u32 arg, u32 rsp_type, u32 check_busy){
+	cmdbuf->cmd = cmd;
+	cmdbuf->arg = arg;
+	cmdbuf->rsp_type = rsp_type;
+	cmdbuf->check_busy = check_busy;
+}
+
+// controller setup, only its configuration is modelled
+
+int sdmmc_init(sdmmc_t *sdmmc, u32 id, u32 power, u32 bus_width, u32 type){
+	mock.power_ups++;
+	mock.ctrl_up = true;
+	mock.ctrl_power = power;
+	mock.ctrl_bus_width = bus_width;
+	sdmmc->id = id;
+	sdmmc->timing = type;
+	sdmmc->clock_stopped = 0;
+	return 1;
+}
+
+void sdmmc_end(sdmmc_t *sdmmc){
+	mock.ctrl_up = false;
+	sdmmc->clock_stopped = 1;
+}
+
+int sdmmc_is_configured(sdmmc_t *sdmmc, u32 id, u32 power, u32 bus_width, u32 type){
+	return mock.ctrl_up && sdmmc->id == id && mock.ctrl_power == power && mock.ctrl_bus_width == bus_width &&
+		sdmmc->timing == type;
+}
+
+int sdmmc_get_io_power(sdmmc_t *sdmmc){
+	return SDMMC_POWER_1_8;
+}
+
+u32 sdmmc_get_bus_width(sdmmc_t *sdmmc){
+	return SDMMC_BUS_WIDTH_4;
+}
+
+void sdmmc_set_bus_width(sdmmc_t *sdmmc, u32 bus_width){
+	mock.ctrl_bus_width = bus_width;
+}
+
+void sdmmc_save_tap_value(sdmmc_t *sdmmc){
+}
+
+u32 sdmmc_get_tap_value(sdmmc_t *sdmmc){
+	return 0;
+}
+
+void sdmmc_set_tap_value(sdmmc_t *sdmmc, u32 tap){
+}
+
+void sdmmc_setup_drv_type(sdmmc_t *sdmmc, u32 type){
+}
+
+int sdmmc_setup_clock(sdmmc_t *sdmmc, u32 type){
+	sdmmc->timing = type;
+	return 1;
+}
+
+void sdmmc_card_clock_powersave(sdmmc_t *sdmmc, int powersave_enable){
+}
+
+int sdmmc_tuning_execute(sdmmc_t *sdmmc, u32 type, u32 cmd){
+	return 1;
+}
+
+int sdmmc_enable_low_voltage(sdmmc_t *sdmmc){
+	return 1;
+}
+
+// reinit after failed transfers, the card stays the same
+
+void sd_error_count_increment(u8 type){
+}
+
+void emmc_error_count_increment(u8 type){
+}
+
+bool sd_initialize(bool power_cycle){
+	sdmmc_storage_t card = mock_storage;
+
+	mock.reinits++;
+	mock.data_state = false;
+
+	// the real init clears the storage, then reads the same card back in
+	sdmmc_storage_reset(&mock_storage, card.sdmmc);
+	mock_storage.rca = card.rca;
+	mock_storage.has_sector_access = card.has_sector_access;
+	mock_storage.sec_cnt = card.sec_cnt;
+	mock_storage.auto_set_blkcnt = card.auto_set_blkcnt;
+	mock_storage.initialized = 1;
+	return true;
+}
+
+// no slower mode to fall back to
+int sd_init_retry(bool power_cycle){
+	mock.reinits++;
+	return 0;
+}
+
+// init ends on the user partition, cleared by the reset
+bool emmc_initialize(bool power_cycle){
+	return sd_initialize(power_cycle);
+}
+
+int emmc_init_retry(bool power_cycle){
+	return sd_init_retry(power_cycle);
+}
@@ -0,0 +1,84 @@
+#ifndef _SDMMC_MOCK_H
+#define _SDMMC_MOCK_H
+
+#include <utils/types.h>
+#include <storage/sdmmc.h>
+
+// software card behind the sdmmc_driver.c api, for tests of bdk/storage/sdmmc.c.
+// data commands work on an in-memory image with modelled bus timing, everything else
+// answers with a card in transfer state. with card set the init commands get the answers of an
+// sdhc card, which powers up from the first ACMD41 after CMD0, or of an emmc instead. the
+// controller keeps the configuration of its last sdmmc_init until sdmmc_end.
+
+#define MOCK_LOG_MAX 512
+
+typedef enum{
+	MOCK_CARD_NONE = 0,
+	MOCK_CARD_SD,
+	MOCK_CARD_EMMC
+}mock_card_t;
+
+typedef struct{
+	u16 cmd;
+	u32 arg;
+	u16 blocks;   // data commands only, blocks actually transferred
+	u8  set_blkcnt; // data commands only, auto CMD23 in front
+	u8  async;
+	u8  ok;
+	u64 start_ns;
+	u64 end_ns;
+}mock_cmd_t;
+
+typedef struct{
+	u8 *data;
+	u32 sectors;
+	// modelled costs (ns): command incl. response, one block, CMD12 incl. busy, one poll of a busy request
+	u32 cmd_ns;
+	u32 sector_ns;
+	u32 stop_ns;
+	u32 poll_ns;
+	// card accepts auto CMD23, except for the next cmd23_rejects requests that use it
+	bool cmd23;
+	u32 cmd23_rejects;
+	// the next switch_fails CMD6 switches fail
+	u32 switch_fails;
+	// card init: an sd card reports busy to ACMD41 until power_up_ns after the first one, an emmc is
+	// ready at once. register reads are zeros apart from the sd scr, the zero csd of the emmc ends its
+	// init before the ext_csd
+	mock_card_t card;
+	u64 power_up_ns;
+	// data requests are counted from 1. a fault returns true to fail the request after *blocks blocks
+	bool (*fault)(u32 req, u32 sector, u32 num_sectors, bool write, u32 *blocks);
+	// state and stats
+	bool data_state;     // left in data state by a failed transfer until CMD12
+	bool busy;           // async request in flight
+	bool app_cmd;        // CMD55 came before
+	bool powering;       // power up started, until CMD0
+	u64 power_start_ns;
+	bool ctrl_up;        // from sdmmc_init until sdmmc_end
+	u32 ctrl_power;
+	u32 ctrl_bus_width;
+	u32 power_ups;       // sdmmc_init calls
+	u32 data_reqs;
+	u32 sg_reqs;         // data requests through the adma2 descriptor table
+	u32 overlaps;        // commands issued while a request was in flight
+	u32 reinits;
+	u32 log_cnt;
+	mock_cmd_t log[MOCK_LOG_MAX];
+}sdmmc_mock_t;
+
+extern sdmmc_mock_t mock;
+extern sdmmc_t mock_sdmmc;
+extern sdmmc_storage_t mock_storage;
+
+// fresh card over data, mock_storage is initialized on it
+void mock_reset(u8 *data, u32 sectors);
+// data commands in the log, in issue order
+u32 mock_data_cmds(mock_cmd_t *out, u32 max);
+// commands in the log with this index, app commands by theirs
+u32 mock_cmd_count(u16 cmd);
+// the controller side of adma2: walks the descriptor table and moves bytes between card and memory
+// until it is done, hits the end descriptor or an invalid one. returns the bytes moved
+u32 mock_adma2_run(const sdmmc_adma2_desc_t *desc, u32 desc_max, u8 *card, u32 bytes, bool write);
+
+#endif
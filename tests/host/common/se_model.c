@@ -0,0 +1,160 @@
+#include "se_model.h"
+#include "host.h"
+#include <string.h>
+#include <sec/se.h>
+#include <sec/se_t210.h>
+
+// software model of the se sha256 engine as bdk/sec/se.c drives it: the hash and the
+// msg_left registers carry the state between chunks, padding is applied once msg_left hits zero
+
+u32 se_model_errors;
+
+static const u32 k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const u32 iv[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+// engine registers
+static u32 hash_reg[8];
+static u64 msg_len;
+static u64 msg_left;
+static bool busy;
+static u64 busy_until;
+
+static u32 ror(u32 x, int n){
+	return (x >> n) | (x << (32 - n));
+}
+
+static void compress(u32 *h, const u8 *blk){
+	u32 w[64];
+	for(int i = 0; i < 16; i++){
+		w[i] = (u32)blk[i * 4] << 24 | (u32)blk[i * 4 + 1] << 16 | (u32)blk[i * 4 + 2] << 8 | blk[i * 4 + 3];
+	}
+	for(int i = 16; i < 64; i++){
+		u32 s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		u32 s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	u32 a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+	for(int i = 0; i < 64; i++){
+		u32 t1 = hh + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+		u32 t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		hh = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+
+	h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+	h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+}
+
+// final block(s) of a message of len bytes, tail holds the len % 64 trailing bytes
+static void pad(u32 *h, const u8 *tail, u32 tail_len, u64 len){
+	u8 blk[128] = {0};
+	memcpy(blk, tail, tail_len);
+	blk[tail_len] = 0x80;
+	u32 n = tail_len < 56 ? 64 : 128;
+	for(int i = 0; i < 8; i++){
+		blk[n - 1 - i] = (len * 8) >> (i * 8);
+	}
+	for(u32 i = 0; i < n; i += 64){
+		compress(h, blk + i);
+	}
+}
+
+static void get_hash(void *hash, u32 *left){
+	u8 *out = hash;
+	for(int i = 0; i < 32; i++){
+		out[i] = hash_reg[i / 4] >> (24 - (i % 4) * 8);
+	}
+	if(left){
+		left[0] = (u32)msg_left;
+		left[1] = (u32)(msg_left >> 32);
+	}
+}
+
+int se_calc_sha256(void *hash, u32 *left, const void *src, u32 src_size, u64 total_size, u32 sha_cfg, bool is_oneshot){
+	if(src_size > 0xffffff || !hash){
+		return 0;
+	}
+
+	if(busy){
+		// the previous operation was never finalized, the hardware would mix both
+		se_model_errors++;
+	}
+
+	if(!total_size){
+		total_size = src_size;
+	}
+
+	msg_len = total_size * 8;
+	msg_left = total_size * 8;
+
+	if(sha_cfg == SHA_CONTINUE && left){
+		const u8 *in = hash;
+		msg_left = left[0] | (u64)left[1] << 32;
+		for(int i = 0; i < 8; i++){
+			hash_reg[i] = (u32)in[i * 4] << 24 | (u32)in[i * 4 + 1] << 16 | (u32)in[i * 4 + 2] << 8 | in[i * 4 + 3];
+		}
+	}else{
+		memcpy(hash_reg, iv, sizeof(hash_reg));
+	}
+
+	u64 bits = (u64)src_size * 8;
+	// everything but the last chunk has to be whole blocks, the engine pads only once the message ends
+	if(bits > msg_left || (bits < msg_left && src_size % 64)){
+		se_model_errors++;
+		return 0;
+	}
+
+	const u8 *p = src;
+	u32 whole = src_size & ~63u;
+	for(u32 i = 0; i < whole; i += 64){
+		compress(hash_reg, p + i);
+	}
+	msg_left -= bits;
+	if(!msg_left){
+		pad(hash_reg, p + whole, src_size - whole, msg_len / 8);
+	}
+
+	busy_until = MAX(busy_until, host_time_ns()) + (u64)host_cost.se_sha * src_size / 1000;
+	busy = true;
+
+	if(is_oneshot){
+		return se_calc_sha256_finalize(hash, left);
+	}
+
+	return 1;
+}
+
+int se_calc_sha256_finalize(void *hash, u32 *left){
+	host_wait_until_ns(busy_until);
+	busy = false;
+	get_hash(hash, left);
+	return 1;
+}
+
+int se_calc_sha256_oneshot(void *hash, const void *src, u32 src_size){
+	return se_calc_sha256(hash, NULL, src, src_size, 0, SHA_INIT_HASH, true);
+}
+
+void host_sha256(const void *src, u32 size, u8 *out){
+	u32 h[8];
+	memcpy(h, iv, sizeof(h));
+	u32 whole = size & ~63u;
+	for(u32 i = 0; i < whole; i += 64){
+		compress(h, (const u8*)src + i);
+	}
+	pad(h, (const u8*)src + whole, size - whole, size);
+	for(int i = 0; i < 32; i++){
+		out[i] = h[i / 4] >> (24 - (i % 4) * 8);
+	}
+}
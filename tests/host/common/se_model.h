@@ -0,0 +1,12 @@
+#ifndef _SE_MODEL_H
+#define _SE_MODEL_H
+
+#include <utils/types.h>
+
+// misuse of the sha engine seen by the model: unaligned intermediate chunks, overruns, unfinished operations
+extern u32 se_model_errors;
+
+// reference sha256 over a whole buffer
+void host_sha256(const void *src, u32 size, u8 *out);
+
+#endif
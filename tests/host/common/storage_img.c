@@ -0,0 +1,408 @@
+#include "storage_img.h"
+#include "host.h"
+#include <memory_map.h>
+#include <stdlib.h>
+#include <string.h>
+#include <storage/emmc.h>
+#include <storage/sd.h>
+#include <storage/sdmmc.h>
+
+img_t *img;
+img_stats_t *img_stats;
+bool (*img_fault)(img_id_t id, u32 sector, u32 num_sectors, bool write);
+bool img_no_session;
+
+sdmmc_t sd_sdmmc;
+sdmmc_t emmc_sdmmc;
+sdmmc_storage_t sd_storage;
+sdmmc_storage_t emmc_storage;
+
+static u64 sd_power_start;
+static bool sd_powering;
+// left up in identification mode by the modchip handshake
+static bool emmc_ctrl_id;
+static bool emmc_cfg_ended;
+
+void img_init(){
+	if(!img){
+		img = host_shared_alloc(sizeof(img_t) * IMG_MAX);
+		img_stats = host_shared_alloc(sizeof(img_stats_t));
+	}
+
+	for(u32 i = 0; i < IMG_MAX; i++){
+		// fixed per device, a test swaps a card by changing it
+		memset(img[i].cid, 0x30 + i, sizeof(img[i].cid));
+	}
+}
+
+void img_create(img_id_t id, u32 sectors){
+	img_init();
+
+	// images are small enough to simply leak on re-creation
+	img[id].data = sectors ? host_shared_alloc(sectors * 0x200) : NULL;
+	img[id].sectors = sectors;
+}
+
+bool img_load(img_id_t id, const char *path){
+	FILE *f = fopen(path, "rb");
+	if(!f){
+		return false;
+	}
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	img_create(id, (size + 0x1ff) / 0x200);
+	bool res = fread(img[id].data, 1, size, f) == (size_t)size;
+	fclose(f);
+	return res;
+}
+
+bool img_save(img_id_t id, const char *path){
+	FILE *f = fopen(path, "wb");
+	if(!f){
+		return false;
+	}
+
+	bool res = fwrite(img[id].data, 0x200, img[id].sectors, f) == img[id].sectors;
+	fclose(f);
+	return res;
+}
+
+u8 *img_sector(img_id_t id, u32 sector){
+	return img[id].data + sector * 0x200;
+}
+
+void img_stats_reset(){
+	memset(img_stats, 0, sizeof(*img_stats));
+}
+
+static img_id_t storage_img(sdmmc_storage_t *storage){
+	if(storage == &sd_storage){
+		return IMG_SD;
+	}
+
+	switch(storage->partition){
+	case EMMC_BOOT0:
+		return IMG_BOOT0;
+	case EMMC_BOOT1:
+		return IMG_BOOT1;
+	default:
+		return IMG_GPP;
+	}
+}
+
+static u32 sector_ns(bool sd, bool write){
+	return sd ? host_cost.sd_sector : write ? host_cost.emmc_write_sector : host_cost.emmc_sector;
+}
+
+// end of the transfers queued on sd and emmc, and of each queued request
+static u64 busy_until[2];
+static u64 req_done[2][SDMMC_STORAGE_QUEUE_SIZE];
+
+static int storage_rw(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf, bool write){
+	img_id_t id = storage_img(storage);
+	bool sd = id == IMG_SD;
+
+	// queued requests finish first
+	host_wait_until_ns(busy_until[!sd]);
+
+	img_stats->cmds++;
+	host_advance_ns(sd ? host_cost.sd_cmd : host_cost.emmc_cmd);
+
+	if(!storage->initialized || !img[id].data || sector + num_sectors > img[id].sectors || (img_fault && img_fault(id, sector, num_sectors, write))){
+		img_stats->failed++;
+		return 0;
+	}
+
+	host_advance_ns((u64)num_sectors * sector_ns(sd, write));
+
+	if(write){
+		memcpy(img_sector(id, sector), buf, num_sectors * 0x200);
+		img_stats->writes++;
+		img_stats->write_sectors += num_sectors;
+	}else{
+		memcpy(buf, img_sector(id, sector), num_sectors * 0x200);
+		img_stats->read_sectors += num_sectors;
+	}
+
+	return 1;
+}
+
+int sdmmc_storage_read(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf){
+	return storage_rw(storage, sector, num_sectors, buf, false);
+}
+
+int sdmmc_storage_write(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf){
+	return storage_rw(storage, sector, num_sectors, buf, true);
+}
+
+// a single command, the descriptor table spreads the data
+int sdmmc_storage_read_sg(sdmmc_storage_t *storage, u32 sector, const sdmmc_sg_t *sg, u32 sg_cnt){
+	img_id_t id = storage_img(storage);
+	bool sd = id == IMG_SD;
+	u32 num_sectors = 0;
+
+	for(u32 i = 0; i < sg_cnt; i++){
+		if(sg[i].size % 0x200){
+			return 0;
+		}
+		num_sectors += sg[i].size / 0x200;
+	}
+
+	host_wait_until_ns(busy_until[!sd]);
+
+	img_stats->cmds++;
+	host_advance_ns(sd ? host_cost.sd_cmd : host_cost.emmc_cmd);
+
+	if(!storage->initialized || !img[id].data || !num_sectors || sector + num_sectors > img[id].sectors || (img_fault && img_fault(id, sector, num_sectors, false))){
+		img_stats->failed++;
+		return 0;
+	}
+
+	host_advance_ns((u64)num_sectors * sector_ns(sd, false));
+
+	for(u32 i = 0; i < sg_cnt; i++){
+		memcpy(sg[i].buf, img_sector(id, sector), sg[i].size);
+		sector += sg[i].size / 0x200;
+	}
+	img_stats->read_sectors += num_sectors;
+
+	return 1;
+}
+
+// the transfer runs from the end of the previous one, the data is there right away but only used after the wait
+static int storage_rw_async(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf, bool write){
+	img_id_t id = storage_img(storage);
+	bool sd = id == IMG_SD;
+
+	if(!storage->initialized || storage->queue_cnt == SDMMC_STORAGE_QUEUE_SIZE){
+		return 0;
+	}
+
+	sdmmc_storage_req_t *req = &storage->queue[(storage->queue_head + storage->queue_cnt) % SDMMC_STORAGE_QUEUE_SIZE];
+	u64 *done = &req_done[!sd][(storage->queue_head + storage->queue_cnt) % SDMMC_STORAGE_QUEUE_SIZE];
+	storage->queue_cnt++;
+
+	img_stats->cmds++;
+	*done = MAX(busy_until[!sd], host_time_ns()) + (sd ? host_cost.sd_cmd : host_cost.emmc_cmd);
+
+	if(!img[id].data || sector + num_sectors > img[id].sectors || (img_fault && img_fault(id, sector, num_sectors, write))){
+		img_stats->failed++;
+		req->state = SDMMC_REQ_ERROR;
+	}else{
+		*done += (u64)num_sectors * sector_ns(sd, write);
+		if(write){
+			memcpy(img_sector(id, sector), buf, num_sectors * 0x200);
+			img_stats->writes++;
+			img_stats->write_sectors += num_sectors;
+		}else{
+			memcpy(buf, img_sector(id, sector), num_sectors * 0x200);
+			img_stats->read_sectors += num_sectors;
+		}
+		req->state = SDMMC_REQ_DONE;
+	}
+	busy_until[!sd] = *done;
+
+	return 1;
+}
+
+int sdmmc_storage_read_async(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf){
+	return storage_rw_async(storage, sector, num_sectors, buf, false);
+}
+
+int sdmmc_storage_write_async(sdmmc_storage_t *storage, u32 sector, u32 num_sectors, void *buf){
+	return storage_rw_async(storage, sector, num_sectors, buf, true);
+}
+
+int sdmmc_storage_async_wait(sdmmc_storage_t *storage){
+	bool sd = storage == &sd_storage;
+
+	if(!storage->queue_cnt){
+		return 0;
+	}
+
+	host_wait_until_ns(req_done[!sd][storage->queue_head]);
+	int res = storage->queue[storage->queue_head].state == SDMMC_REQ_DONE;
+	storage->queue_head = (storage->queue_head + 1) % SDMMC_STORAGE_QUEUE_SIZE;
+	storage->queue_cnt--;
+
+	return res;
+}
+
+int sdmmc_storage_end(sdmmc_storage_t *storage){
+	storage->initialized = 0;
+	return 1;
+}
+
+int sdmmc_storage_set_mmc_partition(sdmmc_storage_t *storage, u32 partition){
+	if(storage->partition != partition){
+		img_stats->switches++;
+		host_advance_ns(host_cost.emmc_switch);
+		storage->partition = partition;
+	}
+	return 1;
+}
+
+u32 sdmmc_storage_get_partition_switches(){
+	return img_stats->switches;
+}
+
+// same card in the same mode and tuned before, the tap is reused
+static bool bus_cache_hit(sdmmc_bus_cache_t *cache, img_id_t id, u8 mode){
+	return cache && cache->mode == mode && cache->tuned && !memcmp(cache->raw_cid, img[id].cid, sizeof(cache->raw_cid));
+}
+
+static void bus_cache_update(sdmmc_bus_cache_t *cache, img_id_t id, u8 mode, u8 type){
+	if(cache){
+		memcpy(cache->raw_cid, img[id].cid, sizeof(cache->raw_cid));
+		cache->mode = mode;
+		cache->type = type;
+		cache->tap = 0x10;
+		cache->tuned = 1;
+	}
+}
+
+void sd_initialize_start(){
+	if(!sd_storage.initialized && !sd_powering){
+		img_stats->power_ups++;
+		sd_power_start = host_time_ns();
+		sd_powering = true;
+	}
+}
+
+void sd_set_bus_cache(sdmmc_bus_cache_t *cache){
+	sd_storage.bus_cache = cache;
+}
+
+// the image card always works in the top mode, the retry policy is sd_bus_test's
+void sd_bus_cache_boot(sdmmc_bus_cache_t *cache){
+}
+
+void sd_bus_cache_persist(sdmmc_bus_cache_t *out, const sdmmc_bus_cache_t *saved){
+	memcpy(out, sd_storage.initialized && sd_storage.bus_cache ? sd_storage.bus_cache : saved, sizeof(*out));
+}
+
+bool sd_initialize(bool power_cycle){
+	if(img_no_session && !emmc_cfg_ended){
+		emmc_cfg_ended = true;
+		emmc_end();
+	}
+
+	if(power_cycle){
+		sd_end();
+	}
+
+	if(sd_storage.initialized){
+		return true;
+	}
+
+	if(!img[IMG_SD].data){
+		// card detect only
+		host_advance_ns(host_cost.sd_cmd);
+		return false;
+	}
+
+	img_stats->sd_inits++;
+
+	if(!sd_powering){
+		sd_initialize_start();
+	}
+	host_wait_until_ns(sd_power_start + host_cost.sd_power_up * 1000ull);
+	sd_powering = false;
+
+	host_advance_ns(host_cost.sd_init * 1000ull);
+
+	sd_storage.bus_cache_hit = bus_cache_hit(sd_storage.bus_cache, IMG_SD, SD_UHS_SDR104);
+	if(!sd_storage.bus_cache_hit){
+		img_stats->tunes++;
+		host_advance_ns(host_cost.sd_tune * 1000ull);
+	}
+	bus_cache_update(sd_storage.bus_cache, IMG_SD, SD_UHS_SDR104, SDHCI_TIMING_UHS_SDR104);
+
+	memcpy(sd_storage.raw_cid, img[IMG_SD].cid, sizeof(sd_storage.raw_cid));
+	sd_storage.sec_cnt = img[IMG_SD].sectors;
+	sd_storage.sdmmc = &sd_sdmmc;
+	sd_storage.initialized = 1;
+	return true;
+}
+
+void sd_end(){
+	sdmmc_storage_end(&sd_storage);
+	sd_powering = false;
+}
+
+void emmc_set_bus_cache(sdmmc_bus_cache_t *cache){
+	emmc_storage.bus_cache = cache;
+}
+
+bool emmc_initialize(bool power_cycle){
+	if(power_cycle){
+		emmc_end();
+	}
+
+	img_stats->emmc_inits++;
+	// sdmmc_storage_init_mmc skips the power up of a controller still in identification mode
+	if(img_no_session || !emmc_ctrl_id){
+		img_stats->power_ups++;
+		host_advance_ns(host_cost.sdmmc_init * 1000ull);
+	}
+	emmc_ctrl_id = false;
+	host_advance_ns(host_cost.emmc_init * 1000ull);
+
+	emmc_storage.bus_cache_hit = bus_cache_hit(emmc_storage.bus_cache, IMG_GPP, EMMC_MMC_HS400);
+	if(!emmc_storage.bus_cache_hit){
+		img_stats->tunes++;
+		host_advance_ns(host_cost.emmc_tune * 1000ull);
+	}
+	bus_cache_update(emmc_storage.bus_cache, IMG_GPP, EMMC_MMC_HS400, SDHCI_TIMING_MMC_HS400);
+
+	// ext_csd is read through the sdmmc buffer, whatever was there is gone
+	memset((void*)SDMMC_UPPER_BUFFER, 0xec, 0x200);
+
+	memcpy(emmc_storage.raw_cid, img[IMG_GPP].cid, sizeof(emmc_storage.raw_cid));
+	emmc_storage.sec_cnt = img[IMG_GPP].sectors;
+	emmc_storage.sdmmc = &emmc_sdmmc;
+	emmc_storage.partition = EMMC_GPP;
+	emmc_storage.initialized = 1;
+	return true;
+}
+
+bool emmc_session_init(){
+	if(emmc_storage.initialized && !img_no_session){
+		return true;
+	}
+	return emmc_initialize(false);
+}
+
+int emmc_set_partition(u32 partition){
+	return sdmmc_storage_set_mmc_partition(&emmc_storage, partition);
+}
+
+void emmc_end(){
+	sdmmc_storage_end(&emmc_storage);
+	emmc_ctrl_id = false;
+}
+
+// raw controller access, only used for the modchip handshake
+int sdmmc_init(sdmmc_t *sdmmc, u32 id, u32 power, u32 bus_width, u32 type){
+	img_stats->power_ups++;
+	host_advance_ns(host_cost.sdmmc_init * 1000ull);
+	emmc_ctrl_id = sdmmc == &emmc_sdmmc && type == SDHCI_TIMING_MMC_ID;
+	return 1;
+}
+
+void sdmmc_init_cmd(sdmmc_cmd_t *cmdbuf, u16 cmd, u32 arg, u32 rsp_type, u32 check_busy){
+	memset(cmdbuf, 0, sizeof(*cmdbuf));
+	cmdbuf->cmd = cmd;
+	cmdbuf->arg = arg;
+	cmdbuf->rsp_type = rsp_type;
+	cmdbuf->check_busy = check_busy;
+}
+
+int sdmmc_execute_cmd(sdmmc_t *sdmmc, sdmmc_cmd_t *cmd, sdmmc_req_t *req, u32 *blkcnt_out){
+	img_stats->cmds++;
+	host_advance_ns(sdmmc == &sd_sdmmc ? host_cost.sd_cmd : host_cost.emmc_cmd);
+	return 1;
+}
@@ -0,0 +1,54 @@
+#ifndef _STORAGE_IMG_H
+#define _STORAGE_IMG_H
+
+#include <utils/types.h>
+
+// sd/emmc storage backed by images in shared memory, replaces sd.c, emmc.c and the sdmmc storage layer.
+// writes of a forked boot stay visible to the next one, like on a console
+
+typedef enum{
+	IMG_SD = 0,
+	IMG_GPP,
+	IMG_BOOT0,
+	IMG_BOOT1,
+	IMG_MAX
+}img_id_t;
+
+typedef struct{
+	u32 cmds;
+	u32 read_sectors;
+	u32 write_sectors;
+	u32 writes;
+	u32 switches;
+	u32 sd_inits;
+	u32 emmc_inits;
+	u32 power_ups; // sd and emmc controller
+	u32 tunes;
+	u32 failed;
+}img_stats_t;
+
+typedef struct{
+	u8 *data;
+	u32 sectors;
+	u8 cid[0x10];
+}img_t;
+
+extern img_t *img;
+extern img_stats_t *img_stats;
+
+// optional fault injection, return true to fail the transfer
+extern bool (*img_fault)(img_id_t id, u32 sector, u32 num_sectors, bool write);
+// the emmc before sessions, for before/after counts: every emmc init powers the controller up,
+// emmc_session_init is a full init like the emmc_initialize its users called and get_cfg ends
+// the emmc again, modelled at the first sd init that follows it in main()
+extern bool img_no_session;
+
+void img_init();
+// zeroed image, sectors == 0 removes it (no sd card inserted)
+void img_create(img_id_t id, u32 sectors);
+bool img_load(img_id_t id, const char *path);
+bool img_save(img_id_t id, const char *path);
+u8  *img_sector(img_id_t id, u32 sector);
+void img_stats_reset();
+
+#endif
@@ -0,0 +1,26 @@
+#include "host.h"
+#include <soc/timer.h>
+
+// soc/timer.h on the simulated clock, apart from host.c as unistd.h declares its own usleep
+
+extern u64 host_now_ns;
+
+u32 get_tmr_us(){
+	return host_now_ns / 1000;
+}
+
+u32 get_tmr_ms(){
+	return host_now_ns / 1000000;
+}
+
+u32 get_tmr_s(){
+	return host_now_ns / 1000000000;
+}
+
+void usleep(u32 us){
+	host_now_ns += (u64)us * 1000;
+}
+
+void msleep(u32 ms){
+	host_now_ns += (u64)ms * 1000000;
+}
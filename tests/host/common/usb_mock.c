@@ -0,0 +1,342 @@
+#include "host.h"
+#include "usb_mock.h"
+#include "storage_img.h"
+#include <string.h>
+#include <usb/usbd.h>
+
+// see usb_mock.h. the device gets its data when a transfer starts and waits for the modelled bus
+// time when it finishes it, so usb and sdmmc overlap like they do with the real controller.
+
+#define CBW_LEN 31
+#define CSW_LEN 13
+#define CBW_SIG 0x43425355
+#define CSW_SIG 0x53425355
+
+usb_mock_cost_t usb_mock_cost = {
+	.byte_ps       = 25000, // ~40MB/s, what the bulk endpoints reach on usb2
+	.xfer_ns       = 4000,
+	.turnaround_ns = 30000,
+};
+
+typedef enum{
+	PHASE_CBW,
+	PHASE_DATA,
+	PHASE_CSW,
+}phase_t;
+
+static struct{
+	usb_mock_cmd_t *cmds;
+	u32 cnt;
+	u32 cur;
+	phase_t phase;
+	u32 data_ofs;
+	bool reset_sent;
+	u32 reset_waits;
+	u64 bus_free;
+	u64 cbw_at;
+
+	// transfers started with USB_XFER_START
+	u8 *out_buf;
+	u32 out_len;
+	int out_res;
+	u32 out_actual;
+	u64 out_done;
+	int in_res;
+	u32 in_actual;
+	u64 in_done;
+}mock;
+
+static u64 bus_xfer(u32 bytes, u64 not_before){
+	u64 start = MAX(MAX(mock.bus_free, host_time_ns()), not_before);
+
+	mock.bus_free = start + usb_mock_cost.xfer_ns + (u64)bytes * usb_mock_cost.byte_ps / 1000;
+
+	return mock.bus_free;
+}
+
+static usb_mock_cmd_t *current(){
+	return mock.cur < mock.cnt ? &mock.cmds[mock.cur] : NULL;
+}
+
+static void next_cmd(){
+	mock.cur++;
+	mock.phase = PHASE_CBW;
+	mock.data_ofs = 0;
+	mock.reset_sent = false;
+	mock.reset_waits = 0;
+}
+
+// what the host puts on the OUT endpoint for a request of len
+static int host_out(u8 *buf, u32 len, u32 *actual, u64 *done){
+	usb_mock_cmd_t *cmd = current();
+
+	*actual = 0;
+	*done = host_time_ns();
+
+	// unplugged
+	if(!cmd){
+		return USB2_ERROR_XFER_EP_DISABLED;
+	}
+
+	// nothing is sent until the reset is acked, the host gives up after a while
+	if(cmd->reset){
+		if(++mock.reset_waits > 100){
+			return USB2_ERROR_XFER_EP_DISABLED;
+		}
+		*done += 1000000;
+		return USB_ERROR_TIMEOUT;
+	}
+
+	if(mock.phase == PHASE_CBW){
+		u8 cbw[CBW_LEN] = {0};
+		u32 sig = CBW_SIG, tag = mock.cur, dlen = cmd->len;
+
+		memcpy(cbw, &sig, 4);
+		memcpy(cbw + 4, &tag, 4);
+		memcpy(cbw + 8, &dlen, 4);
+		cbw[12] = cmd->in ? 0x80 : 0;
+		cbw[13] = cmd->lun;
+		cbw[14] = cmd->cdb_len;
+		memcpy(cbw + 15, cmd->cdb, cmd->cdb_len);
+
+		*actual = MIN(len, CBW_LEN);
+		memcpy(buf, cbw, *actual);
+		*done = bus_xfer(CBW_LEN, mock.cbw_at);
+		mock.phase = cmd->len ? PHASE_DATA : PHASE_CSW;
+
+		return USB_RES_OK;
+	}
+
+	if(mock.phase == PHASE_DATA && !cmd->in){
+		*actual = MIN(len, cmd->len - mock.data_ofs);
+		memcpy(buf, cmd->data + mock.data_ofs, *actual);
+		mock.data_ofs += *actual;
+		cmd->xfered = mock.data_ofs;
+		*done = bus_xfer(*actual, 0);
+		if(mock.data_ofs == cmd->len){
+			mock.phase = PHASE_CSW;
+		}
+
+		return USB_RES_OK;
+	}
+
+	// the host waits for IN data or the CSW
+	*done += 1000000;
+	return USB_ERROR_TIMEOUT;
+}
+
+// what the host takes from the IN endpoint
+static int host_in(const u8 *buf, u32 len, u32 *actual, u64 *done){
+	usb_mock_cmd_t *cmd = current();
+	u32 sig;
+
+	*actual = len;
+	*done = bus_xfer(len, 0);
+
+	if(!cmd || cmd->reset){
+		return USB_ERROR_XFER_ERROR;
+	}
+
+	memcpy(&sig, buf, 4);
+
+	// a CSW ends the data phase, whatever was left of it
+	if(len == CSW_LEN && sig == CSW_SIG && (mock.phase != PHASE_DATA || cmd->len - mock.data_ofs != CSW_LEN)){
+		cmd->status  = buf[12];
+		memcpy(&cmd->residue, buf + 8, 4);
+		cmd->done = true;
+		cmd->done_ns = *done;
+		mock.cbw_at = *done + usb_mock_cost.turnaround_ns;
+		next_cmd();
+
+		return USB_RES_OK;
+	}
+
+	if(mock.phase == PHASE_DATA && cmd->in){
+		u32 n = MIN(len, cmd->len - mock.data_ofs);
+		if(cmd->data){
+			memcpy(cmd->data + mock.data_ofs, buf, n);
+		}
+		mock.data_ofs += n;
+		cmd->xfered = mock.data_ofs;
+		if(mock.data_ofs == cmd->len){
+			mock.phase = PHASE_CSW;
+		}
+	}
+
+	return USB_RES_OK;
+}
+
+// a synced transfer is started and finished in one go
+static int ep1_out_read(u8 *buf, u32 len, u32 *actual, u32 sync){
+	mock.out_buf = buf;
+	mock.out_len = len;
+	mock.out_res = host_out(buf, len, &mock.out_actual, &mock.out_done);
+
+	if(sync == USB_XFER_START){
+		return USB_RES_OK;
+	}
+
+	host_wait_until_ns(mock.out_done);
+	if(actual){
+		*actual = mock.out_actual;
+	}
+
+	return mock.out_res;
+}
+
+static int ep1_out_read_big(u8 *buf, u32 len, u32 *actual){
+	return ep1_out_read(buf, len, actual, USB_XFER_SYNCED_DATA);
+}
+
+static int ep1_out_reading_finish(u32 *actual, u32 sync){
+	// a request that timed out is still queued and gets what the host sends now
+	if(mock.out_res == USB_ERROR_TIMEOUT){
+		mock.out_res = host_out(mock.out_buf, mock.out_len, &mock.out_actual, &mock.out_done);
+	}
+
+	host_wait_until_ns(mock.out_done);
+	if(actual){
+		*actual = mock.out_actual;
+	}
+
+	return mock.out_res;
+}
+
+static int ep1_in_write(u8 *buf, u32 len, u32 *actual, u32 sync){
+	mock.in_res = host_in(buf, len, &mock.in_actual, &mock.in_done);
+
+	if(sync == USB_XFER_START){
+		return USB_RES_OK;
+	}
+
+	host_wait_until_ns(mock.in_done);
+	if(actual){
+		*actual = mock.in_actual;
+	}
+
+	return mock.in_res;
+}
+
+static int ep1_in_writing_finish(u32 *actual, u32 sync){
+	host_wait_until_ns(mock.in_done);
+	if(actual){
+		*actual = mock.in_actual;
+	}
+
+	return mock.in_res;
+}
+
+static int handle_ep0_ctrl_setup(){
+	usb_mock_cmd_t *cmd = current();
+
+	if(cmd && cmd->reset && !mock.reset_sent){
+		mock.reset_sent = true;
+		return USB_RES_BULK_RESET;
+	}
+
+	return USB_RES_OK;
+}
+
+static int ack_bulk_reset(){
+	usb_mock_cmd_t *cmd = current();
+
+	if(cmd && cmd->reset && mock.reset_sent){
+		cmd->ack_write_sectors = img_stats->write_sectors;
+		cmd->done = true;
+		cmd->done_ns = host_time_ns();
+		mock.cbw_at = cmd->done_ns + usb_mock_cost.turnaround_ns;
+		next_cmd();
+	}
+
+	return USB_RES_OK;
+}
+
+static int set_ep_stall(u32 ep, int stall){
+	return USB_RES_OK;
+}
+
+static void end(bool reset_ep, bool only_controller){
+}
+
+static int device_init(){
+	return USB_RES_OK;
+}
+
+static int enumerate(usb_gadget_type gadget){
+	return USB_RES_OK;
+}
+
+static int send_max_lun(u8 max_lun){
+	return USB_RES_OK;
+}
+
+static bool port_in_sleep(){
+	return false;
+}
+
+void xusb_device_get_ops(usb_ops_t *ops){
+	memset(ops, 0, sizeof(*ops));
+	ops->usbd_set_ep_stall                 = set_ep_stall;
+	ops->usbd_handle_ep0_ctrl_setup        = handle_ep0_ctrl_setup;
+	ops->usbd_ack_bulk_reset               = ack_bulk_reset;
+	ops->usbd_end                          = end;
+	ops->usb_device_init                   = device_init;
+	ops->usb_device_enumerate              = enumerate;
+	ops->usb_device_class_send_max_lun     = send_max_lun;
+	ops->usb_device_get_suspended          = port_in_sleep;
+	ops->usb_device_get_port_in_sleep      = port_in_sleep;
+
+	ops->usb_device_ep1_out_read           = ep1_out_read;
+	ops->usb_device_ep1_out_read_big       = ep1_out_read_big;
+	ops->usb_device_ep1_out_reading_finish = ep1_out_reading_finish;
+	ops->usb_device_ep1_in_write           = ep1_in_write;
+	ops->usb_device_ep1_in_writing_finish  = ep1_in_writing_finish;
+}
+
+void usb_mock_start(usb_mock_cmd_t *cmds, u32 cnt){
+	memset(&mock, 0, sizeof(mock));
+	mock.cmds = cmds;
+	mock.cnt = cnt;
+	mock.bus_free = host_time_ns();
+
+	for(u32 i = 0; i < cnt; i++){
+		cmds[i].done = false;
+		cmds[i].status = 0xff;
+		cmds[i].residue = 0;
+		cmds[i].xfered = 0;
+	}
+}
+
+u32 usb_mock_done(){
+	return mock.cur;
+}
+
+void usb_mock_rw(usb_mock_cmd_t *cmd, u8 lun, bool write, u32 lba, u32 sectors, u8 *data, bool fua){
+	memset(cmd, 0, sizeof(*cmd));
+	cmd->lun = lun;
+	cmd->cdb_len = 10;
+	cmd->cdb[0] = write ? 0x2a : 0x28;
+	cmd->cdb[1] = fua ? 0x08 : 0;
+	cmd->cdb[2] = lba >> 24;
+	cmd->cdb[3] = lba >> 16;
+	cmd->cdb[4] = lba >> 8;
+	cmd->cdb[5] = lba;
+	cmd->cdb[7] = sectors >> 8;
+	cmd->cdb[8] = sectors;
+	cmd->in = !write;
+	cmd->len = sectors * 0x200;
+	cmd->data = data;
+}
+
+void usb_mock_cdb(usb_mock_cmd_t *cmd, u8 lun, u8 op, u32 in_len){
+	memset(cmd, 0, sizeof(*cmd));
+	cmd->lun = lun;
+	// group 0 commands are 6 bytes, 1 and 2 are 10
+	cmd->cdb_len = op < 0x20 ? 6 : 10;
+	cmd->cdb[0] = op;
+	if(in_len){
+		cmd->cdb[4] = in_len;
+		cmd->in = true;
+		cmd->len = in_len;
+	}
+}
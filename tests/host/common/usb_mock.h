@@ -0,0 +1,51 @@
+#ifndef _USB_MOCK_H
+#define _USB_MOCK_H
+
+#include <utils/types.h>
+
+// xusb_device_get_ops() on a scripted usb host. bulk only commands (CBW, data, CSW) are replayed
+// in order, a reset entry makes the host send a bulk only mass storage reset and wait for its ack.
+// the bus is modelled as one transfer at a time at a fixed rate, the host sends the next CBW a
+// fixed turnaround after the CSW. once the script is done the port is disabled like on an unplug.
+
+typedef struct{
+	// bulk only mass storage reset instead of a command
+	bool reset;
+	u8   lun;
+	u8   cdb[16];
+	u8   cdb_len;
+	bool in;
+	u32  len;
+	// sent for out, filled for in
+	u8  *data;
+
+	// results
+	bool done;
+	u8   status;
+	u32  residue;
+	// when the CSW or the reset ack was sent
+	u64  done_ns;
+	// in bytes received, out bytes the device took
+	u32  xfered;
+	// sectors written to the images when a reset was acked
+	u32  ack_write_sectors;
+}usb_mock_cmd_t;
+
+typedef struct{
+	// ps per byte on the bus, ns per transfer and between a CSW and the next CBW
+	u32 byte_ps;
+	u32 xfer_ns;
+	u32 turnaround_ns;
+}usb_mock_cost_t;
+
+extern usb_mock_cost_t usb_mock_cost;
+
+void usb_mock_start(usb_mock_cmd_t *cmds, u32 cnt);
+// commands the device finished
+u32  usb_mock_done();
+
+// scsi helpers for the script
+void usb_mock_rw(usb_mock_cmd_t *cmd, u8 lun, bool write, u32 lba, u32 sectors, u8 *data, bool fua);
+void usb_mock_cdb(usb_mock_cmd_t *cmd, u8 lun, u8 op, u32 in_len);
+
+#endif
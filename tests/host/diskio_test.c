@@ -0,0 +1,176 @@
+#include "host.h"
+#include "storage_img.h"
+#include <string.h>
+#include <libs/fatfs/ff.h>
+#include <libs/fatfs/diskio.h>
+#include <storage/emmc.h>
+#include "modchip.h"
+
+// boot0 metadata in sdloader/storage/diskio.c on image backed storage, which counts CMD6 partition
+// switches: the cfg, command and record sectors are read from the card once and the modchip calls
+// of a boot after that don't leave the partition the payload comes from. writes go through the
+// cache, a failed one drops it, and after disk_cache_invalidate a boot0 written around diskio is
+// read again. every case runs in its own process so the cache starts empty.
+
+#define BOOT_SECTORS (4 * 1024 * 1024 / 0x200)
+#define GPP_SECTORS  (64 * 1024 * 1024 / 0x200)
+
+static u8 buf[0x200 * 8] __attribute__((aligned(8)));
+
+static bool fail_writes;
+
+static bool fault(img_id_t id, u32 sector, u32 num_sectors, bool write){
+	return write && fail_writes;
+}
+
+static void setup(){
+	img_create(IMG_GPP, GPP_SECTORS);
+	img_create(IMG_BOOT0, BOOT_SECTORS);
+	img_create(IMG_BOOT1, BOOT_SECTORS);
+	img_fault = fault;
+	fail_writes = false;
+	emmc_session_init();
+	img_stats_reset();
+}
+
+// a payload read from another partition
+static void read_payload(BYTE pdrv){
+	CHECK_EQ(disk_read(pdrv, buf, 0x100, 8), RES_OK);
+}
+
+static void set_trace(sd_loader_cfg_t *cfg, bool on){
+	modchip_get_cfg_or_default(cfg);
+	cfg->boot_trace = on;
+	CHECK(modchip_set_cfg(cfg));
+}
+
+// what a boot with a cached payload location asks boot0 for, around a payload read from gpp
+static void case_boot(void *arg){
+	sd_loader_cfg_t cfg;
+	file_loc_t loc, loc_read;
+	sdmmc_bus_cache_t bus;
+	modchip_desc_t desc;
+
+	setup();
+	memset(&loc, 0, sizeof(loc));
+	loc.data_sect = 0x1234;
+	set_trace(&cfg, true);
+	CHECK(modchip_set_payload_cache(&loc));
+	read_payload(DEV_GPP);
+
+	// the writes above already left the record and cfg sector in the cache
+	img_stats_reset();
+	modchip_get_cfg_or_default(&cfg);
+	CHECK(cfg.boot_trace);
+	CHECK(modchip_get_payload_cache(&loc_read));
+	CHECK_EQ(loc_read.data_sect, 0x1234);
+	modchip_get_bus_cache(&bus);
+	modchip_read_desc(&desc);
+	CHECK_EQ(img_stats->switches, 0);
+	CHECK_EQ(img_stats->read_sectors, 0);
+
+	// only the read of the payload itself
+	read_payload(DEV_BOOT1);
+	modchip_get_cfg_or_default(&cfg);
+	CHECK(modchip_get_payload_cache(&loc_read));
+	CHECK_EQ(img_stats->switches, 1);
+
+	// a write has to go to the card, the reads after it don't
+	loc.data_sect = 0x5678;
+	CHECK(modchip_set_payload_cache(&loc));
+	read_payload(DEV_GPP);
+	CHECK_EQ(img_stats->switches, 3);
+	CHECK(modchip_get_payload_cache(&loc_read));
+	CHECK_EQ(loc_read.data_sect, 0x5678);
+	CHECK_EQ(img_stats->switches, 3);
+}
+
+// the first read of each sector goes to the card, the record slots in one request
+static void case_first_read(void *arg){
+	sd_loader_cfg_t cfg;
+
+	setup();
+	read_payload(DEV_GPP);
+	img_stats_reset();
+
+	modchip_get_cfg_or_default(&cfg);
+	CHECK_EQ(img_stats->switches, 1);
+	// both slots, then the legacy cfg sector as no slot is valid yet
+	CHECK_EQ(img_stats->cmds, 2);
+	CHECK_EQ(img_stats->read_sectors, MODCHIP_RECORD_SLOTS + 1);
+
+	read_payload(DEV_GPP);
+	img_stats_reset();
+	modchip_get_cfg_or_default(&cfg);
+	CHECK_EQ(img_stats->switches, 0);
+	CHECK_EQ(img_stats->cmds, 0);
+
+	// partly cached ranges go to the card as a whole
+	CHECK_EQ(disk_read(DEV_BOOT0, buf, MODCHIP_RECORD_SECTOR - 1, 2), RES_OK);
+	CHECK_EQ(img_stats->cmds, 1);
+	CHECK_EQ(img_stats->switches, 1);
+}
+
+// a failed write leaves the sectors unknown, they come from the card again
+static void case_failed_write(void *arg){
+	sd_loader_cfg_t cfg;
+
+	setup();
+	set_trace(&cfg, true);
+	read_payload(DEV_GPP);
+
+	fail_writes = true;
+	modchip_get_cfg_or_default(&cfg);
+	cfg.boot_trace = false;
+	CHECK(!modchip_set_cfg(&cfg));
+	fail_writes = false;
+	read_payload(DEV_GPP);
+
+	img_stats_reset();
+	modchip_get_cfg_or_default(&cfg);
+	CHECK_EQ(img_stats->switches, 1);
+	CHECK(img_stats->read_sectors);
+	CHECK(cfg.boot_trace);
+}
+
+// boot0 changed behind diskio like a ums host may do it, the next load after the invalidate sees it
+static void case_invalidate(void *arg){
+	sd_loader_cfg_t cfg;
+	u8 slots[MODCHIP_RECORD_SLOTS][0x200];
+
+	setup();
+	set_trace(&cfg, false);
+	memcpy(slots, img_sector(IMG_BOOT0, MODCHIP_RECORD_SECTOR), sizeof(slots));
+	set_trace(&cfg, true);
+
+	// back to the older record
+	memcpy(img_sector(IMG_BOOT0, MODCHIP_RECORD_SECTOR), slots, sizeof(slots));
+	modchip_get_cfg_or_default(&cfg);
+	CHECK(cfg.boot_trace);
+
+	disk_cache_invalidate();
+	modchip_get_cfg_or_default(&cfg);
+	CHECK(!cfg.boot_trace);
+
+	// and the next commit follows the record on the card
+	set_trace(&cfg, true);
+	disk_cache_invalidate();
+	modchip_get_cfg_or_default(&cfg);
+	CHECK(cfg.boot_trace);
+}
+
+static void run(const char *name, void (*fn)(void *)){
+	if(host_run_isolated(fn, NULL)){
+		printf("%s failed\n", name);
+		host_failures++;
+	}
+}
+
+int main(){
+	run("boot", case_boot);
+	run("first read", case_first_read);
+	run("failed write", case_failed_write);
+	run("invalidate", case_invalidate);
+
+	return host_result("diskio_test");
+}
@@ -0,0 +1,157 @@
+#include "host.h"
+#include "storage_img.h"
+#include "fatimg.h"
+#include <stdlib.h>
+#include <string.h>
+#include "files.h"
+
+// file reads of sdloader/files.c on generated fat16/fat32/exfat images: contiguous files are found
+// by get_file_loc and read with a single request, fragmented ones with one request per fragment
+// from the link map, files too fragmented for it through f_read. a saved location doesn't pass
+// check_file_loc on a card formatted again, even with the entry unchanged at the same place. every
+// case runs in its own process so the mount state of files.c starts over.
+
+#define SD_SECTORS (64 * 1024 * 1024 / 0x200)
+#define PART_LBA   0x800
+
+typedef struct{
+	const char *name;
+	fatimg_type_t type;
+	u32 clus_sectors;
+	u32 frag_clusters;
+	u32 size;
+}file_case_t;
+
+static const file_case_t cases[] = {
+	{"fat16",            FATIMG_FAT16, 4,  0,  140 * 1024},
+	{"fat32",            FATIMG_FAT32, 1,  0,  140 * 1024},
+	{"fat32-tail",       FATIMG_FAT32, 1,  0,  140 * 1024 + 100},
+	{"exfat",            FATIMG_EXFAT, 64, 0,  140 * 1024},
+	{"fat32-frag",       FATIMG_FAT32, 1,  40, 100 * 1024},
+	{"exfat-frag",       FATIMG_EXFAT, 8,  4,  100 * 1024 + 100},
+	{"fat32-frag-small", FATIMG_FAT32, 1,  1,  60 * 1024},
+	{"exfat-frag-small", FATIMG_EXFAT, 1,  1,  60 * 1024},
+};
+
+static u8 data[160 * 1024];
+static u8 buf[160 * 1024 + 0x200];
+
+static bool setup(const file_case_t *c, fatimg_file_t *file){
+	img_create(IMG_SD, SD_SECTORS);
+	img_create(IMG_BOOT0, 8192);
+
+	for(u32 i = 0; i < c->size; i++){
+		data[i] = i * 7 + (i >> 9);
+	}
+
+	// something in front of the file like on a used card
+	return fatimg_format(IMG_SD, PART_LBA, SD_SECTORS - PART_LBA, c->type, c->clus_sectors, true) &&
+		(fatimg_skip_clusters(IMG_SD, 37), fatimg_add_file(IMG_SD, "payload.bin", data, c->size, c->frag_clusters, file));
+}
+
+// read in pieces of the given sizes, 0 reads the rest
+static bool read_pieces(FIL *f, const u32 *pieces, u32 cnt){
+	u32 ofs = 0;
+
+	if(f_lseek(f, 0) != FR_OK){
+		return false;
+	}
+	memset(buf, 0, sizeof(buf));
+
+	for(u32 i = 0; i < cnt; i++){
+		u32 len = pieces[i] ? pieces[i] : f_size(f) - ofs;
+		u32 br;
+		if(read_file_fast(f, buf + ofs, len, &br) != FR_OK || br != len){
+			return false;
+		}
+		ofs += br;
+	}
+
+	return ofs == f_size(f) && !memcmp(buf, data, ofs);
+}
+
+static bool sd_fails(img_id_t id, u32 sector, u32 num_sectors, bool write){
+	return id == IMG_SD;
+}
+
+// the same card formatted again with the same file: only the volume serial tells it apart
+static void check_volume(const file_case_t *c, const file_loc_t *loc){
+	fatimg_file_t file;
+
+	fatimg_set_serial(0x5eed0042);
+	CHECK(setup(c, &file));
+	CHECK(!memcmp(img_sector(IMG_SD, loc->ent_sect) + loc->ent_ofs, loc->ent, loc->ent_len));
+	CHECK(!check_file_loc(loc, buf));
+
+	fatimg_set_serial(0x1234abcd);
+	CHECK(setup(c, &file));
+	CHECK(check_file_loc(loc, buf));
+}
+
+static void run_case(void *arg){
+	const file_case_t *c = arg;
+	fatimg_file_t file;
+	file_loc_t loc;
+	FIL f;
+
+	if(!setup(c, &file) || open_file_on("payload.bin", &f, SDLOADER_DRIVE_SD) != FR_OK){
+		CHECK(!"payload.bin on the image");
+		return;
+	}
+
+	bool contiguous = get_file_loc(&f, SDLOADER_DRIVE_SD, &loc);
+	CHECK_EQ(contiguous, file.frags <= 1);
+	// the directory entry is found either way, the cache needs it to notice changes
+	CHECK_EQ(loc.ent_sect, file.ent_sect);
+	CHECK_EQ(loc.ent_ofs, file.ent_ofs);
+
+	if(contiguous){
+		CHECK_EQ(loc.data_sect, file.data_sect);
+		CHECK_EQ(loc.size, c->size);
+
+		img_stats_reset();
+		memset(buf, 0, sizeof(buf));
+		CHECK(read_file_loc(&loc, buf, 0, c->size));
+		CHECK(!memcmp(buf, data, c->size));
+		CHECK_EQ(img_stats->cmds, 1);
+		CHECK(check_file_loc(&loc, buf));
+	}
+
+	// whole file: one request per fragment the link map holds, one per cluster run otherwise
+	img_stats_reset();
+	const u32 whole[] = {0};
+	CHECK(read_pieces(&f, whole, 1));
+	u32 tail = c->size % 0x200 != 0;
+	if(file.frags <= 7){
+		CHECK_EQ(img_stats->cmds, MAX(file.frags, 1) + tail);
+	}else{
+		CHECK(img_stats->cmds >= file.frags);
+	}
+
+	// unaligned pieces go through f_read, the aligned ones in between still take the fast path
+	const u32 pieces[] = {100, 0x1000 - 100, 0x3000, 0x201, 0x5dff, 0};
+	CHECK(read_pieces(&f, pieces, ARRAY_SIZE(pieces)));
+
+	// a failing card is reported
+	img_fault = sd_fails;
+	f_lseek(&f, 0);
+	u32 br;
+	CHECK(read_file_fast(&f, buf, c->size, &br) != FR_OK);
+	img_fault = NULL;
+
+	if(contiguous){
+		check_volume(c, &loc);
+	}
+}
+
+int main(){
+	for(u32 i = 0; i < ARRAY_SIZE(cases); i++){
+		int res = host_run_isolated(run_case, (void*)&cases[i]);
+		if(res){
+			printf("%s failed\n", cases[i].name);
+			host_failures++;
+		}
+	}
+
+	return host_result("files_test");
+}
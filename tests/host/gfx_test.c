@@ -0,0 +1,124 @@
+#include "host.h"
+#include <string.h>
+#include <gfx.h>
+
+// sdloader/gfx/gfx.c: gfx_putc_rot with the pre-rotated font and word stores against the byte
+// per pixel renderer it replaced, byte for byte on the whole framebuffer. every glyph at aligned
+// and unaligned positions, with and without fillbg, over a background that isn't blank.
+
+// the rotated console of main.c
+#define FB_WIDTH  180
+#define FB_HEIGHT 320
+#define FB_STRIDE 192
+
+static u8 fb[FB_STRIDE * FB_HEIGHT] __attribute__((aligned(4)));
+static u8 ref[FB_STRIDE * FB_HEIGHT];
+static u8 font[95][8];
+
+static u32 seed = 0xf0a7;
+
+static u32 rnd(){
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+// gfx_putc still draws from the font as it is, one byte per glyph row
+static void read_font(){
+	gfx_init_ctxt(fb, FB_WIDTH, FB_HEIGHT, FB_STRIDE);
+	gfx_con_init();
+	gfx_con_setcol(1, 1, 0);
+
+	for(u32 c = 32; c <= 126; c++){
+		gfx_con_setpos(0, 0);
+		gfx_putc(c);
+		for(u32 i = 0; i < 8; i++){
+			for(u32 j = 0; j < 8; j++){
+				font[c - 32][i] |= fb[i * FB_STRIDE + j] << j;
+			}
+		}
+	}
+}
+
+// the old gfx_putc_rot
+static void ref_putc_rot(u32 x, u32 y, char c, u8 fg, u8 bg, bool fillbg){
+	const u8 *cbuf = font[c - 32];
+
+	for(u32 i = 0; i < 8; i++){
+		u8 *p = ref + FB_STRIDE * y + x + i;
+		u8 v = cbuf[i];
+		for(u32 j = 0; j < 8; j++){
+			if(v & 1){
+				*p = fg;
+			}else if(fillbg){
+				*p = bg;
+			}
+			v >>= 1;
+			p -= FB_STRIDE;
+		}
+	}
+}
+
+static void fill_background(){
+	for(u32 i = 0; i < sizeof(fb); i++){
+		fb[i] = rnd() & 0x1f;
+	}
+	memcpy(ref, fb, sizeof(fb));
+}
+
+static void test_glyphs(){
+	const u32 xs[] = {0, 1, 2, 3, 4, 5, 8, 100, FB_WIDTH - 8};
+	const u32 ys[] = {7, 8, 100, FB_HEIGHT - 1};
+
+	for(u32 fillbg = 0; fillbg < 2; fillbg++){
+		for(u32 xi = 0; xi < ARRAY_SIZE(xs); xi++){
+			for(u32 yi = 0; yi < ARRAY_SIZE(ys); yi++){
+				u8 fg = rnd(), bg = rnd();
+
+				fill_background();
+				gfx_con_setcol(fg, fillbg, bg);
+				for(u32 c = 32; c <= 126; c++){
+					gfx_con_setpos(xs[xi], ys[yi]);
+					gfx_putc_rot(c);
+					CHECK_EQ(gfx_con.y, ys[yi] - 8);
+					ref_putc_rot(xs[xi], ys[yi], c, fg, bg, fillbg);
+					if(memcmp(fb, ref, sizeof(fb))){
+						printf("'%c' at %u,%u fillbg %u differs\n", c, xs[xi], ys[yi], fillbg);
+						host_failures++;
+						return;
+					}
+				}
+			}
+		}
+	}
+}
+
+// a menu line through gfx_printf_rot, glyphs next to each other and a line break
+static void test_string(){
+	const char *s = "Boot payload.bin\nIPL Stats: 123";
+	u32 x = 9, y = FB_HEIGHT - 1;
+
+	fill_background();
+	gfx_con_setcol(0x1f, 0, 0);
+	gfx_con_set_origin(x, y);
+	gfx_con_setpos(x, y);
+	gfx_printf_rot("%s", s);
+
+	for(const char *c = s; *c; c++){
+		if(*c == '\n'){
+			x += 8;
+			y = FB_HEIGHT - 1;
+			continue;
+		}
+		ref_putc_rot(x, y, *c, 0x1f, 0, false);
+		y -= 8;
+	}
+	CHECK(!memcmp(fb, ref, sizeof(fb)));
+}
+
+int main(){
+	read_font();
+	test_glyphs();
+	test_string();
+
+	return host_result("gfx_test");
+}
@@ -0,0 +1,415 @@
+#include "host.h"
+#include <string.h>
+#include <time.h>
+#include <mem/heap.h>
+
+// bdk/mem/heap.c: blocks stay inside the heap and apart under random allocs and frees, freed
+// neighbours coalesce and everything freed gives the heap back. then allocation traces replayed
+// on it and on the first fit heap it replaced (ref_*, with the walk over every node on each
+// alloc and free), time per call and the most the heap grew to. heap.o has its malloc, calloc and
+// free renamed to heap_*, the process keeps libc's.
+
+void *heap_malloc(u32 size);
+void *heap_calloc(u32 num, u32 size);
+void heap_free(void *buf);
+
+extern heap_t _heap;
+
+#define HEAP_SIZE (1024 * 1024)
+#define SLOTS     512
+
+static u8 heap_buf[HEAP_SIZE] __attribute__((aligned(32)));
+
+// node stats of heap_monitor aren't printed here
+void gfx_printf(const char *fmt, ...){
+}
+
+static u32 seed = 0x4ea9;
+
+static u32 rnd(){
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+// the old heap.c, node and all
+typedef struct __attribute__((aligned(32))) _ref_node{
+	int used;
+	u32 size;
+	struct _ref_node *prev;
+	struct _ref_node *next;
+}ref_node_t;
+
+static struct{
+	void *start;
+	ref_node_t *first;
+	ref_node_t *last;
+}ref_heap;
+
+static void ref_init(void *start){
+	ref_heap.start = start;
+	ref_heap.first = NULL;
+	ref_heap.last = NULL;
+}
+
+static void *ref_malloc(u32 size){
+	ref_node_t *node, *new_node;
+
+	size = ALIGN(size, sizeof(ref_node_t));
+
+	if(!ref_heap.first){
+		node = (ref_node_t*)ref_heap.start;
+		node->used = 1;
+		node->size = size;
+		node->prev = NULL;
+		node->next = NULL;
+		ref_heap.first = node;
+		ref_heap.last = node;
+		return (void*)node + sizeof(ref_node_t);
+	}
+
+	node = ref_heap.first;
+	while(true){
+		if(!node->used && size <= node->size){
+			u32 new_size = node->size - size;
+			new_node = (ref_node_t*)((void*)node + sizeof(ref_node_t) + size);
+			if(new_size >= (sizeof(ref_node_t) << 2)){
+				new_node->size = new_size - sizeof(ref_node_t);
+				new_node->used = 0;
+				new_node->next = node->next;
+				if(new_node->next){
+					new_node->next->prev = new_node;
+				}
+				new_node->prev = node;
+				node->next = new_node;
+			}else{
+				size += new_size;
+			}
+			node->size = size;
+			node->used = 1;
+			return (void*)node + sizeof(ref_node_t);
+		}
+		if(node->next){
+			node = node->next;
+		}else{
+			break;
+		}
+	}
+
+	new_node = (ref_node_t*)((void*)node + sizeof(ref_node_t) + node->size);
+	new_node->used = 1;
+	new_node->size = size;
+	new_node->prev = node;
+	new_node->next = NULL;
+	node->next = new_node;
+	ref_heap.last = new_node;
+	return (void*)new_node + sizeof(ref_node_t);
+}
+
+static void ref_free(void *addr){
+	ref_node_t *node = (ref_node_t*)(addr - sizeof(ref_node_t));
+	node->used = 0;
+
+	for(node = ref_heap.first; node; node = node->next){
+		if(!node->used && node->prev && !node->prev->used){
+			node->prev->size += node->size + sizeof(ref_node_t);
+			node->prev->next = node->next;
+			if(node->next){
+				node->next->prev = node->prev;
+			}
+		}
+	}
+}
+
+// end of the last node, what the old heap grew to
+static u32 ref_extent(){
+	ref_node_t *last = ref_heap.first;
+	while(last && last->next){
+		last = last->next;
+	}
+	return last ? (u32)((void*)last + sizeof(ref_node_t) + last->size - ref_heap.start) : 0;
+}
+
+static u32 new_extent(){
+	return (u32)(_heap.top - _heap.start);
+}
+
+typedef struct{
+	void *p;
+	u32 size;
+	u32 tag;
+}slot_t;
+
+static slot_t slots[SLOTS];
+
+static void fill(slot_t *s){
+	for(u32 i = 0; i < s->size / 4; i++){
+		((u32*)s->p)[i] = s->tag + i;
+	}
+}
+
+static bool intact(const slot_t *s){
+	for(u32 i = 0; i < s->size / 4; i++){
+		if(((u32*)s->p)[i] != s->tag + i){
+			return false;
+		}
+	}
+	return true;
+}
+
+// random sizes and lifetimes, every block filled and checked before it is freed
+static void test_fuzz(){
+	heap_monitor_t mon;
+
+	heap_init(heap_buf, 256 * 1024);
+	memset(slots, 0, sizeof(slots));
+
+	for(u32 op = 0; op < 200000; op++){
+		slot_t *s = &slots[rnd() % SLOTS];
+		if(s->p){
+			if(!intact(s)){
+				printf("block of %u bytes at %p overwritten\n", s->size, s->p);
+				host_failures++;
+				return;
+			}
+			heap_free(s->p);
+			s->p = NULL;
+			continue;
+		}
+
+		s->size = (rnd() % 4 ? 4 + rnd() % 256 : 4 + rnd() % 8192) & ~3;
+		s->tag = rnd();
+		s->p = rnd() % 8 ? heap_malloc(s->size) : heap_calloc(1, s->size);
+		if(!s->p){
+			continue;
+		}
+		CHECK(!((u32)s->p & 31));
+		CHECK(s->p >= (void*)heap_buf && s->p + s->size <= (void*)heap_buf + 256 * 1024);
+		fill(s);
+	}
+
+	for(u32 i = 0; i < SLOTS; i++){
+		if(slots[i].p){
+			CHECK(intact(&slots[i]));
+			heap_free(slots[i].p);
+		}
+	}
+
+	// all coalesced back into the unused space
+	heap_monitor(&mon, false);
+	CHECK_EQ(mon.used, 0);
+	CHECK_EQ(mon.nodes_used, 0);
+	CHECK_EQ(mon.nodes_total, 0);
+	CHECK_EQ(new_extent(), 0);
+	for(u32 i = 0; i < HEAP_CLASSES; i++){
+		CHECK(!_heap.free[i]);
+	}
+}
+
+// freed neighbours below the top make one block, whichever is freed first
+static void test_coalesce(){
+	for(u32 order = 0; order < 3; order++){
+		heap_init(heap_buf, 64 * 1024);
+
+		void *a = heap_malloc(256);
+		void *b = heap_malloc(256);
+		void *c = heap_malloc(256);
+		void *top = heap_malloc(32);
+		u32 extent = new_extent();
+
+		if(order == 0){
+			heap_free(a);
+			heap_free(b);
+			heap_free(c);
+		}else if(order == 1){
+			heap_free(c);
+			heap_free(a);
+			heap_free(b);
+		}else{
+			heap_free(b);
+			heap_free(c);
+			heap_free(a);
+		}
+
+		// three blocks and two nodes
+		CHECK(heap_malloc(3 * 256 + 2 * sizeof(hnode_t)) == a);
+		CHECK_EQ(new_extent(), extent);
+		heap_free(a);
+
+		// split again, the rest stays free for the next one
+		CHECK(heap_malloc(100) == a);
+		CHECK(heap_malloc(256) == a + 128 + sizeof(hnode_t));
+		CHECK_EQ(new_extent(), extent);
+
+		heap_free(top);
+	}
+}
+
+// the sdloader heap: one 992 byte dsi fifo, nothing past the end
+static void test_bounds(){
+	heap_monitor_t mon;
+
+	heap_init(heap_buf, 1024);
+	void *fifo = heap_malloc(992);
+	CHECK(fifo);
+	CHECK(!heap_malloc(1));
+	heap_free(fifo);
+	heap_free(fifo);
+	CHECK(heap_malloc(992) == fifo);
+
+	heap_monitor(&mon, false);
+	CHECK_EQ(mon.failed, 1);
+	CHECK_EQ(mon.used, 1024);
+	CHECK_EQ(mon.used_max, 1024);
+}
+
+typedef struct{
+	bool alloc;
+	u16 slot;
+	u32 size;
+}op_t;
+
+#define OPS_MAX 200000
+
+static op_t ops[OPS_MAX];
+
+// a filesystem session: a mount that lives on, per file an object and a sector buffer, path and
+// name strings, directory listings kept until the menu closes
+static u32 gen_fs(){
+	bool live[SLOTS] = {0};
+	u32 n = 0;
+
+	ops[n++] = (op_t){true, 0, 600};
+	live[0] = true;
+	while(n < OPS_MAX - 64){
+		u32 slot = 1 + rnd() % (SLOTS - 1);
+		if(live[slot]){
+			ops[n++] = (op_t){false, slot, 0};
+			live[slot] = false;
+		}else{
+			u32 r = rnd() % 10;
+			u32 size = r < 5 ? 16 + rnd() % 240 : r < 8 ? 560 : r < 9 ? 512 : 4096 + (rnd() % 4) * 4096;
+			ops[n++] = (op_t){true, slot, size};
+			live[slot] = true;
+		}
+	}
+
+	return n;
+}
+
+// buffers freed in the reverse order of their allocation, a few of them kept
+static u32 gen_lifo(){
+	u32 n = 0, depth = 0;
+	u16 stack[SLOTS];
+
+	while(n < OPS_MAX - SLOTS){
+		if(depth && (depth == SLOTS || rnd() % 2)){
+			u16 slot = stack[--depth];
+			ops[n++] = (op_t){false, slot, 0};
+		}else{
+			stack[depth] = depth;
+			ops[n++] = (op_t){true, depth, 32 + rnd() % 2048};
+			depth++;
+		}
+	}
+	while(depth){
+		ops[n++] = (op_t){false, stack[--depth], 0};
+	}
+
+	return n;
+}
+
+// any size, any lifetime, a few hundred blocks live
+static u32 gen_random(){
+	bool live[SLOTS] = {0};
+	u32 n = 0;
+
+	while(n < OPS_MAX){
+		u32 slot = rnd() % SLOTS;
+		ops[n++] = (op_t){!live[slot], slot, 16 + rnd() % 3000};
+		live[slot] = !live[slot];
+	}
+
+	return n;
+}
+
+static u64 now_ns(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// ns per call and the most the heap grew to
+static void replay(u32 cnt, bool ref, u64 *ns, u32 *extent){
+	static void *ptr[SLOTS];
+
+	memset(ptr, 0, sizeof(ptr));
+	if(ref){
+		ref_init(heap_buf);
+	}else{
+		heap_init(heap_buf, HEAP_SIZE);
+	}
+	*extent = 0;
+
+	u64 start = now_ns();
+	for(u32 i = 0; i < cnt; i++){
+		const op_t *op = &ops[i];
+		if(op->alloc){
+			ptr[op->slot] = ref ? ref_malloc(op->size) : heap_malloc(op->size);
+		}else if(ptr[op->slot]){
+			if(ref){
+				ref_free(ptr[op->slot]);
+			}else{
+				heap_free(ptr[op->slot]);
+			}
+			ptr[op->slot] = NULL;
+		}
+		if(!(i & 63)){
+			*extent = MAX(*extent, ref ? ref_extent() : new_extent());
+		}
+	}
+	*ns = now_ns() - start;
+
+	for(u32 i = 0; i < SLOTS; i++){
+		if(ptr[i]){
+			if(ref){
+				ref_free(ptr[i]);
+			}else{
+				heap_free(ptr[i]);
+			}
+		}
+	}
+	CHECK(ref || !new_extent());
+}
+
+static void bench(const char *name, u32 cnt){
+	u64 ns[2];
+	u32 extent[2];
+
+	// best of a few, the clock is the host's
+	for(u32 ref = 0; ref < 2; ref++){
+		ns[ref] = ~0ull;
+		for(u32 i = 0; i < 3; i++){
+			u64 t;
+			replay(cnt, ref, &t, &extent[ref]);
+			ns[ref] = MIN(ns[ref], t);
+		}
+	}
+
+	printf("%-8s %8u %10.1f %10.1f %10u %10u\n", name, cnt, (double)ns[1] / cnt, (double)ns[0] / cnt, extent[1], extent[0]);
+	CHECK(ns[0] < ns[1]);
+	// coalescing keeps what the heap grows to close to the first fit heap
+	CHECK(extent[0] <= extent[1] + extent[1] / 4);
+}
+
+int main(){
+	test_fuzz();
+	test_coalesce();
+	test_bounds();
+
+	printf("%-8s %8s %10s %10s %10s %10s\n", "trace", "calls", "old ns", "new ns", "old bytes", "new bytes");
+	bench("fs", gen_fs());
+	bench("lifo", gen_lifo());
+	bench("random", gen_random());
+
+	return host_result("heap_test");
+}
@@ -0,0 +1,10 @@
+#ifndef _HOST_LOGO_BMP_H
+#define _HOST_LOGO_BMP_H
+
+// the display is not simulated, bmp2header output is not needed
+static const unsigned char logo_arr[1];
+static const unsigned int logo_lut[1];
+static const int logo_width = 1;
+static const int logo_height = 1;
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef _HOST_TYPES_H
+#define _HOST_TYPES_H
+
+// bdk types.h takes DWORD/QWORD as long types, fatfs wants them exactly 32/64 bit on the host too
+#include <stdint.h>
+
+#define DWORD _bdk_DWORD
+#define QWORD _bdk_QWORD
+#include_next <utils/types.h>
+#undef DWORD
+#undef QWORD
+
+typedef uint32_t DWORD;
+typedef uint64_t QWORD;
+
+#endif
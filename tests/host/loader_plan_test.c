@@ -0,0 +1,114 @@
+#include "host.h"
+#include <string.h>
+#include <memory_map.h>
+#include "loader.h"
+
+// payload planner of sdloader/loader.c against the memory_map.h layout: every size is read in
+// place except the part overlapping sdloader, the bounce buffer for it collides with nothing,
+// and the relocation at launch leaves the whole payload at PAYLOAD_LOAD_ADDR. the report
+// compares the bytes the bpmp still copies with the old copy of the whole payload.
+
+// bpmp clock sdloader runs at on t210
+#define BPMP_MHZ          576
+// ldrb, strb, subs and a taken branch per byte on the arm7tdmi, the relocator before the planner
+#define BYTE_LOOP_CYCLES  9
+
+extern u8 __bss_end[];
+
+typedef struct{
+	bool jumped;
+	bool payload_ok;
+}reloc_result_t;
+
+static reloc_result_t *result;
+static u8 expected[PAYLOAD_SIZE_MAX];
+static payload_plan_t reloc_plan;
+
+static bool overlaps(u32 a, u32 a_size, u32 b, u32 b_size){
+	return a_size && b_size && a < b + b_size && b < a + a_size;
+}
+
+static void check_plan(u32 size, const payload_plan_t *p){
+	u32 head = (u32)(uintptr_t)p->head;
+	u32 rest = (u32)(uintptr_t)p->rest;
+	u32 sdloader_end = (u32)(uintptr_t)__bss_end;
+
+	CHECK_EQ(p->size, size);
+	CHECK_EQ(p->head_size, MIN(ALIGN(sdloader_end - PAYLOAD_LOAD_ADDR, 0x200), size));
+	CHECK_EQ(rest, PAYLOAD_LOAD_ADDR + p->head_size);
+
+	// the part read in place is clear of sdloader, the bounce buffer of both and of the heap
+	CHECK(!overlaps(rest, size - p->head_size, HOST_IRAM_BASE, sdloader_end - HOST_IRAM_BASE));
+	CHECK(!overlaps(head, ALIGN(p->head_size, 0x200), PAYLOAD_LOAD_ADDR, size));
+	CHECK(!overlaps(head, ALIGN(p->head_size, 0x200), HOST_IRAM_BASE, sdloader_end - HOST_IRAM_BASE));
+	CHECK(head + ALIGN(p->head_size, 0x200) <= IPL_HEAP_START);
+	CHECK(head >= PAYLOAD_BUF_ADDR);
+	CHECK(!(head % 0x200));
+
+	// every offset lands in exactly one place
+	CHECK(plan_payload_ptr(p, 0) == (p->head_size ? p->head : p->rest));
+	CHECK(plan_payload_ptr(p, size - 1) == (size > p->head_size ? p->rest + size - 1 - p->head_size : p->head + size - 1));
+}
+
+static void on_jump(){
+	result->jumped = true;
+	result->payload_ok = !memcmp((void*)PAYLOAD_LOAD_ADDR, expected, reloc_plan.size);
+}
+
+static void reloc(void *arg){
+	host_set_jump_handler(on_jump);
+	reloc_and_start_payload(&reloc_plan);
+}
+
+// reads the payload where the plan says and launches it
+static void check_reloc(u32 size, const payload_plan_t *p){
+	for(u32 i = 0; i < size; i++){
+		expected[i] = i * 7 + (i >> 9);
+	}
+
+	memset((void*)HOST_IRAM_BASE, 0xee, HOST_IRAM_SIZE);
+	for(u32 ofs = 0; ofs < size; ofs++){
+		*plan_payload_ptr(p, ofs) = expected[ofs];
+	}
+
+	memset(result, 0, sizeof(*result));
+	reloc_plan = *p;
+	CHECK_EQ(host_run_isolated(reloc, NULL), HOST_EXIT_JUMP);
+	CHECK(result->jumped && result->payload_ok);
+}
+
+int main(){
+	u32 head_max = ALIGN((u32)(uintptr_t)__bss_end - PAYLOAD_LOAD_ADDR, 0x200);
+	u32 sizes[] = {1, 0x1ff, 0x200, head_max - 1, head_max, head_max + 1, 32 * 1024, 64 * 1024, 140 * 1024, PAYLOAD_SIZE_MAX};
+	payload_plan_t p;
+
+	result = host_shared_alloc(sizeof(*result));
+
+	// sdloader takes up to PAYLOAD_SIZE_MAX, a payload running into the heap has no room for the bounce buffer
+	CHECK(plan_payload(PAYLOAD_SIZE_MAX, &p));
+	CHECK(!plan_payload(IPL_HEAP_START - PAYLOAD_LOAD_ADDR, &p));
+	CHECK(!plan_payload(0, &p));
+
+	printf("%-8s %8s %8s %12s %12s %12s\n", "size", "in place", "moved", "cycles", "old moved", "old cycles");
+
+	for(u32 i = 0; i < ARRAY_SIZE(sizes); i++){
+		u32 size = sizes[i];
+		if(!plan_payload(size, &p)){
+			printf("%-8u rejected\n", size);
+			host_failures++;
+			continue;
+		}
+
+		check_plan(size, &p);
+		check_reloc(size, &p);
+
+		// word copy of the head at launch against the byte copy of everything
+		u64 cycles = (u64)ALIGN(p.head_size, 4) * host_cost.cpu_copy * BPMP_MHZ / 1000000;
+		u64 old_cycles = (u64)size * BYTE_LOOP_CYCLES;
+		printf("%-8u %8u %8u %12llu %12u %12llu\n", size, size - p.head_size, p.head_size,
+			(unsigned long long)cycles, size, (unsigned long long)old_cycles);
+		CHECK(p.head_size <= head_max);
+	}
+
+	return host_result("loader_plan_test");
+}
@@ -0,0 +1,163 @@
+#include "host.h"
+#include "arm_sim.h"
+#include <stdlib.h>
+#include <string.h>
+
+// bdk/utils/memops.S run by the arm interpreter: memcpy, memmove and memset fuzzed over sizes,
+// alignments and overlaps against the libc ones, then cycles per call on the arm7tdmi model.
+// mutually misaligned buffers take the byte loop the old routines used for everything.
+//
+//   memops_test [memops.S]
+
+#ifndef MEMOPS_S
+#define MEMOPS_S "../../bdk/utils/memops.S"
+#endif
+
+#define FUZZ_RUNS  20000
+#define BUF        0x1000  // buffers start here in the simulated memory
+#define BUF_SIZE   0x10000
+
+static u8 expected[ARM_SIM_MEM_SIZE];
+static u32 seed = 0x2468ace;
+
+static u32 rnd(){
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+// mostly short and odd sizes where the head and tail handling is, now and then a long one
+static u32 rnd_size(){
+	switch(rnd() % 4){
+	case 0:  return rnd() % 16;
+	case 1:  return rnd() % 80;
+	case 2:  return rnd() % 600;
+	default: return rnd() % 9000;
+	}
+}
+
+// new contents for the range a call touches and a little around it, the rest still matches
+static void fill(u32 ofs, u32 size){
+	ofs -= 32;
+	size += 64;
+	for(u32 i = ofs; i < ofs + size; i++){
+		arm_sim_mem[i] = rnd();
+	}
+	memcpy(expected + ofs, arm_sim_mem + ofs, size);
+}
+
+static u32 sim_addr(u32 ofs){
+	return ARM_SIM_MEM_BASE + ofs;
+}
+
+// runs func and compares all of the memory below the stack, bytes around the range included
+static bool run(const char *func, u32 a0, u32 a1, u32 a2){
+	u32 ret;
+	u64 cycles;
+
+	if(!arm_sim_call(func, sim_addr(a0), a1, a2, &ret, &cycles)){
+		return false;
+	}
+	return ret == sim_addr(a0) && !memcmp(arm_sim_mem, expected, BUF + BUF_SIZE);
+}
+
+static void fuzz_memcpy(){
+	for(u32 i = 0; i < FUZZ_RUNS; i++){
+		u32 size = rnd_size();
+		u32 src = BUF + rnd() % 16;
+		u32 dst = BUF + BUF_SIZE / 2 + rnd() % 16;
+
+		fill(src, size);
+		fill(dst, size);
+		memcpy(expected + dst, expected + src, size);
+		if(!run("memcpy", dst, sim_addr(src), size)){
+			printf("memcpy dst +%u src +%u size %u failed\n", dst % 16, src % 16, size);
+			host_failures++;
+			return;
+		}
+	}
+}
+
+static void fuzz_memmove(){
+	for(u32 i = 0; i < FUZZ_RUNS; i++){
+		u32 size = rnd_size();
+		// overlapping either way, touching and apart
+		u32 src = BUF + 0x40 + rnd() % 64;
+		u32 dst = rnd() % 8 ? src - 32 + rnd() % 64 : src + size + rnd() % 8;
+
+		fill(MIN(src, dst), MAX(src, dst) + size - MIN(src, dst));
+		memmove(expected + dst, expected + src, size);
+		if(!run("memmove", dst, sim_addr(src), size)){
+			printf("memmove dst %+d size %u failed\n", (int)(dst - src), size);
+			host_failures++;
+			return;
+		}
+	}
+}
+
+static void fuzz_memset(){
+	for(u32 i = 0; i < FUZZ_RUNS; i++){
+		u32 size = rnd_size();
+		u32 dst = BUF + rnd() % 16;
+		// only the low byte counts
+		u32 val = rnd() | rnd() << 24;
+
+		fill(dst, size);
+		memset(expected + dst, (u8)val, size);
+		if(!run("memset", dst, val, size)){
+			printf("memset dst +%u size %u failed\n", dst % 16, size);
+			host_failures++;
+			return;
+		}
+	}
+}
+
+static u64 cycles_of(const char *func, u32 a0, u32 a1, u32 a2){
+	u32 ret;
+	u64 cycles;
+
+	if(!arm_sim_call(func, sim_addr(a0), a1, a2, &ret, &cycles)){
+		host_failures++;
+		return 0;
+	}
+	return cycles;
+}
+
+static void bench(){
+	// the last one is the payload head relocated at launch
+	const u32 sizes[] = {16, 64, 512, 4096, 7168};
+
+	printf("%-6s %10s %10s %10s %10s %10s\n", "size", "memcpy", "unaligned", "memmove", "memset", "cyc/byte");
+
+	for(u32 i = 0; i < ARRAY_SIZE(sizes); i++){
+		u32 size = sizes[i];
+		u64 cpy = cycles_of("memcpy", BUF + BUF_SIZE / 2, sim_addr(BUF), size);
+		u64 bytes = cycles_of("memcpy", BUF + BUF_SIZE / 2 + 1, sim_addr(BUF), size);
+		u64 move = cycles_of("memmove", BUF + 0x40, sim_addr(BUF), size);
+		u64 set = cycles_of("memset", BUF, 0, size);
+
+		printf("%-6u %10llu %10llu %10llu %10llu %10.2f\n", size, (unsigned long long)cpy, (unsigned long long)bytes,
+			(unsigned long long)move, (unsigned long long)set, (double)cpy / size);
+
+		// bursts move a word in under a cycle per byte, the byte loop takes 9 per byte
+		if(size >= 512){
+			CHECK(cpy < size);
+			CHECK(move < size);
+			CHECK(set * 2 <= size);
+			CHECK(bytes >= 9 * size);
+		}
+	}
+}
+
+int main(int argc, char *argv[]){
+	if(!arm_sim_load(argc > 1 ? argv[1] : MEMOPS_S)){
+		return 1;
+	}
+
+	memcpy(expected, arm_sim_mem, sizeof(expected));
+	fuzz_memcpy();
+	fuzz_memmove();
+	fuzz_memset();
+	bench();
+
+	return host_result("memops_test");
+}
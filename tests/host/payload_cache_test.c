@@ -0,0 +1,130 @@
+#include "host.h"
+#include "storage_img.h"
+#include "fatimg.h"
+#include "boot_run.h"
+#include <string.h>
+
+// payload location cache in the boot0 cfg sector: the second boot reads payload.bin without
+// mounting, and every way of replacing the file makes the next boot go through FatFs again.
+// cache hits are told by the boot trace, which is only saved with boot_trace set in the cfg
+
+#define PAYLOAD_SIZE (140 * 1024)
+#define SD_SECTORS   (64 * 1024 * 1024 / 0x200)
+#define BOOT_SECTORS (4 * 1024 * 1024 / 0x200)
+
+typedef struct{
+	const char *name;
+	fatimg_type_t type;
+	u32 clus_sectors;
+}fs_case_t;
+
+static const fs_case_t cases[] = {
+	{"fat32", FATIMG_FAT32, 1},
+	{"exfat", FATIMG_EXFAT, 64},
+};
+
+static u8 payload[PAYLOAD_SIZE];
+
+static void make_payload(u32 version){
+	for(u32 i = 0; i < PAYLOAD_SIZE; i++){
+		payload[i] = i * 13 + (i >> 9) + version * 0x55;
+	}
+}
+
+// boots once, true if the payload came from the cached location
+static bool boot_cached(const char *what){
+	boot_result_t res;
+	u32 total[TRACE_ID_MAX];
+	bool seen[TRACE_ID_MAX];
+
+	if(!boot_run(payload, PAYLOAD_SIZE, &res) || !res.payload_ok){
+		fprintf(stderr, "%s: wrong payload\n", what);
+		host_failures++;
+		return false;
+	}
+	CHECK(boot_stages(res.jump_ns, total, seen));
+	return !seen[TRACE_MOUNT];
+}
+
+static void run_case(const fs_case_t *c){
+	fatimg_file_t file;
+
+	img_create(IMG_SD, SD_SECTORS);
+	img_create(IMG_GPP, SD_SECTORS);
+	img_create(IMG_BOOT0, BOOT_SECTORS);
+	boot_enable_trace();
+	img_create(IMG_BOOT1, BOOT_SECTORS);
+
+	make_payload(0);
+	CHECK(fatimg_format(IMG_SD, 0x800, SD_SECTORS - 0x800, c->type, c->clus_sectors, true));
+	fatimg_skip_clusters(IMG_SD, 37);
+	CHECK(fatimg_add_file(IMG_SD, "payload.bin", payload, PAYLOAD_SIZE, 0, &file));
+
+	CHECK(!boot_cached("first boot"));
+	CHECK(boot_cached("cached"));
+
+	// saved over in place, same clusters and size, only the time differs
+	make_payload(1);
+	CHECK(fatimg_update(IMG_SD, "payload.bin", payload, PAYLOAD_SIZE, 0));
+	CHECK(!boot_cached("edited"));
+	CHECK(boot_cached("edited, cached again"));
+
+	// renamed away and a new file next to it
+	make_payload(2);
+	CHECK(fatimg_rename(IMG_SD, "payload.bin", "payload.old"));
+	CHECK(fatimg_add_file(IMG_SD, "payload.bin", payload, PAYLOAD_SIZE, 0, NULL));
+	CHECK(!boot_cached("renamed"));
+	CHECK(boot_cached("renamed, cached again"));
+
+	// rewritten fragmented from the same first cluster, a fragmented file is never cached
+	make_payload(3);
+	CHECK(fatimg_update(IMG_SD, "payload.bin", payload, PAYLOAD_SIZE, 8));
+	CHECK(!boot_cached("fragmented"));
+	CHECK(!boot_cached("fragmented, second boot"));
+
+	// contiguous again
+	make_payload(4);
+	CHECK(fatimg_delete(IMG_SD, "payload.bin"));
+	CHECK(fatimg_add_file(IMG_SD, "payload.bin", payload, PAYLOAD_SIZE, 0, NULL));
+	CHECK(!boot_cached("replaced"));
+	CHECK(boot_cached("replaced, cached again"));
+}
+
+// without boot_trace in the cfg a cached boot writes nothing, with it only the trace sector
+static void test_trace_writes(){
+	static const u8 zero[0x200];
+	boot_result_t res;
+
+	for(u32 trace = 0; trace < 2; trace++){
+		img_create(IMG_SD, SD_SECTORS);
+		img_create(IMG_GPP, SD_SECTORS);
+		img_create(IMG_BOOT0, BOOT_SECTORS);
+		img_create(IMG_BOOT1, BOOT_SECTORS);
+		if(trace){
+			boot_enable_trace();
+		}
+
+		make_payload(0);
+		CHECK(fatimg_format(IMG_SD, 0x800, SD_SECTORS - 0x800, FATIMG_EXFAT, 64, true));
+		CHECK(fatimg_add_file(IMG_SD, "payload.bin", payload, PAYLOAD_SIZE, 0, NULL));
+
+		CHECK(boot_run(payload, PAYLOAD_SIZE, &res) && res.payload_ok);
+		CHECK(boot_run(payload, PAYLOAD_SIZE, &res) && res.payload_ok);
+		CHECK_EQ(res.stats.writes, trace);
+		CHECK_EQ(!memcmp(img_sector(IMG_BOOT0, TRACE_SECTOR), zero, sizeof(zero)), !trace);
+	}
+}
+
+int main(){
+	test_trace_writes();
+
+	for(u32 i = 0; i < ARRAY_SIZE(cases); i++){
+		int failures = host_failures;
+		run_case(&cases[i]);
+		if(host_failures != failures){
+			printf("%s failed\n", cases[i].name);
+		}
+	}
+
+	return host_result("payload_cache_test");
+}
@@ -0,0 +1,183 @@
+#include "host.h"
+#include "storage_img.h"
+#include "fatimg.h"
+#include "boot_run.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <memory_map.h>
+
+// tools/payloadpack round trips: every payload is packed, booted from an exfat sd raw and packed
+// and has to arrive unchanged at PAYLOAD_LOAD_ADDR. prints the sectors read and the time of the
+// read and of the relocation, which is where a packed payload is decoded. payloads given on the
+// command line replace the built in ones, e.g. real payloads from a release.
+//
+//   payloadpack_test [payload.bin ...]
+
+#ifndef PAYLOADPACK
+#define PAYLOADPACK "build/payloadpack"
+#endif
+
+#define SD_SECTORS   (64 * 1024 * 1024 / 0x200)
+#define BOOT_SECTORS (4 * 1024 * 1024 / 0x200)
+#define DATA_MAX     (256 * 1024)
+
+typedef struct{
+	bool ok;
+	u32 read_sectors;
+	u32 read_us;
+	u32 reloc_us;
+	u64 jump_ns;
+}boot_t;
+
+static u8 *exe;
+static u32 exe_size;
+
+static u32 seed = 0xc0ffee;
+
+static u32 rnd(){
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static bool read_file(const char *path, u8 *buf, u32 max, u32 *size){
+	FILE *f = fopen(path, "rb");
+	if(!f){
+		return false;
+	}
+	*size = fread(buf, 1, max, f);
+	fclose(f);
+	return true;
+}
+
+// payloadpack exits with an error on data it can't make smaller
+static bool pack(const u8 *data, u32 size, u8 *out, u32 *out_size){
+	char in_path[] = "/tmp/payloadpack_test_XXXXXX";
+	char out_path[sizeof(in_path) + 4];
+	char cmd[512];
+	int fd = mkstemp(in_path);
+
+	if(fd < 0 || write(fd, data, size) != size){
+		return false;
+	}
+	close(fd);
+
+	snprintf(out_path, sizeof(out_path), "%s.blz", in_path);
+	snprintf(cmd, sizeof(cmd), "%s %s %s >/dev/null", PAYLOADPACK, in_path, out_path);
+	bool res = !system(cmd) && read_file(out_path, out, DATA_MAX, out_size);
+
+	unlink(in_path);
+	unlink(out_path);
+	return res;
+}
+
+static boot_t boot(const u8 *file, u32 file_size, const u8 *payload, u32 size){
+	boot_result_t res;
+	boot_t b = {0};
+	u32 total[TRACE_ID_MAX];
+	bool seen[TRACE_ID_MAX];
+
+	img_create(IMG_SD, SD_SECTORS);
+	img_create(IMG_GPP, SD_SECTORS);
+	img_create(IMG_BOOT0, BOOT_SECTORS);
+	boot_enable_trace();
+	img_create(IMG_BOOT1, BOOT_SECTORS);
+	if(!fatimg_format(IMG_SD, 0x800, SD_SECTORS - 0x800, FATIMG_EXFAT, 64, true) ||
+		!fatimg_add_file(IMG_SD, "payload.bin", file, file_size, 0, NULL)){
+		return b;
+	}
+
+	b.ok = boot_run(payload, size, &res) && res.payload_ok;
+	b.read_sectors = res.stats.read_sectors;
+	b.jump_ns = res.jump_ns;
+	if(b.ok && boot_stages(res.jump_ns, total, seen)){
+		b.read_us = total[TRACE_F_READ];
+		b.reloc_us = total[TRACE_RELOC];
+	}
+
+	return b;
+}
+
+static void run(const char *name, const u8 *data, u32 size, bool compressible){
+	static u8 packed[DATA_MAX];
+	u32 packed_size;
+	boot_t raw = {0};
+
+	if(!pack(data, size, packed, &packed_size)){
+		printf("%-12s %7u  does not compress\n", name, size);
+		CHECK(!compressible);
+		return;
+	}
+	CHECK(compressible);
+	CHECK(packed_size < size);
+
+	bool fits = size <= PAYLOAD_SIZE_MAX;
+	if(fits){
+		raw = boot(data, size, data, size);
+		CHECK(raw.ok);
+	}
+
+	boot_t blz = boot(packed, packed_size, data, size);
+	CHECK(blz.ok);
+	if(fits){
+		CHECK(blz.read_sectors < raw.read_sectors);
+	}
+
+	printf("%-12s %7u %7u %6.1f%% ", name, size, packed_size, packed_size * 100.0 / size);
+	if(fits){
+		printf("%6u %6u %8u %8u %8u ", raw.read_sectors, blz.read_sectors, raw.read_us, blz.read_us, raw.reloc_us);
+	}else{
+		printf("%6s %6u %8s %8u %8s ", "-", blz.read_sectors, "-", blz.read_us, "-");
+	}
+	printf("%8u\n", blz.reloc_us);
+}
+
+// machine code from the start of this binary, some of it with a zeroed tail like a payload with
+// its bss in the file, and data that doesn't compress at all
+static void run_builtin(){
+	static u8 buf[DATA_MAX];
+
+	run("code-32k", exe, 32 * 1024, true);
+	run("code-96k", exe, 96 * 1024, true);
+	run("code-140k", exe, 140 * 1024, true);
+	// over PAYLOAD_SIZE_MAX, only bootable packed
+	run("code-180k", exe, 180 * 1024, true);
+
+	memcpy(buf, exe, 100 * 1024);
+	memset(buf + 100 * 1024, 0, 80 * 1024);
+	run("zero-tail", buf, 180 * 1024, true);
+
+	for(u32 i = 0; i < 64 * 1024; i++){
+		buf[i] = rnd();
+	}
+	run("random-64k", buf, 64 * 1024, false);
+}
+
+int main(int argc, char *argv[]){
+	static u8 file[DATA_MAX];
+
+	exe = malloc(DATA_MAX);
+	if(!read_file("/proc/self/exe", exe, DATA_MAX, &exe_size) || exe_size < 180 * 1024){
+		printf("can't read the test binary\n");
+		return 1;
+	}
+
+	printf("%-12s %7s %7s %7s %6s %6s %8s %8s %8s %8s\n", "payload", "size", "packed", "", "rd raw", "rd blz",
+		"read us", "read us", "reloc us", "reloc us");
+
+	if(argc > 1){
+		for(int i = 1; i < argc; i++){
+			u32 size;
+			if(!read_file(argv[i], file, DATA_MAX, &size)){
+				printf("can't read %s\n", argv[i]);
+				host_failures++;
+				continue;
+			}
+			run(argv[i], file, size, true);
+		}
+	}else{
+		run_builtin();
+	}
+
+	return host_result("payloadpack_test");
+}
@@ -0,0 +1,250 @@
+#include "host.h"
+#include "storage_img.h"
+#include <stdlib.h>
+#include <string.h>
+#include <libs/fatfs/ff.h>
+#include <libs/fatfs/diskio.h>
+#include <storage/emmc.h>
+#include "modchip.h"
+
+// the sdloader record of sdloader/modchip.c on image backed boot0: settings in the legacy cfg
+// sector are imported, every update is a single write and no read, and a power cut during any
+// update leaves either the old or the new record. the cut is modelled on the slot being written:
+// its first bytes are the new record, the rest is what the slot held before, erased or noise.
+// the next boot is a load after disk_cache_invalidate.
+
+#define BOOT_SECTORS (4 * 1024 * 1024 / 0x200)
+#define GPP_SECTORS  (64 * 1024 * 1024 / 0x200)
+#define CUT_STEP     7
+
+typedef enum{
+	TORN_OLD = 0, // the rest of the slot as it was
+	TORN_ERASED,  // the rest erased
+	TORN_NOISE,   // the rest random
+	TORN_MAX
+}torn_t;
+
+static const char *torn_names[TORN_MAX] = {"old", "erased", "noise"};
+
+static u32 seed = 0x7e57;
+
+static u32 rnd(){
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static bool fail_writes;
+
+static bool fault(img_id_t id, u32 sector, u32 num_sectors, bool write){
+	return write && fail_writes;
+}
+
+static void setup(){
+	img_create(IMG_GPP, GPP_SECTORS);
+	img_create(IMG_BOOT0, BOOT_SECTORS);
+	img_fault = fault;
+	fail_writes = false;
+	emmc_session_init();
+	disk_cache_invalidate();
+	img_stats_reset();
+}
+
+static void reboot(){
+	disk_cache_invalidate();
+	img_stats_reset();
+}
+
+static u8 *slot(u32 i){
+	return img_sector(IMG_BOOT0, MODCHIP_RECORD_SECTOR + i);
+}
+
+// settings of an older version, the bus cache is imported as well when it is valid
+static void test_import(){
+	sd_loader_cfg_t cfg, legacy;
+
+	setup();
+	modchip_get_cfg_default(&legacy);
+	legacy.default_action = MODCHIP_DEFAULT_ACTION_MENU;
+	legacy.boot_trace = 1;
+	memcpy(img_sector(IMG_BOOT0, MODCHIP_CFG_SECTOR) + MODCHIP_CFG_OFFSET, &legacy, sizeof(legacy));
+
+	CHECK(modchip_get_cfg(&cfg));
+	CHECK(!memcmp(&cfg, &legacy, sizeof(cfg)));
+	CHECK_EQ(img_stats->writes, 0);
+
+	// first update makes it a record, the cfg sector isn't touched
+	u8 cfg_sector[0x200];
+	memcpy(cfg_sector, img_sector(IMG_BOOT0, MODCHIP_CFG_SECTOR), sizeof(cfg_sector));
+	cfg.default_payload_vol = MODCHIP_PAYLOAD_VOL_SD;
+	CHECK(modchip_set_cfg(&cfg));
+	CHECK(!memcmp(cfg_sector, img_sector(IMG_BOOT0, MODCHIP_CFG_SECTOR), sizeof(cfg_sector)));
+
+	reboot();
+	CHECK(modchip_get_cfg(&cfg));
+	CHECK_EQ(cfg.default_action, MODCHIP_DEFAULT_ACTION_MENU);
+	CHECK_EQ(cfg.default_payload_vol, MODCHIP_PAYLOAD_VOL_SD);
+	// the record is found, the legacy sector isn't read any more
+	CHECK_EQ(img_stats->cmds, 1);
+}
+
+// every update is one write to the other slot, the slots take turns
+static void test_updates(){
+	sd_loader_cfg_t cfg;
+	file_loc_t loc = {0};
+	sdmmc_bus_cache_t bus = {0};
+
+	setup();
+	modchip_get_cfg_or_default(&cfg);
+
+	for(u32 i = 0; i < 6; i++){
+		u32 reads = img_stats->read_sectors;
+		u32 writes = img_stats->writes;
+
+		if(i % 3 == 0){
+			cfg.default_payload_vol = i % 5;
+			CHECK(modchip_set_cfg(&cfg));
+		}else if(i % 3 == 1){
+			loc.size = 1000 + i;
+			CHECK(modchip_set_payload_cache(&loc));
+		}else{
+			bus.mode = i;
+			CHECK(modchip_set_bus_cache(&bus));
+		}
+
+		CHECK_EQ(img_stats->read_sectors, reads);
+		CHECK_EQ(img_stats->writes, writes + 1);
+		CHECK_EQ(((modchip_record_t*)slot((i + 1) % MODCHIP_RECORD_SLOTS))->seq, i + 1);
+	}
+
+	reboot();
+	file_loc_t loc_read;
+	sdmmc_bus_cache_t bus_read;
+	CHECK(modchip_get_cfg(&cfg));
+	CHECK_EQ(cfg.default_payload_vol, 3);
+	CHECK(modchip_get_payload_cache(&loc_read));
+	CHECK_EQ(loc_read.size, 1004);
+	CHECK(modchip_get_bus_cache(&bus_read));
+	CHECK_EQ(bus_read.mode, 5);
+
+	// a write that fails keeps the old record, here and after a reboot
+	fail_writes = true;
+	cfg.default_payload_vol = 4;
+	CHECK(!modchip_set_cfg(&cfg));
+	fail_writes = false;
+	CHECK(modchip_get_cfg(&cfg));
+	CHECK_EQ(cfg.default_payload_vol, 3);
+	reboot();
+	CHECK(modchip_get_cfg(&cfg));
+	CHECK_EQ(cfg.default_payload_vol, 3);
+}
+
+// the second half of the command sector isn't ours, the sector is read once and then served from the cache
+static void test_rst_cmd(){
+	setup();
+	memset(img_sector(IMG_BOOT0, MODCHIP_CMD_SECTOR) + 0x180, 0xa5, 0x20);
+
+	CHECK(modchip_write_rst_cmd());
+	CHECK_EQ(img_stats->read_sectors, 1);
+	CHECK_EQ(img_stats->writes, 1);
+	CHECK(modchip_write_rst_cmd());
+	CHECK_EQ(img_stats->read_sectors, 1);
+	CHECK_EQ(img_stats->writes, 2);
+
+	const modchip_cmd_t *cmd = (const modchip_cmd_t*)(img_sector(IMG_BOOT0, MODCHIP_CMD_SECTOR) + MODCHIP_CMD_OFFSET);
+	CHECK_EQ(cmd->cmd, MODCHIP_CMD_RST);
+	CHECK_EQ(img_sector(IMG_BOOT0, MODCHIP_CMD_SECTOR)[0x19f], 0xa5);
+}
+
+// one update cut after cut bytes of the slot, then the boot after it and one more update
+static bool torn_update(u32 cut, torn_t torn, u32 *old_vol, u32 *new_vol){
+	sd_loader_cfg_t cfg;
+	file_loc_t loc;
+	u8 before[MODCHIP_RECORD_SLOTS][0x200], after[MODCHIP_RECORD_SLOTS][0x200];
+
+	reboot();
+	CHECK(modchip_get_cfg(&cfg));
+	*old_vol = cfg.default_payload_vol;
+	*new_vol = (cfg.default_payload_vol + 1) % 5;
+
+	// the update as it would have landed, then the slot it wrote put back together as cut
+	memcpy(before, slot(0), sizeof(before));
+	cfg.default_payload_vol = *new_vol;
+	CHECK(modchip_set_cfg(&cfg));
+	memcpy(after, slot(0), sizeof(after));
+	memcpy(slot(0), before, sizeof(before));
+
+	u32 written = MODCHIP_RECORD_SLOTS;
+	for(u32 i = 0; i < MODCHIP_RECORD_SLOTS; i++){
+		if(memcmp(before[i], after[i], 0x200)){
+			CHECK_EQ(written, MODCHIP_RECORD_SLOTS);
+			written = i;
+		}
+	}
+	if(written == MODCHIP_RECORD_SLOTS){
+		return false;
+	}
+
+	u8 *s = slot(written);
+	memcpy(s, after[written], cut);
+	for(u32 i = cut; i < 0x200; i++){
+		s[i] = torn == TORN_OLD ? before[written][i] : torn == TORN_ERASED ? 0 : rnd();
+	}
+
+	reboot();
+	if(!modchip_get_cfg(&cfg) || !modchip_is_cfg_valid(&cfg) || !modchip_get_payload_cache(&loc) || loc.size != 1234){
+		return false;
+	}
+	// nothing in between, the whole record or none of it. the rest of the sector isn't part of it
+	bool complete = !memcmp(s, after[written], sizeof(modchip_record_t));
+	if(cfg.default_payload_vol != (complete ? *new_vol : *old_vol)){
+		return false;
+	}
+
+	// the boot after the cut saves again and that sticks
+	cfg.default_payload_vol = *new_vol;
+	if(!modchip_set_cfg(&cfg)){
+		return false;
+	}
+	reboot();
+	return modchip_get_cfg(&cfg) && cfg.default_payload_vol == *new_vol;
+}
+
+static void test_torn(){
+	sd_loader_cfg_t cfg;
+	file_loc_t loc = {0};
+
+	printf("%-8s %8s %8s\n", "rest", "cuts", "intact");
+
+	for(u32 torn = 0; torn < TORN_MAX; torn++){
+		u32 cuts = 0, intact = 0;
+
+		setup();
+		modchip_get_cfg_or_default(&cfg);
+		CHECK(modchip_set_cfg(&cfg));
+		loc.size = 1234;
+		CHECK(modchip_set_payload_cache(&loc));
+
+		// every CUT_STEP bytes and both ends, with the slots taking turns
+		for(u32 cut = 0; cut <= 0x200; cut = cut == 0x200 ? 0x201 : MIN(cut + CUT_STEP, 0x200)){
+			u32 old_vol, new_vol;
+			cuts++;
+			if(torn_update(cut, torn, &old_vol, &new_vol)){
+				intact++;
+			}else{
+				printf("cut after %u bytes, rest %s: record lost or mixed\n", cut, torn_names[torn]);
+			}
+		}
+
+		printf("%-8s %8u %8u\n", torn_names[torn], cuts, intact);
+		CHECK_EQ(intact, cuts);
+	}
+}
+
+int main(){
+	test_import();
+	test_updates();
+	test_rst_cmd();
+	test_torn();
+
+	return host_result("record_test");
+}
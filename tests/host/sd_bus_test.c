@@ -0,0 +1,310 @@
+#include "host.h"
+#include <string.h>
+#include <storage/sd.h>
+#include <storage/sdmmc.h>
+
+// bdk/storage/sd.c on a card model across boots: the mode each boot starts and ends in, the
+// tunings and what ends up in boot0. a card that needed a lower mode keeps the saved one until
+// that happened SD_BUS_CACHE_DOWN_FAILS boots in a row, a lowered card tries the top mode every
+// SD_BUS_CACHE_RETRY_BOOTS boots and a cached tap that stopped working retunes from the top mode.
+// every boot runs in its own process so sd.c starts from its initial state like after a reset.
+
+#define TOP_MODE SD_UHS_SDR104
+
+typedef struct{
+	// card
+	u8  cid[0x10];
+	u32 max_mode;  // fastest mode it still works in
+	u8  good_tap;  // a cached tap other than this fails
+	u32 fail_next; // inits failing whatever the mode
+	// boot0
+	sdmmc_bus_cache_t saved;
+	bool saved_valid;
+	// last boot
+	bool ok;
+	u32 start_mode;
+	u32 mode;
+	u32 starts;
+	u32 inits;
+	u32 tunes;
+	bool written;
+}sim_t;
+
+static sim_t *sim;
+
+// what sd_init_retry asks for, back to the mode
+static u32 type_mode(u32 bus_width, u32 type){
+	switch(type){
+	case SDHCI_TIMING_UHS_SDR104:
+		return SD_UHS_SDR104;
+	case SDHCI_TIMING_UHS_SDR82:
+		return SD_UHS_SDR82;
+	default:
+		return bus_width == SDMMC_BUS_WIDTH_1 ? SD_1BIT_HS25 : SD_4BIT_HS25;
+	}
+}
+
+int sdmmc_storage_init_sd_start(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 bus_width, u32 type){
+	sim->starts++;
+	return 1;
+}
+
+// the cid is read before tuning, a failed init knows it as well
+int sdmmc_storage_init_sd(sdmmc_storage_t *storage, sdmmc_t *sdmmc, u32 bus_width, u32 type){
+	sdmmc_bus_cache_t *cache = storage->bus_cache;
+	u32 mode = type_mode(bus_width, type);
+
+	memset(storage, 0, sizeof(*storage));
+	storage->sdmmc = sdmmc;
+	storage->bus_cache = cache;
+	memcpy(storage->raw_cid, sim->cid, sizeof(storage->raw_cid));
+
+	sim->inits++;
+	if(!sim->start_mode){
+		sim->start_mode = mode;
+	}
+	if(sim->fail_next){
+		sim->fail_next--;
+		return 0;
+	}
+	if(mode > sim->max_mode){
+		return 0;
+	}
+
+	// uhs modes are tuned, same lookup as _sdmmc_storage_tuning_execute
+	if(mode >= SD_UHS_SDR82){
+		if(cache && cache->tuned && cache->type == type && !memcmp(cache->raw_cid, storage->raw_cid, sizeof(storage->raw_cid))){
+			storage->bus_cache_hit = 1;
+			if(cache->tap != sim->good_tap){
+				return 0;
+			}
+		}else{
+			sim->tunes++;
+			if(cache){
+				memcpy(cache->raw_cid, storage->raw_cid, sizeof(cache->raw_cid));
+				cache->type = type;
+				cache->tap = sim->good_tap;
+				cache->tuned = 1;
+			}
+		}
+	}
+
+	storage->initialized = 1;
+	return 1;
+}
+
+int sdmmc_storage_end(sdmmc_storage_t *storage){
+	storage->initialized = 0;
+	return 1;
+}
+
+int sdmmc_get_sd_inserted(){
+	return 1;
+}
+
+// the write rule of update_bus_cache in main.c, tap jitter alone isn't written
+static bool entry_changed(const sdmmc_bus_cache_t *a, const sdmmc_bus_cache_t *b){
+	return memcmp(a->raw_cid, b->raw_cid, sizeof(a->raw_cid)) || a->mode != b->mode || a->type != b->type || a->tuned != b->tuned ||
+		a->boots != b->boots || a->fails != b->fails;
+}
+
+// get_cfg and update_bus_cache of main.c around a single sd init
+static void boot_child(void *arg){
+	sdmmc_bus_cache_t live = {0}, next;
+
+	// power up started ahead of the emmc init, nothing to start once the card is up
+	sd_initialize_start();
+	sd_set_bus_cache(&live);
+	if(sim->saved_valid){
+		memcpy(&live, &sim->saved, sizeof(live));
+		sd_bus_cache_boot(&live);
+	}
+
+	sim->ok = sd_initialize(false);
+	sim->mode = sd_get_mode();
+	sd_initialize_start();
+
+	sd_bus_cache_persist(&next, &sim->saved);
+	if(!sim->saved_valid || entry_changed(&next, &sim->saved)){
+		memcpy(&sim->saved, &next, sizeof(next));
+		sim->saved_valid = true;
+		sim->written = true;
+	}
+}
+
+static void boot(){
+	sim->ok = false;
+	sim->start_mode = 0;
+	sim->mode = 0;
+	sim->starts = 0;
+	sim->inits = 0;
+	sim->tunes = 0;
+	sim->written = false;
+
+	// the child exits 1 on failures it inherited, only a crash is its own
+	CHECK(host_run_isolated(boot_child, NULL) >= 0);
+}
+
+static void new_card(u8 id, u32 max_mode){
+	memset(sim, 0, sizeof(*sim));
+	memset(sim->cid, id, sizeof(sim->cid));
+	sim->max_mode = max_mode;
+	sim->good_tap = 0x20;
+}
+
+// the top mode works, tuned once and never written again
+static void test_healthy(){
+	new_card(1, TOP_MODE);
+
+	boot();
+	CHECK(sim->ok && sim->written);
+	CHECK_EQ(sim->mode, TOP_MODE);
+	CHECK_EQ(sim->tunes, 1);
+
+	for(u32 i = 0; i < 20; i++){
+		boot();
+		CHECK(sim->ok && !sim->written);
+		CHECK_EQ(sim->starts, 1);
+		CHECK_EQ(sim->inits, 1);
+		CHECK_EQ(sim->tunes, 0);
+	}
+}
+
+// a card that only works a mode lower starts there, except for a top mode try every few boots
+static void test_lowered(){
+	new_card(2, SD_UHS_SDR82);
+
+	boot();
+	CHECK(sim->ok);
+	CHECK_EQ(sim->mode, SD_UHS_SDR82);
+	CHECK_EQ(sim->saved.mode, SD_UHS_SDR82);
+
+	for(u32 round = 0; round < 2; round++){
+		for(u32 i = 1; i < SD_BUS_CACHE_RETRY_BOOTS; i++){
+			boot();
+			CHECK(sim->ok && sim->written);
+			CHECK_EQ(sim->start_mode, SD_UHS_SDR82);
+			CHECK_EQ(sim->inits, 1);
+			CHECK_EQ(sim->tunes, 0);
+		}
+
+		boot();
+		CHECK(sim->ok);
+		CHECK_EQ(sim->start_mode, TOP_MODE);
+		CHECK_EQ(sim->mode, SD_UHS_SDR82);
+		CHECK_EQ(sim->inits, 2);
+		CHECK_EQ(sim->saved.mode, SD_UHS_SDR82);
+		CHECK_EQ(sim->saved.boots, 0);
+		CHECK_EQ(sim->saved.fails, 0);
+	}
+
+	// whatever needed the lower mode is gone, the next try keeps the top mode
+	sim->max_mode = TOP_MODE;
+	for(u32 i = 1; i <= SD_BUS_CACHE_RETRY_BOOTS; i++){
+		boot();
+	}
+	CHECK_EQ(sim->mode, TOP_MODE);
+	CHECK_EQ(sim->saved.mode, TOP_MODE);
+
+	boot();
+	CHECK(sim->ok && !sim->written);
+	CHECK_EQ(sim->inits, 1);
+}
+
+// a boot that ended lower once doesn't change the saved mode, SD_BUS_CACHE_DOWN_FAILS in a row do
+static void test_downgrade(){
+	new_card(3, TOP_MODE);
+	boot();
+
+	sim->fail_next = 1;
+	boot();
+	CHECK(sim->ok);
+	CHECK_EQ(sim->mode, SD_UHS_SDR82);
+	CHECK_EQ(sim->saved.mode, TOP_MODE);
+	CHECK_EQ(sim->saved.fails, 1);
+
+	boot();
+	CHECK(sim->ok);
+	CHECK_EQ(sim->mode, TOP_MODE);
+	CHECK_EQ(sim->inits, 1);
+	CHECK_EQ(sim->saved.fails, 0);
+
+	sim->max_mode = SD_UHS_SDR82;
+	for(u32 i = 1; i < SD_BUS_CACHE_DOWN_FAILS; i++){
+		boot();
+		CHECK_EQ(sim->start_mode, TOP_MODE);
+		CHECK_EQ(sim->mode, SD_UHS_SDR82);
+		CHECK_EQ(sim->saved.mode, TOP_MODE);
+		CHECK_EQ(sim->saved.fails, i);
+	}
+
+	boot();
+	CHECK_EQ(sim->saved.mode, SD_UHS_SDR82);
+	CHECK_EQ(sim->saved.fails, 0);
+
+	boot();
+	CHECK_EQ(sim->start_mode, SD_UHS_SDR82);
+	CHECK_EQ(sim->inits, 1);
+}
+
+// the tap of a lowered card stopped working, retuned from the top mode instead of the cached one
+static void test_stale_tap(){
+	new_card(4, SD_UHS_SDR82);
+	boot();
+
+	sim->good_tap = 0x30;
+	sim->max_mode = TOP_MODE;
+	boot();
+	CHECK(sim->ok);
+	CHECK_EQ(sim->start_mode, SD_UHS_SDR82);
+	CHECK_EQ(sim->inits, 2);
+	CHECK_EQ(sim->mode, TOP_MODE);
+	CHECK_EQ(sim->tunes, 1);
+	CHECK_EQ(sim->saved.mode, TOP_MODE);
+
+	// still limited, walks down again and tunes the lower mode
+	new_card(5, SD_UHS_SDR82);
+	boot();
+	sim->good_tap = 0x30;
+	boot();
+	CHECK(sim->ok);
+	CHECK_EQ(sim->inits, 3);
+	CHECK_EQ(sim->mode, SD_UHS_SDR82);
+	CHECK_EQ(sim->tunes, 1);
+	CHECK_EQ(sim->saved.tap, 0x30);
+
+	boot();
+	CHECK_EQ(sim->inits, 1);
+	CHECK_EQ(sim->tunes, 0);
+}
+
+// the saved mode belongs to another card, the new one starts over from the top without counts
+static void test_other_card(){
+	new_card(6, SD_UHS_SDR82);
+	for(u32 i = 0; i < 5; i++){
+		boot();
+	}
+	CHECK(sim->saved.boots);
+
+	memset(sim->cid, 7, sizeof(sim->cid));
+	sim->max_mode = TOP_MODE;
+	boot();
+	CHECK(sim->ok);
+	CHECK_EQ(sim->mode, TOP_MODE);
+	CHECK_EQ(sim->saved.mode, TOP_MODE);
+	CHECK_EQ(sim->saved.boots, 0);
+	CHECK_EQ(sim->saved.fails, 0);
+	CHECK(!memcmp(sim->saved.raw_cid, sim->cid, sizeof(sim->cid)));
+}
+
+int main(){
+	sim = host_shared_alloc(sizeof(*sim));
+
+	test_healthy();
+	test_lowered();
+	test_downgrade();
+	test_stale_tap();
+	test_other_card();
+
+	return host_result("sd_bus_test");
+}
@@ -0,0 +1,193 @@
+#include "host.h"
+#include "sdmmc_mock.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <storage/mmc.h>
+
+// adma2 scatter/gather: the descriptor builder of bdk/storage/sdmmc_adma.c checked entry by entry,
+// then run by the simulated controller, and sdmmc_storage_read_sg into a split buffer like the
+// payload head and the part behind it
+
+#define CARD_SECTORS 0x1000
+#define GUARD        0x200
+#define GUARD_BYTE   0xA5
+
+static u8 *card;
+// descriptors hold 32bit addresses, -no-pie keeps these below 4gb
+static u8 mem[3][GUARD + 160 * 1024 + GUARD] __attribute__((aligned(8)));
+
+static void reset(){
+	for(u32 i = 0; i < CARD_SECTORS * 0x200; i++){
+		card[i] = i / 0x200 + i * 13;
+	}
+	memset(mem, GUARD_BYTE, sizeof(mem));
+	mock_reset(card, CARD_SECTORS);
+	mock_storage.auto_set_blkcnt = 1;
+	host_time_reset();
+}
+
+static bool guards_ok(u32 idx, u32 size){
+	for(u32 i = 0; i < GUARD; i++){
+		if(mem[idx][i] != GUARD_BYTE || mem[idx][GUARD + size + i] != GUARD_BYTE){
+			return false;
+		}
+	}
+	return true;
+}
+
+static void test_builder(){
+	sdmmc_adma2_desc_t desc[SDMMC_ADMA2_DESC_MAX + 1];
+	u8 *buf = mem[0] + GUARD;
+
+	// one small segment
+	sdmmc_sg_t one = {buf, 0x400};
+	memset(desc, 0xFF, sizeof(desc));
+	CHECK_EQ(sdmmc_adma2_build_desc(desc, SDMMC_ADMA2_DESC_MAX, &one, 1), 0x400);
+	CHECK_EQ(desc[0].attr, SDMMC_ADMA2_ATTR_TRAN | SDMMC_ADMA2_ATTR_VALID | SDMMC_ADMA2_ATTR_END);
+	CHECK_EQ(desc[0].len, 0x400);
+	CHECK_EQ(desc[0].addr, (u32)(uintptr_t)buf);
+	CHECK_EQ(desc[0].addr_hi, 0);
+	CHECK_EQ(desc[0].rsvd, 0);
+	// nothing written behind the table
+	CHECK_EQ(desc[1].attr, 0xFFFF);
+
+	// segments over 64kb are split, a full 64kb descriptor has length 0
+	sdmmc_sg_t big[2] = {{buf, 150 * 1024}, {mem[1] + GUARD, 0x200}};
+	CHECK_EQ(sdmmc_adma2_build_desc(desc, SDMMC_ADMA2_DESC_MAX, big, 2), 150 * 1024 + 0x200);
+	CHECK_EQ(desc[0].len, 0);
+	CHECK_EQ(desc[1].len, 0);
+	CHECK_EQ(desc[2].len, 150 * 1024 - 2 * SDMMC_ADMA2_MAX_LEN);
+	CHECK_EQ(desc[3].len, 0x200);
+	CHECK_EQ(desc[1].addr, (u32)(uintptr_t)buf + SDMMC_ADMA2_MAX_LEN);
+	CHECK_EQ(desc[2].addr, (u32)(uintptr_t)buf + 2 * SDMMC_ADMA2_MAX_LEN);
+	CHECK_EQ(desc[3].addr, (u32)(uintptr_t)(mem[1] + GUARD));
+	for(u32 i = 0; i < 4; i++){
+		CHECK_EQ(desc[i].attr & ~SDMMC_ADMA2_ATTR_END, SDMMC_ADMA2_ATTR_TRAN | SDMMC_ADMA2_ATTR_VALID);
+		CHECK_EQ(!!(desc[i].attr & SDMMC_ADMA2_ATTR_END), i == 3);
+	}
+
+	// the controller needs 8 byte aligned addresses and lengths
+	sdmmc_sg_t bad_addr = {buf + 4, 0x200};
+	sdmmc_sg_t bad_size = {buf, 0x204};
+	sdmmc_sg_t empty = {buf, 0};
+	CHECK_EQ(sdmmc_adma2_build_desc(desc, SDMMC_ADMA2_DESC_MAX, &bad_addr, 1), 0);
+	CHECK_EQ(sdmmc_adma2_build_desc(desc, SDMMC_ADMA2_DESC_MAX, &bad_size, 1), 0);
+	CHECK_EQ(sdmmc_adma2_build_desc(desc, SDMMC_ADMA2_DESC_MAX, &empty, 1), 0);
+	CHECK_EQ(sdmmc_adma2_build_desc(desc, SDMMC_ADMA2_DESC_MAX, NULL, 0), 0);
+
+	// more descriptors than the table holds
+	sdmmc_sg_t many[SDMMC_ADMA2_DESC_MAX + 1];
+	for(u32 i = 0; i < ARRAY_SIZE(many); i++){
+		many[i].buf = buf + i * 0x200;
+		many[i].size = 0x200;
+	}
+	CHECK_EQ(sdmmc_adma2_build_desc(desc, SDMMC_ADMA2_DESC_MAX, many, SDMMC_ADMA2_DESC_MAX), SDMMC_ADMA2_DESC_MAX * 0x200);
+	CHECK_EQ(sdmmc_adma2_build_desc(desc, SDMMC_ADMA2_DESC_MAX, many, ARRAY_SIZE(many)), 0);
+	sdmmc_sg_t too_big = {buf, SDMMC_ADMA2_DESC_MAX * SDMMC_ADMA2_MAX_LEN + 0x200};
+	CHECK_EQ(sdmmc_adma2_build_desc(desc, SDMMC_ADMA2_DESC_MAX, &too_big, 1), 0);
+}
+
+// the built table moves exactly the requested bytes into each segment
+static void test_engine(){
+	sdmmc_adma2_desc_t desc[SDMMC_ADMA2_DESC_MAX];
+	const u32 sizes[3] = {7 * 1024, 150 * 1024, 0x200};
+	sdmmc_sg_t sg[3];
+	u32 total = 0;
+
+	reset();
+
+	for(u32 i = 0; i < 3; i++){
+		sg[i].buf = mem[i] + GUARD;
+		sg[i].size = sizes[i];
+		total += sizes[i];
+	}
+	CHECK_EQ(sdmmc_adma2_build_desc(desc, SDMMC_ADMA2_DESC_MAX, sg, 3), total);
+	CHECK_EQ(mock_adma2_run(desc, SDMMC_ADMA2_DESC_MAX, card, total, false), total);
+
+	u32 ofs = 0;
+	for(u32 i = 0; i < 3; i++){
+		CHECK(!memcmp(sg[i].buf, card + ofs, sizes[i]));
+		CHECK(guards_ok(i, sizes[i]));
+		ofs += sizes[i];
+	}
+
+	// an invalid descriptor stops the controller there
+	desc[1].attr &= ~SDMMC_ADMA2_ATTR_VALID;
+	CHECK_EQ(mock_adma2_run(desc, SDMMC_ADMA2_DESC_MAX, card, total, false), sizes[0]);
+}
+
+// head and rest of a payload with a single command, like sdloader reads them
+static void test_read_sg(){
+	mock_cmd_t cmds[4];
+	const u32 head = 7 * 1024;
+	const u32 rest = 32 * 1024;
+
+	reset();
+
+	sdmmc_sg_t sg[2] = {{mem[0] + GUARD, head}, {mem[1] + GUARD, rest}};
+	CHECK(sdmmc_storage_read_sg(&mock_storage, 0x100, sg, 2));
+	u64 sg_ns = host_time_ns();
+
+	CHECK(!memcmp(mem[0] + GUARD, card + 0x100 * 0x200, head));
+	CHECK(!memcmp(mem[1] + GUARD, card + 0x100 * 0x200 + head, rest));
+	CHECK(guards_ok(0, head));
+	CHECK(guards_ok(1, rest));
+	CHECK_EQ(mock_data_cmds(cmds, 4), 1);
+	CHECK_EQ(cmds[0].arg, 0x100);
+	CHECK_EQ(cmds[0].blocks, (head + rest) / 0x200);
+	CHECK_EQ(mock.sg_reqs, 1);
+
+	// the same with two plain reads costs a command more
+	reset();
+	CHECK(sdmmc_storage_read(&mock_storage, 0x100, head / 0x200, mem[0] + GUARD));
+	CHECK(sdmmc_storage_read(&mock_storage, 0x100 + head / 0x200, rest / 0x200, mem[1] + GUARD));
+	CHECK_EQ(host_time_ns() - sg_ns, 2 * mock.cmd_ns);
+}
+
+static bool fail_first(u32 req, u32 sector, u32 num_sectors, bool write, u32 *blocks){
+	*blocks = 3;
+	return req == 1;
+}
+
+// a failed adma2 read is done again segment by segment
+static void test_fallback(){
+	mock_cmd_t cmds[8];
+	const u32 head = 7 * 1024;
+	const u32 rest = 8 * 1024;
+
+	reset();
+	mock.fault = fail_first;
+
+	sdmmc_sg_t sg[2] = {{mem[0] + GUARD, head}, {mem[1] + GUARD, rest}};
+	CHECK(sdmmc_storage_read_sg(&mock_storage, 0x200, sg, 2));
+
+	CHECK(!memcmp(mem[0] + GUARD, card + 0x200 * 0x200, head));
+	CHECK(!memcmp(mem[1] + GUARD, card + 0x200 * 0x200 + head, rest));
+	CHECK(guards_ok(0, head));
+	CHECK(guards_ok(1, rest));
+
+	CHECK_EQ(mock_data_cmds(cmds, 8), 3);
+	CHECK(!cmds[0].ok);
+	CHECK_EQ(cmds[1].arg, 0x200);
+	CHECK_EQ(cmds[1].blocks, head / 0x200);
+	CHECK_EQ(cmds[2].arg, 0x200 + head / 0x200);
+	CHECK_EQ(cmds[2].blocks, rest / 0x200);
+
+	// segments the controller can't take are rejected before any command
+	reset();
+	sdmmc_sg_t odd[2] = {{mem[0] + GUARD, 0x100}, {mem[1] + GUARD, 0x300}};
+	CHECK(!sdmmc_storage_read_sg(&mock_storage, 0, odd, 2));
+	CHECK_EQ(mock.log_cnt, 0);
+}
+
+int main(){
+	card = malloc(CARD_SECTORS * 0x200);
+
+	test_builder();
+	test_engine();
+	test_read_sg();
+	test_fallback();
+
+	return host_result("sdmmc_adma_test");
+}
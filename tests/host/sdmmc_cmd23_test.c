@@ -0,0 +1,144 @@
+#include "host.h"
+#include "sdmmc_mock.h"
+#include <stdlib.h>
+#include <string.h>
+#include <storage/mmc.h>
+
+// pre-defined block counts (auto CMD23) in bdk/storage/sdmmc.c on the mock controller: a card
+// that rejects CMD23 now and then keeps using it, one that keeps rejecting it falls back to
+// auto CMD12 and gets CMD23 tried again later. the benchmark compares both modes on the
+// modelled bus timing.
+
+#define CARD_SECTORS 0x8000
+
+static u8 *card;
+static u8 buf[256 * 0x200] __attribute__((aligned(8)));
+
+static void reset(bool cmd23){
+	mock_reset(card, CARD_SECTORS);
+	mock_storage.auto_set_blkcnt = cmd23;
+	host_time_reset();
+}
+
+static bool read_ok(u32 sector, u32 num_sectors){
+	memset(buf, 0, num_sectors * 0x200);
+	return sdmmc_storage_read(&mock_storage, sector, num_sectors, buf) && !memcmp(buf, card + sector * 0x200, num_sectors * 0x200);
+}
+
+// one rejected CMD23 is retried with CMD23 and doesn't change the mode
+static void test_transient(){
+	mock_cmd_t cmds[16];
+
+	reset(true);
+	mock.cmd23_rejects = 1;
+
+	for(u32 i = 0; i < 8; i++){
+		CHECK(read_ok(i * 64, 64));
+	}
+
+	u32 n = mock_data_cmds(cmds, 16);
+	CHECK_EQ(n, 9);
+	CHECK(cmds[0].set_blkcnt && !cmds[0].ok);
+	for(u32 i = 1; i < n; i++){
+		CHECK(cmds[i].set_blkcnt && cmds[i].ok);
+	}
+	CHECK_EQ(mock_storage.set_blkcnt_errors, 0);
+	CHECK_EQ(mock.reinits, 0);
+}
+
+// a card that keeps rejecting CMD23 gets auto CMD12 within the same request, CMD23 is probed again
+// every SDMMC_SET_BLKCNT_BACKOFF transfers and used again once it works
+static void test_fallback(){
+	mock_cmd_t cmds[MOCK_LOG_MAX];
+	const u32 reads = 3 * SDMMC_SET_BLKCNT_BACKOFF + 1;
+
+	reset(true);
+	mock.cmd23 = false;
+
+	for(u32 i = 0; i < reads; i++){
+		CHECK(read_ok(i * 8, 8));
+	}
+
+	u32 n = mock_data_cmds(cmds, MOCK_LOG_MAX);
+	u32 set_blkcnt = 0;
+	for(u32 i = 0; i < n; i++){
+		set_blkcnt += cmds[i].set_blkcnt;
+		CHECK(cmds[i].ok == !cmds[i].set_blkcnt);
+	}
+	// the first request falls back after SDMMC_SET_BLKCNT_ERRORS_MAX tries, then one probe per backoff
+	CHECK(!cmds[SDMMC_SET_BLKCNT_ERRORS_MAX].set_blkcnt && cmds[SDMMC_SET_BLKCNT_ERRORS_MAX].ok);
+	CHECK_EQ(set_blkcnt, SDMMC_SET_BLKCNT_ERRORS_MAX + 3);
+	CHECK_EQ(n, reads + set_blkcnt);
+	CHECK_EQ(mock.reinits, 0);
+
+	// the card takes CMD23 again, the next probe switches back
+	mock.cmd23 = true;
+	mock.log_cnt = 0;
+	for(u32 i = 0; i < SDMMC_SET_BLKCNT_BACKOFF + 8; i++){
+		CHECK(read_ok(i * 8, 8));
+	}
+	n = mock_data_cmds(cmds, MOCK_LOG_MAX);
+	CHECK_EQ(n, SDMMC_SET_BLKCNT_BACKOFF + 8);
+	CHECK(cmds[n - 1].set_blkcnt);
+	CHECK(cmds[n - 2].set_blkcnt);
+	CHECK_EQ(mock_storage.set_blkcnt_errors, 0);
+}
+
+// queued requests follow the same mode
+static void test_queue(){
+	mock_cmd_t cmds[16];
+
+	reset(true);
+	mock.cmd23 = false;
+
+	for(u32 i = 0; i < SDMMC_STORAGE_QUEUE_SIZE; i++){
+		CHECK(sdmmc_storage_read_async(&mock_storage, i * 64, 64, buf + i * 64 * 0x200));
+	}
+	for(u32 i = 0; i < SDMMC_STORAGE_QUEUE_SIZE; i++){
+		CHECK(sdmmc_storage_async_wait(&mock_storage));
+	}
+	CHECK(!memcmp(buf, card, SDMMC_STORAGE_QUEUE_SIZE * 64 * 0x200));
+
+	// the first queued request fails with CMD23 and its retry falls back, the rest doesn't try it
+	u32 n = mock_data_cmds(cmds, 16);
+	CHECK_EQ(n, SDMMC_SET_BLKCNT_ERRORS_MAX + SDMMC_STORAGE_QUEUE_SIZE);
+	CHECK(!cmds[n - 1].set_blkcnt && cmds[n - 1].ok);
+	CHECK_EQ(mock.overlaps, 0);
+}
+
+// time of reads of a given size with auto CMD23 against auto CMD12
+static void bench(){
+	const u32 sizes[] = {1, 8, 64, 256};
+	const u32 reads = 64;
+
+	printf("%-8s %12s %12s %8s\n", "sectors", "cmd12 us", "cmd23 us", "saved");
+
+	for(u32 i = 0; i < ARRAY_SIZE(sizes); i++){
+		u64 ns[2];
+		for(u32 mode = 0; mode < 2; mode++){
+			reset(mode);
+			for(u32 r = 0; r < reads; r++){
+				CHECK(sdmmc_storage_read(&mock_storage, r * sizes[i], sizes[i], buf));
+			}
+			ns[mode] = host_time_ns();
+		}
+
+		printf("%-8u %12llu %12llu %7lld%%\n", sizes[i], ns[0] / 1000 / reads, ns[1] / 1000 / reads,
+			(long long)(ns[0] - ns[1]) * 100 / (long long)ns[0]);
+		CHECK(ns[1] < ns[0]);
+	}
+}
+
+int main(){
+	card = malloc(CARD_SECTORS * 0x200);
+	for(u32 i = 0; i < CARD_SECTORS * 0x200; i++){
+		card[i] = i / 0x200 + i * 3;
+	}
+
+	test_transient();
+	test_fallback();
+	test_queue();
+	bench();
+
+	return host_result("sdmmc_cmd23_test");
+}
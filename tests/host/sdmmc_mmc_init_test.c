@@ -0,0 +1,104 @@
+#include "host.h"
+#include "sdmmc_mock.h"
+#include <string.h>
+#include <storage/mmc.h>
+
+// emmc init of bdk/storage/sdmmc.c after the modchip handshake of sdloader/modchip.c, which powers
+// SDMMC4 up in identification mode and sends GO_IDLE with the magic argument. sdmmc_storage_init_mmc
+// finds the controller in that configuration and skips its power up. the sdmmc_end the handshake
+// used to do only stopped the controller, the emmc has no power switch of its own, so the card is
+// in the same state either way and the init puts it back to idle with a plain CMD0 before CMD1.
+// a controller that was ended or left in another mode is powered up again.
+
+#define MODCHIP_MAGIC 0xAA5458BA // sdloader/modchip.c
+
+static void reset(){
+	mock_reset(NULL, 0);
+	mock.card = MOCK_CARD_EMMC;
+	memset(&mock_storage, 0, sizeof(mock_storage));
+	memset(&mock_sdmmc, 0, sizeof(mock_sdmmc));
+	mock_sdmmc.card_clock = 400; // khz
+	host_time_reset();
+}
+
+// what modchip_confirm_execution does
+static void handshake(){
+	sdmmc_cmd_t cmdbuf;
+
+	sdmmc_init(&mock_sdmmc, SDMMC_4, SDMMC_POWER_1_8, SDMMC_BUS_WIDTH_1, SDHCI_TIMING_MMC_ID);
+	sdmmc_init_cmd(&cmdbuf, MMC_GO_IDLE_STATE, MODCHIP_MAGIC, SDMMC_RSP_TYPE_0, 0);
+	sdmmc_execute_cmd(&mock_sdmmc, &cmdbuf, NULL, NULL);
+}
+
+static bool init(){
+	return sdmmc_storage_init_mmc(&mock_storage, &mock_sdmmc, SDMMC_BUS_WIDTH_8, SDHCI_TIMING_MMC_HS400);
+}
+
+// the init starts over from idle with its own commands, after the power up wait
+static void check_init_cmds(u32 first){
+	CHECK(mock_storage.initialized);
+	CHECK(mock.log_cnt > first + 1);
+	CHECK_EQ(mock.log[first].cmd, MMC_GO_IDLE_STATE);
+	CHECK_EQ(mock.log[first].arg, 0);
+	CHECK_EQ(mock.log[first + 1].cmd, MMC_SEND_OP_COND);
+	CHECK(mock.log[first].start_ns >= 1000000);
+	CHECK_EQ(mock_cmd_count(MMC_GO_IDLE_STATE), first + 1);
+}
+
+// the controller the handshake left up is taken over as is
+static void test_handshake(){
+	reset();
+	handshake();
+	CHECK_EQ(mock.power_ups, 1);
+
+	u64 t = host_time_ns();
+	CHECK(init());
+	CHECK_EQ(mock.power_ups, 1);
+	CHECK_EQ(mock.log[0].arg, MODCHIP_MAGIC);
+	check_init_cmds(1);
+	CHECK(mock.log[1].start_ns >= t + 1000000);
+}
+
+// ended after the handshake like before, the init powers it up again and sends the same commands
+static void test_ended(){
+	reset();
+	handshake();
+	sdmmc_end(&mock_sdmmc);
+
+	CHECK(init());
+	CHECK_EQ(mock.power_ups, 2);
+	check_init_cmds(1);
+}
+
+// a second init of the session finds the controller in the mode of the first, not in identification mode
+static void test_reinit(){
+	reset();
+	handshake();
+	CHECK(init());
+	u32 cmds = mock.log_cnt;
+
+	mock.log_cnt = 0;
+	CHECK(init());
+	CHECK_EQ(mock.power_ups, 2);
+	CHECK_EQ(mock.log_cnt, cmds - 1);
+	CHECK_EQ(mock.log[0].cmd, MMC_GO_IDLE_STATE);
+	CHECK_EQ(mock.log[1].cmd, MMC_SEND_OP_COND);
+}
+
+// no handshake, the first init powers the controller up itself
+static void test_cold(){
+	reset();
+
+	CHECK(init());
+	CHECK_EQ(mock.power_ups, 1);
+	check_init_cmds(0);
+}
+
+int main(){
+	test_handshake();
+	test_ended();
+	test_reinit();
+	test_cold();
+
+	return host_result("sdmmc_mmc_init_test");
+}
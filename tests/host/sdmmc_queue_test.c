@@ -0,0 +1,223 @@
+#include "host.h"
+#include "sdmmc_mock.h"
+#include <stdlib.h>
+#include <string.h>
+#include <storage/mmc.h>
+
+// request queue of bdk/storage/sdmmc.c on the mock controller: requests start in order and
+// one at a time, the next one starts while the caller works, results come back in order and
+// failed requests are retried from the blocks the card acknowledged
+
+#define CARD_SECTORS 0x4000
+#define REQ_SECTORS  64
+
+static u8 *card;
+static u8 bufs[SDMMC_STORAGE_QUEUE_SIZE + 1][REQ_SECTORS * 0x200] __attribute__((aligned(8)));
+
+static void reset(){
+	for(u32 i = 0; i < CARD_SECTORS * 0x200; i++){
+		card[i] = i / 0x200 + i * 7;
+	}
+	memset(bufs, 0, sizeof(bufs));
+	mock_reset(card, CARD_SECTORS);
+	mock_storage.auto_set_blkcnt = 1;
+	host_time_reset();
+}
+
+static bool buf_ok(u32 idx, u32 sector){
+	return !memcmp(bufs[idx], card + sector * 0x200, REQ_SECTORS * 0x200);
+}
+
+static void test_order(){
+	mock_cmd_t cmds[8];
+	const u32 sectors[SDMMC_STORAGE_QUEUE_SIZE] = {0x100, 0x40, 0x2000, 0x41};
+
+	reset();
+
+	for(u32 i = 0; i < SDMMC_STORAGE_QUEUE_SIZE; i++){
+		CHECK(sdmmc_storage_read_async(&mock_storage, sectors[i], REQ_SECTORS, bufs[i]));
+	}
+	// full
+	CHECK(!sdmmc_storage_read_async(&mock_storage, 0, REQ_SECTORS, bufs[SDMMC_STORAGE_QUEUE_SIZE]));
+
+	// the first one started right away, the rest waits for the controller
+	CHECK_EQ(mock_data_cmds(cmds, 8), 1);
+	CHECK(mock.busy);
+
+	for(u32 i = 0; i < SDMMC_STORAGE_QUEUE_SIZE; i++){
+		CHECK(sdmmc_storage_async_wait(&mock_storage));
+		CHECK(buf_ok(i, sectors[i]));
+	}
+	CHECK(!sdmmc_storage_async_wait(&mock_storage));
+
+	CHECK_EQ(mock_data_cmds(cmds, 8), SDMMC_STORAGE_QUEUE_SIZE);
+	for(u32 i = 0; i < SDMMC_STORAGE_QUEUE_SIZE; i++){
+		CHECK_EQ(cmds[i].cmd, MMC_READ_MULTIPLE_BLOCK);
+		CHECK_EQ(cmds[i].arg, sectors[i]);
+		CHECK(cmds[i].async);
+		// one at a time
+		if(i){
+			CHECK(cmds[i].start_ns >= cmds[i - 1].end_ns);
+		}
+	}
+	CHECK_EQ(mock.overlaps, 0);
+}
+
+// the caller works on each finished buffer for longer than a transfer, polling between its steps
+static void test_completion(){
+	mock_cmd_t cmds[8];
+	const u32 work_ns = 600000;
+
+	reset();
+
+	for(u32 i = 0; i < SDMMC_STORAGE_QUEUE_SIZE; i++){
+		CHECK(sdmmc_storage_read_async(&mock_storage, i * REQ_SECTORS, REQ_SECTORS, bufs[i]));
+	}
+
+	u32 req_ns = mock.cmd_ns * 2 + REQ_SECTORS * mock.sector_ns;
+	for(u32 i = 0; i < SDMMC_STORAGE_QUEUE_SIZE; i++){
+		CHECK(sdmmc_storage_async_wait(&mock_storage));
+		CHECK(buf_ok(i, i * REQ_SECTORS));
+		for(u32 t = 0; t < work_ns; t += 10000){
+			host_advance_ns(10000);
+			sdmmc_storage_async_busy(&mock_storage);
+		}
+	}
+
+	// the controller never waited on the caller for more than a poll step
+	mock_data_cmds(cmds, 8);
+	for(u32 i = 1; i < SDMMC_STORAGE_QUEUE_SIZE; i++){
+		CHECK(cmds[i].start_ns - cmds[i - 1].end_ns <= 10000);
+	}
+	// transfers overlap the work, only the first transfer, the work and the polls are exposed
+	u32 polls = work_ns / 10000 + 1;
+	CHECK(host_time_ns() <= req_ns + SDMMC_STORAGE_QUEUE_SIZE * (work_ns + polls * mock.poll_ns));
+	CHECK(host_time_ns() < SDMMC_STORAGE_QUEUE_SIZE * (req_ns + work_ns));
+	CHECK_EQ(sdmmc_storage_async_busy(&mock_storage), 0);
+}
+
+static u32 fail_req;
+static u32 fail_blocks;
+static u32 fail_times;
+
+static bool fault(u32 req, u32 sector, u32 num_sectors, bool write, u32 *blocks){
+	if(req >= fail_req && req < fail_req + fail_times){
+		*blocks = fail_blocks;
+		return true;
+	}
+	return false;
+}
+
+static void test_retry(){
+	mock_cmd_t cmds[16];
+
+	// second request fails after 5 blocks once, the retry resumes behind them
+	reset();
+	fail_req = 2;
+	fail_blocks = 5;
+	fail_times = 1;
+	mock.fault = fault;
+
+	for(u32 i = 0; i < 3; i++){
+		CHECK(sdmmc_storage_read_async(&mock_storage, 0x1000 + i * REQ_SECTORS, REQ_SECTORS, bufs[i]));
+	}
+	for(u32 i = 0; i < 3; i++){
+		CHECK(sdmmc_storage_async_wait(&mock_storage));
+		CHECK(buf_ok(i, 0x1000 + i * REQ_SECTORS));
+	}
+
+	u32 n = mock_data_cmds(cmds, 16);
+	CHECK_EQ(n, 4);
+	CHECK(!cmds[1].ok);
+	CHECK_EQ(cmds[1].blocks, 5);
+	CHECK_EQ(cmds[2].arg, 0x1000 + REQ_SECTORS + 5);
+	CHECK(!cmds[2].async);
+	CHECK_EQ(cmds[3].arg, 0x1000 + 2 * REQ_SECTORS);
+	CHECK_EQ(mock.overlaps, 0);
+	CHECK_EQ(mock.reinits, 0);
+}
+
+static bool bad_sectors(u32 req, u32 sector, u32 num_sectors, bool write, u32 *blocks){
+	*blocks = 0;
+	return sector < 2 * REQ_SECTORS && sector + num_sectors > REQ_SECTORS;
+}
+
+// unreadable sectors: the request fails after the retries and reinits, the next one is still done
+static void test_persistent_error(){
+	reset();
+	mock.fault = bad_sectors;
+
+	CHECK(sdmmc_storage_read_async(&mock_storage, 0, REQ_SECTORS, bufs[0]));
+	CHECK(sdmmc_storage_read_async(&mock_storage, REQ_SECTORS, REQ_SECTORS, bufs[1]));
+	CHECK(sdmmc_storage_read_async(&mock_storage, 2 * REQ_SECTORS, REQ_SECTORS, bufs[2]));
+	CHECK(sdmmc_storage_async_wait(&mock_storage));
+	CHECK(buf_ok(0, 0));
+	CHECK(!sdmmc_storage_async_wait(&mock_storage));
+	CHECK(mock.reinits >= 1);
+	CHECK(sdmmc_storage_async_wait(&mock_storage));
+	CHECK(buf_ok(2, 2 * REQ_SECTORS));
+	CHECK_EQ(mock.overlaps, 0);
+	// nothing left over or made up by the reinits
+	CHECK_EQ(mock_storage.queue_cnt, 0);
+	CHECK(!sdmmc_storage_async_wait(&mock_storage));
+}
+
+// a failure that outlasts the retries reinits the card, which clears the storage. the queued
+// requests behind it survive that and run on the fresh card
+static void test_reinit(){
+	mock_cmd_t cmds[16];
+
+	reset();
+	fail_req = 2;
+	fail_blocks = 0;
+	fail_times = 6;
+	mock.fault = fault;
+
+	for(u32 i = 0; i < 4; i++){
+		CHECK(sdmmc_storage_read_async(&mock_storage, 0x2000 + i * REQ_SECTORS, REQ_SECTORS, bufs[i]));
+	}
+	for(u32 i = 0; i < 4; i++){
+		CHECK(sdmmc_storage_async_wait(&mock_storage));
+		CHECK(buf_ok(i, 0x2000 + i * REQ_SECTORS));
+	}
+	CHECK_EQ(mock.reinits, 1);
+	CHECK_EQ(mock_storage.queue_cnt, 0);
+	CHECK(!sdmmc_storage_async_wait(&mock_storage));
+
+	// the two after the recovered one went out queued again
+	u32 n = mock_data_cmds(cmds, 16);
+	CHECK_EQ(n, 10);
+	CHECK(cmds[7].ok && !cmds[7].async);
+	CHECK(cmds[8].async && cmds[8].arg == 0x2000 + 2 * REQ_SECTORS);
+	CHECK(cmds[9].async && cmds[9].arg == 0x2000 + 3 * REQ_SECTORS);
+	CHECK_EQ(mock.overlaps, 0);
+}
+
+// synchronous access waits for the queue, queued results are kept
+static void test_sync_flush(){
+	reset();
+
+	CHECK(sdmmc_storage_read_async(&mock_storage, 0x10, REQ_SECTORS, bufs[0]));
+	CHECK(sdmmc_storage_read_async(&mock_storage, 0x20, REQ_SECTORS, bufs[1]));
+	CHECK(sdmmc_storage_read(&mock_storage, 0x30, REQ_SECTORS, bufs[2]));
+	CHECK(buf_ok(2, 0x30));
+	CHECK_EQ(mock.overlaps, 0);
+
+	CHECK(sdmmc_storage_async_wait(&mock_storage));
+	CHECK(buf_ok(0, 0x10));
+	CHECK(sdmmc_storage_async_wait(&mock_storage));
+	CHECK(buf_ok(1, 0x20));
+}
+
+int main(){
+	card = malloc(CARD_SECTORS * 0x200);
+
+	test_order();
+	test_completion();
+	test_retry();
+	test_persistent_error();
+	test_reinit();
+	test_sync_flush();
+
+	return host_result("sdmmc_queue_test");
+}
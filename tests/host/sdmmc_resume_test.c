@@ -0,0 +1,239 @@
+#include "host.h"
+#include "sdmmc_mock.h"
+#include <stdlib.h>
+#include <string.h>
+#include <storage/mmc.h>
+
+// failed transfers in bdk/storage/sdmmc.c on the mock controller: a request that fails part way
+// resumes after the blocks the card acknowledged instead of from its first sector, progress gives
+// the retries back, failures without progress back off and end in a reinit that resumes in place
+// and on the same emmc partition, also under queued requests which outlive the reinit. every failure
+// is counted per controller and bus timing, partition switches only once done.
+
+#define CARD_SECTORS 0x8000
+
+static u8 *card;
+static u8 *ref;
+static u8 buf[512 * 0x200] __attribute__((aligned(8)));
+static u8 bufs[3][100 * 0x200] __attribute__((aligned(8)));
+
+// requests 1 to cnt fail, the first after first blocks and the others after blocks
+static struct{
+	u32 cnt;
+	u32 first;
+	u32 blocks;
+}faults;
+
+static bool fault(u32 req, u32 sector, u32 num_sectors, bool write, u32 *blocks){
+	if(req > faults.cnt){
+		return false;
+	}
+	*blocks = req == 1 ? faults.first : faults.blocks;
+	return true;
+}
+
+static void set_faults(u32 cnt, u32 first, u32 blocks){
+	faults.cnt = cnt;
+	faults.first = first;
+	faults.blocks = blocks;
+}
+
+static void reset(){
+	mock_reset(card, CARD_SECTORS);
+	memcpy(card, ref, CARD_SECTORS * 0x200);
+	mock.fault = fault;
+	host_time_reset();
+}
+
+static u32 moved(){
+	mock_cmd_t cmds[MOCK_LOG_MAX];
+	u32 n = mock_data_cmds(cmds, MOCK_LOG_MAX);
+	u32 blocks = 0;
+	for(u32 i = 0; i < n; i++){
+		blocks += cmds[i].blocks;
+	}
+	return blocks;
+}
+
+static u16 rw_errors(){
+	return sdmmc_storage_get_rw_errors(&mock_storage)[mock_sdmmc.timing];
+}
+
+// one fault at block 60 of 200, the retry starts at block 60
+static void test_resume(bool write){
+	mock_cmd_t cmds[8];
+
+	reset();
+	u16 errors = rw_errors();
+	set_faults(1, 60, 0);
+
+	if(write){
+		for(u32 i = 0; i < 200 * 0x200; i++){
+			buf[i] = ~i;
+		}
+		CHECK(sdmmc_storage_write(&mock_storage, 100, 200, buf));
+		CHECK(!memcmp(card + 100 * 0x200, buf, 200 * 0x200));
+		CHECK(!memcmp(card, ref, 100 * 0x200));
+		CHECK(!memcmp(card + 300 * 0x200, ref + 300 * 0x200, 0x200));
+	}else{
+		memset(buf, 0, 200 * 0x200);
+		CHECK(sdmmc_storage_read(&mock_storage, 100, 200, buf));
+		CHECK(!memcmp(buf, card + 100 * 0x200, 200 * 0x200));
+	}
+
+	CHECK_EQ(mock_data_cmds(cmds, 8), 2);
+	CHECK(!cmds[0].ok && cmds[0].blocks == 60);
+	CHECK(cmds[1].ok);
+	CHECK_EQ(cmds[1].arg, 160);
+	CHECK_EQ(cmds[1].blocks, 140);
+	// 200 blocks on the bus, 260 if it started over
+	CHECK_EQ(moved(), 200);
+	CHECK_EQ(rw_errors(), errors + 1);
+	CHECK_EQ(mock.reinits, 0);
+}
+
+// a fault every 10 blocks is more failures than retries, but each one made progress
+static void test_progress(){
+	reset();
+	u16 errors = rw_errors();
+	set_faults(19, 10, 10);
+
+	memset(buf, 0, 200 * 0x200);
+	CHECK(sdmmc_storage_read(&mock_storage, 0, 200, buf));
+	CHECK(!memcmp(buf, card, 200 * 0x200));
+	CHECK_EQ(mock.data_reqs, 20);
+	CHECK_EQ(moved(), 200);
+	CHECK_EQ(rw_errors(), errors + 19);
+	CHECK_EQ(mock.reinits, 0);
+	// no backoff after progress
+	CHECK(host_time_ns() < 50000000);
+}
+
+// failures without progress wait 1, 4, 16 and 50 ms before the next try
+static void test_backoff(){
+	reset();
+	set_faults(4, 0, 0);
+
+	CHECK(sdmmc_storage_read(&mock_storage, 0, 16, buf));
+	CHECK(!memcmp(buf, card, 16 * 0x200));
+	CHECK_EQ(mock.data_reqs, 5);
+	CHECK_EQ(mock.reinits, 0);
+	CHECK(host_time_ns() >= 71000000ull);
+	CHECK(host_time_ns() < 80000000ull);
+}
+
+// out of retries after some progress: reinit and resume where it stopped, back on the partition
+// the emmc was on
+static void test_reinit(bool emmc){
+	mock_cmd_t cmds[16];
+
+	reset();
+	if(emmc){
+		mock_sdmmc.id = SDMMC_4;
+		mock_storage.partition = EMMC_BOOT0;
+	}
+	u16 errors = rw_errors();
+	// then nothing at all until the reinit
+	set_faults(6, 30, 0);
+
+	memset(buf, 0, 100 * 0x200);
+	CHECK(sdmmc_storage_read(&mock_storage, 500, 100, buf));
+	CHECK(!memcmp(buf, card + 500 * 0x200, 100 * 0x200));
+	CHECK_EQ(mock.reinits, 1);
+	CHECK_EQ(rw_errors(), errors + 6);
+
+	u32 n = mock_data_cmds(cmds, 16);
+	CHECK_EQ(n, 7);
+	for(u32 i = 1; i < n; i++){
+		CHECK_EQ(cmds[i].arg, 530);
+	}
+	CHECK(cmds[n - 1].ok && cmds[n - 1].blocks == 70);
+
+	// the partition switch comes after the failed tries and before the resumed read
+	bool switched = false;
+	for(u32 i = 0; i < mock.log_cnt; i++){
+		if(mock.log[i].cmd == MMC_SWITCH){
+			switched = true;
+			CHECK(mock.log[i].start_ns > cmds[n - 2].end_ns && mock.log[i].end_ns <= cmds[n - 1].start_ns);
+		}
+	}
+	CHECK(switched == emmc);
+	CHECK_EQ(mock_storage.partition, (emmc ? EMMC_BOOT0 : 0));
+}
+
+// the same with the failing read at the head of the queue: the partition switch of the reinit
+// comes before any of the reads queued behind it, which are then done on the fresh card
+static void test_reinit_queued(){
+	mock_cmd_t cmds[16];
+
+	reset();
+	mock_sdmmc.id = SDMMC_4;
+	mock_storage.partition = EMMC_BOOT0;
+	set_faults(6, 30, 0);
+
+	memset(bufs, 0, sizeof(bufs));
+	for(u32 i = 0; i < 3; i++){
+		CHECK(sdmmc_storage_read_async(&mock_storage, 500 + i * 100, 100, bufs[i]));
+	}
+	for(u32 i = 0; i < 3; i++){
+		CHECK(sdmmc_storage_async_wait(&mock_storage));
+		CHECK(!memcmp(bufs[i], card + (500 + i * 100) * 0x200, 100 * 0x200));
+	}
+	CHECK(!sdmmc_storage_async_wait(&mock_storage));
+	CHECK_EQ(mock_storage.queue_cnt, 0);
+	CHECK_EQ(mock.reinits, 1);
+	CHECK_EQ(mock.overlaps, 0);
+	CHECK_EQ(mock_storage.partition, EMMC_BOOT0);
+
+	// failed tries, the resumed read and the two queued ones
+	u32 n = mock_data_cmds(cmds, 16);
+	CHECK_EQ(n, 9);
+	CHECK(cmds[6].ok && cmds[6].arg == 530 && cmds[6].blocks == 70);
+	CHECK(cmds[7].async && cmds[7].arg == 600);
+	CHECK(cmds[8].async && cmds[8].arg == 700);
+
+	u32 switches = 0;
+	for(u32 i = 0; i < mock.log_cnt; i++){
+		if(mock.log[i].cmd == MMC_SWITCH){
+			switches++;
+			CHECK(mock.log[i].start_ns > cmds[5].end_ns && mock.log[i].end_ns <= cmds[6].start_ns);
+		}
+	}
+	CHECK_EQ(switches, 1);
+}
+
+// a reinit whose partition switch fails ends the transfer, the switch isn't counted as done
+static void test_reinit_switch_fail(){
+	reset();
+	mock_sdmmc.id = SDMMC_4;
+	mock_storage.partition = EMMC_BOOT0;
+	set_faults(6, 0, 0);
+	mock.switch_fails = 1;
+
+	u32 switches = sdmmc_storage_get_partition_switches();
+	CHECK(!sdmmc_storage_read(&mock_storage, 500, 100, buf));
+	CHECK_EQ(mock.reinits, 1);
+	CHECK_EQ(sdmmc_storage_get_partition_switches(), switches);
+
+	CHECK(sdmmc_storage_set_mmc_partition(&mock_storage, EMMC_BOOT0));
+	CHECK_EQ(sdmmc_storage_get_partition_switches(), switches + 1);
+}
+
+int main(){
+	card = malloc(CARD_SECTORS * 0x200);
+	ref = malloc(CARD_SECTORS * 0x200);
+	for(u32 i = 0; i < CARD_SECTORS * 0x200; i++){
+		ref[i] = i / 0x200 + i * 5;
+	}
+
+	test_resume(false);
+	test_resume(true);
+	test_progress();
+	test_backoff();
+	test_reinit(false);
+	test_reinit(true);
+	test_reinit_queued();
+	test_reinit_switch_fail();
+
+	return host_result("sdmmc_resume_test");
+}
@@ -0,0 +1,131 @@
+#include "host.h"
+#include "sdmmc_mock.h"
+#include <string.h>
+#include <storage/mmc.h>
+#include <storage/sd_def.h>
+
+// sd init of bdk/storage/sdmmc.c on the sd card model of the mock: sdmmc_storage_init_sd_start sends
+// the first ACMD41 and returns while the card powers up, sdmmc_storage_init_sd then resumes with
+// the ACMD41 polls instead of going back to CMD0. work in between (the emmc init in get_cfg) hides
+// the power up. a start with another voltage request or ended in between inits from CMD0 again.
+
+#define CARD_SECTORS (32 * 1024 * 1024) // 16gb
+#define POWER_UP_NS  35000000ull
+#define WORK_NS      40000000ull
+
+static u64 cold_ns;
+
+static void reset(){
+	mock_reset(NULL, CARD_SECTORS);
+	mock.card = MOCK_CARD_SD;
+	mock.power_up_ns = POWER_UP_NS;
+	memset(&mock_storage, 0, sizeof(mock_storage));
+
+	// powered off long enough ago, no discharge wait
+	host_time_reset();
+	sd_power_cycle_time_start = 0;
+	host_advance_ns(300000000ull);
+}
+
+static bool init(u32 type){
+	return sdmmc_storage_init_sd(&mock_storage, &mock_sdmmc, SDMMC_BUS_WIDTH_4, type);
+}
+
+static bool start(u32 type){
+	return sdmmc_storage_init_sd_start(&mock_storage, &mock_sdmmc, SDMMC_BUS_WIDTH_4, type);
+}
+
+static void check_card(){
+	CHECK(mock_storage.initialized);
+	CHECK(!mock_storage.init_started);
+	CHECK(mock_storage.has_sector_access);
+	CHECK(mock_storage.auto_set_blkcnt);
+	CHECK_EQ(mock_storage.rca, 0xaaaa);
+	CHECK_EQ(mock_storage.sec_cnt, CARD_SECTORS);
+	CHECK_EQ(mock_storage.scr.bus_widths, 5);
+}
+
+// without a start the init waits for the whole power up, polling ACMD41 every 10 ms
+static void test_cold(){
+	reset();
+
+	u64 t = host_time_ns();
+	CHECK(init(SDHCI_TIMING_SD_HS25));
+	cold_ns = host_time_ns() - t;
+	check_card();
+
+	CHECK_EQ(mock_cmd_count(MMC_GO_IDLE_STATE), 1);
+	CHECK_EQ(mock_cmd_count(SD_SEND_IF_COND), 1);
+	CHECK(mock_cmd_count(SD_APP_OP_COND) >= POWER_UP_NS / 10000000);
+	CHECK(cold_ns >= POWER_UP_NS);
+}
+
+// started before other work: the init resumes on the powered card, one more ACMD41 and done
+static void test_resume(){
+	reset();
+
+	u64 t = host_time_ns();
+	CHECK(start(SDHCI_TIMING_UHS_SDR104));
+	CHECK(mock_storage.init_started);
+	CHECK(!mock_storage.initialized);
+	CHECK_EQ(mock_cmd_count(SD_APP_OP_COND), 1);
+	host_advance_ns(WORK_NS);
+
+	u64 resume = host_time_ns();
+	CHECK(init(SDHCI_TIMING_UHS_SDR104));
+	u64 tail_ns = host_time_ns() - resume;
+	u64 total_ns = host_time_ns() - t;
+	check_card();
+
+	CHECK_EQ(mock_cmd_count(MMC_GO_IDLE_STATE), 1);
+	CHECK_EQ(mock_cmd_count(SD_SEND_IF_COND), 1);
+	CHECK_EQ(mock_cmd_count(SD_APP_OP_COND), 2);
+	// the power up is gone from the init, start to ready takes the work and little else
+	CHECK(tail_ns + POWER_UP_NS <= cold_ns);
+	CHECK(total_ns < WORK_NS + cold_ns - POWER_UP_NS);
+
+	printf("sd init: cold %llu us, after start %llu us, start to ready with %llu us of work %llu us\n", cold_ns / 1000,
+		tail_ns / 1000, WORK_NS / 1000, total_ns / 1000);
+}
+
+// the start asked for 3.3v only, a uhs init needs S18R in the ACMD41 that powers the card up
+static void test_voltage_changed(){
+	reset();
+
+	CHECK(start(SDHCI_TIMING_SD_HS25));
+	host_advance_ns(WORK_NS);
+
+	u64 resume = host_time_ns();
+	CHECK(init(SDHCI_TIMING_UHS_SDR104));
+	check_card();
+
+	CHECK_EQ(mock_cmd_count(MMC_GO_IDLE_STATE), 2);
+	CHECK_EQ(mock_cmd_count(SD_SEND_IF_COND), 2);
+	CHECK(host_time_ns() - resume >= POWER_UP_NS);
+}
+
+// ended after the start, e.g. the sd deinit of a failed boot: the next init is a cold one
+static void test_ended(){
+	reset();
+
+	CHECK(start(SDHCI_TIMING_UHS_SDR104));
+	CHECK(sdmmc_storage_end(&mock_storage));
+	CHECK(!mock_storage.init_started);
+	host_advance_ns(WORK_NS);
+
+	u64 resume = host_time_ns();
+	CHECK(init(SDHCI_TIMING_UHS_SDR104));
+	check_card();
+
+	CHECK_EQ(mock_cmd_count(MMC_GO_IDLE_STATE), 3);
+	CHECK(host_time_ns() - resume >= POWER_UP_NS);
+}
+
+int main(){
+	test_cold();
+	test_resume();
+	test_voltage_changed();
+	test_ended();
+
+	return host_result("sdmmc_sd_start_test");
+}
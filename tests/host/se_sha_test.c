@@ -0,0 +1,201 @@
+#include "host.h"
+#include "storage_img.h"
+#include "fatimg.h"
+#include "boot_run.h"
+#include "se_model.h"
+#include <string.h>
+#include <memory_map.h>
+#include <sec/se.h>
+#include <sec/se_t210.h>
+#include "loader.h"
+
+// chunked sha256 on the se model: the model against the standard vectors, chunks chained through
+// msg_left against a one shot hash, then payload.bin trailers whose hashed part ends around the
+// bounce buffer and read chunk boundaries. last the time hashing adds to f_read, overlapped with
+// the reads as sdloader does it and as a second pass after them would
+
+#define SD_SECTORS   (64 * 1024 * 1024 / 0x200)
+#define BOOT_SECTORS (4 * 1024 * 1024 / 0x200)
+// PAYLOAD_READ_CHUNK in main.c
+#define READ_CHUNK   0x8000
+#define DATA_MAX     (160 * 1024)
+
+extern u8 __bss_end[];
+
+static u8 data[DATA_MAX];
+static u8 file[DATA_MAX + sizeof(payload_sha_trailer_t)];
+static u32 head_size;
+
+static void check_vector(const char *msg, const char *hex){
+	u8 hash[SE_SHA_256_SIZE], ref[SE_SHA_256_SIZE];
+	u32 len = strlen(msg);
+
+	for(u32 i = 0; i < SE_SHA_256_SIZE; i++){
+		sscanf(hex + i * 2, "%2hhx", &ref[i]);
+	}
+
+	CHECK(se_calc_sha256_oneshot(hash, msg, len));
+	CHECK(!memcmp(hash, ref, sizeof(ref)));
+	host_sha256(msg, len, hash);
+	CHECK(!memcmp(hash, ref, sizeof(ref)));
+}
+
+// every size up to a few blocks past the padding boundaries, split into chunks of chunk bytes
+static void test_chunks(u32 chunk){
+	for(u32 size = 1; size < 300; size++){
+		u32 hash[SE_SHA_256_SIZE / 4] = {0};
+		u32 msg_left[2];
+		u8 ref[SE_SHA_256_SIZE];
+
+		for(u32 ofs = 0; ofs < size; ofs += chunk){
+			u32 len = MIN(chunk, size - ofs);
+			CHECK(se_calc_sha256(hash, msg_left, data + ofs, len, size, ofs ? SHA_CONTINUE : SHA_INIT_HASH, false));
+			CHECK(se_calc_sha256_finalize(hash, msg_left));
+			// bits still expected
+			CHECK_EQ(msg_left[0], (size - ofs - len) * 8);
+			CHECK_EQ(msg_left[1], 0);
+		}
+
+		host_sha256(data, size, ref);
+		if(memcmp(hash, ref, sizeof(ref))){
+			printf("size %u in chunks of %u: wrong hash\n", size, chunk);
+			host_failures++;
+			return;
+		}
+	}
+}
+
+// what the hardware gets wrong silently is counted by the model
+static void test_misuse(){
+	u32 hash[SE_SHA_256_SIZE / 4] = {0};
+	u32 msg_left[2];
+	u32 errors = se_model_errors;
+
+	// an intermediate chunk that isn't whole blocks
+	CHECK(!se_calc_sha256(hash, msg_left, data, 100, 200, SHA_INIT_HASH, false));
+	CHECK_EQ(se_model_errors, errors + 1);
+
+	// more than the message has left
+	CHECK(se_calc_sha256(hash, msg_left, data, 128, 192, SHA_INIT_HASH, false));
+	CHECK(se_calc_sha256_finalize(hash, msg_left));
+	CHECK(!se_calc_sha256(hash, msg_left, data + 128, 128, 192, SHA_CONTINUE, false));
+	CHECK_EQ(se_model_errors, errors + 2);
+
+	// started again before the previous one was finalized
+	CHECK(se_calc_sha256(hash, msg_left, data, 64, 128, SHA_INIT_HASH, false));
+	CHECK(se_calc_sha256(hash, msg_left, data, 64, 128, SHA_INIT_HASH, false));
+	CHECK_EQ(se_model_errors, errors + 3);
+	se_calc_sha256_finalize(hash, msg_left);
+
+	se_model_errors = errors;
+}
+
+// payload.bin with a trailer over size bytes of data, corrupt flips a byte after hashing
+static u32 make_file(u32 size, s32 corrupt){
+	payload_sha_trailer_t trailer = {.magic = PAYLOAD_SHA_MAGIC, .size = size};
+
+	host_sha256(data, size, trailer.sha256);
+	memcpy(file, data, size);
+	memcpy(file + size, &trailer, sizeof(trailer));
+	if(corrupt >= 0){
+		file[corrupt] ^= 1;
+	}
+
+	img_create(IMG_SD, SD_SECTORS);
+	img_create(IMG_GPP, SD_SECTORS);
+	img_create(IMG_BOOT0, BOOT_SECTORS);
+	boot_enable_trace();
+	img_create(IMG_BOOT1, BOOT_SECTORS);
+	CHECK(fatimg_format(IMG_SD, 0x800, SD_SECTORS - 0x800, FATIMG_EXFAT, 64, true));
+	CHECK(fatimg_add_file(IMG_SD, "payload.bin", file, size + sizeof(trailer), 0, NULL));
+
+	return size + sizeof(trailer);
+}
+
+// the first boot reads through FatFs, the second from the cached location with queued reads
+static void test_boundaries(){
+	const u32 sizes[] = {
+		100, head_size - 1, head_size, head_size + 1, head_size + 64,
+		// the trailer spans two read chunks
+		head_size + READ_CHUNK - 20,
+		head_size + READ_CHUNK - 1, head_size + READ_CHUNK, head_size + READ_CHUNK + 1,
+		head_size + 3 * READ_CHUNK + 100,
+	};
+	boot_result_t res;
+
+	for(u32 i = 0; i < ARRAY_SIZE(sizes); i++){
+		u32 size = sizes[i];
+		u32 file_size = make_file(size, -1);
+		int failures = host_failures;
+
+		for(u32 boot = 0; boot < 2; boot++){
+			CHECK(boot_run(file, file_size, &res) && res.payload_ok);
+			CHECK_EQ(res.se_errors, 0);
+		}
+
+		// first and last hashed byte
+		make_file(size, 0);
+		CHECK(!boot_run(file, file_size, &res));
+		make_file(size, size - 1);
+		CHECK(!boot_run(file, file_size, &res));
+
+		if(host_failures != failures){
+			printf("hashed size %u failed\n", size);
+		}
+	}
+}
+
+static u32 f_read_us(u32 file_size){
+	boot_result_t res;
+	u32 total[TRACE_ID_MAX];
+	bool seen[TRACE_ID_MAX];
+
+	CHECK(boot_run(file, file_size, &res) && res.payload_ok);
+	CHECK(boot_stages(res.jump_ns, total, seen));
+
+	return total[TRACE_F_READ];
+}
+
+static void bench(){
+	u32 size = 140 * 1024;
+	u32 file_size = make_file(size, -1);
+	u32 se_sha = host_cost.se_sha;
+	u32 sequential = (u64)size * se_sha / 1000000;
+
+	printf("%-10s %10s %10s %10s %12s\n", "boot", "read us", "hashed us", "added us", "2nd pass us");
+
+	for(u32 boot = 0; boot < 2; boot++){
+		// both boots of a kind start from the same images
+		host_cost.se_sha = 0;
+		u32 plain = f_read_us(file_size);
+		host_cost.se_sha = se_sha;
+		if(!boot){
+			make_file(size, -1);
+		}
+		u32 hashed = f_read_us(file_size);
+
+		printf("%-10s %10u %10u %10d %12u\n", boot ? "cached" : "fatfs", plain, hashed, (int)(hashed - plain), sequential);
+		// only the hash of the last chunk is left after the reads
+		CHECK(hashed - plain < sequential / 2);
+	}
+}
+
+int main(){
+	head_size = ALIGN((u32)__bss_end - PAYLOAD_LOAD_ADDR, 0x200);
+	for(u32 i = 0; i < DATA_MAX; i++){
+		data[i] = i * 7 + (i >> 8);
+	}
+
+	check_vector("", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+	check_vector("abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+	check_vector("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+		"248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+	test_chunks(64);
+	test_chunks(128);
+	test_chunks(512);
+	test_misuse();
+	test_boundaries();
+	bench();
+
+	return host_result("se_sha_test");
+}
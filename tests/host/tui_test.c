@@ -0,0 +1,144 @@
+#include "host.h"
+#include <stdarg.h>
+#include <string.h>
+#include <gfx.h>
+#include <tui.h>
+#include <utils/btn.h>
+#include <power/max17050.h>
+#include <power/bq24193.h>
+
+// sdloader/gfx/tui.c: glyphs drawn by tui_menu_start_rot per button wait. the menu is drawn once,
+// timeout wakeups draw nothing and navigation repaints the two entries whose highlight changed.
+// after every wait the framebuffer has to match a full tui_print_menu of the same state.
+
+#define FB_WIDTH  180
+#define FB_HEIGHT 320
+#define FB_STRIDE 192
+#define PAD       16
+
+static u8 fb[FB_STRIDE * FB_HEIGHT] __attribute__((aligned(4)));
+static u8 snap[FB_STRIDE * FB_HEIGHT];
+
+static u32 glyphs;
+static u32 actions;
+
+static void action(void *data){
+	actions++;
+}
+
+static tui_entry_t back = TUI_ENTRY_BACK(NULL);
+static tui_entry_t stats = TUI_ENTRY_ACTION_NO_BLANK("IPL Stats", action, NULL, false, &back);
+static tui_entry_t info = TUI_ENTRY_TEXT("sdloader", &stats);
+static tui_entry_t toolbox = TUI_ENTRY_ACTION_NO_BLANK("Toolbox", action, NULL, false, &info);
+static tui_entry_t boot = TUI_ENTRY_ACTION_NO_BLANK("Boot payload", action, NULL, false, &toolbox);
+static tui_entry_menu_t menu = {
+	.title = {.text = "sdloader"},
+	.entries = &boot,
+	.colors = &TUI_COLOR_SCHEME_DEFAULT,
+	.pos_x = 16,
+	.pos_y = 16,
+	.width = PAD,
+	.height = 8,
+	.pad = PAD,
+	.show_title = true,
+};
+
+typedef struct{
+	u8 btn;
+	// glyphs the loop draws after the button
+	u32 glyphs;
+}step_t;
+
+// every entry is padded, the title isn't
+#define FULL (8 + 5 * PAD)
+
+static const step_t script[] = {
+	{0,            0},
+	{0,            0},
+	{BTN_VOL_DOWN, 2 * PAD},
+	{BTN_VOL_DOWN, 2 * PAD}, // over the text entry
+	{0,            0},
+	{BTN_VOL_UP,   2 * PAD},
+	// the action may have changed anything
+	{BTN_POWER,    FULL},
+	{BTN_VOL_DOWN, 2 * PAD},
+	{BTN_VOL_DOWN, 2 * PAD},
+	{BTN_POWER,    0},
+};
+
+static u32 step;
+
+void __wrap_gfx_printf_rot(const char *fmt, ...){
+	char buf[256];
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	for(char *c = buf; *c; c++){
+		glyphs += *c >= 32 && *c <= 126;
+	}
+	gfx_puts_rot(buf);
+}
+
+void __real_gfx_putc_rot(char c);
+
+void __wrap_gfx_putc_rot(char c){
+	glyphs += c >= 32 && c <= 126;
+	__real_gfx_putc_rot(c);
+}
+
+u8 btn_wait_timeout_single1(u32 time_ms){
+	// what the loop drew for the previous step, the first wait comes after the initial print
+	u32 expected = step ? script[step - 1].glyphs : FULL;
+	printf("%-4u %-10s %6u %6u\n", step, !step ? "start" : !script[step - 1].btn ? "timeout" :
+		script[step - 1].btn == BTN_POWER ? "power" : "vol", glyphs, FULL);
+	CHECK_EQ(glyphs, expected);
+
+	// a full print of the same state changes nothing
+	memcpy(snap, fb, sizeof(fb));
+	tui_print_menu(&menu);
+	CHECK(!memcmp(snap, fb, sizeof(fb)));
+	glyphs = 0;
+
+	if(step == ARRAY_SIZE(script)){
+		host_failures++;
+		return BTN_POWER;
+	}
+
+	u8 btn = script[step++].btn;
+	host_advance_ns(btn ? 200000000ull : (u64)time_ms * 1000000);
+
+	return btn;
+}
+
+u32 display_get_backlight_brightness(){
+	return 128;
+}
+
+void display_backlight_brightness(u32 brightness, u32 step_delay){
+}
+
+int bq24193_get_property(enum BQ24193_reg_prop prop, int *value){
+	*value = 0;
+	return 0;
+}
+
+int max17050_get_property(enum MAX17050_reg reg, int *value){
+	*value = 50 << 8;
+	return 0;
+}
+
+int main(){
+	gfx_init_ctxt(fb, FB_WIDTH, FB_HEIGHT, FB_STRIDE);
+	gfx_con_init();
+	gfx_clear_grey(0);
+
+	printf("%-4s %-10s %6s %6s\n", "step", "button", "glyphs", "full");
+	CHECK_EQ(tui_menu_start_rot(&menu), TUI_SUCCESS);
+	CHECK_EQ(step, ARRAY_SIZE(script));
+	CHECK_EQ(actions, 1);
+
+	return host_result("tui_test");
+}
@@ -0,0 +1,423 @@
+#include "host.h"
+#include "storage_img.h"
+#include "usb_mock.h"
+#include <stdlib.h>
+#include <string.h>
+#include <storage/sdmmc.h>
+#include <usb/usbd.h>
+
+// bdk/usb/usb_gadget_ums.c on the scripted usb host with the sd image as its lun: write back
+// errors of the write cache fail the next SYNCHRONIZE CACHE or WRITE, resets and unplugging write
+// the cache back first. prefetched reads return what the lun holds when they are sent. the
+// benchmark replays a write heavy and a read heavy CBW trace with and without the write cache and
+// the read prefetch, or a trace from a file with one command per line: "w|r <lba> <sectors> [fua]"
+// or "s". every read is checked against the lun contents at its place in the trace.
+//
+//   ums_test [trace]
+
+#define SD_SECTORS  (32 * 1024 * 1024 / 0x200)
+#define LUN_OFFSET  0x800
+#define LUN_SECTORS (SD_SECTORS - LUN_OFFSET)
+
+#define SC_TEST_UNIT_READY   0x00
+#define SC_REQUEST_SENSE     0x03
+#define SC_SYNCHRONIZE_CACHE 0x35
+
+#define TRACE_MAX 4096
+#define POOL_SIZE (1024 * 1024)
+// reads past this aren't checked
+#define READ_POOL_SIZE (64 * 1024 * 1024)
+
+static u8 *pool;
+static u8 *ref;
+static u8 *read_pool;
+static u8 *read_ref;
+static u32 read_used;
+static usb_mock_cmd_t cmds[TRACE_MAX];
+static u8 *cmd_ref[TRACE_MAX];
+static u8 sense[TRACE_MAX][18];
+static u32 fail_sector = ~0;
+
+static u32 seed = 0x5eed;
+
+static u32 rnd(){
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static void set_text(void *label, const char *text){
+}
+
+static void maintenance(bool refresh){
+}
+
+static bool write_fails(img_id_t id, u32 sector, u32 num_sectors, bool write){
+	return write && id == IMG_SD && fail_sector >= sector && fail_sector < sector + num_sectors;
+}
+
+static void run(u32 cnt, bool wcache, bool ra){
+	usb_ctxt_vol_t vol = {.type = MMC_SD, .offset = LUN_OFFSET, .sectors = LUN_SECTORS};
+	usb_ctxt_t usbs = {
+		.volumes_cnt = 1,
+		.volumes = &vol,
+		.write_cache = wcache,
+		.read_ahead = ra,
+		.system_maintenance = maintenance,
+		.set_text = set_text,
+	};
+
+	// the clock keeps running, storage_img's queue times are absolute
+	img_stats_reset();
+	usb_mock_start(cmds, cnt);
+	CHECK_EQ(usb_device_gadget_ums(&usbs), 0);
+	CHECK_EQ(usb_mock_done(), cnt);
+}
+
+static u8 *lun_sector(u32 lba){
+	return img_sector(IMG_SD, LUN_OFFSET + lba);
+}
+
+// every sector different, a read from the wrong place or of stale data shows
+static void fill_lun(u8 *lun){
+	for(u32 i = 0; i < LUN_SECTORS * 0x200 / 4; i++){
+		((u32*)lun)[i] = i * 0x9e3779b9 + 0x1234567;
+	}
+}
+
+// the unit attention of the start is cleared like hosts do
+static u32 start(){
+	usb_mock_cdb(&cmds[0], 0, SC_TEST_UNIT_READY, 0);
+	usb_mock_cdb(&cmds[1], 0, SC_REQUEST_SENSE, 18);
+	cmds[1].data = sense[1];
+
+	return 2;
+}
+
+static u32 request_sense(u32 n){
+	usb_mock_cdb(&cmds[n], 0, SC_REQUEST_SENSE, 18);
+	cmds[n].data = sense[n];
+
+	return n + 1;
+}
+
+static void check_sense(u32 n, u32 key, u32 asc, u32 ascq, u32 info){
+	const u8 *s = sense[n];
+
+	CHECK_EQ(s[2], key);
+	CHECK_EQ(s[12], asc);
+	CHECK_EQ(s[13], ascq);
+	if(info != ~0u){
+		CHECK(s[0] & 0x80);
+		CHECK_EQ((u32)s[3] << 24 | s[4] << 16 | s[5] << 8 | s[6], info);
+	}
+}
+
+// a failed write back passes the command that caused it and fails the next write
+static void test_deferred_write(){
+	u32 n = start();
+	u8 *a = pool, *b = pool + 0x1000;
+
+	fail_sector = LUN_OFFSET + 100;
+	usb_mock_rw(&cmds[n++], 0, true, 100, 8, a, false);
+	usb_mock_cdb(&cmds[n++], 0, SC_TEST_UNIT_READY, 0);
+	usb_mock_rw(&cmds[n++], 0, true, 5000, 8, b, false);
+	n = request_sense(n);
+	usb_mock_rw(&cmds[n++], 0, true, 5000, 8, b, false);
+	usb_mock_cdb(&cmds[n++], 0, SC_SYNCHRONIZE_CACHE, 0);
+	run(n, true, true);
+	fail_sector = ~0;
+
+	CHECK_EQ(cmds[2].status, 0);
+	CHECK_EQ(cmds[3].status, 0);
+	CHECK_EQ(cmds[4].status, 1);
+	check_sense(5, 0x3, 0x0c, 0x02, 100);
+	CHECK_EQ(cmds[6].status, 0);
+	CHECK_EQ(cmds[7].status, 0);
+	CHECK(!memcmp(lun_sector(5000), b, 8 * 0x200));
+}
+
+// SYNCHRONIZE CACHE reports it too, once
+static void test_deferred_sync(){
+	u32 n = start();
+
+	fail_sector = LUN_OFFSET + 200;
+	usb_mock_rw(&cmds[n++], 0, true, 200, 4, pool, false);
+	usb_mock_cdb(&cmds[n++], 0, SC_SYNCHRONIZE_CACHE, 0);
+	n = request_sense(n);
+	usb_mock_cdb(&cmds[n++], 0, SC_SYNCHRONIZE_CACHE, 0);
+	run(n, true, true);
+	fail_sector = ~0;
+
+	CHECK_EQ(cmds[2].status, 0);
+	CHECK_EQ(cmds[3].status, 1);
+	check_sense(4, 0x3, 0x0c, 0x02, 200);
+	CHECK_EQ(cmds[5].status, 0);
+}
+
+// a reset is acked with the cache on the medium. a failed write back outlives the reset
+static void test_reset(bool fails){
+	u32 n = start();
+
+	memset(lun_sector(300), 0, 8 * 0x200);
+	fail_sector = fails ? LUN_OFFSET + 300 : ~0u;
+	usb_mock_rw(&cmds[n++], 0, true, 300, 8, pool + 0x2000, false);
+	cmds[n++] = (usb_mock_cmd_t){.reset = true};
+	usb_mock_cdb(&cmds[n++], 0, SC_TEST_UNIT_READY, 0);
+	n = request_sense(n);
+	usb_mock_cdb(&cmds[n++], 0, SC_SYNCHRONIZE_CACHE, 0);
+	n = request_sense(n);
+	run(n, true, true);
+	fail_sector = ~0;
+
+	CHECK_EQ(cmds[2].status, 0);
+	CHECK(cmds[3].done);
+	// the reset's unit attention first
+	CHECK_EQ(cmds[4].status, 1);
+	check_sense(5, 0x6, 0x29, 0x00, ~0);
+	if(fails){
+		CHECK_EQ(cmds[6].status, 1);
+		check_sense(7, 0x3, 0x0c, 0x02, 300);
+	}else{
+		CHECK_EQ(cmds[3].ack_write_sectors, 8);
+		CHECK_EQ(cmds[6].status, 0);
+		CHECK(!memcmp(lun_sector(300), pool + 0x2000, 8 * 0x200));
+	}
+}
+
+// unplugged with cached writes
+static void test_unplug(){
+	u32 n = start();
+
+	memset(lun_sector(400), 0, 2 * 0x200);
+	usb_mock_rw(&cmds[n++], 0, true, 400, 2, pool + 0x3000, false);
+	run(n, true, true);
+
+	CHECK_EQ(cmds[2].status, 0);
+	CHECK(!memcmp(lun_sector(400), pool + 0x3000, 2 * 0x200));
+}
+
+// reads get what ref holds at their place in the trace
+static void add_read(u32 *n, u32 lba, u32 sectors){
+	u32 size = sectors * 0x200;
+	u8 *data = NULL;
+
+	if(read_used + size <= READ_POOL_SIZE){
+		data = read_pool + read_used;
+		cmd_ref[*n] = read_ref + read_used;
+		memcpy(cmd_ref[*n], ref + lba * 0x200, size);
+		read_used += size;
+	}
+	usb_mock_rw(&cmds[(*n)++], 0, false, lba, sectors, data, false);
+}
+
+static void check_reads(u32 cnt){
+	for(u32 i = 0; i < cnt; i++){
+		if(cmd_ref[i] && memcmp(cmds[i].data, cmd_ref[i], cmds[i].len)){
+			printf("read %u differs\n", i);
+			host_failures++;
+		}
+	}
+}
+
+static void trace_reset(){
+	fill_lun(ref);
+	read_used = 0;
+	memset(cmd_ref, 0, sizeof(cmd_ref));
+}
+
+static void add_write(u32 *n, u32 lba, u32 sectors, bool fua){
+	u32 ofs = rnd() % (POOL_SIZE - sectors * 0x200) & ~3;
+
+	usb_mock_rw(&cmds[(*n)++], 0, true, lba, sectors, pool + ofs, fua);
+	memcpy(ref + lba * 0x200, pool + ofs, sectors * 0x200);
+}
+
+// sequential runs of different sizes that continue a prefetch in part or not at all, a write over
+// the prefetched sectors, a read that doesn't continue and a run that ends at the end of the lun
+static void test_read_prefetch(){
+	u32 n = start();
+
+	trace_reset();
+	add_read(&n, 1000, 64);
+	add_read(&n, 1064, 64);
+	add_read(&n, 1128, 64);
+	add_write(&n, 1192, 8, false);
+	add_read(&n, 1192, 64);
+	add_read(&n, 1256, 32);
+	add_read(&n, 1288, 128);
+	add_read(&n, 1416, 64);
+	usb_mock_cdb(&cmds[n++], 0, SC_TEST_UNIT_READY, 0);
+	add_read(&n, 1480, 64);
+	add_read(&n, 5000, 8);
+	add_read(&n, 5008, 8);
+	add_write(&n, 5016, 1, true);
+	add_read(&n, 5016, 8);
+	add_read(&n, LUN_SECTORS - 48, 32);
+	add_read(&n, LUN_SECTORS - 16, 16);
+	add_read(&n, 0, 16);
+
+	fill_lun(lun_sector(0));
+	run(n, true, true);
+
+	for(u32 i = 2; i < n; i++){
+		CHECK_EQ(cmds[i].status, 0);
+	}
+	check_reads(n);
+	CHECK(!memcmp(lun_sector(0), ref, LUN_SECTORS * 0x200));
+}
+
+// what a filesystem does on a copy of many small files: a journal or fat written in short
+// sequential runs, single sector metadata updates, file data and a flush now and then
+static u32 gen_trace(){
+	u32 n = start();
+
+	trace_reset();
+	u32 journal = 0x2000, data = 0x4000;
+
+	while(n < 1200){
+		u32 r = rnd() % 100;
+		if(r < 50){
+			u32 sectors = 1 + rnd() % 8;
+			add_write(&n, journal, sectors, false);
+			journal += sectors;
+		}else if(r < 75){
+			add_write(&n, 0x100 + rnd() % 0x1000, 1, false);
+		}else if(r < 93){
+			u32 sectors = 8 << (rnd() % 5);
+			add_write(&n, data, sectors, false);
+			data += sectors;
+		}else if(r < 96){
+			add_write(&n, 0x100 + rnd() % 0x1000, 1, true);
+		}else{
+			usb_mock_cdb(&cmds[n++], 0, SC_SYNCHRONIZE_CACHE, 0);
+		}
+	}
+
+	return n;
+}
+
+// copying files off the device: each file read in runs of the host's transfer size, fat or
+// directory sectors in between and now and then a file read with another application's size
+static u32 gen_read_trace(){
+	u32 n = start();
+	u32 data = 0x4000;
+
+	trace_reset();
+	while(n < 1200){
+		u32 sectors = 16 + rnd() % 4096;
+		u32 chunk = rnd() % 4 ? 128 : 8 << (rnd() % 5);
+
+		add_read(&n, 0x100 + rnd() % 0x1000, 1);
+		for(u32 ofs = 0; ofs < sectors && n < TRACE_MAX; ofs += chunk){
+			add_read(&n, data + ofs, MIN(chunk, sectors - ofs));
+		}
+		data += sectors + rnd() % 64;
+		if(data + 4096 > LUN_SECTORS){
+			data = 0x4000;
+		}
+	}
+
+	return n;
+}
+
+static u32 load_trace(const char *path){
+	FILE *f = fopen(path, "r");
+	char line[128];
+	u32 n = start();
+
+	trace_reset();
+	if(!f){
+		printf("can't open %s\n", path);
+		host_failures++;
+		return 0;
+	}
+
+	while(n < TRACE_MAX && fgets(line, sizeof(line), f)){
+		char op, fua[8] = "";
+		u32 lba, sectors;
+		if(line[0] == 's'){
+			usb_mock_cdb(&cmds[n++], 0, SC_SYNCHRONIZE_CACHE, 0);
+		}else if(sscanf(line, "%c %u %u %7s", &op, &lba, &sectors, fua) >= 3 && sectors &&
+			sectors * 0x200 <= POOL_SIZE && lba + sectors <= LUN_SECTORS){
+			if(op == 'w'){
+				add_write(&n, lba, sectors, !strcmp(fua, "fua"));
+			}else if(op == 'r'){
+				add_read(&n, lba, sectors);
+			}
+		}
+	}
+	fclose(f);
+
+	return n;
+}
+
+static const struct{
+	bool wcache;
+	bool ra;
+}cfgs[] = {{false, false}, {true, false}, {true, true}};
+
+static u64 ns[ARRAY_SIZE(cfgs)];
+static u32 sd_cmds[ARRAY_SIZE(cfgs)];
+
+// the lun starts out as fill_lun has it, ref gets what it holds after the trace
+static void bench(const char *name, u32 cnt){
+	u64 bytes = 0;
+
+	for(u32 i = 0; i < cnt; i++){
+		bytes += cmds[i].len;
+	}
+
+	printf("%-8s %-8s %-8s %8s %10s %10s %8s\n", "trace", "wcache", "prefetch", "cmds", "sd cmds", "ms", "MB/s");
+
+	for(u32 c = 0; c < ARRAY_SIZE(cfgs); c++){
+		fill_lun(lun_sector(0));
+		run(cnt, cfgs[c].wcache, cfgs[c].ra);
+		// from the end of the start, without the card init
+		ns[c] = cmds[cnt - 1].done_ns - cmds[1].done_ns;
+		sd_cmds[c] = img_stats->cmds;
+
+		for(u32 i = 0; i < cnt; i++){
+			CHECK_EQ(cmds[i].status, i ? 0 : 1);
+		}
+		check_reads(cnt);
+		CHECK(!memcmp(lun_sector(0), ref, LUN_SECTORS * 0x200));
+
+		printf("%-8s %-8s %-8s %8u %10u %10.2f %8.2f\n", name, cfgs[c].wcache ? "on" : "off", cfgs[c].ra ? "on" : "off",
+			cnt, sd_cmds[c], ns[c] / 1e6, bytes * 1e3 / ns[c]);
+	}
+}
+
+int main(int argc, char *argv[]){
+	img_init();
+	img_create(IMG_SD, SD_SECTORS);
+	img_fault = write_fails;
+
+	pool = malloc(POOL_SIZE);
+	ref = malloc(LUN_SECTORS * 0x200);
+	read_pool = malloc(READ_POOL_SIZE);
+	read_ref = malloc(READ_POOL_SIZE);
+	for(u32 i = 0; i < POOL_SIZE; i++){
+		pool[i] = rnd();
+	}
+
+	test_deferred_write();
+	test_deferred_sync();
+	test_reset(false);
+	test_reset(true);
+	test_unplug();
+	test_read_prefetch();
+	if(argc > 1){
+		bench("file", load_trace(argv[1]));
+	}else{
+		bench("write", gen_trace());
+		CHECK(sd_cmds[1] < sd_cmds[0]);
+		CHECK(ns[1] < ns[0]);
+
+		// sequential reads overlap the card with the bus, a dropped prefetch costs its chunk
+		bench("read", gen_read_trace());
+		CHECK(ns[2] < ns[1] * 9 / 10);
+		CHECK(sd_cmds[2] < sd_cmds[1] * 11 / 10);
+	}
+
+	return host_result("ums_test");
+}
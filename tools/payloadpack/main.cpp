@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+// must match sdloader/loader.h
+#define PAYLOAD_BLZ_MAGIC 0x5A4C4453 // "SDLZ"
+#define PAYLOAD_SHA_MAGIC 0x48534453 // "SDSH"
+
+// blz as decoded by bdk/libs/compr/blz.c, the decoder works backwards from the end in place
+#define BLZ_FOOTER_SIZE 12
+#define BLZ_MIN_MATCH   3
+#define BLZ_MAX_MATCH   (0xf + BLZ_MIN_MATCH)
+#define BLZ_MAX_OFS     (0xfff + BLZ_MIN_MATCH)
+
+static void put_u32(std::vector<uint8_t> &v, uint32_t val){
+	for(int i = 0; i < 4; i++){
+		v.push_back((val >> (i * 8)) & 0xff);
+	}
+}
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static uint32_t ror(uint32_t x, int n){
+	return (x >> n) | (x << (32 - n));
+}
+
+static void sha256(const std::vector<uint8_t> &d, uint8_t out[32]){
+	uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+	std::vector<uint8_t> m(d);
+	m.push_back(0x80);
+	while(m.size() % 64 != 56){
+		m.push_back(0);
+	}
+	uint64_t bits = (uint64_t)d.size() * 8;
+	for(int i = 7; i >= 0; i--){
+		m.push_back((bits >> (i * 8)) & 0xff);
+	}
+
+	for(size_t blk = 0; blk < m.size(); blk += 64){
+		uint32_t w[64];
+		for(int i = 0; i < 16; i++){
+			w[i] = (m[blk + i * 4] << 24) | (m[blk + i * 4 + 1] << 16) | (m[blk + i * 4 + 2] << 8) | m[blk + i * 4 + 3];
+		}
+		for(int i = 16; i < 64; i++){
+			uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+			uint32_t s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+
+		uint32_t a = h[0], b = h[1], c = h[2], e = h[4], f = h[5], g = h[6], dd = h[3], hh = h[7];
+		for(int i = 0; i < 64; i++){
+			uint32_t t1 = hh + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+			uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+			hh = g; g = f; f = e; e = dd + t1;
+			dd = c; c = b; b = a; a = t1 + t2;
+		}
+
+		h[0] += a; h[1] += b; h[2] += c; h[3] += dd;
+		h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+	}
+
+	for(int i = 0; i < 32; i++){
+		out[i] = h[i / 4] >> (24 - (i % 4) * 8);
+	}
+}
+
+// longest match ending at pos, copied from already decoded data at pos + ofs
+static uint32_t match_len(const std::vector<uint8_t> &d, uint32_t pos, uint32_t ofs){
+	// source has to be decoded before the copy starts, so no overlap (ofs >= len)
+	uint32_t max_len = std::min<uint32_t>({BLZ_MAX_MATCH, pos, ofs});
+	uint32_t len = 0;
+	while(len < max_len && d[pos - 1 - len] == d[pos - 1 - len + ofs]){
+		len++;
+	}
+	return len;
+}
+
+static bool compress(const std::vector<uint8_t> &d, std::vector<uint8_t> &out){
+	uint32_t n = (uint32_t)d.size();
+	// compressed stream in the order the decoder consumes it (backwards)
+	std::vector<uint8_t> stream;
+	uint32_t pos = n;
+	size_t ctrl = 0;
+	uint32_t ctrl_bit = 0;
+
+	// the decoder writes below what it still has to read as long as the gain never exceeds the final one,
+	// so everything in front of the point with the highest gain is left uncompressed
+	int64_t best_gain = 0;
+	uint32_t best_pos = n;
+	size_t best_stream = 0;
+
+	while(pos){
+		if(!ctrl_bit){
+			ctrl = stream.size();
+			stream.push_back(0);
+			ctrl_bit = 0x80;
+		}
+
+		uint32_t best_len = 0, best_ofs = 0;
+		for(uint32_t ofs = BLZ_MIN_MATCH; ofs <= BLZ_MAX_OFS && pos + ofs <= n; ofs++){
+			uint32_t len = match_len(d, pos, ofs);
+			if(len > best_len){
+				best_len = len;
+				best_ofs = ofs;
+				if(len == BLZ_MAX_MATCH){
+					break;
+				}
+			}
+		}
+
+		if(best_len >= BLZ_MIN_MATCH){
+			uint16_t val = ((best_len - BLZ_MIN_MATCH) << 12) | (best_ofs - BLZ_MIN_MATCH);
+			stream.push_back(val >> 8);
+			stream.push_back(val & 0xff);
+			stream[ctrl] |= ctrl_bit;
+			pos -= best_len;
+		}else{
+			stream.push_back(d[pos - 1]);
+			pos--;
+		}
+
+		ctrl_bit >>= 1;
+
+		int64_t gain = (int64_t)(n - pos) - (int64_t)stream.size();
+		if(gain > best_gain){
+			best_gain = gain;
+			best_pos = pos;
+			best_stream = stream.size();
+		}
+	}
+
+	if(best_gain < BLZ_FOOTER_SIZE){
+		return false;
+	}
+
+	out.assign(d.begin(), d.begin() + best_pos);
+	out.insert(out.end(), stream.rend() - best_stream, stream.rend());
+
+	put_u32(out, (uint32_t)best_stream + BLZ_FOOTER_SIZE); // compressed and header size
+	put_u32(out, BLZ_FOOTER_SIZE);                         // header size
+	put_u32(out, (uint32_t)best_gain - BLZ_FOOTER_SIZE);   // additional size
+
+	put_u32(out, PAYLOAD_BLZ_MAGIC);
+	put_u32(out, n);
+
+	return true;
+}
+
+int main(int argc, char *argv[]){
+	bool do_compress = true;
+	bool do_hash = false;
+	int argi = 1;
+
+	for(; argi < argc && argv[argi][0] == '-'; argi++){
+		if(!strcmp(argv[argi], "--sha256")){
+			do_hash = true;
+		}else if(!strcmp(argv[argi], "--no-compress")){
+			do_compress = false;
+		}else{
+			argi = argc;
+		}
+	}
+
+	if(argc - argi < 2){
+		std::cout << "usage: payloadpack [--sha256] [--no-compress] infile outfile";
+		return 1;
+	}
+
+	std::filesystem::path p(argv[argi]);
+	std::filesystem::path op(argv[argi + 1]);
+
+	std::ifstream f(p, std::ios::binary);
+	std::vector<uint8_t> in((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+	std::vector<uint8_t> out;
+	if(!do_compress){
+		out = in;
+	}else if(!compress(in, out)){
+		std::cout << p.string() << " does not compress, use --no-compress\n";
+		return 1;
+	}
+
+	// verified by sdloader while the payload is read
+	if(do_hash){
+		uint8_t hash[32];
+		sha256(out, hash);
+		uint32_t hashed_size = (uint32_t)out.size();
+		put_u32(out, PAYLOAD_SHA_MAGIC);
+		put_u32(out, hashed_size);
+		out.insert(out.end(), hash, hash + sizeof(hash));
+	}
+
+	std::ofstream o(op, std::ios::binary);
+	o.write(reinterpret_cast<const char*>(out.data()), out.size());
+	o.flush();
+
+	std::cout << p.filename().string() << ": " << in.size() << " -> " << out.size() << " bytes, "
+		<< (in.size() + 0x1ff) / 0x200 << " -> " << (out.size() + 0x1ff) / 0x200 << " sectors\n";
+
+	return 0;
+}
@@ -0,0 +1,122 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+// must match sdloader/trace.h
+#define TRACE_SECTOR      0x1eff
+#define TRACE_MAGIC       0x43525453 // "STRC"
+#define TRACE_MAX_POINTS  24
+#define TRACE_MAX_BOOTS   4
+#define TRACE_END         0x80
+
+#define SECTOR_SIZE       0x200
+
+// same order as trace_id_t
+static const char *trace_names[] = {
+	"confirm", "get_cfg", "btn", "sd_init", "emmc_ini", "mount", "f_open", "f_read", "display", "reloc",
+};
+
+// little endian on disk, offsets as laid out by trace_sector_t
+#define BOOT_OFS(i)  (8 + (i) * (4 + TRACE_MAX_POINTS * 4))
+
+static uint32_t get_u32(const uint8_t *p){
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static std::string trace_name(uint8_t id){
+	id &= ~TRACE_END;
+	return id < std::size(trace_names) ? trace_names[id] : "id " + std::to_string(id);
+}
+
+struct point{
+	uint8_t id;
+	uint32_t us;
+};
+
+static void dump_boot(const uint8_t *b){
+	uint16_t seq = b[0] | (b[1] << 8);
+	uint8_t cnt = b[2];
+	uint8_t switches = b[3];
+
+	if(!cnt){
+		return;
+	}
+
+	// the ring keeps the last TRACE_MAX_POINTS points, oldest first once it wrapped
+	uint32_t n = std::min<uint32_t>(cnt, TRACE_MAX_POINTS);
+	uint32_t first = cnt > TRACE_MAX_POINTS ? cnt % TRACE_MAX_POINTS : 0;
+	std::vector<point> points;
+	for(uint32_t i = 0; i < n; i++){
+		uint32_t v = get_u32(b + 4 + ((first + i) % TRACE_MAX_POINTS) * 4);
+		points.push_back({(uint8_t)(v & 0xff), v >> 8});
+	}
+
+	std::cout << "boot #" << seq << ", " << (uint32_t)cnt << " points";
+	if(cnt > TRACE_MAX_POINTS){
+		std::cout << " (" << cnt - TRACE_MAX_POINTS << " dropped)";
+	}
+	if(cnt == 0xff){
+		std::cout << " (saturated)";
+	}
+	std::cout << ", " << (uint32_t)switches << " emmc partition switches\n";
+
+	// stages nest, indent by the number of stages still open
+	std::vector<point> open;
+	for(const point &p : points){
+		if(p.id & TRACE_END){
+			auto it = open.end();
+			while(it != open.begin() && (--it)->id != (p.id & ~TRACE_END)){}
+			bool paired = it != open.end() && it->id == (p.id & ~TRACE_END);
+			uint32_t depth = paired ? (uint32_t)(it - open.begin()) : (uint32_t)open.size();
+
+			std::cout << std::setw(10) << p.us << "us " << std::string(depth * 2, ' ') << "end   " << trace_name(p.id);
+			if(paired){
+				std::cout << " (" << p.us - it->us << "us)";
+				open.erase(it, open.end());
+			}
+			std::cout << "\n";
+		}else{
+			std::cout << std::setw(10) << p.us << "us " << std::string(open.size() * 2, ' ') << "begin " << trace_name(p.id) << "\n";
+			open.push_back(p);
+		}
+	}
+
+	std::cout << "\n";
+}
+
+int main(int argc, char *argv[]){
+	if(argc < 2){
+		std::cout << "usage: tracedump boot0.bin|sector.bin";
+		return 1;
+	}
+
+	std::filesystem::path p(argv[1]);
+	std::ifstream f(p, std::ios::binary);
+	std::vector<uint8_t> in((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+	// either a full boot0 dump or just the trace sector
+	size_t ofs = in.size() > SECTOR_SIZE ? (size_t)TRACE_SECTOR * SECTOR_SIZE : 0;
+	if(in.size() < ofs + SECTOR_SIZE){
+		std::cout << p.filename().string() << " is too small\n";
+		return 1;
+	}
+
+	const uint8_t *s = in.data() + ofs;
+	uint32_t next = get_u32(s + 4);
+	if(get_u32(s) != TRACE_MAGIC || next >= TRACE_MAX_BOOTS){
+		std::cout << "no boot trace found\n";
+		return 1;
+	}
+
+	// boots[next] is the oldest record
+	for(uint32_t i = 0; i < TRACE_MAX_BOOTS; i++){
+		dump_boot(s + BOOT_OFS((next + i) % TRACE_MAX_BOOTS));
+	}
+
+	return 0;
+}